@@ -12,11 +12,11 @@
 #include "app.h"
 #include "pid.h"
 #include "monitor.h"
+#include "telemetry.h"
+#include "trace.h"
 
 /* *** Global Variables *** */
 
-static int g_forced_servo_position;
-
 static pid_type g_pid;
 
 static char g_channel_names[NBR_OF_THERMISTORS][MAX_NAME_LENGTH];
@@ -75,6 +75,10 @@ void App_Service( void )
     float setpoint;
 	int x, y;
 	fire_detect_state_type fire_detect_state;
+	telemetry_record_type telemetry_record;
+	uint8_t pid_updated = false;
+	int64_t sweep_start_ns;
+	int64_t sweep_end_ns;
 
 	static float cabinet_temperature = 0.0;
 	static int servo_position;
@@ -88,10 +92,16 @@ void App_Service( void )
 	memcpy( (char*)temperature_data, (char*)p_shared_data->temp_deg_f, sizeof(temperature_data) );
 	fire_detect_state = p_shared_data->fire_detect_state;
     setpoint = p_shared_data->temp_deg_f_cabinet_setpoint;
+	sweep_start_ns = p_shared_data->adc_sweep_start_ns;
+	sweep_end_ns = p_shared_data->adc_sweep_end_ns;
 	pthread_mutex_unlock(&mutex);
 
+	Trace_Begin_Tick( sweep_start_ns, sweep_end_ns );
+
 	// Call the thermistor service routine and have it convert the ADC measurements to temperatures
+	Trace_Stage_Begin( TRACE_STAGE_THERMISTOR );
 	Thermistor_Service( adc_data, temperature_data );
+	Trace_Stage_End( TRACE_STAGE_THERMISTOR );
 	
 	// Calculate the thermocouple temperature.  The conversion data is the last ADC channel
 	thermocouple_temperature = App_Calculate_Thermocouple_Temperature( adc_data[NBR_ADC_CHANNELS-1] );
@@ -103,7 +113,10 @@ void App_Service( void )
 	{
 		timer = 0;
 		
+		Trace_Stage_Begin( TRACE_STAGE_PID );
 		Pid_Update(&g_pid, (double)temperature_error, (double)(MAIN_LOOP_TIME_US/1000));
+		Trace_Stage_End( TRACE_STAGE_PID );
+		pid_updated = true;
 		
 		// The PID outputs a number from 0 to X depending on the gains.  Limit the servo
 		// position to minimum and maximum values.  Too low and the flame will go out,
@@ -132,6 +145,7 @@ void App_Service( void )
 		
 		Servo_Service( servo_position );
 	}
+	Trace_End_Tick();			// The sensor to actuator path ends here
 	
 		// Print PID information to the console for easy monitoring
 	if (print_timer++ >= PRINT_DELAY)
@@ -167,19 +181,54 @@ void App_Service( void )
 	p_shared_data->temp_deg_f_fire = thermocouple_temperature;
 	p_shared_data->servo_position = servo_position;
 	pthread_mutex_unlock(&mutex);
-	
+
+	// Hand the tick to the telemetry thread.  This is only a copy into a ring buffer.
+	memcpy( (char*)telemetry_record.adc_results, (char*)adc_data, sizeof(telemetry_record.adc_results) );
+	memcpy( (char*)telemetry_record.temp_deg_f, (char*)temperature_data, sizeof(telemetry_record.temp_deg_f) );
+	memset( telemetry_record.reserved, 0, sizeof(telemetry_record.reserved) );
+	telemetry_record.servo_position = servo_position;
+	telemetry_record.temp_deg_f_fire = thermocouple_temperature;
+	telemetry_record.temp_deg_f_cabinet_setpoint = setpoint;
+	telemetry_record.pid_p_term = g_pid.p_term;
+	telemetry_record.pid_i_term = g_pid.i_term;
+	telemetry_record.pid_d_term = g_pid.d_term;
+	telemetry_record.pid_control = g_pid.control;
+	telemetry_record.fire_detect_state = fire_detect_state;
+	telemetry_record.pid_updated = pid_updated;
+	Telemetry_Record_Control_Tick( &telemetry_record );
 }
 
 /** ***********************************************************************************************
 @brief Sets the temperature setpoint of the cabinet_temperature
 
+Every front-end sets the setpoint through here, a value out of range leaves the setpoint unchanged.
+
 @param[in] temp_deg_f   Setpoint for the system
+
+@return -1 if the setpoint is out of range
+		 1 on success
 **************************************************************************************************/
-void App_Set_Cabinet_Setpoint( float temp_deg_f )
+int App_Set_Cabinet_Setpoint( float temp_deg_f )
 {
+	if (!((temp_deg_f > APP_MIN_SETPOINT) && (temp_deg_f < APP_MAX_SETPOINT)))
+		return -1;
+
     pthread_mutex_lock(&mutex);
 	p_shared_data->temp_deg_f_cabinet_setpoint = temp_deg_f;
     pthread_mutex_unlock(&mutex);
+
+	return 1;
+}
+
+float App_Get_Cabinet_Setpoint( void )
+{
+	float temp_deg_f;
+
+    pthread_mutex_lock(&mutex);
+	temp_deg_f = p_shared_data->temp_deg_f_cabinet_setpoint;
+    pthread_mutex_unlock(&mutex);
+
+	return temp_deg_f;
 }
 
 /**************************************************************************
@@ -1,10 +1,13 @@
 
 #define MAX_NAME_LENGTH			64
 
+#define APP_MIN_SETPOINT		0.0			// The cabinet setpoint lies strictly between these, deg F
+#define APP_MAX_SETPOINT		400.0
+
 void App_Init( void* shared_data_address );
 void App_Service( void );
 
-void App_Set_Cabinet_Setpoint( float temp_deg_f );
+int App_Set_Cabinet_Setpoint( float temp_deg_f );
 float App_Get_Cabinet_Setpoint( void );
 
 void App_Set_Kp( float gain );
@@ -0,0 +1,564 @@
+/***************************************************************************************************
+Benchmarks
+
+Microbenchmarks of the hot paths of the daemon, built by "make bench" without pigpio or ncurses so
+they run on a PC as well as on the Pi:
+
+	bench/bench [-r repetitions] [-w warmup ms] [-s sample ms] [-f text|csv|json] [-l] [name...]
+
+Each benchmark is first run for the warmup time, which also sizes a sample so that it takes about
+the sample time.  Then the given number of samples are timed.  The median time per operation is the
+figure to compare, the spread of the samples tells whether the machine was quiet enough to trust
+it.  Names select the benchmarks whose names contain them.  csv and json print one line per
+benchmark for scripts, json starts with a line describing the machine.
+
+The pigpio benchmarks run against a stand-in daemon on pipes of their own (pigpio_standin.c, which
+runs the emulator core of tools/fake_pigpiod), so they measure the pipe protocol and the scheduling
+of two threads, not the SPI bus.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/utsname.h>
+#include "main.h"
+#include "monitor.h"
+#include "app.h"
+#include "thermistor.h"
+#include "pid.h"
+#include "commands.h"
+#include "cmd_registry.h"
+#include "event_log.h"
+#include "str_builder.h"
+#include "bench/bench.h"
+
+/* *** Defined Values *** */
+#define BENCH_DEFAULT_REPETITIONS	20
+#define BENCH_DEFAULT_WARMUP_MS		200
+#define BENCH_DEFAULT_SAMPLE_MS		20
+#define BENCH_MAX_REPETITIONS		1000
+#define BENCH_MAX_LINE				256
+#define BENCH_LEGACY_STATUS_SIZE	1024		// The static buffer of the old Eth_Get_Status()
+
+/* *** Data Types *** */
+typedef enum
+{
+	BENCH_FORMAT_TEXT = 0,
+	BENCH_FORMAT_CSV,
+	BENCH_FORMAT_JSON,
+} bench_format_type;
+
+// Runs the operation under test iterations times
+typedef void (*bench_function)( uint64_t iterations );
+
+typedef struct
+{
+	const char* name;
+	const char* description;
+	bench_function function;
+	bool needs_pigpio;						// Uses the stand-in pigpio daemon
+} bench_case_type;
+
+typedef struct
+{
+	uint64_t iterations;					// Operations per sample
+	int samples;
+	double median_ns;						// Per operation
+	double min_ns;
+	double max_ns;
+	double mean_ns;
+	double stdev_ns;
+} bench_result_type;
+
+/* *** Global Variables *** */
+
+// Normally defined by main.c
+shared_data_type shared_data;
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t pigpio_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Normally defined by monitor.c, which needs the mail library
+void Monitor_Light_Fire( void ) { }
+void Monitor_Send_Notification( char* pSubject, char* pMsg ) { }
+
+static int g_repetitions = BENCH_DEFAULT_REPETITIONS;
+static int g_warmup_ms = BENCH_DEFAULT_WARMUP_MS;
+static int g_sample_ms = BENCH_DEFAULT_SAMPLE_MS;
+static bench_format_type g_format = BENCH_FORMAT_TEXT;
+
+static volatile float g_sink;				// Keeps the compiler from dropping unused results
+
+// Not in thermistor.h, the daemon only converts through Thermistor_Service()
+float Thermistor_Convert_Adc_To_Deg_F( uint16_t adc );
+
+static inline int64_t Bench_Get_Time_Ns( void )
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((int64_t)now.tv_sec * 1000000000LL) + now.tv_nsec;
+}
+
+/* *** Benchmarks *** */
+
+static void Bench_Case_Thermistor_Convert( uint64_t iterations )
+{
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++)
+		g_sink = Thermistor_Convert_Adc_To_Deg_F( (uint16_t)(i & 0x3FF) );
+}
+
+static void Bench_Case_Thermistor_Service( uint64_t iterations )
+{
+	uint16_t adc_data[NBR_ADC_CHANNELS];
+	float temperature_data[NBR_OF_THERMISTORS];
+	uint64_t i;
+	int j;
+
+	for (i = 0; i < iterations; i++)
+	{
+		for (j = 0; j < NBR_ADC_CHANNELS; j++)
+			adc_data[j] = (uint16_t)((i + (j * 97)) & 0x3FF);
+		Thermistor_Service( adc_data, temperature_data );
+		g_sink = temperature_data[0];
+	}
+}
+
+static void Bench_Case_Pid_Update( uint64_t iterations )
+{
+	pid_type pid;
+	uint64_t i;
+
+	Pid_Reset( &pid );
+	pid.windup_guard = 4000000.0;
+	pid.proportional_gain = 20.0;
+	pid.integral_gain = 0.0001;
+
+	for (i = 0; i < iterations; i++)
+		Pid_Update( &pid, (float)((int)(i & 0xFF) - 128) * 0.1f, (float)(MAIN_LOOP_TIME_US / 1000) );
+	g_sink = pid.control;
+}
+
+static void Bench_Case_Thermocouple( uint64_t iterations )
+{
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++)
+		g_sink = Bench_App_Thermocouple_Temperature( (uint16_t)(i & 0x3FF) );
+}
+
+/***************************************************************************************************
+The command handlers tokenize their line, so every operation works on a fresh copy
+***************************************************************************************************/
+static void Bench_Case_Registry_Dispatch( uint64_t iterations )
+{
+	char line[BENCH_MAX_LINE];
+	char buffer[1024];
+	str_builder_type builder;
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++)
+	{
+		strcpy(line, "KP?");
+		Str_Builder_Init( &builder, buffer, sizeof(buffer), NULL, NULL );
+		Cmd_Registry_Execute( CMD_FRONTEND_ETHERNET, NULL, line, &builder );
+	}
+}
+
+/***************************************************************************************************
+STATUS? the way Eth_Get_Status() formatted it before the string builder, a chain of
+sprintf(buf, "%s,%f", buf, ...).  The buffer was both source and destination, which is undefined
+behaviour, so the chain alternates between two buffers instead.  The work is the same: every field
+copies the whole response so far.  Compare with status_builder.
+***************************************************************************************************/
+static void Bench_Case_Status_Sprintf_Legacy( uint64_t iterations )
+{
+	#define BENCH_LEGACY_APPEND( format, value ) \
+		do { sprintf(p_next, "%s," format, p_status, value); p_swap = p_status; p_status = p_next; p_next = p_swap; } while (0)
+	char* p_buffer_a = malloc(BENCH_LEGACY_STATUS_SIZE);
+	char* p_buffer_b = malloc(BENCH_LEGACY_STATUS_SIZE);
+	shared_data_type local_shared_data;
+	char* p_status;
+	char* p_next;
+	char* p_swap;
+	uint64_t n;
+	int i;
+
+	for (n = 0; (n < iterations) && (p_buffer_a != NULL) && (p_buffer_b != NULL); n++)
+	{
+		pthread_mutex_lock(&mutex);
+		memcpy(&local_shared_data, &shared_data, sizeof(local_shared_data));
+		pthread_mutex_unlock(&mutex);
+
+		p_status = p_buffer_a;
+		p_next = p_buffer_b;
+		strcpy(p_status, "STATUS");
+
+		BENCH_LEGACY_APPEND( "%f", local_shared_data.temp_deg_f_cabinet_setpoint );
+		for (i = 0; i < NBR_OF_THERMISTORS; i++)
+			BENCH_LEGACY_APPEND( "%f", local_shared_data.temp_deg_f[i] );
+		BENCH_LEGACY_APPEND( "%f", local_shared_data.temp_deg_f_fire );
+		for (i = 0; i < NBR_ADC_CHANNELS; i++)
+			BENCH_LEGACY_APPEND( "%u", (0x3FF & local_shared_data.adc_results[i]) );
+		BENCH_LEGACY_APPEND( "%u", local_shared_data.fire_detect_state );
+
+		g_sink = p_status[6];
+	}
+
+	free(p_buffer_a);
+	free(p_buffer_b);
+	#undef BENCH_LEGACY_APPEND
+}
+
+/***************************************************************************************************
+STATUS? as it is formatted now, by Commands_Status() into a string builder
+***************************************************************************************************/
+static void Bench_Case_Status_Builder( uint64_t iterations )
+{
+	char line[BENCH_MAX_LINE];
+	char buffer[1024];
+	str_builder_type builder;
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++)
+	{
+		strcpy(line, "STATUS?");
+		Str_Builder_Init( &builder, buffer, sizeof(buffer), NULL, NULL );
+		Cmd_Registry_Execute( CMD_FRONTEND_ETHERNET, NULL, line, &builder );
+	}
+	g_sink = buffer[6];
+}
+
+static void Bench_Case_Eth_Status( uint64_t iterations )
+{
+	char line[BENCH_MAX_LINE];
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++)
+	{
+		strcpy(line, "STATUS?");
+		Bench_Eth_Process_Command( line );
+	}
+}
+
+static void Bench_Case_Eth_Temps( uint64_t iterations )
+{
+	char line[BENCH_MAX_LINE];
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++)
+	{
+		strcpy(line, "TEMPS?");
+		Bench_Eth_Process_Command( line );
+	}
+}
+
+static void Bench_Case_Eth_Receive_Batch( uint64_t iterations )
+{
+	static const char batch[] = "SETTEMP=225\nTEMPS?\nKP?\nSETPOINT?\n";
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++)
+		Bench_Eth_Receive( batch, sizeof(batch) - 1 );
+}
+
+static void Bench_Case_File_Fifo_Temps( uint64_t iterations )
+{
+	char line[BENCH_MAX_LINE];
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++)
+	{
+		strcpy(line, "TEMPS?");
+		Bench_File_Fifo_Process_Command( line );
+	}
+}
+
+static void Bench_Case_Tlc1543_Transfer( uint64_t iterations )
+{
+	uint8_t data[2];
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++)
+	{
+		data[0] = (uint8_t)((i % NBR_ADC_CHANNELS) << 4);
+		data[1] = 0;
+		Bench_Tlc1543_Transfer( data, sizeof(data) );
+	}
+	g_sink = data[0];
+}
+
+static void Bench_Case_Servo_Set_Position( uint64_t iterations )
+{
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++)
+		Bench_Servo_Set_Position( 1000 + (int)(i & 0xFF) );
+}
+
+static const bench_case_type g_benchmarks[] =
+{
+	{ "thermistor_convert",		"Thermistor_Convert_Adc_To_Deg_F, one conversion",			Bench_Case_Thermistor_Convert,	false },
+	{ "thermistor_service",		"Thermistor_Service, every channel",						Bench_Case_Thermistor_Service,	false },
+	{ "pid_update",				"Pid_Update",												Bench_Case_Pid_Update,			false },
+	{ "thermocouple",			"App_Calculate_Thermocouple_Temperature",					Bench_Case_Thermocouple,		false },
+	{ "registry_dispatch",		"Cmd_Registry_Execute of KP?",								Bench_Case_Registry_Dispatch,	false },
+	{ "status_sprintf_legacy",	"STATUS? formatted by the old sprintf chain",				Bench_Case_Status_Sprintf_Legacy,	false },
+	{ "status_builder",			"STATUS? formatted by Commands_Status, registry included",	Bench_Case_Status_Builder,		false },
+	{ "eth_response_status",	"Ethernet STATUS? response, written to /dev/null",			Bench_Case_Eth_Status,			false },
+	{ "eth_response_temps",		"Ethernet TEMPS? response, written to /dev/null",			Bench_Case_Eth_Temps,			false },
+	{ "eth_receive_batch",		"Ethernet framing and dispatch of four commands",			Bench_Case_Eth_Receive_Batch,	false },
+	{ "fifo_response_temps",	"File FIFO TEMPS? response",								Bench_Case_File_Fifo_Temps,		false },
+	{ "tlc1543_transfer",		"Tlc1543_Transfer of one channel, stand-in pigpiod",		Bench_Case_Tlc1543_Transfer,	true },
+	{ "servo_set_position",		"Servo_Set_Position, stand-in pigpiod",						Bench_Case_Servo_Set_Position,	true },
+};
+#define BENCHMARKS_SIZE		(sizeof (g_benchmarks)/sizeof(g_benchmarks[0]))
+
+/* *** Harness *** */
+
+/***************************************************************************************************
+A plausible mid cook snapshot, so the STATUS? benchmarks format values of realistic lengths
+***************************************************************************************************/
+static void Bench_Set_Status_Snapshot( void )
+{
+	int i;
+
+	pthread_mutex_lock(&mutex);
+	shared_data.temp_deg_f_cabinet_setpoint = 225.0;
+	for (i = 0; i < NBR_OF_THERMISTORS; i++)
+		shared_data.temp_deg_f[i] = 224.0 - (i * 13.37f);
+	shared_data.temp_deg_f_fire = 412.734f;
+	for (i = 0; i < NBR_ADC_CHANNELS; i++)
+		shared_data.adc_results[i] = (uint16_t)(300 + (i * 41));
+	shared_data.fire_detect_state = MONITOR_FIRE_DETECTED;
+	pthread_mutex_unlock(&mutex);
+}
+
+static int Bench_Compare_Doubles( const void* pA, const void* pB )
+{
+	double a = *(const double*)pA;
+	double b = *(const double*)pB;
+
+	return (a > b) - (a < b);
+}
+
+/***************************************************************************************************
+Warms a benchmark up while doubling the operations per sample until a sample takes the sample
+time, then times the samples
+***************************************************************************************************/
+static void Bench_Run( const bench_case_type* pCase, bench_result_type* pResult )
+{
+	static double samples[BENCH_MAX_REPETITIONS];
+	int64_t warmup_end_ns = Bench_Get_Time_Ns() + ((int64_t)g_warmup_ms * 1000000);
+	int64_t sample_ns = (int64_t)g_sample_ms * 1000000;
+	int64_t start_ns;
+	int64_t elapsed_ns;
+	uint64_t iterations = 1;
+	double sum = 0.0;
+	double squares = 0.0;
+	int i;
+
+	do {
+		start_ns = Bench_Get_Time_Ns();
+		pCase->function( iterations );
+		elapsed_ns = Bench_Get_Time_Ns() - start_ns;
+
+		if (elapsed_ns < sample_ns)
+		{
+			if (elapsed_ns < (sample_ns / 2))
+				iterations *= 2;
+			else
+				iterations = (uint64_t)((double)iterations * sample_ns / (elapsed_ns + 1)) + 1;
+		}
+	} while (Bench_Get_Time_Ns() < warmup_end_ns);
+
+	for (i = 0; i < g_repetitions; i++)
+	{
+		start_ns = Bench_Get_Time_Ns();
+		pCase->function( iterations );
+		samples[i] = (double)(Bench_Get_Time_Ns() - start_ns) / iterations;
+		sum += samples[i];
+	}
+
+	qsort(samples, g_repetitions, sizeof(samples[0]), Bench_Compare_Doubles);
+
+	pResult->iterations = iterations;
+	pResult->samples = g_repetitions;
+	pResult->mean_ns = sum / g_repetitions;
+	pResult->min_ns = samples[0];
+	pResult->max_ns = samples[g_repetitions - 1];
+	pResult->median_ns = (g_repetitions & 1) ? samples[g_repetitions / 2] :
+						 (samples[(g_repetitions / 2) - 1] + samples[g_repetitions / 2]) / 2.0;
+
+	for (i = 0; i < g_repetitions; i++)
+		squares += (samples[i] - pResult->mean_ns) * (samples[i] - pResult->mean_ns);
+	pResult->stdev_ns = (g_repetitions > 1) ? sqrt(squares / (g_repetitions - 1)) : 0.0;
+}
+
+static void Bench_Print_Header( void )
+{
+	struct utsname machine;
+
+	uname(&machine);
+
+	switch (g_format)
+	{
+		case BENCH_FORMAT_TEXT:
+			printf("%s %s %s, %d samples of ~%d ms after %d ms of warmup\n\n", machine.nodename, machine.machine,
+				   machine.release, g_repetitions, g_sample_ms, g_warmup_ms);
+			printf("%-22s %12s %12s %12s %8s %14s\n", "benchmark", "median ns", "min ns", "max ns", "rsd %", "ops/s");
+			break;
+
+		case BENCH_FORMAT_CSV:
+			printf("name,iterations,samples,median_ns,min_ns,max_ns,mean_ns,stdev_ns,ops_per_s\n");
+			break;
+
+		case BENCH_FORMAT_JSON:
+			printf("{\"host\":\"%s\",\"machine\":\"%s\",\"kernel\":\"%s\",\"samples\":%d,\"sample_ms\":%d,\"warmup_ms\":%d}\n",
+				   machine.nodename, machine.machine, machine.release, g_repetitions, g_sample_ms, g_warmup_ms);
+			break;
+	}
+}
+
+static void Bench_Print_Result( const bench_case_type* pCase, const bench_result_type* pResult )
+{
+	double ops_per_s = (pResult->median_ns > 0.0) ? (1.0e9 / pResult->median_ns) : 0.0;
+
+	switch (g_format)
+	{
+		case BENCH_FORMAT_TEXT:
+			printf("%-22s %12.1f %12.1f %12.1f %8.2f %14.0f\n", pCase->name, pResult->median_ns, pResult->min_ns,
+				   pResult->max_ns, (pResult->mean_ns > 0.0) ? (100.0 * pResult->stdev_ns / pResult->mean_ns) : 0.0, ops_per_s);
+			break;
+
+		case BENCH_FORMAT_CSV:
+			printf("%s,%llu,%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.0f\n", pCase->name, (unsigned long long)pResult->iterations,
+				   pResult->samples, pResult->median_ns, pResult->min_ns, pResult->max_ns, pResult->mean_ns,
+				   pResult->stdev_ns, ops_per_s);
+			break;
+
+		case BENCH_FORMAT_JSON:
+			printf("{\"name\":\"%s\",\"iterations\":%llu,\"samples\":%d,\"median_ns\":%.1f,\"min_ns\":%.1f,\"max_ns\":%.1f,"
+				   "\"mean_ns\":%.1f,\"stdev_ns\":%.1f,\"ops_per_s\":%.0f}\n", pCase->name,
+				   (unsigned long long)pResult->iterations, pResult->samples, pResult->median_ns, pResult->min_ns,
+				   pResult->max_ns, pResult->mean_ns, pResult->stdev_ns, ops_per_s);
+			break;
+	}
+	fflush(stdout);
+}
+
+static bool Bench_Is_Selected( const bench_case_type* pCase, int argc, char** argv )
+{
+	int i;
+
+	if (argc == 0)
+		return true;
+
+	for (i = 0; i < argc; i++)
+	{
+		if (strstr(pCase->name, argv[i]) != NULL)
+			return true;
+	}
+	return false;
+}
+
+static void Bench_Usage( void )
+{
+	printf("Usage: bench [-r repetitions] [-w warmup ms] [-s sample ms] [-f text|csv|json] [-l] [name...]\n");
+}
+
+int main( int argc, char** argv )
+{
+	bench_result_type result;
+	bool pigpio_started = false;
+	int saved_stdout;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "r:w:s:f:lh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'r':
+				g_repetitions = atoi(optarg);
+				if ((g_repetitions < 1) || (g_repetitions > BENCH_MAX_REPETITIONS))
+					g_repetitions = BENCH_DEFAULT_REPETITIONS;
+				break;
+
+			case 'w':
+				g_warmup_ms = atoi(optarg);
+				break;
+
+			case 's':
+				g_sample_ms = (atoi(optarg) > 0) ? atoi(optarg) : BENCH_DEFAULT_SAMPLE_MS;
+				break;
+
+			case 'f':
+				if (strcmp(optarg, "csv") == 0)
+					g_format = BENCH_FORMAT_CSV;
+				else if (strcmp(optarg, "json") == 0)
+					g_format = BENCH_FORMAT_JSON;
+				else
+					g_format = BENCH_FORMAT_TEXT;
+				break;
+
+			case 'l':
+				for (i = 0; i < BENCHMARKS_SIZE; i++)
+					printf("%-22s %s\n", g_benchmarks[i].name, g_benchmarks[i].description);
+				return 0;
+
+			default:
+				Bench_Usage();
+				return 1;
+		}
+	}
+
+	// The same start up as the daemon, without the threads.  What the modules print would spoil
+	// the csv and json output.
+	fflush(stdout);
+	saved_stdout = dup(STDOUT_FILENO);
+	dup2(open("/dev/null", O_WRONLY), STDOUT_FILENO);
+
+	Event_Log_Init();
+	Commands_Init( &shared_data );
+	Thermistor_Init();
+	App_Init( &shared_data );
+	Bench_Eth_Init( &shared_data );
+	Bench_Set_Status_Snapshot();
+
+	fflush(stdout);
+	dup2(saved_stdout, STDOUT_FILENO);
+	close(saved_stdout);
+
+	Bench_Print_Header();
+
+	for (i = 0; i < BENCHMARKS_SIZE; i++)
+	{
+		if (!Bench_Is_Selected( &g_benchmarks[i], argc - optind, &argv[optind] ))
+			continue;
+
+		if (g_benchmarks[i].needs_pigpio && !pigpio_started)
+		{
+			if (Pigpio_Standin_Start() < 0)
+				return 2;
+			pigpio_started = true;
+		}
+
+		Bench_Run( &g_benchmarks[i], &result );
+		Bench_Print_Result( &g_benchmarks[i], &result );
+	}
+
+	if (pigpio_started)
+		Pigpio_Standin_Stop();
+	return 0;
+}
+
+/* *** End of File *** */
@@ -0,0 +1,29 @@
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <stdint.h>
+
+// Paths of the pipes served by the stand-in pigpio daemon, the modules are built against them
+#define BENCH_PIGPIO_COMMAND_PIPE		"/tmp/smokinpi_bench_pigpio"
+#define BENCH_PIGPIO_RESPONSE_PIPE		"/tmp/smokinpi_bench_pigout"
+
+/***************************************************************************************************
+Entry points into functions that are static in their modules.  Each hook_<module>.c file includes
+the module's source, so the benchmark measures exactly the code of the daemon.
+***************************************************************************************************/
+float Bench_App_Thermocouple_Temperature( uint16_t adc_counts );
+
+void Bench_Eth_Init( void* shared_data_address );
+void Bench_Eth_Process_Command( char* p_command );
+void Bench_Eth_Receive( const char* p_data, int length );
+
+void Bench_File_Fifo_Process_Command( char* p_command );
+
+int Bench_Tlc1543_Transfer( uint8_t* pData, int length );
+int Bench_Servo_Set_Position( int width );
+
+// Stand-in pigpio daemon answering s, spio, spix and spic on the bench pipes, see tools/pigpio_emulator.c
+int Pigpio_Standin_Start( void );
+void Pigpio_Standin_Stop( void );
+
+#endif //__BENCH_H
@@ -0,0 +1,12 @@
+/***************************************************************************************************
+Benchmark hooks into app.c
+***************************************************************************************************/
+#include "app.c"
+#include "bench/bench.h"
+
+float Bench_App_Thermocouple_Temperature( uint16_t adc_counts )
+{
+	return App_Calculate_Thermocouple_Temperature( adc_counts );
+}
+
+/* *** End of File *** */
@@ -0,0 +1,41 @@
+/***************************************************************************************************
+Benchmark hooks into eth_comms.c.  Connection slot 0 stands for a client, its socket is /dev/null so
+responses cost a write() like they do on a real connection.
+***************************************************************************************************/
+#include "eth_comms.c"
+#include "bench/bench.h"
+
+void Bench_Eth_Init( void* shared_data_address )
+{
+	int i;
+
+	p_shared_data = (shared_data_type*)shared_data_address;
+	for (i = 0; i < ETH_MAX_CONNECTIONS; i++)
+	{
+		g_conns[i].fd = -1;
+		g_conns[i].pass_fd = -1;
+	}
+
+	Cmd_Registry_Add( g_eth_cmds, ETH_CMDS_SIZE );
+	g_conns[0].fd = open("/dev/null", O_WRONLY);
+}
+
+// Registry lookup, argument conversion, handler and response building of one command line
+void Bench_Eth_Process_Command( char* p_command )
+{
+	Eth_Comms_Process_Commands( &g_conns[0], p_command );
+}
+
+// The whole receive path: framing of the received bytes, then every command in them
+void Bench_Eth_Receive( const char* p_data, int length )
+{
+	eth_conn_type* pConn = &g_conns[0];
+
+	pConn->batching = true;
+	Eth_Comms_Receive( pConn, (unsigned char*)p_data, length );
+	Eth_Comms_Extract_Commands( pConn );
+	pConn->batching = false;
+	Eth_Comms_Send_Pending( pConn );
+}
+
+/* *** End of File *** */
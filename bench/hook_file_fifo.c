@@ -0,0 +1,12 @@
+/***************************************************************************************************
+Benchmark hooks into file_fifo.c
+***************************************************************************************************/
+#include "file_fifo.c"
+#include "bench/bench.h"
+
+void Bench_File_Fifo_Process_Command( char* p_command )
+{
+	File_Fifo_Process_Cmd( p_command );		// The pipes are not open, the response is only formatted
+}
+
+/* *** End of File *** */
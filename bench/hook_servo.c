@@ -0,0 +1,17 @@
+/***************************************************************************************************
+Benchmark hooks into servo.c
+***************************************************************************************************/
+#include "bench/bench.h"
+
+// Talk to the stand-in daemon
+#define PIGPIO_COMMAND_PIPE			BENCH_PIGPIO_COMMAND_PIPE
+#define PIGPIO_RESPONSE_PIPE		BENCH_PIGPIO_RESPONSE_PIPE
+
+#include "servo.c"
+
+int Bench_Servo_Set_Position( int width )
+{
+	return Servo_Set_Position( width );
+}
+
+/* *** End of File *** */
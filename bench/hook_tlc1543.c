@@ -0,0 +1,17 @@
+/***************************************************************************************************
+Benchmark hooks into tlc1543.c
+***************************************************************************************************/
+#include "bench/bench.h"
+
+// Talk to the stand-in daemon
+#define PIGPIO_COMMAND_PIPE			BENCH_PIGPIO_COMMAND_PIPE
+#define PIGPIO_RESPONSE_PIPE		BENCH_PIGPIO_RESPONSE_PIPE
+
+#include "tlc1543.c"
+
+int Bench_Tlc1543_Transfer( uint8_t* pData, int length )
+{
+	return Tlc1543_Transfer( pData, length );
+}
+
+/* *** End of File *** */
@@ -0,0 +1,79 @@
+/***************************************************************************************************
+Pigpio Stand-in
+
+A thread that plays pigpiod on the bench pipes, so Tlc1543_Transfer() and Servo_Set_Position() can
+be measured on any Linux machine.  The commands are run by the emulator core of tools/fake_pigpiod
+(tools/pigpio_emulator.c) without any injected faults, so the benchmarks and the fake daemon answer
+s, spio, spix and spic the same way.
+
+The pipes are opened read-write, so clients opening and closing them for every transfer never leave
+the stand-in at end of file or without a reader.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "tools/pigpio_emulator.h"
+#include "bench/bench.h"
+
+/* *** Global Variables *** */
+static int g_command_fd = -1;
+static int g_response_fd = -1;
+static pthread_t g_thread;
+static pigpio_emulator_line_type g_line;
+
+/***************************************************************************************************
+Reads command lines and writes their replies until the pipes are closed
+***************************************************************************************************/
+static void* Pigpio_Standin_Service( void* pArg )
+{
+	while (Pigpio_Emulator_Pipe_Read( g_command_fd, g_response_fd, &g_line ) > 0)
+		;
+
+	return NULL;
+}
+
+/***************************************************************************************************
+Creates the pipes and starts the stand-in
+
+Returns -1 on error
+		 1 on success
+***************************************************************************************************/
+int Pigpio_Standin_Start( void )
+{
+	pigpio_emulator_config_type config = { 0 };
+
+	unlink(BENCH_PIGPIO_COMMAND_PIPE);
+	unlink(BENCH_PIGPIO_RESPONSE_PIPE);
+
+	if ((mkfifo(BENCH_PIGPIO_COMMAND_PIPE, 0600) < 0) || (mkfifo(BENCH_PIGPIO_RESPONSE_PIPE, 0600) < 0))
+	{
+		printf("Error creating the stand-in pigpio pipes - %s.%u\n", __FILE__, __LINE__);
+		return -1;
+	}
+
+	g_command_fd = open(BENCH_PIGPIO_COMMAND_PIPE, O_RDWR);
+	g_response_fd = open(BENCH_PIGPIO_RESPONSE_PIPE, O_RDWR);
+	if ((g_command_fd < 0) || (g_response_fd < 0))
+	{
+		printf("Error opening the stand-in pigpio pipes - %s.%u\n", __FILE__, __LINE__);
+		return -1;
+	}
+
+	Pigpio_Emulator_Init( &config );
+	if (pthread_create(&g_thread, NULL, Pigpio_Standin_Service, NULL) != 0)
+		return -1;
+
+	return 1;
+}
+
+void Pigpio_Standin_Stop( void )
+{
+	unlink(BENCH_PIGPIO_COMMAND_PIPE);
+	unlink(BENCH_PIGPIO_RESPONSE_PIPE);
+}
+
+/* *** End of File *** */
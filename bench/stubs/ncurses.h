@@ -0,0 +1,13 @@
+/***************************************************************************************************
+Stand-in for <ncurses.h> in the benchmark build.  The console output of the modules is dropped.
+***************************************************************************************************/
+#ifndef __BENCH_NCURSES_H
+#define __BENCH_NCURSES_H
+
+#define stdscr						NULL
+#define getyx(win, y, x)			((y) = 0, (x) = 0)
+#define move(y, x)					((void)(y), (void)(x))
+#define printw(...)					((void)0)
+#define refresh()					((void)0)
+
+#endif //__BENCH_NCURSES_H
@@ -0,0 +1,8 @@
+/***************************************************************************************************
+Stand-in for <pigpio.h> in the benchmark build.  The modules talk to pigpiod through its pipes and
+only include the header, so nothing of the library is needed.
+***************************************************************************************************/
+#ifndef __BENCH_PIGPIO_H
+#define __BENCH_PIGPIO_H
+
+#endif //__BENCH_PIGPIO_H
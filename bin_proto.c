@@ -0,0 +1,256 @@
+/***************************************************************************************************
+Binary Protocol
+
+Compact alternative to the ASCII Ethernet commands.  A client switches its connection to binary
+with the ASCII command BINARY and back with CMD_SET_ASCII_MODE.  Every message in either direction
+is a frame:
+
+	uint16 sync			SYNC_PATTERN
+	uint16 length		Payload bytes
+	uint16 cmd_id		message_id_type
+	payload
+	uint16 crc			CRC-16/CCITT-FALSE of the header and payload
+
+All values are little endian.  Temperatures are int16 tenths of a degree F.
+
+Payloads
+	CMD_GET_VERSION					none
+	CMD_VERSION_RESPONSE			uint16 major, minor, revision
+	CMD_GET_STATUS					none
+	CMD_STATUS_RESPONSE				int16 setpoint, int16 probe[NBR_OF_THERMISTORS], int16 fire,
+									uint16 adc[NBR_ADC_CHANNELS], uint16 fire state
+	CMD_SET_TEMPERATURE_SETPOINT	float32 setpoint
+	CMD_SETPOINT_RESPONSE			float32 setpoint in use
+	CMD_GET_HISTORY					uint32 channel mask, int32 from s, int32 to s, uint16 max points
+									(times <= 0 are relative to now, as for HISTORY?)
+	CMD_HISTORY_RESPONSE			uint8 channel, uint8 reserved, uint16 count, int64 first ms,
+									count * { uint32 ms after first, int16 value * 10 }
+									One frame per channel, then one with channel 0xFF and count 0
+	CMD_SUBSCRIBE					uint32 field mask, uint16 period ms, optional uint8 flags
+									(bit 0 requests delta frames)
+	CMD_UNSUBSCRIBE					none
+	CMD_SUBSCRIBE_RESPONSE			uint32 field mask (0 when unsubscribed), uint16 period ms
+	CMD_PUSH_FRAME					int64 time ms, uint32 field mask, one uint16 per field in the
+									mask in subscription_field_type order (temperatures as int16)
+	CMD_DELTA_FRAME					As CMD_PUSH_FRAME, only the fields that changed
+	CMD_REQUEST_KEYFRAME			none, the next frame is a CMD_PUSH_FRAME
+	CMD_SET_DEADBAND				uint32 field mask, float32 deadband, answered like CMD_SUBSCRIBE
+	CMD_MULTICAST_FRAME				uint32 sequence, then as CMD_PUSH_FRAME with every field.  Only
+									sent as UDP datagrams, see multicast.c
+	CMD_SET_ASCII_MODE				none, no response
+	CMD_ERROR_RESPONSE				uint16 cmd_id of the rejected message
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "rev_history.h"
+#include "bin_proto.h"
+
+/* *** Global Variables *** */
+	// CRC-16/CCITT-FALSE remainders of each nibble
+static const uint16_t g_crc_nibble_table[16] =
+{
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+};
+
+/***************************************************************************************************
+CRC-16/CCITT-FALSE, start with crc = 0xFFFF
+***************************************************************************************************/
+uint16_t Bin_Proto_Crc16( const uint8_t* p_data, int length, uint16_t crc )
+{
+	while (length-- > 0)
+	{
+		crc = (uint16_t)((crc << 4) ^ g_crc_nibble_table[(crc >> 12) ^ (*p_data >> 4)]);
+		crc = (uint16_t)((crc << 4) ^ g_crc_nibble_table[(crc >> 12) ^ (*p_data & 0x0F)]);
+		p_data++;
+	}
+
+	return crc;
+}
+
+/***************************************************************************************************
+Converts a temperature to int16 tenths of a degree, saturating at the int16 limits
+***************************************************************************************************/
+int16_t Bin_Proto_Temp_To_Fixed( float temp_deg_f )
+{
+	float scaled = temp_deg_f * BIN_PROTO_TEMP_SCALE;
+
+	if (scaled >= 32767.0f)
+		return 32767;
+	if (scaled <= -32768.0f)
+		return -32768;
+
+	return (int16_t)((scaled < 0.0f) ? (scaled - 0.5f) : (scaled + 0.5f));
+}
+
+/***************************************************************************************************
+Completes a frame whose payload has been written at p_frame + BIN_PROTO_HEADER_SIZE by filling in
+the header and the CRC
+
+Returns the length of the whole frame
+***************************************************************************************************/
+int Bin_Proto_Finish_Frame( uint8_t* p_frame, message_id_type cmd_id, int payload_length )
+{
+	uint16_t crc;
+
+	Bin_Proto_Put_U16( &p_frame[0], SYNC_PATTERN );
+	Bin_Proto_Put_U16( &p_frame[2], (uint16_t)payload_length );
+	Bin_Proto_Put_U16( &p_frame[4], (uint16_t)cmd_id );
+
+	crc = Bin_Proto_Crc16( p_frame, BIN_PROTO_HEADER_SIZE + payload_length, 0xFFFF );
+	Bin_Proto_Put_U16( &p_frame[BIN_PROTO_HEADER_SIZE + payload_length], crc );
+
+	return BIN_PROTO_OVERHEAD + payload_length;
+}
+
+/***************************************************************************************************
+Checks whether p_data starts with a complete, valid frame
+
+Returns the length of the frame
+		BIN_PROTO_INCOMPLETE when more data is needed
+		BIN_PROTO_BAD_SYNC, BIN_PROTO_BAD_LENGTH or BIN_PROTO_BAD_CRC when the first byte should be
+		dropped to search for the next frame
+***************************************************************************************************/
+int Bin_Proto_Check_Frame( const uint8_t* p_data, int available, int max_payload )
+{
+	int payload_length;
+	int frame_length;
+
+	if (available < 2)
+		return BIN_PROTO_INCOMPLETE;
+	if (Bin_Proto_Get_U16( p_data ) != SYNC_PATTERN)
+		return BIN_PROTO_BAD_SYNC;
+	if (available < BIN_PROTO_HEADER_SIZE)
+		return BIN_PROTO_INCOMPLETE;
+
+	payload_length = Bin_Proto_Get_U16( &p_data[2] );
+	if (payload_length > max_payload)
+		return BIN_PROTO_BAD_LENGTH;
+
+	frame_length = BIN_PROTO_OVERHEAD + payload_length;
+	if (available < frame_length)
+		return BIN_PROTO_INCOMPLETE;
+
+	if (Bin_Proto_Crc16( p_data, BIN_PROTO_HEADER_SIZE + payload_length, 0xFFFF ) !=
+		Bin_Proto_Get_U16( &p_data[BIN_PROTO_HEADER_SIZE + payload_length] ))
+		return BIN_PROTO_BAD_CRC;
+
+	return frame_length;
+}
+
+/***************************************************************************************************
+Builds a CMD_VERSION_RESPONSE frame
+
+Returns the frame length or -1 if frame_size is too small
+***************************************************************************************************/
+int Bin_Proto_Encode_Version( uint8_t* p_frame, int frame_size )
+{
+	uint8_t* p = &p_frame[BIN_PROTO_HEADER_SIZE];
+
+	if (frame_size < (BIN_PROTO_OVERHEAD + 6))
+		return -1;
+
+	Bin_Proto_Put_U16( &p[0], FIRMWARE_MAJOR );
+	Bin_Proto_Put_U16( &p[2], FIRMWARE_MINOR );
+	Bin_Proto_Put_U16( &p[4], FIRMWARE_REVISION );
+
+	return Bin_Proto_Finish_Frame( p_frame, CMD_VERSION_RESPONSE, 6 );
+}
+
+/***************************************************************************************************
+Writes one field of a snapshot as 16 bits
+***************************************************************************************************/
+static inline void Bin_Proto_Put_Field( uint8_t* p, const subscription_snapshot_type* pSnapshot, int field )
+{
+	if (field >= SUBSCRIPTION_FIELD_ADC_0)
+		Bin_Proto_Put_U16( p, (uint16_t)pSnapshot->values[field] );
+	else
+		Bin_Proto_Put_U16( p, (uint16_t)Bin_Proto_Temp_To_Fixed( pSnapshot->values[field] ) );
+}
+
+/***************************************************************************************************
+Builds a CMD_STATUS_RESPONSE frame, the binary form of STATUS?
+
+Returns the frame length or -1 if frame_size is too small
+***************************************************************************************************/
+int Bin_Proto_Encode_Status( const subscription_snapshot_type* pSnapshot, uint8_t* p_frame, int frame_size )
+{
+	uint8_t* p = &p_frame[BIN_PROTO_HEADER_SIZE];
+	int field;
+
+	if (frame_size < (BIN_PROTO_OVERHEAD + (SUBSCRIPTION_FIELD_FIRE_STATE + 1) * 2))
+		return -1;
+
+	for (field = 0; field <= SUBSCRIPTION_FIELD_FIRE_STATE; field++, p += 2)
+		Bin_Proto_Put_Field( p, pSnapshot, field );
+
+	return Bin_Proto_Finish_Frame( p_frame, CMD_STATUS_RESPONSE, (SUBSCRIPTION_FIELD_FIRE_STATE + 1) * 2 );
+}
+
+/***************************************************************************************************
+Writes the time, the mask and the fields of the mask as in CMD_PUSH_FRAME
+
+Returns the number of bytes written
+***************************************************************************************************/
+static int Bin_Proto_Put_Push_Payload( uint8_t* p_payload, const subscription_snapshot_type* pSnapshot, uint32_t mask )
+{
+	uint8_t* p = p_payload;
+	int field;
+
+	Bin_Proto_Put_U64( &p[0], (uint64_t)pSnapshot->timestamp_ms );
+	Bin_Proto_Put_U32( &p[8], mask );
+	p += 12;
+
+	for (field = 0; field < NBR_SUBSCRIPTION_FIELDS; field++)
+	{
+		if (mask & (1UL << field))
+		{
+			Bin_Proto_Put_Field( p, pSnapshot, field );
+			p += 2;
+		}
+	}
+
+	return (int)(p - p_payload);
+}
+
+/***************************************************************************************************
+Builds a CMD_PUSH_FRAME (keyframe) or CMD_DELTA_FRAME frame with the fields of the mask
+
+Returns the frame length or -1 if frame_size is too small
+***************************************************************************************************/
+int Bin_Proto_Encode_Push( const subscription_snapshot_type* pSnapshot, uint32_t mask, bool keyframe,
+						   uint8_t* p_frame, int frame_size )
+{
+	int length;
+
+	if (frame_size < (BIN_PROTO_OVERHEAD + 12 + (NBR_SUBSCRIPTION_FIELDS * 2)))
+		return -1;
+
+	length = Bin_Proto_Put_Push_Payload( &p_frame[BIN_PROTO_HEADER_SIZE], pSnapshot, mask );
+
+	return Bin_Proto_Finish_Frame( p_frame, keyframe ? CMD_PUSH_FRAME : CMD_DELTA_FRAME, length );
+}
+
+/***************************************************************************************************
+Builds a CMD_MULTICAST_FRAME frame with every field
+
+Returns the frame length or -1 if frame_size is too small
+***************************************************************************************************/
+int Bin_Proto_Encode_Multicast( const subscription_snapshot_type* pSnapshot, uint32_t sequence,
+								uint8_t* p_frame, int frame_size )
+{
+	uint8_t* p = &p_frame[BIN_PROTO_HEADER_SIZE];
+	int length;
+
+	if (frame_size < BIN_PROTO_MULTICAST_FRAME_SIZE)
+		return -1;
+
+	Bin_Proto_Put_U32( p, sequence );
+	length = 4 + Bin_Proto_Put_Push_Payload( p + 4, pSnapshot, SUBSCRIPTION_ALL_FIELDS );
+
+	return Bin_Proto_Finish_Frame( p_frame, CMD_MULTICAST_FRAME, length );
+}
+
+/* *** End of File *** */
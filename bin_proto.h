@@ -0,0 +1,65 @@
+#ifndef __BIN_PROTO_H
+#define __BIN_PROTO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "eth_comms.h"			// For SYNC_PATTERN, msg_header_type and message_id_type
+#include "subscription.h"		// For subscription_snapshot_type
+
+#define BIN_PROTO_HEADER_SIZE		6			// sync, length and cmd_id, 16 bits each
+#define BIN_PROTO_CRC_SIZE			2
+#define BIN_PROTO_OVERHEAD			(BIN_PROTO_HEADER_SIZE + BIN_PROTO_CRC_SIZE)
+#define BIN_PROTO_MAX_PAYLOAD		65535
+#define BIN_PROTO_TEMP_SCALE		10			// Temperatures are sent in tenths of a degree
+#define BIN_PROTO_MULTICAST_FRAME_SIZE	(BIN_PROTO_OVERHEAD + 16 + (NBR_SUBSCRIPTION_FIELDS * 2))
+
+	// Results of Bin_Proto_Check_Frame() other than a frame length
+#define BIN_PROTO_INCOMPLETE		0
+#define BIN_PROTO_BAD_SYNC			-1
+#define BIN_PROTO_BAD_LENGTH		-2
+#define BIN_PROTO_BAD_CRC			-3
+
+/***************************************************************************************************
+Little endian helpers for building and reading payloads
+***************************************************************************************************/
+static inline void Bin_Proto_Put_U16( uint8_t* p, uint16_t value )
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+}
+
+static inline void Bin_Proto_Put_U32( uint8_t* p, uint32_t value )
+{
+	Bin_Proto_Put_U16( p, (uint16_t)value );
+	Bin_Proto_Put_U16( p + 2, (uint16_t)(value >> 16) );
+}
+
+static inline void Bin_Proto_Put_U64( uint8_t* p, uint64_t value )
+{
+	Bin_Proto_Put_U32( p, (uint32_t)value );
+	Bin_Proto_Put_U32( p + 4, (uint32_t)(value >> 32) );
+}
+
+static inline uint16_t Bin_Proto_Get_U16( const uint8_t* p )
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t Bin_Proto_Get_U32( const uint8_t* p )
+{
+	return Bin_Proto_Get_U16( p ) | ((uint32_t)Bin_Proto_Get_U16( p + 2 ) << 16);
+}
+
+uint16_t Bin_Proto_Crc16( const uint8_t* p_data, int length, uint16_t crc );
+int16_t Bin_Proto_Temp_To_Fixed( float temp_deg_f );
+int Bin_Proto_Finish_Frame( uint8_t* p_frame, message_id_type cmd_id, int payload_length );
+int Bin_Proto_Check_Frame( const uint8_t* p_data, int available, int max_payload );
+
+int Bin_Proto_Encode_Version( uint8_t* p_frame, int frame_size );
+int Bin_Proto_Encode_Status( const subscription_snapshot_type* pSnapshot, uint8_t* p_frame, int frame_size );
+int Bin_Proto_Encode_Push( const subscription_snapshot_type* pSnapshot, uint32_t mask, bool keyframe,
+						   uint8_t* p_frame, int frame_size );
+int Bin_Proto_Encode_Multicast( const subscription_snapshot_type* pSnapshot, uint32_t sequence,
+								uint8_t* p_frame, int frame_size );
+
+#endif //__BIN_PROTO_H
@@ -3,65 +3,38 @@
 #include <string.h>
 #include <unistd.h>
 #include <ncurses.h>
+#include <time.h>
 #include "cmd_line.h"
 #include "main.h"
-#include "app.h"
-#include "monitor.h"
-
-/* *** Data Types *** */
-typedef struct 
-{
-	char* cmd;
-	char* description;	
-} cmd_type;
+#include "cmd_registry.h"
 
 /* *** Defined Values *** */
-typedef enum
-{
-	CMD_SHOW_MENU=0,
-	CMD_EXIT,
-	CMD_SET_SETPOINT,
-	CMD_SET_KP,
-	CMD_SET_KI,
-	CMD_SET_KL,
-	CMD_LIGHT_FIRE,
-	CMD_SEND_TEST_TEXT,
-	
-	NBR_OF_CMDS,
-	NO_CMD_AVAILABLE,
-} cmd_ids;
+#define CMD_LINE_RESPONSE_SIZE		1024		// Longer responses are printed in pieces
 
 /* *** Global Variables *** */
-static const cmd_type cmd_list[NBR_OF_CMDS] = {
-	{ "HELP",			"Shows this menu\n"									},
-	{ "EXIT",			"Closes the program\n"								},
-	{ "SETTEMP=",		"Set the target cabinet temperature\n" 		},
-	{ "KP=",				"Set proportaional gain\n"							},
-	{ "KI=",				"Set integral gain\n"								},
-	{ "KL=",				"Set integral limit\n"								},
-	{ "LIGHT",				"Set servo to max position so the fire can be lit\n"								},
-	{ "TEXT",				"Send a test text message\n"			},
-};
-
 char g_cmd[MAX_CMD_LENGTH];
 
 /* *** Function Prototypes *** */
 static void Cmd_Line_Get_Command( void );
 static void Cmd_Line_Process( void );
+static void Cmd_Line_Print( void* pContext, const char* p_data, int length );
+static int Cmd_Line_Exit( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
 
-// Command Processors
-void Cmd_Line_Print_Menu( void );
+static const cmd_definition_type g_cmd_line_cmds[] =
+{
+	{ "EXIT",		{ NULL },		"Closes the program",
+		CMD_FRONTEND_CONSOLE, 0, 0, { { 0 } },		Cmd_Line_Exit, CMD_ACCESS_WRITE },
+};
 
 /* *** Accessors *** */
 
 /*******************************************************************************
-Prepares the program for control via the command line
+Prepares the program for control via the command line.  The commands come from
+the command registry, only EXIT is specific to the console.
 *******************************************************************************/
 void Cmd_Line_Init( void* shared_data_address )
 {
-//	pthread_mutex_lock(&cmd_line_mutex);
-//	cmd_line_shared_data.cmd_number = NO_CMD_AVAILABLE;
-//	pthread_mutex_unlock(&cmd_line_mutex);
+	Cmd_Registry_Add( g_cmd_line_cmds, sizeof(g_cmd_line_cmds) / sizeof(g_cmd_line_cmds[0]) );
 }
 
 /*******************************************************************************
@@ -120,75 +93,33 @@ static void Cmd_Line_Get_Command( void )
 
 static void Cmd_Line_Process( void )
 {
-	int cmd_nbr;
-	int cmd_found = false;
-	char* p_param = NULL;
-	
-	for (cmd_nbr = 0; cmd_nbr < NBR_OF_CMDS; cmd_nbr++)
-	{
-		if (strncasecmp( g_cmd, cmd_list[cmd_nbr].cmd, strlen(cmd_list[cmd_nbr].cmd) ) == 0)
-		{
-			cmd_found = true;
-			p_param = &g_cmd[strlen(cmd_list[cmd_nbr].cmd)];
-			break;	// Get out of the 'for' loop without incrementing 'i'
-		}
-	}
-	
-	if (cmd_found)
+	char buffer[CMD_LINE_RESPONSE_SIZE];
+	str_builder_type builder;
+
+	move( 4, 0 );
+
+	Str_Builder_Init( &builder, buffer, sizeof(buffer), Cmd_Line_Print, NULL );
+	if (Cmd_Registry_Execute( CMD_FRONTEND_CONSOLE, NULL, g_cmd, &builder ) == CMD_RESULT_UNKNOWN)
 	{
-		move( 4, 0 );
-		
-		switch (cmd_nbr)
-		{
-			case CMD_SHOW_MENU:
-				Cmd_Line_Print_Menu();
-				break;
-				
-			case CMD_EXIT:
-				endwin();
-				_exit(3);
-				break;
-				
-			case CMD_SET_SETPOINT:
-				printw("New Setpoint: %4.2f\n", atof(p_param) );
-				App_Set_Cabinet_Setpoint( atof(p_param) );
-				break;
-			
-			case CMD_SET_KP:
-				printw("New proportional gain: %0.3f\n", atof(p_param) );
-				App_Set_Kp( atof(p_param) );
-				break;
-				
-			case CMD_SET_KI:
-				printw("New integral gain: %0.3f\n", atof(p_param) );
-				App_Set_Ki( atof(p_param) );
-				break;
-				
-			case CMD_SET_KL:
-				printw("New integral limit: %0.3f\n", atof(p_param) );
-				App_Set_Kl( atof(p_param) );
-				break;
-				
-			case CMD_LIGHT_FIRE:
-				printw("Ignoring fire temperature temporarily\n");
-				Monitor_Light_Fire();
-				break;
-				
-			case CMD_SEND_TEST_TEXT:
-				printw("Sending test text\n");
-				Monitor_Send_Notification( "Test", "This is a test notification" );
-				break;
-				
-		}
-	}
-	else
 		printw("Cmd not found: %s\n", g_cmd);
+		return;
+	}
+
+	Str_Builder_Append_Char( &builder, '\n' );
+	Str_Builder_Flush( &builder );
 }
 
-void Cmd_Line_Print_Menu( void )
+/*******************************************************************************
+Flush function of the response builder
+*******************************************************************************/
+static void Cmd_Line_Print( void* pContext, const char* p_data, int length )
 {
-	int i;
+	printw("%.*s", length, p_data);
+}
 
-	for (i = 0; i < NBR_OF_CMDS; i++)
-		printw( "%10s %s", cmd_list[i].cmd, cmd_list[i].description );
+static int Cmd_Line_Exit( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	endwin();
+	_exit(3);
+	return 1;
 }
@@ -0,0 +1,377 @@
+/***************************************************************************************************
+Command Registry
+
+One table of typed commands shared by the console, the named pipes and the Ethernet server.  Each
+module adds its commands with Cmd_Registry_Add() during initialization.  A command line has the form
+
+	NAME[=|?|<space>]arg,arg,...			(arguments may also be separated by spaces)
+
+The name is case insensitive and may be any of the command's aliases, so SETTEMP=225, SETTEMP 225
+and SET_CABINET_TARGET 225 are the same command.  Arguments are converted and range checked before
+the handler is called.  Front-ends that do not trust every client run commands with
+Cmd_Registry_Execute_Checked(), which refuses the commands that change settings to the clients that
+may not.
+
+Names are found with a perfect hash: whenever commands are added, a seed is searched for which
+every name lands in its own slot of the table.  A lookup is then one hash, one slot and one string
+compare, however many commands there are.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "cmd_registry.h"
+
+/* *** Defined Values *** */
+#define CMD_REGISTRY_EMPTY_SLOT			0xFF
+#define CMD_REGISTRY_SEED_TRIES			1000		// Seeds tried before the table is made larger
+#define CMD_REGISTRY_MAX_SLOTS			65536
+#define CMD_REGISTRY_ARG_SEPARATORS		", \t\r\n"
+
+_Static_assert(CMD_REGISTRY_MAX_KEYS < CMD_REGISTRY_EMPTY_SLOT, "key indices are stored in a byte");
+
+/* *** Data Types *** */
+typedef struct
+{
+	char name[CMD_REGISTRY_MAX_NAME];			// Upper case
+	const cmd_definition_type* pCommand;
+} cmd_key_type;
+
+/* *** Global Variables *** */
+static const cmd_definition_type* g_commands[CMD_REGISTRY_MAX_COMMANDS];
+static int g_nbr_commands = 0;
+static cmd_key_type g_keys[CMD_REGISTRY_MAX_KEYS];
+static int g_nbr_keys = 0;
+
+static uint8_t* g_slots = NULL;					// Index into g_keys of each slot
+static uint32_t g_slot_mask = 0;
+static uint32_t g_seed = 0;
+
+/***************************************************************************************************
+FNV-1a with a seed and a final mix, so that the low bits used for the slot depend on every character
+***************************************************************************************************/
+static inline uint32_t Cmd_Registry_Hash( const char* p_name, uint32_t seed )
+{
+	uint32_t hash = 2166136261UL ^ seed;
+
+	while (*p_name != '\0')
+	{
+		hash ^= (uint8_t)*p_name++;
+		hash *= 16777619UL;
+	}
+
+	hash ^= hash >> 16;
+	hash *= 0x45D9F3BUL;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+/***************************************************************************************************
+Searches for a seed that puts every key in a slot of its own.  The table has at least as many slots
+as the square of the number of keys, so about half of all seeds work.
+
+Returns -1 if no seed was found
+		 1 on success
+***************************************************************************************************/
+static int Cmd_Registry_Build_Hash( void )
+{
+	uint32_t nbr_slots = 64;
+	uint32_t seed;
+	uint32_t slot;
+	uint8_t* p_slots;
+	int i;
+
+	while (nbr_slots < (uint32_t)(g_nbr_keys * g_nbr_keys))
+		nbr_slots <<= 1;
+
+	for (; nbr_slots <= CMD_REGISTRY_MAX_SLOTS; nbr_slots <<= 1)
+	{
+		p_slots = realloc(g_slots, nbr_slots);
+		if (p_slots == NULL)
+			return -1;
+		g_slots = p_slots;
+
+		for (seed = 1; seed <= CMD_REGISTRY_SEED_TRIES; seed++)
+		{
+			memset(g_slots, CMD_REGISTRY_EMPTY_SLOT, nbr_slots);
+
+			for (i = 0; i < g_nbr_keys; i++)
+			{
+				slot = Cmd_Registry_Hash( g_keys[i].name, seed ) & (nbr_slots - 1);
+				if (g_slots[slot] != CMD_REGISTRY_EMPTY_SLOT)
+					break;
+				g_slots[slot] = (uint8_t)i;
+			}
+
+			if (i == g_nbr_keys)
+			{
+				g_slot_mask = nbr_slots - 1;
+				g_seed = seed;
+				return 1;
+			}
+		}
+	}
+
+	g_slot_mask = 0;
+	return -1;
+}
+
+/***************************************************************************************************
+Returns the key with the given (upper case) name or NULL
+***************************************************************************************************/
+static const cmd_key_type* Cmd_Registry_Find_Key( const char* p_name )
+{
+	uint8_t index;
+
+	if (g_slots == NULL)
+		return NULL;
+
+	index = g_slots[Cmd_Registry_Hash( p_name, g_seed ) & g_slot_mask];
+	if ((index == CMD_REGISTRY_EMPTY_SLOT) || (strcmp(g_keys[index].name, p_name) != 0))
+		return NULL;
+
+	return &g_keys[index];
+}
+
+/***************************************************************************************************
+Adds a name of a command to the keys
+
+Returns -1 if the name is too long, already in use or there are too many keys
+		 1 on success
+***************************************************************************************************/
+static int Cmd_Registry_Add_Key( const char* p_name, const cmd_definition_type* pCommand )
+{
+	cmd_key_type* pKey = &g_keys[g_nbr_keys];
+	int i;
+
+	if ((g_nbr_keys >= CMD_REGISTRY_MAX_KEYS) || (strlen(p_name) >= CMD_REGISTRY_MAX_NAME))
+		return -1;
+
+	for (i = 0; p_name[i] != '\0'; i++)
+		pKey->name[i] = (char)toupper((unsigned char)p_name[i]);
+	pKey->name[i] = '\0';
+
+	for (i = 0; i < g_nbr_keys; i++)
+	{
+		if (strcmp(g_keys[i].name, pKey->name) == 0)
+			return -1;
+	}
+
+	pKey->pCommand = pCommand;
+	g_nbr_keys++;
+	return 1;
+}
+
+/***************************************************************************************************
+Adds a table of commands to the registry.  Must be called before the front-ends start, the table
+must stay valid for the life of the program.
+
+Returns -1 on error (a name in use twice, too many commands)
+		 1 on success
+***************************************************************************************************/
+int Cmd_Registry_Add( const cmd_definition_type* p_commands, int count )
+{
+	int result = 1;
+	int i, j;
+
+	for (i = 0; i < count; i++)
+	{
+		if ((g_nbr_commands >= CMD_REGISTRY_MAX_COMMANDS) || (Cmd_Registry_Add_Key( p_commands[i].name, &p_commands[i] ) < 0))
+		{
+			printf("Error adding command %s - %s.%u\n", p_commands[i].name, __FILE__, __LINE__);
+			result = -1;
+			continue;
+		}
+
+		for (j = 0; (j < CMD_REGISTRY_MAX_ALIASES) && (p_commands[i].aliases[j] != NULL); j++)
+		{
+			if (Cmd_Registry_Add_Key( p_commands[i].aliases[j], &p_commands[i] ) < 0)
+			{
+				printf("Error adding alias %s - %s.%u\n", p_commands[i].aliases[j], __FILE__, __LINE__);
+				result = -1;
+			}
+		}
+
+		g_commands[g_nbr_commands++] = &p_commands[i];
+	}
+
+	if (Cmd_Registry_Build_Hash() < 0)
+	{
+		printf("Error building the command hash - %s.%u\n", __FILE__, __LINE__);
+		result = -1;
+	}
+
+	return result;
+}
+
+/***************************************************************************************************
+Returns the command with the given name or alias if it may be used from the front-end, else NULL
+***************************************************************************************************/
+const cmd_definition_type* Cmd_Registry_Find( const char* p_name, cmd_frontend_type frontend )
+{
+	char name[CMD_REGISTRY_MAX_NAME];
+	const cmd_key_type* pKey;
+	int i;
+
+	for (i = 0; p_name[i] != '\0'; i++)
+	{
+		if (i >= (CMD_REGISTRY_MAX_NAME - 1))
+			return NULL;
+		name[i] = (char)toupper((unsigned char)p_name[i]);
+	}
+	name[i] = '\0';
+
+	pKey = Cmd_Registry_Find_Key( name );
+	if ((pKey == NULL) || !(pKey->pCommand->frontends & frontend))
+		return NULL;
+
+	return pKey->pCommand;
+}
+
+/***************************************************************************************************
+Converts and checks one argument
+
+Returns -1 if the text is not a valid value of the argument
+		 1 on success
+***************************************************************************************************/
+static int Cmd_Registry_Parse_Arg( const cmd_arg_spec_type* pSpec, char* p_text, cmd_arg_value_type* pValue )
+{
+	char* p_end;
+
+	pValue->s = p_text;
+	pValue->i = 0;
+	pValue->f = 0.0;
+
+	switch (pSpec->kind)
+	{
+		case CMD_ARG_INT:
+			pValue->i = strtol(p_text, &p_end, 10);
+			pValue->f = (double)pValue->i;
+			if ((*p_end != '\0') || (p_end == p_text))
+				return -1;
+			break;
+
+		case CMD_ARG_FLOAT:
+			pValue->f = strtod(p_text, &p_end);
+			if ((*p_end != '\0') || (p_end == p_text) || !isfinite(pValue->f))
+				return -1;
+			break;
+
+		case CMD_ARG_STRING:
+			return ((pSpec->max <= 0) || (strlen(p_text) <= pSpec->max)) ? 1 : -1;
+	}
+
+	return ((pValue->f >= pSpec->min) && (pValue->f <= pSpec->max)) ? 1 : -1;
+}
+
+/***************************************************************************************************
+Parses a command line, checks its arguments and runs the command.  p_line is modified.
+
+Returns CMD_RESULT_OK		when the command ran
+		CMD_RESULT_UNKNOWN	when there is no such command for the front-end (nothing is written)
+		CMD_RESULT_ERROR	when the arguments were invalid or the command failed
+***************************************************************************************************/
+int Cmd_Registry_Execute( cmd_frontend_type frontend, void* pConnection, char* p_line, str_builder_type* pBuilder )
+{
+	return Cmd_Registry_Execute_Checked( frontend, pConnection, true, p_line, pBuilder );
+}
+
+/***************************************************************************************************
+Same as Cmd_Registry_Execute() for a client that may only change settings if may_write is set
+
+Returns CMD_RESULT_DENIED as well, when the command would have changed settings
+***************************************************************************************************/
+int Cmd_Registry_Execute_Checked( cmd_frontend_type frontend, void* pConnection, bool may_write, char* p_line,
+								  str_builder_type* pBuilder )
+{
+	char name[CMD_REGISTRY_MAX_NAME];
+	const cmd_definition_type* pCommand;
+	const cmd_key_type* pKey;
+	cmd_context_type context;
+	cmd_args_type args;
+	char* p_save = NULL;
+	char* p_token;
+	int length = 0;
+
+	while (isspace((unsigned char)*p_line))
+		p_line++;
+
+	while ((*p_line != '\0') && (strchr("=?" CMD_REGISTRY_ARG_SEPARATORS, *p_line) == NULL))
+	{
+		if (length >= (CMD_REGISTRY_MAX_NAME - 1))
+			return CMD_RESULT_UNKNOWN;
+		name[length++] = (char)toupper((unsigned char)*p_line++);
+	}
+	name[length] = '\0';
+
+	pKey = Cmd_Registry_Find_Key( name );
+	if ((pKey == NULL) || !(pKey->pCommand->frontends & frontend))
+		return CMD_RESULT_UNKNOWN;
+	pCommand = pKey->pCommand;
+
+	if ((*p_line == '=') || (*p_line == '?'))
+		p_line++;
+
+	args.count = 0;
+	for (p_token = strtok_r(p_line, CMD_REGISTRY_ARG_SEPARATORS, &p_save); p_token != NULL;
+		 p_token = strtok_r(NULL, CMD_REGISTRY_ARG_SEPARATORS, &p_save))
+	{
+		if ((args.count >= pCommand->nbr_args) ||
+			(Cmd_Registry_Parse_Arg( &pCommand->args[args.count], p_token, &args.values[args.count] ) < 0))
+			break;
+		args.count++;
+	}
+
+	context.frontend = frontend;
+	context.pConnection = pConnection;
+
+	if (!may_write && (p_token == NULL) && ((pCommand->access == CMD_ACCESS_WRITE) ||
+		((pCommand->access == CMD_ACCESS_WRITE_WITH_ARGS) && (args.count > pCommand->nbr_required))))
+	{
+		Str_Builder_Append( pBuilder, pCommand->name );
+		Str_Builder_Append( pBuilder, ",DENIED" );
+		return CMD_RESULT_DENIED;
+	}
+
+	if ((p_token != NULL) || (args.count < pCommand->nbr_required) ||
+		(pCommand->handler( &context, &args, pBuilder ) < 0))
+	{
+		Str_Builder_Append( pBuilder, pCommand->name );
+		Str_Builder_Append( pBuilder, ",ERROR" );
+		return CMD_RESULT_ERROR;
+	}
+
+	return CMD_RESULT_OK;
+}
+
+/***************************************************************************************************
+Lists the commands of a front-end with their arguments, one per line
+***************************************************************************************************/
+void Cmd_Registry_Help( cmd_frontend_type frontend, str_builder_type* pBuilder )
+{
+	const cmd_definition_type* pCommand;
+	int lines = 0;
+	int i, j;
+
+	for (i = 0; i < g_nbr_commands; i++)
+	{
+		pCommand = g_commands[i];
+		if (!(pCommand->frontends & frontend))
+			continue;
+
+		if (lines++ > 0)
+			Str_Builder_Append_Char( pBuilder, '\n' );
+
+		Str_Builder_Append( pBuilder, pCommand->name );
+		for (j = 0; j < pCommand->nbr_args; j++)
+			Str_Builder_Printf( pBuilder, (j < pCommand->nbr_required) ? " <%s>" : " [%s]", pCommand->args[j].name );
+		Str_Builder_Append( pBuilder, " - " );
+		Str_Builder_Append( pBuilder, pCommand->description );
+	}
+}
+
+/* *** End of File *** */
@@ -0,0 +1,105 @@
+#ifndef __CMD_REGISTRY_H
+#define __CMD_REGISTRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "str_builder.h"
+
+#define CMD_REGISTRY_MAX_ARGS			4
+#define CMD_REGISTRY_MAX_ALIASES		4
+#define CMD_REGISTRY_MAX_NAME			24			// Longest name or alias, including the terminator
+#define CMD_REGISTRY_MAX_COMMANDS		64
+#define CMD_REGISTRY_MAX_KEYS			160			// Names plus aliases
+
+// Front-ends a command can be used from
+typedef enum
+{
+	CMD_FRONTEND_CONSOLE = 0x01,
+	CMD_FRONTEND_FIFO = 0x02,
+	CMD_FRONTEND_ETHERNET = 0x04,
+	CMD_FRONTEND_WEBSOCKET = 0x08,
+	CMD_FRONTEND_LOCAL = 0x10,			// Unix domain socket
+
+	CMD_FRONTEND_ALL = 0x1F,
+} cmd_frontend_type;
+
+// What a command changes, for front-ends where only some clients may change settings
+typedef enum
+{
+	CMD_ACCESS_READ = 0,				// Reads, or only changes the connection it arrives on
+	CMD_ACCESS_WRITE,					// Changes settings of the smoker
+	CMD_ACCESS_WRITE_WITH_ARGS,			// Reads without its optional arguments, changes settings with them
+} cmd_access_type;
+
+typedef enum
+{
+	CMD_ARG_INT = 0,					// Decimal integer within [min, max]
+	CMD_ARG_FLOAT,						// Floating point value within [min, max]
+	CMD_ARG_STRING,						// Text of at most max characters (0 for any length)
+} cmd_arg_kind_type;
+
+typedef struct
+{
+	cmd_arg_kind_type kind;
+	const char* name;					// Shown by HELP
+	double min;
+	double max;
+} cmd_arg_spec_type;
+
+// A validated argument.  Integers are available as f as well.
+typedef struct
+{
+	long i;
+	double f;
+	char* s;
+} cmd_arg_value_type;
+
+typedef struct
+{
+	int count;
+	cmd_arg_value_type values[CMD_REGISTRY_MAX_ARGS];
+} cmd_args_type;
+
+// Where a command came from
+typedef struct
+{
+	cmd_frontend_type frontend;
+	void* pConnection;					// Front-end specific, e.g. the Ethernet connection
+} cmd_context_type;
+
+/***************************************************************************************************
+Command handler.  The response starts with the name of the command and its fields are separated by
+commas, e.g. SETTEMP,225.000000.  Lines of multi-line responses are separated by '\n', the
+front-end terminates the last one.  A handler that returns -1 must not have written anything, the
+registry then responds <NAME>,ERROR.
+***************************************************************************************************/
+typedef int (*cmd_handler_function)( const cmd_context_type* pContext, const cmd_args_type* pArgs,
+									 str_builder_type* pBuilder );
+
+typedef struct
+{
+	const char* name;									// Canonical name, upper case
+	const char* aliases[CMD_REGISTRY_MAX_ALIASES];		// Other names, NULL terminated if fewer
+	const char* description;
+	unsigned frontends;									// cmd_frontend_type bits
+	int nbr_required;									// Arguments that must be given
+	int nbr_args;										// Arguments that may be given
+	cmd_arg_spec_type args[CMD_REGISTRY_MAX_ARGS];
+	cmd_handler_function handler;
+	cmd_access_type access;
+} cmd_definition_type;
+
+	// Results of Cmd_Registry_Execute()
+#define CMD_RESULT_OK				1
+#define CMD_RESULT_UNKNOWN			0			// Nothing was written
+#define CMD_RESULT_ERROR			-1			// <NAME>,ERROR was written
+#define CMD_RESULT_DENIED			-2			// <NAME>,DENIED was written, the command was not run
+
+int Cmd_Registry_Add( const cmd_definition_type* p_commands, int count );
+const cmd_definition_type* Cmd_Registry_Find( const char* p_name, cmd_frontend_type frontend );
+int Cmd_Registry_Execute( cmd_frontend_type frontend, void* pConnection, char* p_line, str_builder_type* pBuilder );
+int Cmd_Registry_Execute_Checked( cmd_frontend_type frontend, void* pConnection, bool may_write, char* p_line,
+								  str_builder_type* pBuilder );
+void Cmd_Registry_Help( cmd_frontend_type frontend, str_builder_type* pBuilder );
+
+#endif //__CMD_REGISTRY_H
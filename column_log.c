@@ -0,0 +1,432 @@
+/***************************************************************************************************
+Column Log
+
+Block-columnar history file.  Control ticks are decimated to COLUMN_LOG_SAMPLE_PERIOD_MS and each
+channel is appended to its own fixed size block.  A small per-block index (channel, time span and
+value range) lives at the front of the file so that time range and single channel queries only touch
+the blocks they need.  The file is memory mapped and preallocated in chunks with fallocate() so that
+appends never have to extend the file one page at a time on the uSD card.
+
+The row oriented CSV produced by the logging thread is still written, and the contents of the column
+log can be exported to CSV with Column_Log_Export_Csv().
+***************************************************************************************************/
+
+#define _GNU_SOURCE				// For fallocate()
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "main.h"
+#include "app.h"
+#include "column_log.h"
+#include "metrics.h"
+
+/* *** Defined Values *** */
+#define COLUMN_LOG_INDEX_OFFSET			COLUMN_LOG_PAGE_SIZE
+#define COLUMN_LOG_INDEX_SIZE			(COLUMN_LOG_MAX_BLOCKS * sizeof(column_log_index_type))
+#define COLUMN_LOG_DATA_OFFSET			(COLUMN_LOG_INDEX_OFFSET + COLUMN_LOG_INDEX_SIZE)
+#define COLUMN_LOG_MAX_FILE_SIZE		(COLUMN_LOG_DATA_OFFSET + ((size_t)COLUMN_LOG_MAX_BLOCKS * COLUMN_LOG_BLOCK_SIZE))
+#define COLUMN_LOG_GROW_BLOCKS			256			// Blocks preallocated at a time (1 MB)
+#define COLUMN_LOG_SYNC_PERIOD_MS		30000
+
+/* *** Global Variables *** */
+static pthread_mutex_t g_column_log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int g_column_log_fd = -1;
+static uint8_t* g_map;
+static column_log_header_type* g_header;
+static column_log_index_type* g_index;
+static uint32_t g_allocated_blocks;					// Data blocks backed by the file
+static int g_active_block[NBR_TELEMETRY_CHANNELS];	// Block currently being filled, -1 if none
+static int64_t g_last_sample_ms;
+static int64_t g_last_sync_ms;
+
+/* *** Function Declarations *** */
+static int Column_Log_Allocate_Blocks( uint32_t nbr_blocks );
+static void Column_Log_Append_Sample( int channel, int64_t timestamp_ms, float value );
+
+static inline int32_t* Column_Log_Block_Times( int block )
+{
+	return (int32_t*)&g_map[COLUMN_LOG_DATA_OFFSET + ((size_t)block * COLUMN_LOG_BLOCK_SIZE)];
+}
+
+static inline float* Column_Log_Block_Values( int block )
+{
+	return (float*)&g_map[COLUMN_LOG_DATA_OFFSET + ((size_t)block * COLUMN_LOG_BLOCK_SIZE) +
+						  (COLUMN_LOG_SAMPLES_PER_BLOCK * sizeof(int32_t))];
+}
+
+/***************************************************************************************************
+Opens (or creates) the day's column log and maps it into memory.  When an existing file is opened,
+the last block of each channel is reused if it still has room.
+
+Returns -1 on error
+		 1 on success
+***************************************************************************************************/
+int Column_Log_Init( void )
+{
+	char filename[50];
+	time_t t = time(NULL);
+	struct tm tm;
+	struct stat file_stat;
+	uint32_t i;
+
+	for (i = 0; i < NBR_TELEMETRY_CHANNELS; i++)
+		g_active_block[i] = -1;
+
+	tm = *localtime(&t);
+	sprintf(filename, "logs/History-%d-%d-%d.col", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+	g_column_log_fd = open(filename, O_RDWR | O_CREAT, 0644);
+
+	if ((g_column_log_fd < 0) || (fstat(g_column_log_fd, &file_stat) < 0))
+	{
+		printf("Error, can't open column log: %s\n", filename);
+		return -1;
+	}
+
+	// Reserve address space for the largest possible file.  Only the preallocated part is touched.
+	g_map = mmap(NULL, COLUMN_LOG_MAX_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, g_column_log_fd, 0);
+	if (g_map == MAP_FAILED)
+	{
+		printf("Error mapping column log: %s\n", filename);
+		close(g_column_log_fd);
+		g_column_log_fd = -1;
+		return -1;
+	}
+
+	g_header = (column_log_header_type*)g_map;
+	g_index = (column_log_index_type*)&g_map[COLUMN_LOG_INDEX_OFFSET];
+
+	if (file_stat.st_size < COLUMN_LOG_DATA_OFFSET)
+	{
+		g_allocated_blocks = 0;
+		if (Column_Log_Allocate_Blocks( COLUMN_LOG_GROW_BLOCKS ) < 0)
+			return -1;
+
+		g_header->magic = COLUMN_LOG_MAGIC;
+		g_header->version = COLUMN_LOG_VERSION;
+		g_header->block_size = COLUMN_LOG_BLOCK_SIZE;
+		g_header->max_blocks = COLUMN_LOG_MAX_BLOCKS;
+		g_header->nbr_blocks = 0;
+		g_header->nbr_channels = NBR_TELEMETRY_CHANNELS;
+		g_header->created_ms = Telemetry_Get_Time_Ns( CLOCK_REALTIME ) / 1000000;
+	}
+	else if ((g_header->magic != COLUMN_LOG_MAGIC) || (g_header->version != COLUMN_LOG_VERSION) ||
+			 (g_header->nbr_channels != NBR_TELEMETRY_CHANNELS))
+	{
+		printf("Error, incompatible column log: %s\n", filename);
+		munmap(g_map, COLUMN_LOG_MAX_FILE_SIZE);
+		close(g_column_log_fd);
+		g_column_log_fd = -1;
+		return -1;
+	}
+	else
+	{
+		g_allocated_blocks = (file_stat.st_size - COLUMN_LOG_DATA_OFFSET) / COLUMN_LOG_BLOCK_SIZE;
+		for (i = 0; i < g_header->nbr_blocks; i++)
+		{
+			if (g_index[i].channel < NBR_TELEMETRY_CHANNELS)
+				g_active_block[g_index[i].channel] = i;
+		}
+	}
+
+	printf("Column log: %s\n", filename);
+	return 1;
+}
+
+/***************************************************************************************************
+Preallocates more data blocks at the end of the file.  Space is reserved with fallocate() so the
+file system can hand out contiguous extents, falling back to posix_fallocate() if necessary.
+***************************************************************************************************/
+static int Column_Log_Allocate_Blocks( uint32_t nbr_blocks )
+{
+	off_t offset = COLUMN_LOG_DATA_OFFSET + ((off_t)g_allocated_blocks * COLUMN_LOG_BLOCK_SIZE);
+	off_t length = (off_t)nbr_blocks * COLUMN_LOG_BLOCK_SIZE;
+
+	if (g_allocated_blocks == 0)
+	{
+		offset = 0;
+		length += COLUMN_LOG_DATA_OFFSET;
+	}
+
+	if ((fallocate(g_column_log_fd, 0, offset, length) < 0) &&
+		(posix_fallocate(g_column_log_fd, offset, length) != 0))
+	{
+		printf("Error preallocating column log - %s.%u\n", __FILE__, __LINE__);
+		return -1;
+	}
+
+	g_allocated_blocks += nbr_blocks;
+	return 1;
+}
+
+/***************************************************************************************************
+Called by the telemetry thread for every control tick.  Ticks are decimated to one sample per
+COLUMN_LOG_SAMPLE_PERIOD_MS and every history channel is appended.
+***************************************************************************************************/
+void Column_Log_Append_Record( const telemetry_record_type* pRecord )
+{
+	int64_t timestamp_ms = pRecord->timestamp_ns / 1000000;
+	int channel;
+
+	if (g_column_log_fd < 0)
+		return;
+
+	if ((timestamp_ms >= g_last_sample_ms) && ((timestamp_ms - g_last_sample_ms) < COLUMN_LOG_SAMPLE_PERIOD_MS))
+		return;
+
+	g_last_sample_ms = timestamp_ms;
+
+	pthread_mutex_lock(&g_column_log_mutex);
+	for (channel = 0; channel < NBR_TELEMETRY_CHANNELS; channel++)
+		Column_Log_Append_Sample( channel, timestamp_ms, Telemetry_Get_Channel_Value( pRecord, channel ) );
+	pthread_mutex_unlock(&g_column_log_mutex);
+
+	if ((timestamp_ms - g_last_sync_ms) >= COLUMN_LOG_SYNC_PERIOD_MS)
+	{
+		g_last_sync_ms = timestamp_ms;
+		Column_Log_Sync();
+	}
+}
+
+/***************************************************************************************************
+Appends a sample to the active block of the channel, starting a new block when the active block is
+full.  The caller must hold g_column_log_mutex.
+***************************************************************************************************/
+static void Column_Log_Append_Sample( int channel, int64_t timestamp_ms, float value )
+{
+	int block = g_active_block[channel];
+	column_log_index_type* pEntry;
+
+	// Start a new block when the active one is full, or when the time offset would not fit or would
+	// go backwards (the clock was changed) so that the index time span of each block stays valid
+	if ((block < 0) || (g_index[block].count >= COLUMN_LOG_SAMPLES_PER_BLOCK) ||
+		(timestamp_ms < g_index[block].last_ms) || ((timestamp_ms - g_index[block].first_ms) > INT32_MAX))
+	{
+		if (g_header->nbr_blocks >= COLUMN_LOG_MAX_BLOCKS)
+			return;		// The file is full, drop the sample
+
+		if ((g_header->nbr_blocks >= g_allocated_blocks) &&
+			(Column_Log_Allocate_Blocks( COLUMN_LOG_GROW_BLOCKS ) < 0))
+			return;
+
+		block = g_header->nbr_blocks;
+		pEntry = &g_index[block];
+		pEntry->channel = channel;
+		pEntry->count = 0;
+		pEntry->first_ms = timestamp_ms;
+		pEntry->min_value = value;
+		pEntry->max_value = value;
+		g_header->nbr_blocks++;
+		g_active_block[channel] = block;
+	}
+
+	pEntry = &g_index[block];
+	Column_Log_Block_Times( block )[pEntry->count] = (int32_t)(timestamp_ms - pEntry->first_ms);
+	Column_Log_Block_Values( block )[pEntry->count] = value;
+
+	if (value < pEntry->min_value)
+		pEntry->min_value = value;
+	if (value > pEntry->max_value)
+		pEntry->max_value = value;
+	pEntry->last_ms = timestamp_ms;
+	pEntry->count++;
+}
+
+/***************************************************************************************************
+Schedules the dirty pages of the mapping to be written to the uSD card
+***************************************************************************************************/
+void Column_Log_Sync( void )
+{
+	size_t length;
+	int64_t start_ns;
+
+	if (g_column_log_fd < 0)
+		return;
+
+	pthread_mutex_lock(&g_column_log_mutex);
+	length = COLUMN_LOG_DATA_OFFSET + ((size_t)g_header->nbr_blocks * COLUMN_LOG_BLOCK_SIZE);
+	pthread_mutex_unlock(&g_column_log_mutex);
+
+	start_ns = Metrics_Now_Ns();
+	msync(g_map, length, MS_ASYNC);
+	Metrics_Observe_Since( METRIC_COLUMN_LOG_SYNC, start_ns );
+}
+
+/***************************************************************************************************
+Calls the callback for every sample of the channel between from_ms and to_ms (inclusive).  Only the
+index and the data blocks whose time span overlaps the request are read.
+
+Returns the number of samples found or -1 if the column log is not open
+***************************************************************************************************/
+int Column_Log_Query( int channel, int64_t from_ms, int64_t to_ms,
+					  column_log_sample_function callback, void* pContext )
+{
+	uint32_t block;
+	uint32_t i;
+	int64_t timestamp_ms;
+	int32_t* p_times;
+	float* p_values;
+	int found = 0;
+
+	if ((g_column_log_fd < 0) || (channel < 0) || (channel >= NBR_TELEMETRY_CHANNELS))
+		return -1;
+
+	pthread_mutex_lock(&g_column_log_mutex);
+	for (block = 0; block < g_header->nbr_blocks; block++)
+	{
+		column_log_index_type* pEntry = &g_index[block];
+
+		if ((pEntry->channel != channel) || (pEntry->count == 0) ||
+			(pEntry->last_ms < from_ms) || (pEntry->first_ms > to_ms))
+			continue;
+
+		p_times = Column_Log_Block_Times( block );
+		p_values = Column_Log_Block_Values( block );
+		for (i = 0; i < pEntry->count; i++)
+		{
+			timestamp_ms = pEntry->first_ms + p_times[i];
+			if ((timestamp_ms >= from_ms) && (timestamp_ms <= to_ms))
+			{
+				callback( pContext, channel, timestamp_ms, p_values[i] );
+				found++;
+			}
+		}
+	}
+	pthread_mutex_unlock(&g_column_log_mutex);
+
+	return found;
+}
+
+/* *** CSV export *** */
+typedef struct
+{
+	int64_t* p_times;
+	float* p_values;
+	int count;
+	int size;
+	bool failed;								// The arrays could not grow, samples were lost
+} column_log_series_type;
+
+static void Column_Log_Collect_Sample( void* pContext, int channel, int64_t timestamp_ms, float value )
+{
+	column_log_series_type* pSeries = (column_log_series_type*)pContext;
+	int64_t* p_times;
+	float* p_values;
+	int size;
+
+	if (pSeries->failed)
+		return;
+
+	if (pSeries->count >= pSeries->size)
+	{
+		size = (pSeries->size == 0) ? 1024 : (pSeries->size * 2);
+		p_times = realloc(pSeries->p_times, size * sizeof(int64_t));
+		if (p_times != NULL)
+			pSeries->p_times = p_times;
+		p_values = realloc(pSeries->p_values, size * sizeof(float));
+		if (p_values != NULL)
+			pSeries->p_values = p_values;
+
+		if ((p_times == NULL) || (p_values == NULL))
+		{
+			pSeries->failed = true;
+			return;
+		}
+		pSeries->size = size;
+	}
+
+	pSeries->p_times[pSeries->count] = timestamp_ms;
+	pSeries->p_values[pSeries->count] = value;
+	pSeries->count++;
+}
+
+static void Column_Log_Free_Series( column_log_series_type* pSeries )
+{
+	int channel;
+
+	for (channel = 0; channel < NBR_TELEMETRY_CHANNELS; channel++)
+	{
+		free(pSeries[channel].p_times);
+		free(pSeries[channel].p_values);
+	}
+}
+
+/***************************************************************************************************
+Writes the samples between from_ms and to_ms to a CSV file, one row per sample time and one column
+per channel.  Every channel is sampled at the same instant, so rows are keyed on the times of the
+first channel.
+
+Returns the number of rows written or -1 on error, also when there is not enough memory to collect
+the samples
+***************************************************************************************************/
+int Column_Log_Export_Csv( const char* pFilename, int64_t from_ms, int64_t to_ms )
+{
+	column_log_series_type series[NBR_TELEMETRY_CHANNELS];
+	int position[NBR_TELEMETRY_CHANNELS] = { 0 };
+	FILE* pFile = NULL;
+	bool failed = false;
+	time_t t;
+	struct tm tm;
+	int channel;
+	int row;
+
+	memset(series, 0, sizeof(series));
+	for (channel = 0; channel < NBR_TELEMETRY_CHANNELS; channel++)
+	{
+		Column_Log_Query( channel, from_ms, to_ms, Column_Log_Collect_Sample, &series[channel] );
+		failed = failed || series[channel].failed;
+	}
+
+	if (!failed)
+		pFile = fopen(pFilename, "w");
+	if (pFile == NULL)
+	{
+		Column_Log_Free_Series( series );
+		return -1;
+	}
+
+	fprintf(pFile, "Time");
+	for (channel = 0; channel < NBR_OF_THERMISTORS; channel++)
+		fprintf(pFile, ",%s", App_Get_Channel_Name( channel ));
+	fprintf(pFile, ",Fire,Setpoint,Servo\n");
+
+	for (row = 0; row < series[0].count; row++)
+	{
+		int64_t row_ms = series[0].p_times[row];
+
+		t = row_ms / 1000;
+		tm = *localtime(&t);
+		fprintf(pFile, "%d-%d-%d %2d:%02d:%02d", tm.tm_year + 1900, tm.tm_mon + 1,
+				tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+
+		for (channel = 0; channel < NBR_TELEMETRY_CHANNELS; channel++)
+		{
+			column_log_series_type* pSeries = &series[channel];
+
+			while ((position[channel] < pSeries->count) && (pSeries->p_times[position[channel]] < row_ms))
+				position[channel]++;
+
+			if ((position[channel] < pSeries->count) && (pSeries->p_times[position[channel]] == row_ms))
+				fprintf(pFile, ",%4.2f", pSeries->p_values[position[channel]]);
+			else
+				fprintf(pFile, ",");
+		}
+		fwrite("\n", 1, 1, pFile);
+	}
+
+	fclose(pFile);
+	Column_Log_Free_Series( series );
+
+	return row;
+}
+
+/* *** End of File *** */
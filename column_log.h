@@ -0,0 +1,62 @@
+#ifndef __COLUMN_LOG_H
+#define __COLUMN_LOG_H
+
+#include <stdint.h>
+#include "telemetry.h"			// For telemetry_record_type and NBR_TELEMETRY_CHANNELS
+
+#define COLUMN_LOG_MAGIC				0x4C4F4350		// "PCOL" in little endian byte order
+#define COLUMN_LOG_VERSION				1
+#define COLUMN_LOG_PAGE_SIZE			4096
+#define COLUMN_LOG_BLOCK_SIZE			4096
+#define COLUMN_LOG_SAMPLES_PER_BLOCK	(COLUMN_LOG_BLOCK_SIZE / (sizeof(int32_t) + sizeof(float)))
+#define COLUMN_LOG_MAX_BLOCKS			8192		// ~32 MB of samples, enough for a day at 1 Hz
+#define COLUMN_LOG_SAMPLE_PERIOD_MS		1000		// Control ticks are decimated to this period
+
+/***************************************************************************************************
+On-disk layout of a column log file
+
+	Page 0				column_log_header_type
+	Index pages			COLUMN_LOG_MAX_BLOCKS x column_log_index_type
+	Data blocks			COLUMN_LOG_MAX_BLOCKS x COLUMN_LOG_BLOCK_SIZE
+
+Each data block holds samples for a single channel.  The first half of the block is the column of
+time offsets (ms relative to the block's first_ms), the second half is the column of values.  The
+index entry for a block records its channel, sample count, time span and value range so that
+queries only have to touch the blocks that can contain matching samples.
+***************************************************************************************************/
+typedef struct
+{
+	uint32_t magic;								// COLUMN_LOG_MAGIC
+	uint32_t version;							// COLUMN_LOG_VERSION
+	uint32_t block_size;						// COLUMN_LOG_BLOCK_SIZE
+	uint32_t max_blocks;						// COLUMN_LOG_MAX_BLOCKS
+	uint32_t nbr_blocks;						// Number of blocks in use
+	uint32_t nbr_channels;						// NBR_TELEMETRY_CHANNELS
+	int64_t created_ms;							// Wall clock time the file was created
+} column_log_header_type;
+
+typedef struct
+{
+	uint16_t channel;							// telemetry_channel_type
+	uint16_t count;								// Number of samples in the block
+	uint32_t reserved;
+	int64_t first_ms;							// Time of the first sample (ms since the epoch)
+	int64_t last_ms;							// Time of the last sample (ms since the epoch)
+	float min_value;
+	float max_value;
+} column_log_index_type;
+
+_Static_assert(sizeof(column_log_index_type) == 32, "column log index entry size");
+
+// Prototype of the function called for each sample returned by a query
+typedef void (*column_log_sample_function)( void* pContext, int channel, int64_t timestamp_ms, float value );
+
+int Column_Log_Init( void );
+void Column_Log_Append_Record( const telemetry_record_type* pRecord );
+void Column_Log_Sync( void );
+
+int Column_Log_Query( int channel, int64_t from_ms, int64_t to_ms,
+					  column_log_sample_function callback, void* pContext );
+int Column_Log_Export_Csv( const char* pFilename, int64_t from_ms, int64_t to_ms );
+
+#endif //__COLUMN_LOG_H
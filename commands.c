@@ -0,0 +1,418 @@
+/***************************************************************************************************
+Commands
+
+The commands that are available from every front-end (console, named pipes and Ethernet).  Commands
+that need the state of a front-end, e.g. the subscription of an Ethernet connection, are added to
+the registry by that front-end.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "main.h"
+#include "app.h"
+#include "monitor.h"
+#include "telemetry.h"
+#include "column_log.h"
+#include "history.h"
+#include "event_log.h"
+#include "rev_history.h"
+#include "cmd_registry.h"
+#include "commands.h"
+
+/* *** Defined Values *** */
+#define COMMANDS_MAX_GAIN				1.0e9
+#define COMMANDS_MAX_EXPORT_MINUTES		(7 * 24 * 60)
+
+/* *** Global Variables *** */
+static shared_data_type* p_shared_data;
+
+/* *** Function Prototypes *** */
+static int Commands_Help(          const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Version(       const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Temps(         const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Status(        const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Set_Temp(      const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Setpoint(      const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Kp(            const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Ki(            const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Kl(            const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Probe(         const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Set_Name(      const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Names(         const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Light(         const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Text(          const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Telemetry(     const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Export(        const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_History_Stats( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Log_Level(     const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Commands_Log_Rate(      const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+
+static const cmd_definition_type g_commands[] =
+{
+	{ "HELP",		{ NULL },								"Lists the commands",
+		CMD_FRONTEND_ALL, 0, 0, { { 0 } },																Commands_Help },
+	{ "VERSION",	{ "VER", "GET_VERSION" },				"Returns version information",
+		CMD_FRONTEND_ALL, 0, 0, { { 0 } },																Commands_Version },
+	{ "TEMPS",		{ "GET_ALL_TEMPS" },					"Returns the setpoint, probe and fire temperatures",
+		CMD_FRONTEND_ALL, 0, 0, { { 0 } },																Commands_Temps },
+	{ "STATUS",		{ NULL },								"Returns most information about the SMPi",
+		CMD_FRONTEND_ALL, 0, 0, { { 0 } },																Commands_Status },
+	{ "SETTEMP",	{ "SET_CABINET_TARGET" },				"Sets the target cabinet temperature",
+		CMD_FRONTEND_ALL, 1, 1, { { CMD_ARG_FLOAT, "deg F", APP_MIN_SETPOINT, APP_MAX_SETPOINT } },		Commands_Set_Temp, CMD_ACCESS_WRITE },
+	{ "SETPOINT",	{ "GET_CABINET_TARGET" },				"Returns the target cabinet temperature",
+		CMD_FRONTEND_ALL, 0, 0, { { 0 } },																Commands_Setpoint },
+	{ "KP",			{ "SETKP", "SET_KP", "GET_KP" },		"Sets (if given) and returns the proportional gain",
+		CMD_FRONTEND_ALL, 0, 1, { { CMD_ARG_FLOAT, "gain", 0.0, COMMANDS_MAX_GAIN } },					Commands_Kp, CMD_ACCESS_WRITE_WITH_ARGS },
+	{ "KI",			{ "SETKI", "SET_KI", "GET_KI" },		"Sets (if given) and returns the integral gain",
+		CMD_FRONTEND_ALL, 0, 1, { { CMD_ARG_FLOAT, "gain", 0.0, COMMANDS_MAX_GAIN } },					Commands_Ki, CMD_ACCESS_WRITE_WITH_ARGS },
+	{ "KL",			{ "SETKL", "SET_KL", "GET_KL" },		"Sets (if given) and returns the integral windup limit",
+		CMD_FRONTEND_ALL, 0, 1, { { CMD_ARG_FLOAT, "limit", 0.0, COMMANDS_MAX_GAIN } },					Commands_Kl, CMD_ACCESS_WRITE_WITH_ARGS },
+	{ "PROBE",		{ "GET_PROBE_TEMP" },					"Returns the temperature of one probe",
+		CMD_FRONTEND_ALL, 1, 1, { { CMD_ARG_INT, "channel", 0, NBR_OF_THERMISTORS - 1 } },				Commands_Probe },
+	{ "NAME",		{ "SET_CHANNEL_NAME" },					"Sets the name of a probe channel",
+		CMD_FRONTEND_ALL, 2, 2, { { CMD_ARG_INT, "channel", 0, NBR_OF_THERMISTORS - 1 },
+								  { CMD_ARG_STRING, "name", 0, MAX_NAME_LENGTH - 1 } },					Commands_Set_Name, CMD_ACCESS_WRITE },
+	{ "NAMES",		{ "GET_CHANNEL_NAMES" },				"Returns the names of all probe channels",
+		CMD_FRONTEND_ALL, 0, 0, { { 0 } },																Commands_Names },
+	{ "LIGHT",		{ NULL },								"Sets the servo to max position so the fire can be lit",
+		CMD_FRONTEND_ALL, 0, 0, { { 0 } },																Commands_Light, CMD_ACCESS_WRITE },
+	{ "TEXT",		{ NULL },								"Sends a test text message",
+		CMD_FRONTEND_ALL, 0, 0, { { 0 } },																Commands_Text, CMD_ACCESS_WRITE },
+	{ "TELEM",		{ NULL },								"Enables (1) or disables (0) high rate telemetry logging, fsync 0 never, 1 every write, 2 periodic",
+		CMD_FRONTEND_ALL, 0, 2, { { CMD_ARG_INT, "0|1", 0, 1 },
+								  { CMD_ARG_INT, "fsync", TELEMETRY_FSYNC_NEVER, TELEMETRY_FSYNC_PERIODIC } },	Commands_Telemetry, CMD_ACCESS_WRITE_WITH_ARGS },
+	{ "EXPORT",		{ NULL },								"Exports the last N minutes of history to CSV (0 for all)",
+		CMD_FRONTEND_ALL, 1, 1, { { CMD_ARG_INT, "minutes", 0, COMMANDS_MAX_EXPORT_MINUTES } },		Commands_Export, CMD_ACCESS_WRITE },
+	{ "HISTSTATS",	{ NULL },								"Shows the size of the in-memory cook history",
+		CMD_FRONTEND_ALL, 0, 0, { { 0 } },																Commands_History_Stats },
+	{ "LOGLEVEL",	{ NULL },								"Sets the syslog verbosity (3 errors ... 7 debug with packet dumps)",
+		CMD_FRONTEND_ALL, 0, 1, { { CMD_ARG_INT, "level", LOG_EMERG, LOG_DEBUG } },					Commands_Log_Level, CMD_ACCESS_WRITE_WITH_ARGS },
+	{ "LOGRATE",	{ NULL },								"Limits an event to a number per second, logging 1 in N",
+		CMD_FRONTEND_ALL, 2, 3, { { CMD_ARG_STRING, "event", 0, 0 }, { CMD_ARG_INT, "per s", 0, 1000000 },
+								  { CMD_ARG_INT, "N", 1, 1000000 } },									Commands_Log_Rate, CMD_ACCESS_WRITE },
+};
+#define COMMANDS_SIZE		(sizeof(g_commands) / sizeof(g_commands[0]))
+
+/***************************************************************************************************
+Adds the common commands to the registry
+
+Returns -1 on error
+		 1 on success
+***************************************************************************************************/
+int Commands_Init( void* shared_data_address )
+{
+	p_shared_data = (shared_data_type*)shared_data_address;
+
+	return Cmd_Registry_Add( g_commands, COMMANDS_SIZE );
+}
+
+/***************************************************************************************************
+Response format:  HELP\n<command> <args> - <description>\n...
+***************************************************************************************************/
+static int Commands_Help( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	Str_Builder_Append( pBuilder, "HELP\n" );
+	Cmd_Registry_Help( pContext->frontend, pBuilder );
+	return 1;
+}
+
+/***************************************************************************************************
+Response format:  VERSION,Smokin'Pi v<major>.<minor>.<revision>
+***************************************************************************************************/
+static int Commands_Version( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	Str_Builder_Printf( pBuilder, "VERSION,Smokin'Pi v%u.%03u.%03u", FIRMWARE_MAJOR, FIRMWARE_MINOR, FIRMWARE_REVISION );
+	return 1;
+}
+
+/***************************************************************************************************
+Response format:  TEMPS,<setpoint>,<ch 0 temp>,...,<ch 9 temp>,<fire temp>
+***************************************************************************************************/
+static int Commands_Temps( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	float temp_deg_f[NBR_OF_THERMISTORS];
+	float fire_temp;
+	float cabinet_setpoint;
+	int i;
+
+	pthread_mutex_lock(&mutex);
+	memcpy(temp_deg_f, p_shared_data->temp_deg_f, sizeof(temp_deg_f));
+	fire_temp = p_shared_data->temp_deg_f_fire;
+	cabinet_setpoint = p_shared_data->temp_deg_f_cabinet_setpoint;
+	pthread_mutex_unlock(&mutex);
+
+	Str_Builder_Append( pBuilder, "TEMPS," );
+	Str_Builder_Append_Fixed( pBuilder, cabinet_setpoint, 6 );
+
+	for (i = 0; i < NBR_OF_THERMISTORS; i++)
+	{
+		Str_Builder_Append_Char( pBuilder, ',' );
+		Str_Builder_Append_Fixed( pBuilder, temp_deg_f[i], 6 );
+	}
+
+	Str_Builder_Append_Char( pBuilder, ',' );
+	Str_Builder_Append_Fixed( pBuilder, fire_temp, 6 );
+	return 1;
+}
+
+/***************************************************************************************************
+Response format:  STATUS,<setpoint>,<ch 0 temp>,...,<ch 9 temp>,<fire temp>,<ch 0 adc>,...,
+				  <fire detected state>
+***************************************************************************************************/
+static int Commands_Status( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	shared_data_type local_shared_data;
+	int i;
+
+	pthread_mutex_lock(&mutex);
+	memcpy(&local_shared_data, p_shared_data, sizeof(local_shared_data));
+	pthread_mutex_unlock(&mutex);
+
+	Str_Builder_Append( pBuilder, "STATUS," );
+	Str_Builder_Append_Fixed( pBuilder, local_shared_data.temp_deg_f_cabinet_setpoint, 6 );
+
+	for (i = 0; i < NBR_OF_THERMISTORS; i++)
+	{
+		Str_Builder_Append_Char( pBuilder, ',' );
+		Str_Builder_Append_Fixed( pBuilder, local_shared_data.temp_deg_f[i], 6 );
+	}
+
+	Str_Builder_Append_Char( pBuilder, ',' );
+	Str_Builder_Append_Fixed( pBuilder, local_shared_data.temp_deg_f_fire, 6 );
+
+	for (i = 0; i < NBR_ADC_CHANNELS; i++)
+	{
+		Str_Builder_Append_Char( pBuilder, ',' );
+		Str_Builder_Append_Uint( pBuilder, 0x3FF & local_shared_data.adc_results[i] );
+	}
+
+	Str_Builder_Append_Char( pBuilder, ',' );
+	Str_Builder_Append_Uint( pBuilder, local_shared_data.fire_detect_state );
+	return 1;
+}
+
+/***************************************************************************************************
+Response format:  SETTEMP,<new setpoint>  (the setpoint must lie strictly between the bounds)
+***************************************************************************************************/
+static int Commands_Set_Temp( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	if (App_Set_Cabinet_Setpoint( pArgs->values[0].f ) < 0)
+		return -1;
+
+	Str_Builder_Append( pBuilder, "SETTEMP," );
+	Str_Builder_Append_Fixed( pBuilder, App_Get_Cabinet_Setpoint(), 6 );
+	return 1;
+}
+
+/***************************************************************************************************
+Response format:  SETPOINT,<setpoint>
+***************************************************************************************************/
+static int Commands_Setpoint( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	Str_Builder_Append( pBuilder, "SETPOINT," );
+	Str_Builder_Append_Fixed( pBuilder, App_Get_Cabinet_Setpoint(), 6 );
+	return 1;
+}
+
+/***************************************************************************************************
+Response format:  KP,<gain>  KI,<gain>  KL,<limit>  (the value in use, gains of 0 are ignored)
+***************************************************************************************************/
+static int Commands_Kp( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	if (pArgs->count > 0)
+		App_Set_Kp( pArgs->values[0].f );
+
+	Str_Builder_Append( pBuilder, "KP," );
+	Str_Builder_Append_Fixed( pBuilder, App_Get_Kp(), 6 );
+	return 1;
+}
+
+static int Commands_Ki( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	if (pArgs->count > 0)
+		App_Set_Ki( pArgs->values[0].f );
+
+	Str_Builder_Append( pBuilder, "KI," );
+	Str_Builder_Append_Fixed( pBuilder, App_Get_Ki(), 6 );
+	return 1;
+}
+
+static int Commands_Kl( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	if (pArgs->count > 0)
+		App_Set_Kl( pArgs->values[0].f );
+
+	Str_Builder_Append( pBuilder, "KL," );
+	Str_Builder_Append_Fixed( pBuilder, App_Get_Kl(), 6 );
+	return 1;
+}
+
+/***************************************************************************************************
+Response format:  PROBE,<channel>,<temp>
+***************************************************************************************************/
+static int Commands_Probe( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	int channel = (int)pArgs->values[0].i;
+	float temperature;
+
+	pthread_mutex_lock(&mutex);
+	temperature = p_shared_data->temp_deg_f[channel];
+	pthread_mutex_unlock(&mutex);
+
+	Str_Builder_Printf( pBuilder, "PROBE,%d,", channel );
+	Str_Builder_Append_Fixed( pBuilder, temperature, 6 );
+	return 1;
+}
+
+/***************************************************************************************************
+Response format:  NAME,<channel>,<name>
+***************************************************************************************************/
+static int Commands_Set_Name( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	int channel = (int)pArgs->values[0].i;
+
+	App_Set_Channel_Name( channel, pArgs->values[1].s );
+
+	Str_Builder_Printf( pBuilder, "NAME,%d,", channel );
+	Str_Builder_Append( pBuilder, App_Get_Channel_Name( channel ) );
+	return 1;
+}
+
+/***************************************************************************************************
+Response format:  NAMES,<ch 0 name>,...,<ch 9 name>
+***************************************************************************************************/
+static int Commands_Names( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	int i;
+
+	Str_Builder_Append( pBuilder, "NAMES" );
+	for (i = 0; i < NBR_OF_THERMISTORS; i++)
+	{
+		Str_Builder_Append_Char( pBuilder, ',' );
+		Str_Builder_Append( pBuilder, App_Get_Channel_Name( i ) );
+	}
+	return 1;
+}
+
+/***************************************************************************************************
+Response format:  LIGHT
+***************************************************************************************************/
+static int Commands_Light( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	Monitor_Light_Fire();
+
+	Str_Builder_Append( pBuilder, "LIGHT" );
+	return 1;
+}
+
+/***************************************************************************************************
+Response format:  TEXT
+***************************************************************************************************/
+static int Commands_Text( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	Monitor_Send_Notification( "Test", "This is a test notification" );
+
+	Str_Builder_Append( pBuilder, "TEXT" );
+	return 1;
+}
+
+/***************************************************************************************************
+e.g. TELEM=1,2 enables telemetry logging with a periodic fdatasync()
+
+Response format:  TELEM,<0|1>,<fsync policy>,<dropped records>
+***************************************************************************************************/
+static int Commands_Telemetry( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	if (pArgs->count > 0)
+		Telemetry_Set_Enabled( pArgs->values[0].i != 0 );
+	if (pArgs->count > 1)
+		Telemetry_Set_Fsync_Policy( (telemetry_fsync_policy_type)pArgs->values[1].i );
+
+	Str_Builder_Printf( pBuilder, "TELEM,%d,%d,%u", Telemetry_Get_Enabled() ? 1 : 0, (int)Telemetry_Get_Fsync_Policy(),
+						Telemetry_Get_Dropped_Records() );
+	return 1;
+}
+
+/***************************************************************************************************
+Exports the last 'minutes' of the column log to logs/Export-<time>.csv.  When minutes is 0, the whole
+file is exported.
+
+Response format:  EXPORT,<rows>,<filename>
+***************************************************************************************************/
+static int Commands_Export( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	char filename[50];
+	time_t t = time(NULL);
+	struct tm tm;
+	int64_t to_ms = (int64_t)t * 1000;
+	int64_t from_ms = (pArgs->values[0].i > 0) ? (to_ms - ((int64_t)pArgs->values[0].i * 60000)) : 0;
+	int rows;
+
+	localtime_r(&t, &tm);
+	sprintf(filename, "logs/Export-%d-%d-%d-%02d%02d%02d.csv", tm.tm_year + 1900, tm.tm_mon + 1,
+			tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+
+	rows = Column_Log_Export_Csv( filename, from_ms, to_ms );
+	if (rows < 0)
+		return -1;
+
+	Str_Builder_Printf( pBuilder, "EXPORT,%d,%s", rows, filename );
+	return 1;
+}
+
+/***************************************************************************************************
+Response format:  HISTSTATS,<cook>,<samples>,<compressed bytes>,<released samples>\n  (one line per cook)
+				  HISTSTATS,MEMORY,<bytes in use>,<max bytes>
+***************************************************************************************************/
+static int Commands_History_Stats( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	history_stats_type stats;
+	int cook;
+
+	for (cook = 0; cook < NBR_HISTORY_COOKS; cook++)
+	{
+		History_Get_Stats( cook, &stats );
+		if (cook > 0)
+			Str_Builder_Append_Char( pBuilder, '\n' );
+		Str_Builder_Printf( pBuilder, "HISTSTATS,%s,%llu,%llu,%llu", (cook == HISTORY_COOK_CURRENT) ? "CURRENT" : "PREVIOUS",
+							(unsigned long long)stats.nbr_samples, (unsigned long long)stats.compressed_bytes,
+							(unsigned long long)stats.nbr_released );
+	}
+	Str_Builder_Printf( pBuilder, "\nHISTSTATS,MEMORY,%llu,%llu", (unsigned long long)stats.memory_bytes,
+						(unsigned long long)stats.max_memory_bytes );
+	return 1;
+}
+
+/***************************************************************************************************
+Response format:  LOGLEVEL,<level>
+***************************************************************************************************/
+static int Commands_Log_Level( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	if (pArgs->count > 0)
+		Event_Log_Set_Verbosity( (int)pArgs->values[0].i );
+
+	Str_Builder_Printf( pBuilder, "LOGLEVEL,%d", Event_Log_Get_Verbosity() );
+	return 1;
+}
+
+/***************************************************************************************************
+e.g. LOGRATE=RX,5,10 logs at most 5 per second of every 10th received packet
+
+Response format:  LOGRATE,<event>,<max per second>,<N>
+***************************************************************************************************/
+static int Commands_Log_Rate( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	int sample_every = (pArgs->count > 2) ? (int)pArgs->values[2].i : 1;
+
+	if (Event_Log_Set_Rate_Limit( Event_Log_Find( pArgs->values[0].s ), (int)pArgs->values[1].i, sample_every ) < 0)
+		return -1;
+
+	Str_Builder_Printf( pBuilder, "LOGRATE,%s,%ld,%d", pArgs->values[0].s, pArgs->values[1].i, sample_every );
+	return 1;
+}
+
+/* *** End of File *** */
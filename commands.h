@@ -0,0 +1,6 @@
+#ifndef __COMMANDS_H
+#define __COMMANDS_H
+
+int Commands_Init( void* shared_data_address );
+
+#endif //__COMMANDS_H
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE				// For struct ucred and SCM_CREDENTIALS
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,96 +7,275 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/fcntl.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
+#include <stddef.h>
+#include <grp.h>
 #include <stdbool.h>
-#include <syslog.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
 #include "main.h"
 #include "app.h"
 #include "eth_comms.h"
 #include "rev_history.h"
-
-/* **** Data Types **** */
-	//! Prototype of function that is called after a sucessful determination of a command
-typedef char* (*eth_function)(char*);
-
-	//! Structure to associate a command to a description and function
-typedef struct eth_cmd_type
-{
-   const char* cmd;
-   const char* description;
-   eth_function action;
-} eth_cmd_type;
+#include "telemetry.h"
+#include "history.h"
+#include "rollup.h"
+#include "subscription.h"
+#include "bin_proto.h"
+#include "str_builder.h"
+#include "event_log.h"
+#include "cmd_registry.h"
+#include "http_server.h"
+#include "metrics.h"
+#include "shm_telemetry.h"
 
 /* **** Defined Values **** */
 #define TCP_LISTENING_PORT		46879
+#define LOCAL_SOCKET_PATH		"/tmp/smpi.sock"	// A leading '@' puts the socket in the abstract namespace
+#define LOCAL_WRITE_GROUP		"smokinpi"			// Local clients of this group may change settings
 #define BULK_BUFFER_SIZE		1024
 #define READ_BUFFER_SIZE		64
+#define MAX_COMMAND_LENGTH		256			// Longer command lines are discarded
+#define COMMAND_DELIMITER		'\n'		// Terminates every command and every response line
+#define FRAME_TIMEOUT_MS		50			// Undelimited data idle this long is processed as a command
+#define STREAM_CHUNK_SIZE		1024		// Large responses are written in chunks of this size
+#define HISTORY_MAX_POINTS		5000		// Upper limit of the max_points parameter of HISTORY?
+
+#define ETH_MAX_CONNECTIONS		64			// Further clients are refused
+#define ETH_MAX_EVENTS			16			// Events returned by one epoll_wait()
+#define ETH_POLL_PERIOD_MS		1000		// Longest wait before idle connections are checked
+#define ETH_IDLE_TIMEOUT_MS		300000		// Connections silent for this long are closed, unless subscribed
+#define ETH_TX_BUFFER_INITIAL	4096		// First allocation of a connection's transmit buffer
+#define ETH_TX_BUFFER_MAX		(2 * 1024 * 1024)	// A client this far behind is disconnected
+#define ETH_MAX_PUSH_FRAMES		8			// Distinct field selections and protocols formatted once per push pass
+
+/* **** Data Types **** */
+	//! State of one client connection
+typedef struct
+{
+   int fd;                                      // -1 when the slot is free
+   int64_t last_activity_ms;                    // CLOCK_MONOTONIC time of the last received data
+   unsigned char rx_buffer[BULK_BUFFER_SIZE];   // Receive ring
+   int rx_idx_in;
+   int rx_idx_out;
+   char cmd_buffer[MAX_COMMAND_LENGTH];         // Command being assembled from the receive ring
+   int cmd_length;
+   bool cmd_overflow;                           // Discarding the remainder of an overlong command
+   bool delimited;                              // The client terminates its commands
+   bool batching;                               // Responses are collected and written together
+   bool want_write;                             // EPOLLOUT is requested
+   bool binary;                                 // Framed binary protocol instead of ASCII lines
+   subscription_type subscription;              // Pushed status frames
+   char* p_tx_buffer;                           // Data the socket has not accepted yet
+   int tx_offset;                               // First byte of p_tx_buffer still to be written
+   int tx_length;                               // Bytes of p_tx_buffer in use, including written ones
+   int tx_size;                                 // Allocated size of p_tx_buffer
+   bool local;                                  // Client of the Unix domain socket
+   bool may_write;                              // The local client may change settings, see Eth_Comms_Read_Local()
+   int uid;                                     // User of the local client that sent the last data
+   int pass_fd;                                 // Descriptor sent with the next write to a local client, -1 if none
+} eth_conn_type;
 
 /* **** Global Variables **** */
 static int g_eth_fd;
+static int g_local_fd = -1;				// Unix domain socket, its address identifies it in epoll events
+static gid_t g_write_gid = (gid_t)-1;	// LOCAL_WRITE_GROUP, if it exists
+static int g_epoll_fd = -1;
 static struct sockaddr_in g_serv_addr;
-static int g_conn_fd = -1;
+static eth_conn_type g_conns[ETH_MAX_CONNECTIONS];
 static shared_data_type* p_shared_data;
 
-static char* Eth_Comms_Version( char* param );
-static char* Eth_Get_Temps(     char* param );
-static char* Eth_Get_Status(    char* param );
-static char* Eth_Set_Temp(      char* param );
+static int Eth_Get_History(   const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Eth_Subscribe(     const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Eth_Unsubscribe(   const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Eth_Set_Binary(    const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Eth_Keyframe(      const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Eth_Set_Deadband(  const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+static int Eth_Share_Telemetry( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
 
-static const eth_cmd_type		g_eth_cmds[] =				//!< List of standard commands
+	//! Commands added to the command registry.  HISTORY works on every front-end, the others act on
+	//! the Ethernet, local or WebSocket connection they arrive on.
+static const cmd_definition_type g_eth_cmds[] =
 {
-	// All *COMMANDS* must be fully uppercase
-    {"VERSION?",	"Returns version information",                      Eth_Comms_Version   },
-    {"TEMPS?",      "Returns the temperature information",              Eth_Get_Temps       },
-    {"STATUS?",     "Returns most information about the SMPi",          Eth_Get_Status      },
-    {"SETTEMP=",    "Sets the setpoint to the specified value",         Eth_Set_Temp        },
+    { "HISTORY",     { NULL },  "Returns downsampled history of the channels",
+        CMD_FRONTEND_ALL, 4, 4, { { CMD_ARG_STRING, "channels", 0, 0 }, { CMD_ARG_FLOAT, "from s", -1.0e12, 1.0e12 },
+                                  { CMD_ARG_FLOAT, "to s", -1.0e12, 1.0e12 }, { CMD_ARG_INT, "max points", 1, 1.0e9 } },
+        Eth_Get_History },
+    { "SUBSCRIBE",   { NULL },  "Pushes the selected fields at the given period",
+        CMD_FRONTEND_ETHERNET | CMD_FRONTEND_LOCAL | CMD_FRONTEND_WEBSOCKET, 2, 3, { { CMD_ARG_STRING, "fields", 0, 0 }, { CMD_ARG_INT, "period ms", 0, 1.0e9 },
+                                       { CMD_ARG_STRING, "DELTA", 0, 5 } },
+        Eth_Subscribe },
+    { "UNSUBSCRIBE", { NULL },  "Stops pushing status frames",
+        CMD_FRONTEND_ETHERNET | CMD_FRONTEND_LOCAL | CMD_FRONTEND_WEBSOCKET, 0, 0, { { 0 } }, Eth_Unsubscribe },
+    { "BINARY",      { NULL },  "Switches the connection to the binary protocol",
+        CMD_FRONTEND_ETHERNET | CMD_FRONTEND_LOCAL, 0, 0, { { 0 } }, Eth_Set_Binary },
+    { "KEYFRAME",    { NULL },  "Sends every subscribed field in the next frame",
+        CMD_FRONTEND_ETHERNET | CMD_FRONTEND_LOCAL | CMD_FRONTEND_WEBSOCKET, 0, 0, { { 0 } }, Eth_Keyframe },
+    { "DEADBAND",    { NULL },  "Sets the delta deadband of subscribed fields",
+        CMD_FRONTEND_ETHERNET | CMD_FRONTEND_LOCAL | CMD_FRONTEND_WEBSOCKET, 2, 2, { { CMD_ARG_STRING, "fields", 0, 0 }, { CMD_ARG_FLOAT, "deadband", 0.0, 1.0e6 } },
+        Eth_Set_Deadband },
+    { "SHMFD",       { NULL },  "Passes a descriptor of the shared memory telemetry",
+        CMD_FRONTEND_LOCAL, 0, 0, { { 0 } }, Eth_Share_Telemetry },
 };
 #define ETH_CMDS_SIZE		(sizeof (g_eth_cmds)/sizeof(g_eth_cmds[0]))
 
-static unsigned char g_bulk_buffer[BULK_BUFFER_SIZE];
-static int g_buff_idx_in;
-static int g_buff_idx_out;
-
 /* **** Function Prototypes **** */
 static void Eth_Comms_Signal_Handler( int signalnum );
-static void Eth_Comms_Receive( unsigned char* pData, int bytes );
-static void Eth_Comms_Process_Commands( char* cmd );
-static int Eth_Comms_Get_Byte( unsigned char* ch );
-static int Eth_Comms_Buffer_Bytes_Available( void );
+static int Eth_Comms_Local_Init( void );
+static void Eth_Comms_Accept( int listen_fd );
+static void Eth_Comms_Read( eth_conn_type* pConn );
+static int Eth_Comms_Read_Local( eth_conn_type* pConn, unsigned char* pData, int size );
+static int Eth_Comms_Write( eth_conn_type* pConn, const char* pData, int length );
+static void Eth_Comms_Close( eth_conn_type* pConn );
+static void Eth_Comms_Close_Idle( int64_t now_ms );
+static void Eth_Comms_Send( eth_conn_type* pConn, const char* pData, int length );
+static void Eth_Comms_Send_Pending( eth_conn_type* pConn );
+static void Eth_Comms_Receive( eth_conn_type* pConn, unsigned char* pData, int bytes );
+static void Eth_Comms_Extract_Commands( eth_conn_type* pConn );
+static void Eth_Comms_Extract_Frames( eth_conn_type* pConn );
+static void Eth_Comms_Process_Frame( eth_conn_type* pConn, message_id_type cmd_id, const uint8_t* p_payload, int length );
+static int Eth_Comms_Process_Undelimited( int64_t now_ms );
+static int Eth_Comms_Push_Subscriptions( int64_t now_ms );
+static float Eth_Apply_Setpoint( float setpoint );
+static void Eth_Comms_Process_Commands( eth_conn_type* pConn, char* cmd );
+static int Eth_Comms_Get_Byte( eth_conn_type* pConn, unsigned char* ch );
+static int Eth_Comms_Buffer_Bytes_Available( eth_conn_type* pConn );
 
 /* **** Accessors **** */
+static inline int64_t Eth_Comms_Get_Time_Ms( void ) { return Telemetry_Get_Time_Ns( CLOCK_MONOTONIC ) / 1000000; }
+static inline int Eth_Comms_Slot( const eth_conn_type* pConn ) { return (int)(pConn - g_conns); }
 
 /* **** Function Definitions **** */
 
 /**************************************************************************************************
-Description:  Initialization routine for setting up Ethernet communications and data storage 
+Description:  Initialization routine for setting up Ethernet communications and data storage
 **************************************************************************************************/
 int Eth_Comms_Init( void* shared_data_address )
 {
+	struct epoll_event event;
+	int i;
+
     p_shared_data = (shared_data_type*)shared_data_address;
-    
+
+	if (Cmd_Registry_Add( g_eth_cmds, ETH_CMDS_SIZE ) < 0)
+		return -1;
+
 	g_eth_fd = socket(AF_INET, SOCK_STREAM, 0 );	// Create the socket
 	memset((unsigned char*)&g_serv_addr, 0, sizeof(g_serv_addr));
 	g_serv_addr.sin_family = AF_INET;
 	g_serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
 	g_serv_addr.sin_port = htons(TCP_LISTENING_PORT);
 	bind(g_eth_fd, (struct sockaddr*)&g_serv_addr, sizeof(g_serv_addr));
+	fcntl(g_eth_fd, F_SETFL, fcntl(g_eth_fd, F_GETFL, 0) | O_NONBLOCK);
+
+	for (i = 0; i < ETH_MAX_CONNECTIONS; i++)
+	{
+		g_conns[i].fd = -1;
+		g_conns[i].pass_fd = -1;
+	}
 
-	g_buff_idx_in = 0;
-	g_buff_idx_out = 0;
+	g_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (g_epoll_fd < 0)
+	{
+		printf("Error creating the Ethernet epoll instance - %s.%u\n", __FILE__, __LINE__);
+		return -1;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;				// NULL identifies the listening socket
+	if (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, g_eth_fd, &event) < 0)
+	{
+		printf("Error adding the listening socket to epoll - %s.%u\n", __FILE__, __LINE__);
+		return -1;
+	}
+
+	// Local clients are a convenience, the Ethernet server runs without them
+	Eth_Comms_Local_Init();
 
 	return listen(g_eth_fd, 10);
 }
 
 /**************************************************************************************************
-Description:  Service routine for receiving data over ethernet, storing the data, and calling the
-data processor and handling lost connections.
+Description:  Offers the command protocol on the Unix domain socket LOCAL_SOCKET_PATH as well.
+Anyone on the Pi may connect and read.  Every read carries the credentials of the process that
+wrote the data (SCM_CREDENTIALS), and only root, the user of the daemon and members of
+LOCAL_WRITE_GROUP may change settings, see Eth_Comms_Read_Local().
+
+Returns -1 on error
+		 1 on success
+**************************************************************************************************/
+static int Eth_Comms_Local_Init( void )
+{
+	struct sockaddr_un address;
+	struct epoll_event event;
+	struct group* pGroup;
+	socklen_t length;
+	int option = 1;
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, LOCAL_SOCKET_PATH, sizeof(address.sun_path) - 1);
+	length = offsetof(struct sockaddr_un, sun_path) + strlen(address.sun_path);
+	if (address.sun_path[0] == '@')
+		address.sun_path[0] = '\0';
+	else
+		unlink(address.sun_path);			// Left behind by an earlier run
+
+	g_local_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if ((g_local_fd < 0) || (bind(g_local_fd, (struct sockaddr*)&address, length) < 0) ||
+		(listen(g_local_fd, ETH_MAX_CONNECTIONS) < 0))
+	{
+		printf("Error creating the local socket %s - %s.%u\n", LOCAL_SOCKET_PATH, __FILE__, __LINE__);
+		if (g_local_fd >= 0)
+			close(g_local_fd);
+		g_local_fd = -1;
+		return -1;
+	}
+	setsockopt(g_local_fd, SOL_SOCKET, SO_PASSCRED, &option, sizeof(option));
+
+	// The credentials decide who may change settings, not the permissions of the file
+	if (address.sun_path[0] != '\0')
+		chmod(address.sun_path, 0666);
+
+	pGroup = getgrnam(LOCAL_WRITE_GROUP);
+	if (pGroup != NULL)
+		g_write_gid = pGroup->gr_gid;
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.ptr = &g_local_fd;
+	if (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, g_local_fd, &event) < 0)
+	{
+		printf("Error adding the local socket to epoll - %s.%u\n", __FILE__, __LINE__);
+		close(g_local_fd);
+		g_local_fd = -1;
+		return -1;
+	}
+
+	return 1;
+}
+
+/**************************************************************************************************
+Description:  Service routine for the Ethernet connections.  A single epoll loop accepts new
+clients, receives and processes their commands and writes out whatever a socket could not take
+earlier, so a slow or stalled client never blocks the others.  Connections without any received
+data for ETH_IDLE_TIMEOUT_MS are closed, unless they are subscribed.
 **************************************************************************************************/
 void Eth_Comms_Service( void )
 {
-	int bytes_read;
-	unsigned char read_buffer[READ_BUFFER_SIZE] = { 0 };
-	
+	struct epoll_event events[ETH_MAX_EVENTS];
+	eth_conn_type* pConn;
+	int64_t last_idle_check_ms = Eth_Comms_Get_Time_Ms();
+	int64_t now_ms;
+	int wait_ms = ETH_POLL_PERIOD_MS;
+	int nbr_events;
+	int i;
+
 	signal(SIGINT, Eth_Comms_Signal_Handler);
 	signal(SIGHUP, SIG_IGN);
 	signal(SIGTERM, SIG_IGN);
@@ -103,264 +283,1166 @@ void Eth_Comms_Service( void )
 
 	while (1)
 	{
-		if (g_conn_fd == -1)
+		nbr_events = epoll_wait(g_epoll_fd, events, ETH_MAX_EVENTS, wait_ms);
+		if ((nbr_events < 0) && (errno != EINTR))
+		{
+			printf("Error waiting for Ethernet events - %s.%u\n", __FILE__, __LINE__);
+			usleep(100000);
+		}
+
+		for (i = 0; i < nbr_events; i++)
 		{
-         g_conn_fd = accept(g_eth_fd, NULL, NULL);
-         openlog("smpiethlog", LOG_ODELAY, LOG_USER);
-         syslog(LOG_INFO, "Ethernet connection established");
-         closelog();
-      }
-		
-		if (g_conn_fd >= 0)
-		{	
-			memset(read_buffer, 0, sizeof(read_buffer));
-			bytes_read = read(g_conn_fd, read_buffer, sizeof(read_buffer));
-
-			if (bytes_read > 0)
+			pConn = (eth_conn_type*)events[i].data.ptr;
+
+			if ((pConn == NULL) || (events[i].data.ptr == &g_local_fd))
 			{
-            uint16_t i;
-            char log_msg[128];
-            
-            Eth_Comms_Receive(read_buffer, bytes_read);
-            Eth_Comms_Process_Commands(read_buffer);
-            openlog("smpiethlog", LOG_ODELAY, LOG_USER);
-            sprintf(log_msg, "Rx: %u bytes - ", bytes_read);
-            for (i = 0; i < bytes_read; i++)
-            {
-               sprintf(log_msg, "%s 0x%02X", log_msg, read_buffer[i]);
-            }
-            
-            syslog(LOG_INFO, log_msg);
-            closelog();
+				Eth_Comms_Accept( (pConn == NULL) ? g_eth_fd : g_local_fd );
+				continue;
 			}
-			
-			if (bytes_read <= 0)
+
+			if (events[i].events & (EPOLLERR | EPOLLHUP))
 			{
-				close(g_conn_fd);
-				g_conn_fd = -1;
-            openlog("smpiethlog", LOG_ODELAY, LOG_USER);
-            syslog(LOG_INFO, "Connection closed");
-            closelog();
+				Eth_Comms_Close( pConn );
+				continue;
 			}
+
+			if (events[i].events & EPOLLOUT)
+				Eth_Comms_Send_Pending( pConn );
+
+			if ((pConn->fd >= 0) && (events[i].events & EPOLLIN))
+				Eth_Comms_Read( pConn );
+		}
+
+		now_ms = Eth_Comms_Get_Time_Ms();
+		if ((now_ms - last_idle_check_ms) >= ETH_POLL_PERIOD_MS)
+		{
+			Eth_Comms_Close_Idle( now_ms );
+			last_idle_check_ms = now_ms;
 		}
+
+		// Wake up again soon while a client has sent part of a line
+		wait_ms = Eth_Comms_Process_Undelimited( now_ms ) ? FRAME_TIMEOUT_MS : ETH_POLL_PERIOD_MS;
+
+		i = Eth_Comms_Push_Subscriptions( now_ms );
+		if (i < wait_ms)
+			wait_ms = i;
 	}
 }
 
-static void Eth_Print( unsigned char* pStr )
+/**************************************************************************************************
+Description:  Accepts every pending connection of a listening socket, Ethernet or local, and gives
+each one a free connection slot
+**************************************************************************************************/
+static void Eth_Comms_Accept( int listen_fd )
 {
-	write(g_conn_fd, pStr, strlen(pStr));
+	struct epoll_event event;
+	eth_conn_type* pConn;
+	bool local = (listen_fd == g_local_fd);
+	int option = 1;
+	int fd;
+	int i;
+
+	while ((fd = accept(listen_fd, NULL, NULL)) >= 0)
+	{
+		pConn = NULL;
+		for (i = 0; i < ETH_MAX_CONNECTIONS; i++)
+		{
+			if (g_conns[i].fd < 0)
+			{
+				pConn = &g_conns[i];
+				break;
+			}
+		}
+
+		if (pConn == NULL)
+		{
+			close(fd);
+			Event_Log( EVENT_ETH_REFUSED, ETH_MAX_CONNECTIONS, 0 );
+			continue;
+		}
+
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+		if (local)
+			setsockopt(fd, SOL_SOCKET, SO_PASSCRED, &option, sizeof(option));
+
+		pConn->fd = fd;
+		pConn->last_activity_ms = Eth_Comms_Get_Time_Ms();
+		pConn->rx_idx_in = 0;
+		pConn->rx_idx_out = 0;
+		pConn->cmd_length = 0;
+		pConn->cmd_overflow = false;
+		pConn->delimited = false;
+		pConn->batching = false;
+		pConn->want_write = false;
+		pConn->binary = false;
+		Subscription_Stop( &pConn->subscription );
+		pConn->tx_offset = 0;
+		pConn->tx_length = 0;
+		pConn->local = local;
+		pConn->may_write = false;
+		pConn->uid = -1;
+		pConn->pass_fd = -1;
+
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.ptr = pConn;
+		if (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+		{
+			close(fd);
+			pConn->fd = -1;
+			continue;
+		}
+
+		Metrics_Add( local ? METRIC_LOCAL_CONNECTIONS : METRIC_TCP_CONNECTIONS, 1 );
+		Metrics_Gauge_Add( local ? METRIC_LOCAL_CLIENTS : METRIC_TCP_CLIENTS, 1 );
+		Event_Log( EVENT_ETH_CONNECTED, Eth_Comms_Slot( pConn ), 0 );
+	}
 }
 
 /**************************************************************************************************
-Description:  Ethernet communications processor
+Description:  Reads everything the socket holds and processes every complete command in it.  The
+responses to all of them are written together once the socket has been drained.  The connection
+is closed when the client has disconnected.
+**************************************************************************************************/
+static void Eth_Comms_Read( eth_conn_type* pConn )
+{
+	int bytes_read;
+	unsigned char read_buffer[READ_BUFFER_SIZE];
+
+	pConn->batching = true;
 
-1. Search for sync header
-2. Read message length field
-3. Read message remainder of message
-4. Verify CRC (not yet implemented)
-5. Pass message body to relevant processing function
+	while (pConn->fd >= 0)
+	{
+		memset(read_buffer, 0, sizeof(read_buffer));
+		if (pConn->local)
+			bytes_read = Eth_Comms_Read_Local( pConn, read_buffer, sizeof(read_buffer) - 1 );
+		else
+			bytes_read = read(pConn->fd, read_buffer, sizeof(read_buffer) - 1);	// Keep the terminator
+		if (bytes_read > 0)
+		{
+			pConn->last_activity_ms = Eth_Comms_Get_Time_Ms();
+			if (!pConn->local)
+				Metrics_Add( METRIC_TCP_RX_BYTES, bytes_read );
+			Event_Log_Data( EVENT_ETH_RX, Eth_Comms_Slot( pConn ), bytes_read, read_buffer, bytes_read );
 
+			Eth_Comms_Receive(pConn, read_buffer, bytes_read);
+			Eth_Comms_Extract_Commands(pConn);
+		}
+		else if ((bytes_read < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+			break;
+		else if ((bytes_read < 0) && (errno == EINTR))
+			continue;
+		else
+			Eth_Comms_Close( pConn );
+	}
+
+	pConn->batching = false;
+	Eth_Comms_Send_Pending( pConn );
+}
+
+/**************************************************************************************************
+Description:  Reads from a local client like read(), and takes the credentials of the process that
+wrote the data from SCM_CREDENTIALS.  The kernel fills them in and never merges the data of two
+writers into one read, so they hold for every byte read, even when the connection was handed to
+another process.  Descriptors the client sends along are closed.
 **************************************************************************************************/
-static void Eth_Comms_Process_Commands( char* cmd )
+static int Eth_Comms_Read_Local( eth_conn_type* pConn, unsigned char* pData, int size )
 {
-    int i;
-    int cmd_length;
-   
-    for (i = 0; i < ETH_CMDS_SIZE; i++)
-    {
-        cmd_length = strlen (g_eth_cmds[i].cmd);
+	union
+	{
+		struct cmsghdr header;
+		char buffer[CMSG_SPACE(sizeof(struct ucred)) + CMSG_SPACE(4 * sizeof(int))];
+	} control;
+	struct ucred credentials;
+	struct cmsghdr* pHeader;
+	struct msghdr message;
+	struct iovec iov;
+	int bytes_read;
+	int i;
+
+	iov.iov_base = pData;
+	iov.iov_len = size;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = &iov;
+	message.msg_iovlen = 1;
+	message.msg_control = control.buffer;
+	message.msg_controllen = sizeof(control.buffer);
+
+	bytes_read = recvmsg(pConn->fd, &message, MSG_CMSG_CLOEXEC);
+	if (bytes_read <= 0)
+		return bytes_read;
+
+	pConn->may_write = false;
+	pConn->uid = -1;
+	for (pHeader = CMSG_FIRSTHDR(&message); pHeader != NULL; pHeader = CMSG_NXTHDR(&message, pHeader))
+	{
+		if (pHeader->cmsg_level != SOL_SOCKET)
+			continue;
 
-		if (strncmp	(cmd, g_eth_cmds[i].cmd, cmd_length) == 0)
+		if (pHeader->cmsg_type == SCM_CREDENTIALS)
 		{
-			char* response = g_eth_cmds[i].action ((char *)&cmd[cmd_length] );
-            Eth_Print( response );
+			memcpy(&credentials, CMSG_DATA(pHeader), sizeof(credentials));
+			pConn->uid = (int)credentials.uid;
+			pConn->may_write = (credentials.uid == 0) || (credentials.uid == geteuid()) ||
+							   ((g_write_gid != (gid_t)-1) && (credentials.gid == g_write_gid));
+		}
+		else if (pHeader->cmsg_type == SCM_RIGHTS)
+		{
+			for (i = 0; i < (int)((pHeader->cmsg_len - CMSG_LEN(0)) / sizeof(int)); i++)
+				close(((int*)CMSG_DATA(pHeader))[i]);
+		}
+	}
+
+	return bytes_read;
+}
+
+/**************************************************************************************************
+Description:  Closes a connection and releases its slot
+**************************************************************************************************/
+static void Eth_Comms_Close( eth_conn_type* pConn )
+{
+	if (pConn->fd < 0)
+		return;
+
+	epoll_ctl(g_epoll_fd, EPOLL_CTL_DEL, pConn->fd, NULL);
+	close(pConn->fd);
+	pConn->fd = -1;
+	pConn->batching = false;
+	pConn->want_write = false;
+	Subscription_Stop( &pConn->subscription );
+
+	free(pConn->p_tx_buffer);
+	pConn->p_tx_buffer = NULL;
+	pConn->tx_size = 0;
+	pConn->tx_offset = 0;
+	pConn->tx_length = 0;
+	pConn->pass_fd = -1;
+
+	Metrics_Gauge_Add( pConn->local ? METRIC_LOCAL_CLIENTS : METRIC_TCP_CLIENTS, -1 );
+	Event_Log( EVENT_ETH_CLOSED, Eth_Comms_Slot( pConn ), 0 );
+}
+
+/**************************************************************************************************
+Description:  Closes the connections that have not sent anything for ETH_IDLE_TIMEOUT_MS.  A
+subscribed client may only listen, e.g. a dashboard, and is kept; if it went away, its pushes fail
+or pile up beyond ETH_TX_BUFFER_MAX and close it.
+**************************************************************************************************/
+static void Eth_Comms_Close_Idle( int64_t now_ms )
+{
+	int i;
+
+	for (i = 0; i < ETH_MAX_CONNECTIONS; i++)
+	{
+		if ((g_conns[i].fd >= 0) && (g_conns[i].subscription.mask == 0) &&
+			((now_ms - g_conns[i].last_activity_ms) >= ETH_IDLE_TIMEOUT_MS))
+		{
+			Event_Log( EVENT_ETH_IDLE_CLOSED, i, 0 );
+			Eth_Comms_Close( &g_conns[i] );
+		}
+	}
+}
+
+/**************************************************************************************************
+Description:  Selects the epoll events of a connection.  EPOLLOUT is only requested while data is
+waiting in the transmit buffer.
+**************************************************************************************************/
+static void Eth_Comms_Update_Events( eth_conn_type* pConn, bool want_write )
+{
+	struct epoll_event event;
+
+	if (pConn->want_write == want_write)
+		return;
+	pConn->want_write = want_write;
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+	event.data.ptr = pConn;
+	epoll_ctl(g_epoll_fd, EPOLL_CTL_MOD, pConn->fd, &event);
+}
+
+/**************************************************************************************************
+Description:  Writes to a connection like write().  A descriptor waiting to be passed to a local
+client goes along with the first bytes written.
+**************************************************************************************************/
+static int Eth_Comms_Write( eth_conn_type* pConn, const char* pData, int length )
+{
+	union
+	{
+		struct cmsghdr header;
+		char buffer[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct cmsghdr* pHeader;
+	struct msghdr message;
+	struct iovec iov;
+	int written;
+
+	if (pConn->pass_fd < 0)
+		written = write(pConn->fd, pData, length);
+	else
+	{
+		iov.iov_base = (void*)pData;
+		iov.iov_len = length;
+		memset(&message, 0, sizeof(message));
+		memset(&control, 0, sizeof(control));
+		message.msg_iov = &iov;
+		message.msg_iovlen = 1;
+		message.msg_control = control.buffer;
+		message.msg_controllen = sizeof(control.buffer);
+		pHeader = CMSG_FIRSTHDR(&message);
+		pHeader->cmsg_level = SOL_SOCKET;
+		pHeader->cmsg_type = SCM_RIGHTS;
+		pHeader->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(pHeader), &pConn->pass_fd, sizeof(int));
+
+		written = sendmsg(pConn->fd, &message, MSG_NOSIGNAL);
+		if (written > 0)
+			pConn->pass_fd = -1;
+	}
+
+	if ((written > 0) && !pConn->local)
+		Metrics_Add( METRIC_TCP_TX_BYTES, written );
+	return written;
+}
+
+/**************************************************************************************************
+Description:  Writes data to a connection without blocking.  Whatever the socket does not accept
+is kept in the connection's transmit buffer and written once the socket becomes writable again.
+Data is always sent in order.  While the connection is batching, the data is only queued.  A client
+that lets more than ETH_TX_BUFFER_MAX bytes pile up is disconnected.
+**************************************************************************************************/
+static void Eth_Comms_Send( eth_conn_type* pConn, const char* pData, int length )
+{
+	int written;
+	int pending;
+	int new_size;
+	char* p_new_buffer;
+
+	if (pConn->fd < 0)
+		return;
+
+	// Write directly when nothing is queued ahead of this data
+	while ((!pConn->batching) && (pConn->tx_offset == pConn->tx_length) && (length > 0))
+	{
+		written = Eth_Comms_Write( pConn, pData, length );
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+			{
+				Eth_Comms_Close( pConn );
+				return;
+			}
+			break;
+		}
+		pData += written;
+		length -= written;
+	}
+
+	if (length <= 0)
+		return;
+
+	// Move the unwritten bytes to the front before growing the buffer
+	pending = pConn->tx_length - pConn->tx_offset;
+	if (pConn->tx_offset > 0)
+	{
+		memmove(pConn->p_tx_buffer, &pConn->p_tx_buffer[pConn->tx_offset], pending);
+		pConn->tx_offset = 0;
+		pConn->tx_length = pending;
+	}
+
+	if ((pending + length) > pConn->tx_size)
+	{
+		new_size = (pConn->tx_size == 0) ? ETH_TX_BUFFER_INITIAL : pConn->tx_size;
+		while (new_size < (pending + length))
+			new_size *= 2;
+
+		p_new_buffer = (new_size <= ETH_TX_BUFFER_MAX) ? realloc(pConn->p_tx_buffer, new_size) : NULL;
+		if (p_new_buffer == NULL)
+		{
+			Event_Log( EVENT_ETH_SLOW_CLIENT, Eth_Comms_Slot( pConn ), pending + length );
+			Eth_Comms_Close( pConn );
+			return;
+		}
+		pConn->p_tx_buffer = p_new_buffer;
+		pConn->tx_size = new_size;
+	}
+
+	memcpy(&pConn->p_tx_buffer[pConn->tx_length], pData, length);
+	pConn->tx_length += length;
+
+	if (!pConn->batching)
+		Eth_Comms_Update_Events( pConn, true );
+}
+
+/**************************************************************************************************
+Description:  Sends as much of the transmit buffer as the socket accepts.  Called when a connection
+becomes writable and at the end of a batch of responses.
+**************************************************************************************************/
+static void Eth_Comms_Send_Pending( eth_conn_type* pConn )
+{
+	int written;
+
+	if (pConn->fd < 0)
+		return;
+
+	while (pConn->tx_offset < pConn->tx_length)
+	{
+		written = Eth_Comms_Write( pConn, &pConn->p_tx_buffer[pConn->tx_offset], pConn->tx_length - pConn->tx_offset );
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+				Eth_Comms_Close( pConn );
+			else
+				Eth_Comms_Update_Events( pConn, true );
 			return;
 		}
+		pConn->tx_offset += written;
+	}
+
+	pConn->tx_offset = 0;
+	pConn->tx_length = 0;
+	Eth_Comms_Update_Events( pConn, false );
+}
+
+/**************************************************************************************************
+Description:  Flush function of the response builders, writes a full chunk to the connection
+**************************************************************************************************/
+static void Eth_Stream_Send( void* pContext, const char* p_data, int length )
+{
+	Eth_Comms_Send( (eth_conn_type*)pContext, p_data, length );
+}
+
+/**************************************************************************************************
+Description:  Ethernet communications processor.  Runs one complete command line through the
+command registry, the response is terminated by COMMAND_DELIMITER.  Unknown commands are echoed
+back.  Local clients that may not change settings get <NAME>,DENIED for the commands that would.
+**************************************************************************************************/
+static void Eth_Comms_Process_Commands( eth_conn_type* pConn, char* cmd )
+{
+    char buffer[STREAM_CHUNK_SIZE];
+    str_builder_type builder;
+    int result;
+
+    Str_Builder_Init( &builder, buffer, sizeof(buffer), Eth_Stream_Send, pConn );
+
+    result = Cmd_Registry_Execute_Checked( pConn->local ? CMD_FRONTEND_LOCAL : CMD_FRONTEND_ETHERNET, pConn,
+                                           !pConn->local || pConn->may_write, cmd, &builder );
+    if (result == CMD_RESULT_UNKNOWN)
+        Str_Builder_Append( &builder, cmd );
+    else if (result == CMD_RESULT_DENIED)
+    {
+        Metrics_Add( METRIC_LOCAL_DENIED, 1 );
+        Event_Log( EVENT_ETH_DENIED, Eth_Comms_Slot( pConn ), pConn->uid );
     }
-    
-    Eth_Print( cmd );
+
+    Str_Builder_Append_Char( &builder, COMMAND_DELIMITER );
+    Str_Builder_Flush( &builder );
 }
 
 /**************************************************************************************************
-Description:  Stores received data in the data buffer to be processed shortly
+Description:  Stores received data in the connection's buffer to be processed shortly
 **************************************************************************************************/
-static void Eth_Comms_Receive( unsigned char* pData, int bytes )
+static void Eth_Comms_Receive( eth_conn_type* pConn, unsigned char* pData, int bytes )
 {
 	int i = 0;
 
 	for (i = 0; i < bytes; i++)
 	{
-		g_bulk_buffer[g_buff_idx_in++] = *pData++;
-		if (g_buff_idx_in >= BULK_BUFFER_SIZE)
-			g_buff_idx_in = 0;
+		pConn->rx_buffer[pConn->rx_idx_in++] = *pData++;
+		if (pConn->rx_idx_in >= BULK_BUFFER_SIZE)
+			pConn->rx_idx_in = 0;
 	}
 }
 
 /**************************************************************************************************
-Description:  Returns the number of bytes available in the Ethernet bulk storage buffer
+Description:  Returns the number of bytes available in the connection's receive buffer
 **************************************************************************************************/
-static int Eth_Comms_Buffer_Bytes_Available( void )
+static int Eth_Comms_Buffer_Bytes_Available( eth_conn_type* pConn )
 {
 	int result = 0;
 
-	if (g_buff_idx_in >= g_buff_idx_out)
-		result = g_buff_idx_in - g_buff_idx_out;
+	if (pConn->rx_idx_in >= pConn->rx_idx_out)
+		result = pConn->rx_idx_in - pConn->rx_idx_out;
 	else
-		result = BULK_BUFFER_SIZE - g_buff_idx_out + g_buff_idx_in;
+		result = BULK_BUFFER_SIZE - pConn->rx_idx_out + pConn->rx_idx_in;
 
 	return result;
 }
 
 /**************************************************************************************************
-Description:  Reads data from the bulk storage buffer.  Returns 0 if there is no data available
-else returns 1.
+Description:  Reads data from the connection's receive buffer.  Returns 0 if there is no data
+available else returns 1.
 **************************************************************************************************/
-static int Eth_Comms_Get_Byte( unsigned char* pCh )
+static int Eth_Comms_Get_Byte( eth_conn_type* pConn, unsigned char* pCh )
 {
 int result = 0;
 
-	if (g_buff_idx_in != g_buff_idx_out)
+	if (pConn->rx_idx_in != pConn->rx_idx_out)
 	{
-		*pCh = g_bulk_buffer[g_buff_idx_out++];
-		if (g_buff_idx_out >= BULK_BUFFER_SIZE)
-			g_buff_idx_out = 0;
+		*pCh = pConn->rx_buffer[pConn->rx_idx_out++];
+		if (pConn->rx_idx_out >= BULK_BUFFER_SIZE)
+			pConn->rx_idx_out = 0;
 		result = 1;
 	}
 
 	return result;
 }
 
-/** ***********************************************************************************************
- @brief Returns the firmware veraion
- 
- @param[in] param           ASCII parameter associated with this command
- @param[in] shared_data     Pointer to the shared system data
- *************************************************************************************************/
-static char* Eth_Comms_Version( char* param )
+/**************************************************************************************************
+Description:  Processes the command that has been assembled so far and starts a new one
+**************************************************************************************************/
+static void Eth_Comms_Complete_Command( eth_conn_type* pConn )
+{
+	if ((pConn->cmd_length > 0) && (pConn->cmd_buffer[pConn->cmd_length - 1] == '\r'))
+		pConn->cmd_length--;
+	pConn->cmd_buffer[pConn->cmd_length] = '\0';
+
+	if (pConn->cmd_overflow)
+		Event_Log( EVENT_ETH_LONG_COMMAND, Eth_Comms_Slot( pConn ), MAX_COMMAND_LENGTH - 1 );
+	else if (pConn->cmd_length > 0)
+		Eth_Comms_Process_Commands( pConn, pConn->cmd_buffer );
+
+	pConn->cmd_length = 0;
+	pConn->cmd_overflow = false;
+}
+
+/**************************************************************************************************
+Description:  Framing layer.  Moves the data of the receive ring into the command buffer and
+processes every command terminated by COMMAND_DELIMITER, so commands split across reads and
+several commands in one read are handled alike.  A trailing '\r' is ignored.  Connections in
+binary mode assemble frames instead.
+**************************************************************************************************/
+static void Eth_Comms_Extract_Commands( eth_conn_type* pConn )
+{
+	unsigned char ch;
+
+	while ((pConn->fd >= 0) && (Eth_Comms_Buffer_Bytes_Available( pConn ) > 0))
+	{
+		Eth_Comms_Get_Byte( pConn, &ch );
+
+		if (pConn->binary)
+		{
+			pConn->cmd_buffer[pConn->cmd_length++] = ch;
+			Eth_Comms_Extract_Frames( pConn );
+		}
+		else if (ch == COMMAND_DELIMITER)
+		{
+			pConn->delimited = true;
+			Eth_Comms_Complete_Command( pConn );
+		}
+		else if (pConn->cmd_length < (MAX_COMMAND_LENGTH - 1))
+			pConn->cmd_buffer[pConn->cmd_length++] = ch;
+		else
+			pConn->cmd_overflow = true;
+	}
+}
+
+/**************************************************************************************************
+Description:  Older clients send commands without a delimiter, one per write.  Until a client has
+sent a delimiter, data left without one for FRAME_TIMEOUT_MS is therefore processed as a complete
+command.
+
+Returns 1 if a connection still holds part of a command, else 0
+**************************************************************************************************/
+static int Eth_Comms_Process_Undelimited( int64_t now_ms )
+{
+	eth_conn_type* pConn;
+	int waiting = 0;
+	int i;
+
+	for (i = 0; i < ETH_MAX_CONNECTIONS; i++)
+	{
+		pConn = &g_conns[i];
+		if ((pConn->fd < 0) || (pConn->cmd_length == 0) || (pConn->delimited) || (pConn->binary))
+			continue;
+
+		if ((now_ms - pConn->last_activity_ms) >= FRAME_TIMEOUT_MS)
+		{
+			pConn->batching = true;
+			Eth_Comms_Complete_Command( pConn );
+			pConn->batching = false;
+			Eth_Comms_Send_Pending( pConn );
+		}
+		else
+			waiting = 1;
+	}
+
+	return waiting;
+}
+
+/**************************************************************************************************
+Description:  Processes the binary frame at the start of the command buffer once it is complete.
+Bytes that cannot start a valid frame are dropped one at a time until the next sync pattern.
+**************************************************************************************************/
+static void Eth_Comms_Extract_Frames( eth_conn_type* pConn )
 {
-   static char version[64];
-   
-   sprintf(version, "VERSION,Smokin'Pi v%u.%03u.%03u", FIRMWARE_MAJOR, FIRMWARE_MINOR, FIRMWARE_REVISION);
-	
-   return version;
+	uint8_t* p_buffer = (uint8_t*)pConn->cmd_buffer;
+	int result;
+
+	while (pConn->cmd_length > 0)
+	{
+		result = Bin_Proto_Check_Frame( p_buffer, pConn->cmd_length, MAX_COMMAND_LENGTH - BIN_PROTO_OVERHEAD );
+		if (result == BIN_PROTO_INCOMPLETE)
+			break;
+
+		if (result > 0)
+		{
+			Eth_Comms_Process_Frame( pConn, (message_id_type)Bin_Proto_Get_U16( &p_buffer[4] ),
+									 &p_buffer[BIN_PROTO_HEADER_SIZE], result - BIN_PROTO_OVERHEAD );
+		}
+		else
+		{
+			if (result == BIN_PROTO_BAD_CRC)
+				Event_Log( EVENT_ETH_BAD_CRC, Eth_Comms_Slot( pConn ), 0 );
+			result = 1;
+		}
+
+		pConn->cmd_length -= result;
+		memmove(p_buffer, &p_buffer[result], pConn->cmd_length);
+
+		if (!pConn->binary)
+			break;		// The rest of the data is ASCII again
+	}
 }
 
 /** ***********************************************************************************************
- @brief Returns the firmware veraion
- 
- @param[in] param           ASCII parameter associated with this command
- @param[in] shared_data     Pointer to the shared system data
- 
- Response format:  TEMPS,<setpoint>,<ch 1 temp>,...,<ch 9 temp>,<fire temp>
- All temperatures are in ASCII floating point representation
+ @brief Sets the setpoint if it is within range
+
+ @param[in] setpoint        Requested setpoint
+
+ @return The setpoint in use afterwards
  *************************************************************************************************/
-static char* Eth_Get_Temps( char* param )
+static float Eth_Apply_Setpoint( float setpoint )
 {
-    static char temp_data[128];
-    int i;
-    float local_temperature_data[NBR_OF_THERMISTORS];
-    float fire_temp;
-    float cabinet_setpoint;
-   
-    pthread_mutex_lock(&mutex);
-    memcpy( (char*)local_temperature_data, (char*)p_shared_data->temp_deg_f, sizeof(local_temperature_data) );
-    fire_temp = p_shared_data->temp_deg_f_fire;
-    cabinet_setpoint = p_shared_data->temp_deg_f_cabinet_setpoint;
-	pthread_mutex_unlock(&mutex);
-
-   strcpy(temp_data, "TEMPS");
-   
-   sprintf(temp_data, "%s,%f", temp_data, cabinet_setpoint);
-   
-   for (i = 0; i < NBR_OF_THERMISTORS; i++)
-      sprintf(temp_data, "%s,%f", temp_data, local_temperature_data[i]);
-   
-   sprintf(temp_data, "%s,%f", temp_data, fire_temp);
-   
-   return temp_data;
+    if (App_Set_Cabinet_Setpoint( setpoint ) < 0)
+        setpoint = App_Get_Cabinet_Setpoint();
+
+    return setpoint;
 }
 
 /** ***********************************************************************************************
- @brief Returns much of the operational data from the SMPi
- 
- @param[in] param           ASCII parameter associated with this command
- @param[in] shared_data     Pointer to the shared system data
- 
- Response format:  STATUS,<setpoint>,<ch 1 temp>,...,<ch 9 temp>,<fire temp>,<ch 0 adc>,...,
-                         <fire detected state>
- 
+ @brief Fills a subscription snapshot from a copy of the shared data
  *************************************************************************************************/
-static char* Eth_Get_Status( char* param )
+static void Eth_Take_Snapshot( subscription_snapshot_type* pSnapshot )
 {
-    static char status_data[1024];
-    int i;
     shared_data_type local_shared_data;
-    
+
     pthread_mutex_lock(&mutex);
     memcpy( (char*)&local_shared_data, (char*)p_shared_data, sizeof(local_shared_data) );
     pthread_mutex_unlock(&mutex);
 
-    strcpy(status_data, "STATUS");
+    Subscription_Take_Snapshot( &local_shared_data, pSnapshot );
+}
+
+
+/** ***********************************************************************************************
+ @brief Reads at most max_points points of the history of one channel into p_times and p_values
+
+ When each output point covers a second or more, the points come from the rollup engine (mean of each
+ time bucket).  Finer requests are served from the full rate in-memory history and reduced to
+ max_points with LTTB downsampling.  If the in-memory history has nothing for the span (e.g. the
+ daemon was restarted) or there is not enough memory to collect its samples, the rollups are used
+ regardless.
 
-    sprintf(status_data, "%s,%f", status_data, local_shared_data.temp_deg_f_cabinet_setpoint);
+ @return The number of points
+ *************************************************************************************************/
+static int Eth_Read_Channel_History( int channel, int64_t from_ms, int64_t to_ms, int max_points,
+                                     int64_t* p_times, float* p_values )
+{
+    rollup_point_type* p_points;
+    int count = 0;
+    int i;
 
-    for (i = 0; i < NBR_OF_THERMISTORS; i++)
-      sprintf(status_data, "%s,%f", status_data, local_shared_data.temp_deg_f[i]);
+    if (((to_ms - from_ms) / max_points) < 1000)
+        count = History_Query_Arrays( HISTORY_COOK_PREVIOUS, channel, from_ms, to_ms, p_times, p_values, max_points );
 
-    sprintf(status_data, "%s,%f", status_data, local_shared_data.temp_deg_f_fire);
+    if (count <= 0)
+    {
+        p_points = malloc(max_points * sizeof(rollup_point_type));
+        if (p_points != NULL)
+            count = Rollup_Query( channel, from_ms, to_ms, max_points, p_points, NULL );
+
+        for (i = 0; i < count; i++)
+        {
+            p_times[i] = p_points[i].start_ms;
+            p_values[i] = p_points[i].mean_value;
+        }
 
-    for (i = 0; i < NBR_ADC_CHANNELS; i++)
-        sprintf(status_data, "%s,%u", status_data, (0x3FF & local_shared_data.adc_results[i]));
-   
-    sprintf(status_data, "%s,%u", status_data, local_shared_data.fire_detect_state);
+        free(p_points);
+    }
 
-    return status_data;
+    return (count > 0) ? count : 0;
 }
 
 /** ***********************************************************************************************
- @brief Sets the setpoint for the system
- 
- @param[in] param           ASCII parameter associated with this command
- @param[in] shared_data     Pointer to the shared system data
- 
- Response format:  SETTEMP,<new setpoint>
- 
+ @brief Streams the history of one channel as one ASCII line
  *************************************************************************************************/
-static char* Eth_Set_Temp( char* param )
+static void Eth_Stream_Channel_History( str_builder_type* pBuilder, int channel, int64_t from_ms, int64_t to_ms,
+                                        int max_points )
 {
-    static char response[128];
-    float setpoint = atof(param);
-    
-    if ((setpoint > 0.0) && (setpoint < 400.0))
+    int64_t* p_times = malloc(max_points * sizeof(int64_t));
+    float* p_values = malloc(max_points * sizeof(float));
+    int count = 0;
+    int i;
+
+    if ((p_times != NULL) && (p_values != NULL))
+        count = Eth_Read_Channel_History( channel, from_ms, to_ms, max_points, p_times, p_values );
+
+    Str_Builder_Printf( pBuilder, "HISTORY,%d,%d", channel, count );
+    for (i = 0; i < count; i++)
     {
-        pthread_mutex_lock(&mutex);
-        p_shared_data->temp_deg_f_cabinet_setpoint = setpoint;
-        pthread_mutex_unlock(&mutex);
+        Str_Builder_Append_Char( pBuilder, ',' );
+        Str_Builder_Append_Int( pBuilder, p_times[i] );
+        Str_Builder_Append_Char( pBuilder, ',' );
+        Str_Builder_Append_Fixed( pBuilder, p_values[i], 2 );
     }
+    Str_Builder_Append_Char( pBuilder, '\n' );
+
+    free(p_times);
+    free(p_values);
+}
+
+/** ***********************************************************************************************
+ @brief Sends the history of one channel as a CMD_HISTORY_RESPONSE frame.  Channel 0xFF with no
+ points marks the end of a response.
+ *************************************************************************************************/
+static void Eth_Send_Channel_History_Frame( eth_conn_type* pConn, int channel, int64_t from_ms, int64_t to_ms,
+                                            int max_points )
+{
+    int64_t* p_times = NULL;
+    float* p_values = NULL;
+    uint8_t* p_frame;
+    uint8_t* p;
+    int count = 0;
+    int i;
+
+    if (channel != 0xFF)
+    {
+        p_times = malloc(max_points * sizeof(int64_t));
+        p_values = malloc(max_points * sizeof(float));
+        if ((p_times != NULL) && (p_values != NULL))
+            count = Eth_Read_Channel_History( channel, from_ms, to_ms, max_points, p_times, p_values );
+    }
+
+    p_frame = malloc(BIN_PROTO_OVERHEAD + 12 + (count * 6));
+    if (p_frame != NULL)
+    {
+        p = &p_frame[BIN_PROTO_HEADER_SIZE];
+        p[0] = (uint8_t)channel;
+        p[1] = 0;
+        Bin_Proto_Put_U16( &p[2], (uint16_t)count );
+        Bin_Proto_Put_U64( &p[4], (uint64_t)((count > 0) ? p_times[0] : 0) );
+        for (i = 0, p += 12; i < count; i++, p += 6)
+        {
+            Bin_Proto_Put_U32( &p[0], (uint32_t)(p_times[i] - p_times[0]) );
+            Bin_Proto_Put_U16( &p[4], (uint16_t)Bin_Proto_Temp_To_Fixed( p_values[i] ) );
+        }
+
+        Eth_Comms_Send( pConn, (char*)p_frame, Bin_Proto_Finish_Frame( p_frame, CMD_HISTORY_RESPONSE, 12 + (count * 6) ) );
+        free(p_frame);
+    }
+
+    free(p_times);
+    free(p_values);
+}
+
+/** ***********************************************************************************************
+ @brief Converts a HISTORY? time in seconds to ms since the epoch, values <= 0 are relative to now
+ *************************************************************************************************/
+static int64_t Eth_History_Time_To_Ms( double seconds, int64_t now_ms )
+{
+    int64_t time_ms = (int64_t)(seconds * 1000.0);
+
+    return (time_ms <= 0) ? (time_ms + now_ms) : time_ms;
+}
+
+/** ***********************************************************************************************
+ @brief Returns the history of one or more channels
+
+ @param[in] pArgs           <channels>,<from>,<to>,<max_points>
+ @param[in] pBuilder        Response
+
+ channels is ALL or a ':' separated list of channel numbers (0-9 probes, 10 fire, 11 setpoint,
+ 12 servo).  from and to are seconds since the epoch, a value <= 0 is relative to now, e.g.
+ HISTORY?0:10,-1800,0,500 returns the last 30 minutes of the cabinet and fire temperatures.
+
+ Response format:  HISTORY,<channel>,<nbr points>,<time ms>,<value>,...\n  (one line per channel)
+                   HISTORY,END
+ *************************************************************************************************/
+static int Eth_Get_History( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+    char channels[64];
+    char* p_save = NULL;
+    char* p_channel;
+    uint32_t channel_mask = 0;
+    int64_t now_ms = Telemetry_Get_Time_Ns( CLOCK_REALTIME ) / 1000000;
+    int64_t from_ms, to_ms;
+    int max_points;
+    int channel;
+
+    if (strcasecmp(pArgs->values[0].s, "ALL") == 0)
+        channel_mask = (1UL << NBR_TELEMETRY_CHANNELS) - 1;
     else
     {
-        pthread_mutex_lock(&mutex);
-        setpoint = p_shared_data->temp_deg_f_cabinet_setpoint;
-        pthread_mutex_unlock(&mutex);
+        snprintf(channels, sizeof(channels), "%s", pArgs->values[0].s);
+        for (p_channel = strtok_r(channels, ":", &p_save); p_channel != NULL; p_channel = strtok_r(NULL, ":", &p_save))
+        {
+            channel = atoi(p_channel);
+            if ((channel >= 0) && (channel < NBR_TELEMETRY_CHANNELS))
+                channel_mask |= 1UL << channel;
+        }
+    }
+
+    from_ms = Eth_History_Time_To_Ms( pArgs->values[1].f, now_ms );
+    to_ms = Eth_History_Time_To_Ms( pArgs->values[2].f, now_ms );
+
+    max_points = (int)pArgs->values[3].i;
+    if (max_points > HISTORY_MAX_POINTS)
+        max_points = HISTORY_MAX_POINTS;
+
+    if ((channel_mask == 0) || (to_ms < from_ms))
+        return -1;
+
+    for (channel = 0; channel < NBR_TELEMETRY_CHANNELS; channel++)
+    {
+        if (channel_mask & (1UL << channel))
+            Eth_Stream_Channel_History( pBuilder, channel, from_ms, to_ms, max_points );
     }
-    
-    sprintf(response, "SETTEMP,%f", setpoint);
 
-    return response;
+    Str_Builder_Append( pBuilder, "HISTORY,END" );
+    return 1;
 }
 
+/**************************************************************************************************
+Description:  Sends a status frame to every subscriber that is due.  The shared data is copied
+once and each distinct frame (field selection, keyframe or delta, protocol) is formatted once,
+however many clients receive it.  Deadlines are aligned to multiples of the period, so subscribers
+with the same period share a pass.
+
+Returns the number of ms until the next frame is due (at most ETH_POLL_PERIOD_MS)
+**************************************************************************************************/
+static int Eth_Comms_Push_Subscriptions( int64_t now_ms )
+{
+	static struct
+	{
+		uint32_t mask;
+		bool keyframe;
+		bool binary;
+		int length;
+		char buffer[SUBSCRIPTION_MAX_FRAME_SIZE];
+	} frames[ETH_MAX_PUSH_FRAMES];
+	int nbr_frames = 0;
+	subscription_snapshot_type snapshot;
+	bool have_snapshot = false;
+	eth_conn_type* pConn;
+	subscription_type* pSubscription;
+	uint32_t mask;
+	bool keyframe;
+	int64_t next_ms = now_ms + ETH_POLL_PERIOD_MS;
+	int i, j;
+
+	for (i = 0; i < ETH_MAX_CONNECTIONS; i++)
+	{
+		pConn = &g_conns[i];
+		pSubscription = &pConn->subscription;
+		if ((pConn->fd < 0) || (pSubscription->mask == 0))
+			continue;
+
+		if (now_ms >= pSubscription->next_ms)
+		{
+			if (!have_snapshot)
+			{
+				Eth_Take_Snapshot( &snapshot );
+				have_snapshot = true;
+			}
+
+			mask = Subscription_Next_Frame( pSubscription, &snapshot, now_ms, &keyframe );
+
+			for (j = 0; j < nbr_frames; j++)
+			{
+				if ((frames[j].mask == mask) && (frames[j].keyframe == keyframe) && (frames[j].binary == pConn->binary))
+					break;
+			}
+
+			if ((mask != 0) && (j >= nbr_frames))
+			{
+				j = (nbr_frames < ETH_MAX_PUSH_FRAMES) ? nbr_frames++ : (ETH_MAX_PUSH_FRAMES - 1);
+				frames[j].mask = mask;
+				frames[j].keyframe = keyframe;
+				frames[j].binary = pConn->binary;
+				if (pConn->binary)
+					frames[j].length = Bin_Proto_Encode_Push( &snapshot, mask, keyframe, (uint8_t*)frames[j].buffer, sizeof(frames[j].buffer) );
+				else
+					frames[j].length = Subscription_Format_Frame( &snapshot, mask, keyframe, frames[j].buffer, sizeof(frames[j].buffer) );
+			}
+
+			if ((mask != 0) && (frames[j].length > 0))
+				Eth_Comms_Send( pConn, frames[j].buffer, frames[j].length );
+		}
+
+		if ((pConn->fd >= 0) && (pSubscription->next_ms < next_ms))
+			next_ms = pSubscription->next_ms;
+	}
+
+	return (int)(next_ms - now_ms);
+}
+
+/**************************************************************************************************
+Description:  Returns the subscription of the connection a command arrived on
+**************************************************************************************************/
+static subscription_type* Eth_Get_Subscription( const cmd_context_type* pContext )
+{
+    if (pContext->frontend == CMD_FRONTEND_WEBSOCKET)
+        return Http_Server_Get_Subscription( pContext->pConnection );
+
+    return &((eth_conn_type*)pContext->pConnection)->subscription;
+}
+
+/** ***********************************************************************************************
+ @brief Subscribes the connection to periodic status frames
+
+ @param[in] pArgs           <fields>,<period ms>[,DELTA]
+ @param[in] pBuilder        Response
+
+ fields is a ':' separated list of ALL, SETPOINT, TEMPS, FIRE, ADC, STATE and SERVO.  A new
+ subscription replaces the previous one.  Frames follow the response, see subscription.c.  With
+ DELTA, frames only carry the fields that moved beyond their deadband (see DEADBAND=).
+
+ Response format:  SUBSCRIBE,<field mask in hex>,<period ms>  or  SUBSCRIBE,ERROR
+ *************************************************************************************************/
+static int Eth_Subscribe( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+    subscription_type* pSubscription = Eth_Get_Subscription( pContext );
+    uint32_t mask;
+
+    if (Subscription_Parse_Fields( pArgs->values[0].s, &mask ) < 0)
+        return -1;
+
+    Subscription_Start( pSubscription, mask, (int)pArgs->values[1].i,
+                        (pArgs->count > 2) && (strcasecmp(pArgs->values[2].s, "DELTA") == 0) );
+
+    Str_Builder_Printf( pBuilder, "SUBSCRIBE,%X,%d%s", pSubscription->mask, pSubscription->period_ms,
+                        pSubscription->delta ? ",DELTA" : "" );
+    return 1;
+}
+
+/** ***********************************************************************************************
+ @brief Stops the status frames of the connection
+
+ Response format:  UNSUBSCRIBE
+ *************************************************************************************************/
+static int Eth_Unsubscribe( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+    Subscription_Stop( Eth_Get_Subscription( pContext ) );
+
+    Str_Builder_Append( pBuilder, "UNSUBSCRIBE" );
+    return 1;
+}
+
+/** ***********************************************************************************************
+ @brief Makes the next frame of the subscription a keyframe and sends it on the next pass
+
+ Response format:  KEYFRAME
+ *************************************************************************************************/
+static int Eth_Keyframe( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+    Subscription_Request_Keyframe( Eth_Get_Subscription( pContext ) );
+
+    Str_Builder_Append( pBuilder, "KEYFRAME" );
+    return 1;
+}
+
+/** ***********************************************************************************************
+ @brief Sets the deadband of some fields of the delta subscription
+
+ @param[in] pArgs           <fields>,<deadband>
+
+ fields is a list as for SUBSCRIBE=.  A field is sent when it differs from the value last sent by
+ more than its deadband.  Defaults are 0.1 degree for temperatures, 2 counts for the ADC and any
+ change for the fire state and servo.  SUBSCRIBE= restores the defaults.
+
+ Response format:  DEADBAND,<field mask in hex>,<deadband>  or  DEADBAND,ERROR
+ *************************************************************************************************/
+static int Eth_Set_Deadband( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+    uint32_t mask;
+
+    if (Subscription_Parse_Fields( pArgs->values[0].s, &mask ) < 0)
+        return -1;
+
+    Subscription_Set_Deadband( Eth_Get_Subscription( pContext ), mask, pArgs->values[1].f );
+
+    Str_Builder_Printf( pBuilder, "DEADBAND,%X,%.2f", mask, pArgs->values[1].f );
+    return 1;
+}
+
+/** ***********************************************************************************************
+ @brief Passes a read only descriptor of the shared memory telemetry segment to a local client
+
+ The descriptor arrives as SCM_RIGHTS with the response, or with a response written ahead of it,
+ and is mapped with Shm_Telemetry_Attach_Fd() of shm_telemetry.h.
+
+ Response format:  SHMFD,<segment size>  or  SHMFD,ERROR
+ *************************************************************************************************/
+static int Eth_Share_Telemetry( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+    eth_conn_type* pConn = (eth_conn_type*)pContext->pConnection;
+    int fd = Shm_Telemetry_Get_Client_Fd();
+
+    if (fd < 0)
+        return -1;
+
+    pConn->pass_fd = fd;
+    Str_Builder_Printf( pBuilder, "SHMFD,%u", (unsigned)sizeof(shm_telemetry_segment_type) );
+    return 1;
+}
+
+/** ***********************************************************************************************
+ @brief Switches the connection to the binary protocol, see bin_proto.c
+
+ Response format:  BINARY,OK  (everything after it is binary)
+ *************************************************************************************************/
+static int Eth_Set_Binary( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+    Str_Builder_Append( pBuilder, "BINARY,OK" );
+    ((eth_conn_type*)pContext->pConnection)->binary = true;
+    return 1;
+}
+
+/**************************************************************************************************
+Description:  Sends a frame with no more than 16 bytes of payload
+**************************************************************************************************/
+static void Eth_Send_Frame( eth_conn_type* pConn, message_id_type cmd_id, const uint8_t* p_payload, int length )
+{
+	uint8_t frame[BIN_PROTO_OVERHEAD + 16];
+
+	memcpy(&frame[BIN_PROTO_HEADER_SIZE], p_payload, length);
+	Eth_Comms_Send( pConn, (char*)frame, Bin_Proto_Finish_Frame( frame, cmd_id, length ) );
+}
+
+/**************************************************************************************************
+Description:  Binary protocol processor.  Handles one valid frame received from the connection.
+Unknown messages and payloads of the wrong size are answered with CMD_ERROR_RESPONSE.
+**************************************************************************************************/
+static void Eth_Comms_Process_Frame( eth_conn_type* pConn, message_id_type cmd_id, const uint8_t* p_payload, int length )
+{
+	uint8_t frame[BIN_PROTO_OVERHEAD + 64];
+	uint8_t payload[16];
+	subscription_snapshot_type snapshot;
+	int64_t now_ms;
+	int64_t from_ms, to_ms;
+	uint32_t mask;
+	float setpoint;
+	int max_points;
+	int channel;
+
+	switch (cmd_id)
+	{
+		case CMD_GET_VERSION:
+			Eth_Comms_Send( pConn, (char*)frame, Bin_Proto_Encode_Version( frame, sizeof(frame) ) );
+			return;
+
+		case CMD_GET_STATUS:
+			Eth_Take_Snapshot( &snapshot );
+			Eth_Comms_Send( pConn, (char*)frame, Bin_Proto_Encode_Status( &snapshot, frame, sizeof(frame) ) );
+			return;
+
+		case CMD_SET_TEMPERATURE_SETPOINT:
+			if (length != sizeof(float))
+				break;
+			if (pConn->local && !pConn->may_write)
+			{
+				Metrics_Add( METRIC_LOCAL_DENIED, 1 );
+				Event_Log( EVENT_ETH_DENIED, Eth_Comms_Slot( pConn ), pConn->uid );
+				break;
+			}
+			mask = Bin_Proto_Get_U32( p_payload );
+			memcpy(&setpoint, &mask, sizeof(float));
+			setpoint = Eth_Apply_Setpoint( setpoint );
+			memcpy(&mask, &setpoint, sizeof(float));
+			Bin_Proto_Put_U32( payload, mask );
+			Eth_Send_Frame( pConn, CMD_SETPOINT_RESPONSE, payload, sizeof(float) );
+			return;
+
+		case CMD_GET_HISTORY:
+			if (length != 14)
+				break;
+			now_ms = Telemetry_Get_Time_Ns( CLOCK_REALTIME ) / 1000000;
+			mask = Bin_Proto_Get_U32( &p_payload[0] );
+			from_ms = Eth_History_Time_To_Ms( (int32_t)Bin_Proto_Get_U32( &p_payload[4] ), now_ms );
+			to_ms = Eth_History_Time_To_Ms( (int32_t)Bin_Proto_Get_U32( &p_payload[8] ), now_ms );
+			max_points = Bin_Proto_Get_U16( &p_payload[12] );
+			if (max_points > HISTORY_MAX_POINTS)
+				max_points = HISTORY_MAX_POINTS;
+			if ((max_points <= 0) || (to_ms < from_ms))
+				break;
+			for (channel = 0; channel < NBR_TELEMETRY_CHANNELS; channel++)
+			{
+				if (mask & (1UL << channel))
+					Eth_Send_Channel_History_Frame( pConn, channel, from_ms, to_ms, max_points );
+			}
+			Eth_Send_Channel_History_Frame( pConn, 0xFF, 0, 0, 0 );
+			return;
+
+		case CMD_SUBSCRIBE:
+			if ((length != 6) && (length != 7))
+				break;
+			Subscription_Start( &pConn->subscription, Bin_Proto_Get_U32( &p_payload[0] ), Bin_Proto_Get_U16( &p_payload[4] ),
+								(length == 7) && (p_payload[6] & 0x01) );
+			Bin_Proto_Put_U32( &payload[0], pConn->subscription.mask );
+			Bin_Proto_Put_U16( &payload[4], (uint16_t)pConn->subscription.period_ms );
+			Eth_Send_Frame( pConn, CMD_SUBSCRIBE_RESPONSE, payload, 6 );
+			return;
+
+		case CMD_UNSUBSCRIBE:
+			Subscription_Stop( &pConn->subscription );
+			memset(payload, 0, 6);
+			Eth_Send_Frame( pConn, CMD_SUBSCRIBE_RESPONSE, payload, 6 );
+			return;
+
+		case CMD_REQUEST_KEYFRAME:
+			Subscription_Request_Keyframe( &pConn->subscription );
+			return;
+
+		case CMD_SET_DEADBAND:
+			if (length != 8)
+				break;
+			mask = Bin_Proto_Get_U32( &p_payload[4] );
+			memcpy(&setpoint, &mask, sizeof(float));
+			Subscription_Set_Deadband( &pConn->subscription, Bin_Proto_Get_U32( &p_payload[0] ), setpoint );
+			Bin_Proto_Put_U32( &payload[0], pConn->subscription.mask );
+			Bin_Proto_Put_U16( &payload[4], (uint16_t)pConn->subscription.period_ms );
+			Eth_Send_Frame( pConn, CMD_SUBSCRIBE_RESPONSE, payload, 6 );
+			return;
+
+		case CMD_SET_ASCII_MODE:
+			pConn->binary = false;
+			return;
+
+		default:
+			break;
+	}
+
+	Bin_Proto_Put_U16( &payload[0], (uint16_t)cmd_id );
+	Eth_Send_Frame( pConn, CMD_ERROR_RESPONSE, payload, 2 );
+}
 
 /***************************************************************************************************
 ***************************************************************************************************/
 static void Eth_Comms_Signal_Handler( int signalnum )
 {
+	int i;
+
 	switch (signalnum)
 	{
 		case SIGINT:
-			if (g_conn_fd >= 0)
+			for (i = 0; i < ETH_MAX_CONNECTIONS; i++)
 			{
-				close(g_conn_fd);
-				g_conn_fd = -1;
+				if (g_conns[i].fd >= 0)
+					close(g_conns[i].fd);
 			}
 			exit(signalnum);
 			break;
@@ -368,10 +1450,10 @@ static void Eth_Comms_Signal_Handler( int signalnum )
 		case SIGTERM:
 		case SIGHUP:
 		case SIGPIPE:
-			if (g_conn_fd >= 0)
+			for (i = 0; i < ETH_MAX_CONNECTIONS; i++)
 			{
-				close(g_conn_fd);
-				g_conn_fd = -1;
+				if (g_conns[i].fd >= 0)
+					Eth_Comms_Close( &g_conns[i] );
 			}
 			break;
 	}
@@ -20,6 +20,20 @@ typedef enum
 	
 	CMD_VERSION_RESPONSE,
 	CMD_STATUS_RESPONSE,
+
+	CMD_SET_ASCII_MODE,				// Leaves the binary protocol, see bin_proto.c
+	CMD_GET_HISTORY,
+	CMD_HISTORY_RESPONSE,
+	CMD_SUBSCRIBE,
+	CMD_UNSUBSCRIBE,
+	CMD_SUBSCRIBE_RESPONSE,
+	CMD_PUSH_FRAME,
+	CMD_SETPOINT_RESPONSE,
+	CMD_ERROR_RESPONSE,
+	CMD_DELTA_FRAME,
+	CMD_REQUEST_KEYFRAME,
+	CMD_SET_DEADBAND,
+	CMD_MULTICAST_FRAME,
 } message_id_type;
 
 typedef struct
@@ -0,0 +1,289 @@
+/***************************************************************************************************
+Event Log
+
+Structured, asynchronous logging to syslog.  Threads that report an event only fill in a small
+fixed size record and push it into a lock-free queue, which costs no system calls.  The event log
+thread drains the queue and applies, in this order:
+
+	- The verbosity.  Events above it are already dropped by the producer.
+	- Sampling.  Only every Nth occurrence of an event is considered.
+	- Rate limiting.  At most max_per_s occurrences of an event are logged per second, a summary of
+	  the suppressed ones is logged when the second is over.
+
+Packet data is copied into the record (up to EVENT_LOG_MAX_DATA bytes) and formatted as a hex dump
+only when the verbosity is LOG_DEBUG.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include <strings.h>
+#include <time.h>
+#include "event_log.h"
+#include "mpsc_queue.h"
+#include "str_builder.h"
+
+/* *** Defined Values *** */
+#define EVENT_LOG_QUEUE_CAPACITY		256
+#define EVENT_LOG_SERVICE_RATE_US		20000		// Idle sleep when the queue is empty
+#define EVENT_LOG_RATE_WINDOW_MS		1000
+#define EVENT_LOG_MESSAGE_SIZE			(128 + (EVENT_LOG_MAX_DATA * 5))
+
+/* *** Data Types *** */
+typedef struct
+{
+	const char* name;							// Used by Event_Log_Find()
+	int level;									// syslog level
+	const char* format;							// printf format taking arg0 and arg1 as int
+	int max_per_s;								// 0 for no limit
+	int sample_every;							// 1 logs every occurrence
+} event_definition_type;
+
+// Rate limiting state of one event, only used by the event log thread
+typedef struct
+{
+	int64_t window_start_ms;
+	int logged;									// Occurrences logged in the current window
+	int suppressed;								// Occurrences dropped in the current window
+	uint32_t occurrences;						// For sampling
+} event_state_type;
+
+/* *** Global Variables *** */
+static const event_definition_type g_events[NBR_EVENT_IDS] =
+{
+	[EVENT_ETH_CONNECTED] =		{ "CONNECT",	LOG_INFO,		"Ethernet connection %d established",			10,	1 },
+	[EVENT_ETH_REFUSED] =		{ "REFUSED",	LOG_WARNING,	"Ethernet connection refused, %d clients connected",	1,	1 },
+	[EVENT_ETH_CLOSED] =		{ "CLOSE",		LOG_INFO,		"Ethernet connection %d closed",				10,	1 },
+	[EVENT_ETH_IDLE_CLOSED] =	{ "IDLE",		LOG_INFO,		"Closing idle Ethernet connection %d",			10,	1 },
+	[EVENT_ETH_RX] =			{ "RX",			LOG_DEBUG,		"Rx %d: %d bytes -",							20,	1 },
+	[EVENT_ETH_SLOW_CLIENT] =	{ "SLOW",		LOG_WARNING,	"Ethernet client %d too slow, %d bytes pending",	1,	1 },
+	[EVENT_ETH_LONG_COMMAND] =	{ "LONGCMD",	LOG_WARNING,	"Ethernet client %d sent a command longer than %d bytes",	1,	1 },
+	[EVENT_ETH_BAD_CRC] =		{ "BADCRC",		LOG_WARNING,	"Ethernet client %d sent a frame with a bad CRC",	1,	1 },
+	[EVENT_ETH_DENIED] =		{ "DENIED",		LOG_NOTICE,		"Local client %d (uid %d) may not change settings",	1,	1 },
+};
+
+static mpsc_queue_type g_queue;
+static _Atomic int g_verbosity = EVENT_LOG_DEFAULT_LEVEL;
+static _Atomic int g_max_per_s[NBR_EVENT_IDS];
+static _Atomic int g_sample_every[NBR_EVENT_IDS];
+static event_state_type g_states[NBR_EVENT_IDS];
+
+/* *** Function Declarations *** */
+static void Event_Log_Write( const event_log_record_type* pRecord );
+static void Event_Log_Report_Suppressed( int id, int64_t now_ms );
+
+/* *** Accessors *** */
+void Event_Log_Set_Verbosity( int level ) { atomic_store( &g_verbosity, level ); }
+int Event_Log_Get_Verbosity( void ) { return atomic_load( &g_verbosity ); }
+
+static inline int64_t Event_Log_Get_Time_Ms( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ((int64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/***************************************************************************************************
+Allocates the queue and loads the default rate limits
+
+Returns -1 on error
+		 1 on success
+***************************************************************************************************/
+int Event_Log_Init( void )
+{
+	int id;
+
+	if (Mpsc_Queue_Init( &g_queue, sizeof(event_log_record_type), EVENT_LOG_QUEUE_CAPACITY ) < 0)
+	{
+		printf("Error allocating the event log queue - %s.%u\n", __FILE__, __LINE__);
+		return -1;
+	}
+
+	for (id = 0; id < NBR_EVENT_IDS; id++)
+	{
+		atomic_init( &g_max_per_s[id], g_events[id].max_per_s );
+		atomic_init( &g_sample_every[id], g_events[id].sample_every );
+		memset(&g_states[id], 0, sizeof(g_states[id]));
+	}
+
+	return 1;
+}
+
+/***************************************************************************************************
+Returns the id of the event with the given name (case insensitive) or -1 if there is none
+***************************************************************************************************/
+int Event_Log_Find( const char* p_name )
+{
+	int id;
+
+	for (id = 0; id < NBR_EVENT_IDS; id++)
+	{
+		if (strcasecmp(p_name, g_events[id].name) == 0)
+			return id;
+	}
+
+	return -1;
+}
+
+/***************************************************************************************************
+Changes the rate limit and sampling of an event.  max_per_s 0 removes the limit, sample_every 1 logs
+every occurrence.
+
+Returns -1 if the event does not exist
+		 1 on success
+***************************************************************************************************/
+int Event_Log_Set_Rate_Limit( int id, int max_per_s, int sample_every )
+{
+	if ((id < 0) || (id >= NBR_EVENT_IDS))
+		return -1;
+
+	atomic_store( &g_max_per_s[id], (max_per_s > 0) ? max_per_s : 0 );
+	atomic_store( &g_sample_every[id], (sample_every > 1) ? sample_every : 1 );
+	return 1;
+}
+
+/***************************************************************************************************
+Queues an event.  Nothing is done for events above the verbosity.
+***************************************************************************************************/
+void Event_Log( event_id_type id, int32_t arg0, int32_t arg1 )
+{
+	Event_Log_Data( id, arg0, arg1, NULL, 0 );
+}
+
+void Event_Log_Data( event_id_type id, int32_t arg0, int32_t arg1, const uint8_t* p_data, int length )
+{
+	event_log_record_type record;
+
+	if (g_events[id].level > atomic_load_explicit( &g_verbosity, memory_order_relaxed ))
+		return;
+
+	record.id = (uint16_t)id;
+	record.arg0 = arg0;
+	record.arg1 = arg1;
+	record.timestamp_ms = Event_Log_Get_Time_Ms();
+	record.data_length = 0;
+
+	if ((p_data != NULL) && (atomic_load_explicit( &g_verbosity, memory_order_relaxed ) >= LOG_DEBUG))
+	{
+		record.data_length = (uint16_t)((length < EVENT_LOG_MAX_DATA) ? length : EVENT_LOG_MAX_DATA);
+		memcpy(record.data, p_data, record.data_length);
+	}
+
+	Mpsc_Queue_Push( &g_queue, &record );
+}
+
+/***************************************************************************************************
+Drains the event queue into syslog, applying sampling and rate limits.  Events lost because the
+queue was full are reported as well.
+***************************************************************************************************/
+void Event_Log_Service( void* shared_data_address )
+{
+	event_log_record_type record;
+	event_state_type* pState;
+	uint32_t reported_drops = 0;
+	uint32_t drops;
+	int64_t now_ms;
+	int max_per_s;
+	int sample_every;
+	int drained;
+	int id;
+
+	openlog("smpiethlog", LOG_ODELAY, LOG_USER);
+
+	while (1)
+	{
+		drained = 0;
+
+		while (Mpsc_Queue_Pop( &g_queue, &record ))
+		{
+			drained++;
+			if (record.id >= NBR_EVENT_IDS)
+				continue;
+
+			pState = &g_states[record.id];
+			sample_every = atomic_load_explicit( &g_sample_every[record.id], memory_order_relaxed );
+			if ((pState->occurrences++ % (uint32_t)sample_every) != 0)
+				continue;
+
+			if ((record.timestamp_ms - pState->window_start_ms) >= EVENT_LOG_RATE_WINDOW_MS)
+			{
+				Event_Log_Report_Suppressed( record.id, record.timestamp_ms );
+				pState->window_start_ms = record.timestamp_ms;
+			}
+
+			max_per_s = atomic_load_explicit( &g_max_per_s[record.id], memory_order_relaxed );
+			if ((max_per_s > 0) && (pState->logged >= max_per_s))
+			{
+				pState->suppressed++;
+				continue;
+			}
+
+			pState->logged++;
+			Event_Log_Write( &record );
+		}
+
+		// Summaries of windows that ended without a further occurrence of the event
+		now_ms = Event_Log_Get_Time_Ms();
+		for (id = 0; id < NBR_EVENT_IDS; id++)
+		{
+			if ((g_states[id].suppressed > 0) && ((now_ms - g_states[id].window_start_ms) >= EVENT_LOG_RATE_WINDOW_MS))
+				Event_Log_Report_Suppressed( id, now_ms );
+		}
+
+		drops = Mpsc_Queue_Dropped( &g_queue );
+		if (drops != reported_drops)
+		{
+			syslog(LOG_WARNING, "Event log queue full, %u events lost", drops - reported_drops);
+			reported_drops = drops;
+		}
+
+		if (drained == 0)
+			usleep(EVENT_LOG_SERVICE_RATE_US);
+	}
+}
+
+/***************************************************************************************************
+Logs the number of occurrences of an event dropped by the rate limit and starts a new window
+***************************************************************************************************/
+static void Event_Log_Report_Suppressed( int id, int64_t now_ms )
+{
+	event_state_type* pState = &g_states[id];
+
+	if (pState->suppressed > 0)
+		syslog(g_events[id].level, "%d %s events suppressed", pState->suppressed, g_events[id].name);
+
+	pState->window_start_ms = now_ms;
+	pState->logged = 0;
+	pState->suppressed = 0;
+}
+
+/***************************************************************************************************
+Formats one event, followed by a hex dump of its data if it has any
+***************************************************************************************************/
+static void Event_Log_Write( const event_log_record_type* pRecord )
+{
+	static const char hex_digits[] = "0123456789ABCDEF";
+	const event_definition_type* pEvent = &g_events[pRecord->id];
+	char message[EVENT_LOG_MESSAGE_SIZE];
+	char hex[5] = { ' ', '0', 'x', 0, 0 };
+	str_builder_type builder;
+	int i;
+
+	Str_Builder_Init( &builder, message, sizeof(message), NULL, NULL );
+	Str_Builder_Printf( &builder, pEvent->format, (int)pRecord->arg0, (int)pRecord->arg1 );
+
+	for (i = 0; i < pRecord->data_length; i++)
+	{
+		hex[3] = hex_digits[pRecord->data[i] >> 4];
+		hex[4] = hex_digits[pRecord->data[i] & 0x0F];
+		Str_Builder_Append_N( &builder, hex, sizeof(hex) );
+	}
+
+	syslog(pEvent->level, "%s", Str_Builder_Get( &builder ));
+}
+
+/* *** End of File *** */
@@ -0,0 +1,52 @@
+#ifndef __EVENT_LOG_H
+#define __EVENT_LOG_H
+
+#include <stdint.h>
+#include <syslog.h>				// For the LOG_ levels
+
+#define EVENT_LOG_MAX_DATA			40			// Bytes of packet data kept for a hex dump
+#define EVENT_LOG_DEFAULT_LEVEL		LOG_INFO
+
+/***************************************************************************************************
+Events that can be logged.  The level, message, rate limit and sampling of each one are defined in
+the event table of event_log.c.
+***************************************************************************************************/
+typedef enum
+{
+	EVENT_ETH_CONNECTED = 0,			// arg0: connection slot
+	EVENT_ETH_REFUSED,					// arg0: clients connected
+	EVENT_ETH_CLOSED,					// arg0: connection slot
+	EVENT_ETH_IDLE_CLOSED,				// arg0: connection slot
+	EVENT_ETH_RX,						// arg0: connection slot, arg1: bytes read, data: the bytes
+	EVENT_ETH_SLOW_CLIENT,				// arg0: connection slot, arg1: bytes pending
+	EVENT_ETH_LONG_COMMAND,				// arg0: connection slot, arg1: longest command accepted
+	EVENT_ETH_BAD_CRC,					// arg0: connection slot
+	EVENT_ETH_DENIED,					// arg0: connection slot, arg1: user id of the local client
+
+	NBR_EVENT_IDS,
+} event_id_type;
+
+// One queued event
+typedef struct
+{
+	uint16_t id;								// event_id_type
+	uint16_t data_length;						// Bytes used in data
+	int32_t arg0;
+	int32_t arg1;
+	int64_t timestamp_ms;						// CLOCK_MONOTONIC when the event happened
+	uint8_t data[EVENT_LOG_MAX_DATA];
+} event_log_record_type;
+
+int Event_Log_Init( void );
+void Event_Log_Service( void* shared_data_address );
+
+// Producer side, may be called from any thread.  Events below the verbosity are dropped on the spot.
+void Event_Log( event_id_type id, int32_t arg0, int32_t arg1 );
+void Event_Log_Data( event_id_type id, int32_t arg0, int32_t arg1, const uint8_t* p_data, int length );
+
+void Event_Log_Set_Verbosity( int level );
+int Event_Log_Get_Verbosity( void );
+int Event_Log_Find( const char* p_name );
+int Event_Log_Set_Rate_Limit( int id, int max_per_s, int sample_every );
+
+#endif //__EVENT_LOG_H
@@ -1,125 +1,89 @@
 /***************************************************************************************************
 File FIFO
 
-This thread opens files to read input commands, write output responses, and write error outputs for
-control via external applications.
+Named pipes for control by scripts and other programs on the Pi:
+
+	SMPI_INPFIFO	command lines, e.g. echo "SETTEMP=225" > /tmp/smpiinp
+	SMPI_OUTFIFO	"1\n<response>\n" for every command that succeeded, "-1\n" otherwise
+	SMPI_ERRFIFO	why a command failed
+
+A single thread serves all three pipes with poll().  Like pigpiod, it keeps the input pipe open
+read-write, so writers may come and go without it ever reaching end of file.  Every read may hold
+several commands, each is run as soon as its line is complete.
+
+The output pipes are only opened while somebody reads them, so replies never wait in a pipe for a
+later reader they were not meant for.  A reply for which no reader turns up within
+FILE_FIFO_REPLY_HOLD_MS is dropped, which leaves time for "echo ... > /tmp/smpiinp; cat /tmp/smpiout".
+Replies the reader does not take at once are queued and written when poll() reports the pipe
+writable again.  A reader too slow for its writer loses the oldest queued replies, whole ones, and
+commands are always read, so the pipes never stop serving commands nobody waits the replies of.
 ***************************************************************************************************/
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <pthread.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <unistd.h>
 #include <signal.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/stat.h>
-#include <stdbool.h>
-#include "thermistor.h"
-#include "tlc1543.h"
-#include "servo.h"
-#include "app.h"
 #include "main.h"
-#include "rev_history.h"
 #include "file_fifo.h"
-
-typedef struct 
+#include "telemetry.h"
+#include "str_builder.h"
+#include "cmd_registry.h"
+
+/* **** Defined Values *** */
+#define FILE_FIFO_MAX_COMMAND		256			// Longer command lines are discarded
+#define FILE_FIFO_READ_SIZE			1024
+#define FILE_FIFO_CHUNK_SIZE		1024		// Large responses are queued in chunks of this size
+#define FILE_FIFO_QUEUE_INITIAL		4096
+#define FILE_FIFO_QUEUE_MAX			(256 * 1024)	// The oldest replies are dropped beyond this...
+#define FILE_FIFO_MAX_REPLIES		256			// ...or beyond this many
+#define FILE_FIFO_REPLY_HOLD_MS		250			// How long a reply waits for a reader to open its pipe
+#define FILE_FIFO_RETRY_MS			50			// Period of the checks for a reader while replies wait
+
+/* **** Data Types *** */
+// An output pipe and the replies it did not take yet
+typedef struct
 {
-	char* cmd;
-	char* description;	
-} cmd_type;
-
-/* **** Global Data **** */
-
-/* *** Global Variables *** */
-typedef enum 
-{
-	CMD_GET_VERSION = 0,
-	CMD_EXIT,
-	CMD_SET_CAB_TEMP,
-	CMD_GET_CAB_TEMP,
-	CMD_SET_PROBE_TARGET_TEMP,
-	CMD_GET_PROBE_TARGET_TEMP,
-	CMD_GET_PROBE_TEMP,
-	CMD_GET_ALL_TEMPS,
-	CMD_SET_CHANNEL_NAME,
-	CMD_GET_CHANNEL_NAMES,
-	CMD_SET_P_GAIN,
-	CMD_SET_I_GAIN,
-	CMD_SET_I_LIMIT,
-	CMD_GET_P_GAIN,
-	CMD_GET_I_GAIN,
-	CMD_GET_I_LIMIT,
-
-	NBR_OF_CMDS,
-	CMD_UNKNOWN=-1
-} cmd_id_type;
-
-static const cmd_type cmd_list[NBR_OF_CMDS] = {
-	{ "VER",					"Gets the firmware versioninformation\n"	},
-	{ "EXIT",					"Closes the program\n"						},
-	{ "SET_CABINET_TARGET",		"Set the target cabinet temperature\n" 		},
-	{ "GET_CABINET_TARGET",		"Gets the target cabinet temperature\n"		},
-	{ "SET_PROBE_TARGET",		"Set the target channel temperature\n"		},
-	{ "GET_PROBE_TARGET",		"Gets the target channel temperature\n"		},
-	{ "GET_PROBE_TEMP",			"Gets the current probe temperature\n"		},
-	{ "GET_ALL_TEMPS",		"Gets the temperature of all sensors\n"		},
-	{ "SET_CHANNEL_NAME",		"Set the name of the target channel\n"		},
-	{ "GET_CHANNEL_NAMES",		"Gets the names of all probe channels\n"		},
-	{ "SET_KP",					"Set proportaional gain\n"					},
-	{ "SET_KI",					"Set integral gain\n"						},
-	{ "SET_KL",					"Set integral limit\n"						},
-	{ "GET_KP",					"Gets the proportional gain\n"				},
-	{ "GET_KI",					"Gets the integral gain\n"					},
-	{ "GET_KL",					"Gets the integral windup limit\n"			},
-};
-
+	const char* p_path;
+	int fd;										// -1 while nobody reads the pipe
+	char* p_queue;
+	int queue_offset;							// First byte of p_queue still to be written
+	int queue_length;							// Bytes of p_queue in use, including written ones
+	int queue_size;
+	int reply_ends[FILE_FIFO_MAX_REPLIES];		// Where each complete reply in p_queue ends, oldest first
+	int nbr_replies;
+	int head_start;								// Where the oldest reply in p_queue starts
+	int64_t hold_until_ms;						// Queued replies are dropped if no reader turns up by then, 0 if none wait
+	uint32_t dropped;							// Replies lost for want of a reader or of room
+} file_fifo_output_type;
 
 /* **** Global Variables *** */
+static int g_input_fd = -1;
+static file_fifo_output_type g_output = { SMPI_OUTFIFO, -1 };
+static file_fifo_output_type g_errout = { SMPI_ERRFIFO, -1 };
 
-// Pointer to the shared data
-shared_data_type* gp_shared_data;
-
-// File handlers for the named pipes
-static FILE *g_fifo_output;
-static FILE *g_fifo_input;
-static FILE *g_fifo_errout;
-
-// Buffer for reading files
-static char g_in_buffer[1024];		// Buffer for holding incoming data
-static char g_out_buffer[1024];		// Buffer for holding outgoing data
-static char g_err_buffer[1024];		// Buffer for holding output error
-
-static int g_write_data_bytes = 0;
-static int g_write_error_data_bytes = 0;
+static char g_cmd_buffer[FILE_FIFO_MAX_COMMAND];	// Command being assembled from the input
+static int g_cmd_length = 0;
+static bool g_cmd_overflow = false;				// Discarding the remainder of an overlong command
+static bool g_response_started = false;			// "1\n" was queued for the command being run
 
 static void File_Fifo_Process_Cmd( char* cmd_buff );
-static void File_Fifo_Signal_Handler( int signalnum );
-
-	// Command processing functions
-static void File_Fifo_Set_Cook_Temp( char* tokens );
-static void File_Fifo_Set_P_Gain( char* tokens );
-static void File_Fifo_Set_I_Gain( char* tokens );
-static void File_Fifo_Set_I_Limit( char* tokens );
-static void File_Fifo_Get_Probe_Temp( char* tokens );
-static void File_Fifo_Get_Cook_Temp( void );
-static void File_Fifo_Get_P_Gain( void );
-static void File_Fifo_Get_I_Gain( void );
-static void File_Fifo_Get_I_Limit( void );
-static void File_Fifo_Get_All_Probe_Temps( void );
-static void File_Fifo_Get_Probe_Temp( char* tokens );
-static void File_Fifo_Set_Channel_Name( char* tokens );
-static void File_Fifo_Get_Channel_Names( void );
 
 /***************************************************************************************************
-Sets up the named pipes for receiving commands, sending responses, and reporting errors.
+Sets up the named pipes for receiving commands, sending responses, and reporting errors, and opens
+the input pipe for the service.
 
-Returns -1 on error opening files
-		 1 on successful opening of files
+Returns -1 on error creating or opening the pipes
+		 1 on success
 ***************************************************************************************************/
 int File_Fifo_Init( void )
 {
-	int result = 0;
-
 	// attempt to remove the files in case they are already present
 	remove(SMPI_INPFIFO);
 	remove(SMPI_OUTFIFO);
@@ -127,438 +91,357 @@ int File_Fifo_Init( void )
 
 	// Create the fifos
 	if (mkfifo(SMPI_INPFIFO, 0777) || mkfifo(SMPI_OUTFIFO, 0777) || mkfifo(SMPI_ERRFIFO, 0777))
-		result = -1;
-	else
-		result = 1;
+		return -1;
+
+	// The output pipes are opened when they have a reader, see File_Fifo_Open_Output()
+	g_input_fd = open(SMPI_INPFIFO, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (g_input_fd < 0)
+	{
+		printf("Error opening the named pipes - %s.%u\n", __FILE__, __LINE__);
+		return -1;
+	}
 
-	return result;
+	return 1;
 }
 
-void File_Fifo_Service_Input( void *shared_data_address )
+/***************************************************************************************************
+Forgets every queued reply and closes the pipe, whose reader left or never came
+***************************************************************************************************/
+static void File_Fifo_Close_Output( file_fifo_output_type* pOutput )
 {
-	int rd_index;
-	char ch;
-
-	gp_shared_data = (shared_data_type*)shared_data_address;
-
-	signal(SIGINT, File_Fifo_Signal_Handler);
-	signal(SIGPIPE, SIG_IGN);
-	
-	while (1)
+	if (pOutput->fd >= 0)
 	{
-		g_fifo_input = fopen(SMPI_INPFIFO, "r");
+		close(pOutput->fd);
+		pOutput->fd = -1;
+	}
+
+	pOutput->dropped += pOutput->nbr_replies;
+	pOutput->queue_offset = 0;
+	pOutput->queue_length = 0;
+	pOutput->nbr_replies = 0;
+	pOutput->head_start = 0;
+	pOutput->hold_until_ms = 0;
+}
 
-		rd_index = 0;
-		g_in_buffer[0] = 0;
-		do {
-			ch = fgetc(g_fifo_input);
-			g_in_buffer[rd_index++] = ch;
-		} while ((ch != '\n') && (rd_index < sizeof(g_in_buffer)));
+/***************************************************************************************************
+Opens an output pipe if somebody reads it.  The first reply without a reader starts the time it may
+wait for one.
 
-		File_Fifo_Process_Cmd( g_in_buffer );
+Returns -1 if nobody reads the pipe
+		 1 if it is open
+***************************************************************************************************/
+static int File_Fifo_Open_Output( file_fifo_output_type* pOutput )
+{
+	if (pOutput->fd >= 0)
+		return 1;
 
-		fclose(g_fifo_input);
+	pOutput->fd = open(pOutput->p_path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	if (pOutput->fd >= 0)
+	{
+		pOutput->hold_until_ms = 0;
+		return 1;
 	}
+
+	if (pOutput->hold_until_ms == 0)
+		pOutput->hold_until_ms = Telemetry_Get_Time_Ns( CLOCK_MONOTONIC ) / 1000000 + FILE_FIFO_REPLY_HOLD_MS;
+	return -1;
 }
 
-void File_Fifo_Service_Output( void *shared_data_address )
+/***************************************************************************************************
+Drops the oldest reply that was not started yet, a reply is never cut
+
+Returns -1 if every queued reply was started or there are none
+		 1 on success
+***************************************************************************************************/
+static int File_Fifo_Drop_Oldest( file_fifo_output_type* pOutput )
 {
+	int index = (pOutput->queue_offset > pOutput->head_start) ? 1 : 0;
+	int start;
+	int length;
 	int i;
 
-	gp_shared_data = (shared_data_type*)shared_data_address;
-
-	signal(SIGINT, File_Fifo_Signal_Handler);
-	signal(SIGPIPE, SIG_IGN);
+	if (index >= pOutput->nbr_replies)
+		return -1;
 
-	while (1)
-	{
-		g_fifo_output = fopen(SMPI_OUTFIFO, "w");
+	start = (index == 0) ? pOutput->head_start : pOutput->reply_ends[0];
+	length = pOutput->reply_ends[index] - start;
 
-		while (g_fifo_output)
-		{
-			if (g_write_data_bytes > 0)
-			{
-				i = 0;
-				while (i < g_write_data_bytes)
-					fputc(g_out_buffer[i++], g_fifo_output);
-				fflush(g_fifo_output);
-				g_write_data_bytes = 0;
-			}
-			else
-				usleep(1000);
-		}
-	}
-}
-
-void File_Fifo_Respond( char* pResponse )
-{
-	strcpy(g_out_buffer, pResponse);
-	g_write_data_bytes = strlen(pResponse);
-}
+	memmove(&pOutput->p_queue[start], &pOutput->p_queue[start + length], pOutput->queue_length - start - length);
+	pOutput->queue_length -= length;
+	for (i = index; i < (pOutput->nbr_replies - 1); i++)
+		pOutput->reply_ends[i] = pOutput->reply_ends[i + 1] - length;
+	pOutput->nbr_replies--;
+	pOutput->dropped++;
 
-void File_Fifo_Report_Error( char* pError )
-{
-	strcpy( g_err_buffer, pError );
-	g_write_error_data_bytes = strlen(pError);
+	return 1;
 }
 
 /***************************************************************************************************
-This function accepts a command buffer containing ascii data.  It tokenizes the string then
-identifies the command passed to it.
+Writes as much of the queue of an output pipe as the pipe takes
 ***************************************************************************************************/
-static void File_Fifo_Process_Cmd( char* cmd_buff )
+static void File_Fifo_Write_Pending( file_fifo_output_type* pOutput )
 {
-	char* cmd;
-	char* tokens;
-	int cmd_nbr;
-	char buffer[50];
-	
-	cmd = strtok(cmd_buff, " \n");	// cmd will now point to the CMD in the input buffer
-	
-	if (cmd)
+	int written;
+
+	while (pOutput->queue_offset < pOutput->queue_length)
 	{
-		tokens = strtok(NULL, " \n");
-	
-		for (cmd_nbr = 0; cmd_nbr < NBR_OF_CMDS; cmd_nbr++)
+		written = write(pOutput->fd, &pOutput->p_queue[pOutput->queue_offset], pOutput->queue_length - pOutput->queue_offset);
+		if (written < 0)
 		{
-			if (strcasecmp(cmd, cmd_list[cmd_nbr].cmd) == 0)
-				break;
+			if (errno == EINTR)
+				continue;
+			if (errno == EPIPE)
+				File_Fifo_Close_Output( pOutput );
+			break;								// Full, poll() tells when it drained
 		}
+		pOutput->queue_offset += written;
 	}
-	else
-		cmd_nbr = -1;
 
-	switch (cmd_nbr)
+	// Complete replies are forgotten once written
+	while ((pOutput->nbr_replies > 0) && (pOutput->reply_ends[0] <= pOutput->queue_offset))
 	{
-		default:
-		case CMD_UNKNOWN:
-			File_Fifo_Respond("-1\n");
-			break;
-
-		case CMD_GET_VERSION:
-			sprintf(buffer, "1\n%d.%d.%d\n", FIRMWARE_MAJOR, FIRMWARE_MINOR, FIRMWARE_REVISION);
-			File_Fifo_Respond(buffer);
-			break;
-	
-		case CMD_EXIT:
-		case CMD_SET_PROBE_TARGET_TEMP:
-		case CMD_GET_PROBE_TARGET_TEMP:
-			File_Fifo_Respond("-1\n");
-			File_Fifo_Report_Error("Cmd not implemented\n");
-			break;
-
-		case CMD_SET_CHANNEL_NAME:
-			File_Fifo_Set_Channel_Name( tokens );
-			break;
-
-		case CMD_GET_CHANNEL_NAMES:	
-			File_Fifo_Get_Channel_Names();
-			break;
-
-		case CMD_SET_CAB_TEMP:
-			File_Fifo_Set_Cook_Temp( tokens );
-			break;
-
-		case CMD_GET_CAB_TEMP:
-			File_Fifo_Get_Cook_Temp();
-			break;
-
-		case CMD_GET_PROBE_TEMP:
-			File_Fifo_Get_Probe_Temp( tokens );
-			break;
-
-		case CMD_GET_ALL_TEMPS:
-			File_Fifo_Get_All_Probe_Temps();
-			break;
-		
-		case CMD_SET_P_GAIN:
-			File_Fifo_Set_P_Gain( tokens );
-			break;
-		
-		case CMD_SET_I_GAIN:
-			File_Fifo_Set_I_Gain( tokens );
-			break;
-		
-		case CMD_SET_I_LIMIT:
-			File_Fifo_Set_I_Limit( tokens );
-			break;
-	
-		case CMD_GET_P_GAIN:
-			File_Fifo_Get_P_Gain();
-			break;
-	
-		case CMD_GET_I_GAIN:
-			File_Fifo_Get_I_Gain();
-			break;
-
-		case CMD_GET_I_LIMIT:
-			File_Fifo_Get_I_Limit();
-			break;
+		pOutput->head_start = pOutput->reply_ends[0];
+		memmove(&pOutput->reply_ends[0], &pOutput->reply_ends[1], (pOutput->nbr_replies - 1) * sizeof(int));
+		pOutput->nbr_replies--;
 	}
-}
-
-/***************************************************************************************************
-This function takes a pointer to an ASCII floating point value and sets the cabinet temperature to
-that value.
-***************************************************************************************************/
-static void File_Fifo_Set_Cook_Temp( char* tokens )
-{
-	float new_temp = 0.0;
-	char buffer[50];
-	int response;
 
-	if (tokens != NULL)
-	{
-		sscanf(tokens, "%f", &new_temp);
-		App_Set_Cabinet_Setpoint( new_temp );
-		response = 0;
-	}
-	else
+	if ((pOutput->queue_offset == pOutput->queue_length) && (pOutput->nbr_replies == 0))
 	{
-		strcpy(buffer, "Error:  Tokens - Set Cook Temp\n");
-		File_Fifo_Report_Error(buffer);
-		response = -1;
+		pOutput->queue_offset = 0;
+		pOutput->queue_length = 0;
+		pOutput->head_start = 0;
 	}
-
-	sprintf(buffer, "%d\n", response);
-	File_Fifo_Respond(buffer);
 }
 
 /***************************************************************************************************
-This function takes a pointer to an ASCII floating point value and sets the P gain to that value.
+Queues data of the reply being formatted for an output pipe, and writes what the pipe takes.  The
+oldest replies make room when the queue is full.
 ***************************************************************************************************/
-static void File_Fifo_Set_P_Gain( char* tokens )
+static void File_Fifo_Send( file_fifo_output_type* pOutput, const char* pData, int length )
 {
-	float new_gain = 0.0;
-	char buffer[50];
-	int response;
+	char* p_new_queue;
+	int new_size;
+	int i;
 
-	if (tokens != NULL)
+	if (g_input_fd < 0)
+		return;									// Not initialized, e.g. in the benchmarks
+
+	// Written bytes are only kept while they belong to a reply still being written
+	if (pOutput->head_start > 0)
 	{
-		sscanf(tokens, "%f", &new_gain);
-		App_Set_Kp( new_gain );
-		response = 0;
+		memmove(pOutput->p_queue, &pOutput->p_queue[pOutput->head_start], pOutput->queue_length - pOutput->head_start);
+		for (i = 0; i < pOutput->nbr_replies; i++)
+			pOutput->reply_ends[i] -= pOutput->head_start;
+		pOutput->queue_offset -= pOutput->head_start;
+		pOutput->queue_length -= pOutput->head_start;
+		pOutput->head_start = 0;
 	}
-	else
+
+	while (((pOutput->queue_length + length) > FILE_FIFO_QUEUE_MAX) && (File_Fifo_Drop_Oldest( pOutput ) > 0))
+		;
+	if ((pOutput->queue_length + length) > FILE_FIFO_QUEUE_MAX)
+		return;									// A reply this long is cut
+
+	if ((pOutput->queue_length + length) > pOutput->queue_size)
 	{
-		strcpy(buffer, "Error:  Tokens - Set P Gain\n");
-		File_Fifo_Report_Error(buffer);
-		response = -1;
+		new_size = (pOutput->queue_size == 0) ? FILE_FIFO_QUEUE_INITIAL : pOutput->queue_size;
+		while (new_size < (pOutput->queue_length + length))
+			new_size *= 2;
+		if (new_size > FILE_FIFO_QUEUE_MAX)
+			new_size = FILE_FIFO_QUEUE_MAX;
+
+		p_new_queue = realloc(pOutput->p_queue, new_size);
+		if (p_new_queue == NULL)
+			return;
+		pOutput->p_queue = p_new_queue;
+		pOutput->queue_size = new_size;
 	}
 
-	sprintf(buffer, "%d\n", response);
-	File_Fifo_Respond(buffer);
+	memcpy(&pOutput->p_queue[pOutput->queue_length], pData, length);
+	pOutput->queue_length += length;
+
+	if (File_Fifo_Open_Output( pOutput ) > 0)
+		File_Fifo_Write_Pending( pOutput );
 }
 
 /***************************************************************************************************
-This function takes a pointer to an ASCII floating point value and sets the I gain to that value.
+Marks the end of a reply in the queue of an output pipe
 ***************************************************************************************************/
-static void File_Fifo_Set_I_Gain( char* tokens )
+static void File_Fifo_End_Reply( file_fifo_output_type* pOutput )
 {
-	float new_gain = 0.0;
-	char buffer[50];
-	int response;
+	int last_end = (pOutput->nbr_replies > 0) ? pOutput->reply_ends[pOutput->nbr_replies - 1] : pOutput->head_start;
 
-	if (tokens != NULL)
-	{
-		sscanf(tokens, "%f", &new_gain);
-		App_Set_Ki( new_gain );
-		response = 0;
-	}
-	else
+	if (pOutput->queue_length == last_end)
+		return;									// Written already, or nothing was queued
+
+	if ((pOutput->nbr_replies == FILE_FIFO_MAX_REPLIES) && (File_Fifo_Drop_Oldest( pOutput ) < 0))
 	{
-		strcpy(buffer, "Error:  Tokens - Set I Gain\n");
-		File_Fifo_Report_Error(buffer);
-		response = -1;
+		File_Fifo_Close_Output( pOutput );		// Every one was started, which cannot happen
+		return;
 	}
 
-	sprintf(buffer, "%d\n", response);
-	File_Fifo_Respond(buffer);
+	pOutput->reply_ends[pOutput->nbr_replies++] = pOutput->queue_length;
+	File_Fifo_Write_Pending( pOutput );
 }
 
 /***************************************************************************************************
-This function takes a pointer to an ASCII floating point value and sets the I windup limit to that 
-value.
+Checks an output pipe after poll(): writes its queue when it drained, closes it when its reader
+left, and drops the replies that waited too long for a reader
+
+Returns true while replies wait for a reader to open the pipe
 ***************************************************************************************************/
-static void File_Fifo_Set_I_Limit( char* tokens )
+static bool File_Fifo_Service_Output( file_fifo_output_type* pOutput, short revents )
 {
-	float new_gain = 0.0;
-	char buffer[50];
-	int response;
+	if ((pOutput->fd >= 0) && (revents & (POLLERR | POLLHUP)))
+		File_Fifo_Close_Output( pOutput );
+	else if ((pOutput->fd >= 0) && (revents & POLLOUT))
+		File_Fifo_Write_Pending( pOutput );
+
+	if ((pOutput->fd >= 0) || (pOutput->queue_length == 0))
+		return false;
 
-	if (tokens != NULL)
+	if (File_Fifo_Open_Output( pOutput ) > 0)
 	{
-		sscanf(tokens, "%f", &new_gain);
-		App_Set_Kl( new_gain );
-		response = 0;
+		File_Fifo_Write_Pending( pOutput );
+		return false;
 	}
-	else
+
+	if ((Telemetry_Get_Time_Ns( CLOCK_MONOTONIC ) / 1000000) >= pOutput->hold_until_ms)
 	{
-		strcpy(buffer, "Error:  Tokens - Set I Limit\n");
-		File_Fifo_Report_Error(buffer);
-		response = -1;
+		File_Fifo_Close_Output( pOutput );
+		return false;
 	}
 
-	sprintf(buffer, "%d\n", response);
-	File_Fifo_Respond(buffer);
+	return true;
 }
 
-static void File_Fifo_Get_Cook_Temp( void )
-{
-	char buffer[50];
-	float temperature;
-
-	temperature = App_Get_Cabinet_Setpoint();
-	sprintf(buffer, "1\n%4.2f\n", temperature);
-	File_Fifo_Respond(buffer);
-}
-
-static void File_Fifo_Get_P_Gain( void )
+/***************************************************************************************************
+Runs every complete command line of the data read, keeping a partial line for the next read
+***************************************************************************************************/
+static void File_Fifo_Receive( const char* pData, int bytes )
 {
-	char buffer[50];
-	float gain;
-
-	gain = App_Get_Kp();
-	sprintf(buffer, "1\n%4.2f\n", gain);
-	File_Fifo_Respond(buffer);
-}
+	int i;
 
-static void File_Fifo_Get_I_Gain( void )
-{
-	char buffer[50];
-	float gain;
+	for (i = 0; i < bytes; i++)
+	{
+		if (pData[i] == '\n')
+		{
+			if (g_cmd_overflow)
+			{
+				File_Fifo_Send( &g_errout, "Command too long\n", 17 );
+				File_Fifo_End_Reply( &g_errout );
+				File_Fifo_Send( &g_output, "-1\n", 3 );
+				File_Fifo_End_Reply( &g_output );
+			}
+			else
+			{
+				if ((g_cmd_length > 0) && (g_cmd_buffer[g_cmd_length - 1] == '\r'))
+					g_cmd_length--;
+				g_cmd_buffer[g_cmd_length] = '\0';
+				if (g_cmd_length > 0)
+					File_Fifo_Process_Cmd( g_cmd_buffer );
+			}
 
-	gain = App_Get_Ki();
-	sprintf(buffer, "1\n%4.2f\n", gain);
-	File_Fifo_Respond(buffer);
+			g_cmd_length = 0;
+			g_cmd_overflow = false;
+		}
+		else if (g_cmd_length < (FILE_FIFO_MAX_COMMAND - 1))
+			g_cmd_buffer[g_cmd_length++] = pData[i];
+		else
+			g_cmd_overflow = true;
+	}
 }
 
-static void File_Fifo_Get_I_Limit( void )
+/***************************************************************************************************
+Serves the named pipes: waits in poll() for commands, for room in the output pipes while replies are
+queued, and for their readers to leave.  While replies wait for a reader, poll() times out to look
+for one.
+***************************************************************************************************/
+void File_Fifo_Service( void *shared_data_address )
 {
-	char buffer[50];
-	float limit;
+	char buffer[FILE_FIFO_READ_SIZE];
+	struct pollfd fds[3];
+	bool waiting = false;
+	int bytes_read;
 
-	limit = App_Get_Kl();
-	sprintf(buffer, "1\n%4.2f\n", limit);
-	File_Fifo_Respond(buffer);
-}
+	signal(SIGPIPE, SIG_IGN);
 
-static void File_Fifo_Get_Probe_Temp( char* tokens )
-{
-	char buffer[50];
-	float temperature;
-	int response;
-	int channel;
+	fds[0].fd = g_input_fd;
+	fds[0].events = POLLIN;
 
-	if (tokens != NULL)
+	while (1)
 	{
-		sscanf(tokens, "%d", &channel);
-		if ((channel >= 0) && (channel < NBR_OF_THERMISTORS))
+		fds[1].fd = g_output.fd;				// poll() ignores a pipe without a reader, fd -1
+		fds[1].events = (g_output.queue_offset < g_output.queue_length) ? POLLOUT : 0;
+		fds[1].revents = 0;
+		fds[2].fd = g_errout.fd;
+		fds[2].events = (g_errout.queue_offset < g_errout.queue_length) ? POLLOUT : 0;
+		fds[2].revents = 0;
+
+		if (poll(fds, 3, waiting ? FILE_FIFO_RETRY_MS : -1) < 0)
 		{
-			pthread_mutex_lock(&mutex);
-			temperature = gp_shared_data->temp_deg_f[channel];
-			pthread_mutex_unlock(&mutex);
-			response = 1;
+			if (errno != EINTR)
+			{
+				printf("Error waiting for the named pipes - %s.%u\n", __FILE__, __LINE__);
+				return;
+			}
+			continue;
 		}
-		else
+
+		if (fds[0].revents & POLLIN)
 		{
-			response = -1;	
+			while ((bytes_read = read(g_input_fd, buffer, sizeof(buffer))) > 0)
+				File_Fifo_Receive( buffer, bytes_read );
 		}
-	}
-	else
-	{
-		strcpy(buffer, "Error:  Tokens - Get Probe Temp\n");
-		File_Fifo_Report_Error(buffer);
-		response = -1;
-	}
 
-	if (response == 1)
-		sprintf(buffer, "%d\n%4.2f\n", response, temperature);
-	else
-		sprintf(buffer, "%d\n", response);
-	File_Fifo_Respond(buffer);
-}
-
-static void File_Fifo_Set_Channel_Name( char* tokens )
-{
-	int response;
-	int channel;
-	char buffer[128];
-	char name[128];
-
-	if (tokens != NULL)
-	{
-		sscanf(tokens, "%d", &channel);
-		tokens = strtok(NULL, " \n");
-		if (strlen(tokens) < (sizeof(name)-1))
-			strcpy(name, tokens);
-		App_Set_Channel_Name( channel, name );
-		response = 0;
-	}
-	else
-	{
-		response = -1;
+		waiting = File_Fifo_Service_Output( &g_output, fds[1].revents );
+		waiting = File_Fifo_Service_Output( &g_errout, fds[2].revents ) || waiting;
 	}
-
-	sprintf(buffer, "%d\n", response);
-	File_Fifo_Respond(buffer);
 }
 
-static void File_Fifo_Get_Channel_Names( void )
+/***************************************************************************************************
+Flush function of the response builder.  The success marker goes out ahead of the first chunk, a
+command writing that much has succeeded.
+***************************************************************************************************/
+static void File_Fifo_Stream_Send( void* pContext, const char* p_data, int length )
 {
-	int i;
-	char buffer[1024] = { 0 };
-	char* name;
-	
-	strcpy( buffer, "1\n" );
-	for (i = 0; i < NBR_OF_THERMISTORS; i++)
+	if (!g_response_started)
 	{
-		name = App_Get_Channel_Name( i );
-		sprintf(buffer, "%s%s,", buffer, name);
+		File_Fifo_Send( &g_output, "1\n", 2 );
+		g_response_started = true;
 	}
 
-	// convert the ',' at the end of the string to a '\n'
-	buffer[strlen(buffer)-1] = '\n';
-	File_Fifo_Respond(buffer);
+	File_Fifo_Send( &g_output, p_data, length );
 }
 
-
-static void File_Fifo_Get_All_Probe_Temps( void )
+/***************************************************************************************************
+Runs one command line through the command registry.  The response is "1\n<response>\n" on success
+and "-1\n" otherwise, in which case the reason is written to the error pipe.
+***************************************************************************************************/
+static void File_Fifo_Process_Cmd( char* cmd_buff )
 {
-	char buffer[150];
-	int channel;
+	char buffer[FILE_FIFO_CHUNK_SIZE];
+	str_builder_type builder;
+	int result;
 
-	strcpy(buffer, "1\n");
-	pthread_mutex_lock(&mutex);
-	for (channel = 0; channel < NBR_OF_THERMISTORS; channel++)
-		sprintf(buffer, "%s%4.2f,", buffer, gp_shared_data->temp_deg_f[channel]);
-	pthread_mutex_unlock(&mutex);
+	g_response_started = false;
+	Str_Builder_Init( &builder, buffer, sizeof(buffer), File_Fifo_Stream_Send, NULL );
 
-	// Change the ',' at the end of the string to a '\n'
-	buffer[strlen(buffer)-1] = '\n';
+	result = Cmd_Registry_Execute( CMD_FRONTEND_FIFO, NULL, cmd_buff, &builder );
+	Str_Builder_Append_Char( &builder, '\n' );
 
-	File_Fifo_Respond(buffer);
-}
-
-
-/***************************************************************************************************
-When Ctrl+C is pressed to end the process, this function will catch the signal and close the file 
-stream before exiting the thread
-***************************************************************************************************/
-static void File_Fifo_Signal_Handler( int signalnum )
-{
-	switch (signalnum)
+	if ((result == CMD_RESULT_OK) || g_response_started)
+		Str_Builder_Flush( &builder );
+	else
 	{
-		case SIGINT:
-			if (g_fifo_input)
-				fclose(g_fifo_input);
-			if (g_fifo_output)
-				fclose(g_fifo_output);
-			if (g_fifo_errout)
-				fclose(g_fifo_errout);
-			exit(signalnum);
-			break;
+		if (result == CMD_RESULT_ERROR)
+			File_Fifo_Send( &g_errout, Str_Builder_Get( &builder ), Str_Builder_Length( &builder ) );
+		else
+			File_Fifo_Send( &g_errout, "Unknown command\n", 16 );
+		File_Fifo_End_Reply( &g_errout );
+		File_Fifo_Send( &g_output, "-1\n", 3 );
 	}
+	File_Fifo_End_Reply( &g_output );
 }
 
 /* *** End of File *** */
@@ -7,7 +7,6 @@
 
 int File_Fifo_Init( void );
 
-void File_Fifo_Service_Input( void *shared_data_address );
-void File_Fifo_Service_Output( void *shared_data_address );
+void File_Fifo_Service( void *shared_data_address );
 
 #endif //__FILE_FIFO_H
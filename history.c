@@ -0,0 +1,655 @@
+/***************************************************************************************************
+History
+
+Compressed in-memory history of the current and previous cook.  Every control tick is stored at full
+resolution and each channel is stored as a list of fixed size chunks using the encoding from
+Facebook's Gorilla time series database:
+
+	Timestamps - The first timestamp of a chunk is stored raw.  After that, the difference between
+				 consecutive deltas (delta of delta) is stored with a variable length prefix code.
+				 Control ticks are evenly spaced, so most timestamps cost a single bit.
+	Values	   - Each value is XORed with the previous value.  Identical values cost a single bit,
+				 otherwise only the meaningful bits of the XOR are stored, reusing the previous
+				 leading/trailing zero window when possible.
+
+Chunks are immutable once full, so a range query only decodes the chunks overlapping the request.
+
+Retention: the probe and fire filters run on every tick, so with one count of ADC noise most values
+change every tick.  A simulated cook takes about 17 bits per sample (timestamp included), or about
+19 MB per hour for all 13 channels at 200 samples per second, and 4 bits per sample without the ADC
+noise.  HISTORY_MAX_MEMORY_BYTES holds about 9 to 10 hours of a noisy cook.  Above it the previous cook
+is released first, then the oldest chunks of the current one.  The released samples are counted and
+reported by History_Get_Stats, the resolution of what is kept is never reduced.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include "main.h"
+#include "history.h"
+
+/* *** Defined Values *** */
+#define HISTORY_CHUNK_WORDS				128			// 1 KB of compressed data per chunk
+#define HISTORY_CHUNK_BITS				(HISTORY_CHUNK_WORDS * 64)
+#define HISTORY_MAX_SAMPLE_BITS			(4 + 32 + 2 + 5 + 5 + 32)	// Worst case encoding of one sample
+#define HISTORY_NO_WINDOW				0xFF
+
+/* *** Types *** */
+typedef struct
+{
+	int64_t first_ms;							// Time of the first sample in the chunk
+	int64_t last_ms;							// Time of the last sample in the chunk
+	uint32_t count;								// Number of samples in the chunk
+	uint32_t bit_count;							// Number of bits written to words[]
+
+	// Encoder state, needed to append the next sample
+	int64_t prev_delta;
+	uint32_t prev_value;
+	uint8_t prev_leading;
+	uint8_t prev_trailing;
+
+	uint64_t words[HISTORY_CHUNK_WORDS];
+} history_chunk_type;
+
+typedef struct
+{
+	history_chunk_type** p_chunks;				// Oldest chunk first
+	uint32_t nbr_chunks;
+	uint32_t size;
+} history_series_type;
+
+typedef struct
+{
+	const uint64_t* p_words;
+	uint32_t position;
+} history_bit_reader_type;
+
+// Samples returned by History_Query, in growable arrays
+typedef struct
+{
+	int64_t* p_times;
+	float* p_values;
+	int count;
+	int size;
+	bool failed;								// The arrays could not grow, samples were lost
+} history_arrays_type;
+
+/* *** Global Variables *** */
+static pthread_rwlock_t g_history_lock = PTHREAD_RWLOCK_INITIALIZER;
+static history_series_type g_series[NBR_HISTORY_COOKS][NBR_TELEMETRY_CHANNELS];
+static size_t g_memory_bytes;
+static uint64_t g_released_samples[NBR_HISTORY_COOKS];
+
+/* *** Function Declarations *** */
+static void History_Append_Sample( history_series_type* pSeries, int64_t timestamp_ms, float value );
+static void History_Release_Memory( void );
+static void History_Free_Cook( history_cook_type cook );
+
+/***************************************************************************************************
+Bit level helpers.  Bits are written most significant bit first into 64-bit words.
+***************************************************************************************************/
+static inline void History_Write_Bits( history_chunk_type* pChunk, uint64_t value, int nbr_bits )
+{
+	while (nbr_bits > 0)
+	{
+		int used = pChunk->bit_count & 63;
+		int room = 64 - used;
+		int n = (nbr_bits < room) ? nbr_bits : room;
+		uint64_t bits = (value >> (nbr_bits - n)) & ((n == 64) ? ~0ULL : ((1ULL << n) - 1));
+
+		pChunk->words[pChunk->bit_count >> 6] |= bits << (room - n);
+		pChunk->bit_count += n;
+		nbr_bits -= n;
+	}
+}
+
+static inline uint64_t History_Read_Bits( history_bit_reader_type* pReader, int nbr_bits )
+{
+	uint64_t result = 0;
+
+	while (nbr_bits > 0)
+	{
+		int used = pReader->position & 63;
+		int room = 64 - used;
+		int n = (nbr_bits < room) ? nbr_bits : room;
+		uint64_t word = pReader->p_words[pReader->position >> 6];
+
+		result = (n == 64) ? word : ((result << n) | ((word >> (room - n)) & ((1ULL << n) - 1)));
+		pReader->position += n;
+		nbr_bits -= n;
+	}
+
+	return result;
+}
+
+static inline uint32_t History_Float_Bits( float value )
+{
+	uint32_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static inline float History_Bits_Float( uint32_t bits )
+{
+	float value;
+
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+/***************************************************************************************************
+Nothing needs to be allocated up front, chunks are allocated as samples arrive
+***************************************************************************************************/
+int History_Init( void )
+{
+	memset(g_series, 0, sizeof(g_series));
+	g_memory_bytes = 0;
+	memset(g_released_samples, 0, sizeof(g_released_samples));
+
+	return 1;
+}
+
+/***************************************************************************************************
+Called by the telemetry thread for every control tick.  Every history channel is appended to the
+current cook.
+***************************************************************************************************/
+void History_Append_Record( const telemetry_record_type* pRecord )
+{
+	int64_t timestamp_ms = pRecord->timestamp_ns / 1000000;
+	float value;
+	int channel;
+
+	pthread_rwlock_wrlock(&g_history_lock);
+
+	for (channel = 0; channel < NBR_TELEMETRY_CHANNELS; channel++)
+	{
+		value = Telemetry_Get_Channel_Value( pRecord, channel );
+		History_Append_Sample( &g_series[HISTORY_COOK_CURRENT][channel], timestamp_ms, value );
+	}
+
+	if (g_memory_bytes > HISTORY_MAX_MEMORY_BYTES)
+		History_Release_Memory();
+
+	pthread_rwlock_unlock(&g_history_lock);
+}
+
+/***************************************************************************************************
+Moves the current cook to the previous cook slot, discarding the old previous cook
+***************************************************************************************************/
+void History_Start_New_Cook( void )
+{
+	pthread_rwlock_wrlock(&g_history_lock);
+	History_Free_Cook( HISTORY_COOK_PREVIOUS );
+	memcpy(g_series[HISTORY_COOK_PREVIOUS], g_series[HISTORY_COOK_CURRENT], sizeof(g_series[HISTORY_COOK_CURRENT]));
+	memset(g_series[HISTORY_COOK_CURRENT], 0, sizeof(g_series[HISTORY_COOK_CURRENT]));
+	g_released_samples[HISTORY_COOK_PREVIOUS] = g_released_samples[HISTORY_COOK_CURRENT];
+	g_released_samples[HISTORY_COOK_CURRENT] = 0;
+	pthread_rwlock_unlock(&g_history_lock);
+}
+
+/***************************************************************************************************
+Encodes a sample into the newest chunk of the series, starting a new chunk if there is no room left
+or the timestamp can't be encoded relative to the previous one.  The caller must hold the write lock.
+***************************************************************************************************/
+static void History_Append_Sample( history_series_type* pSeries, int64_t timestamp_ms, float value )
+{
+	history_chunk_type* pChunk = (pSeries->nbr_chunks > 0) ? pSeries->p_chunks[pSeries->nbr_chunks - 1] : NULL;
+	history_chunk_type** p_chunks;
+	uint32_t value_bits = History_Float_Bits( value );
+	int64_t delta;
+	int64_t delta_of_delta = 0;
+	uint32_t xor_value;
+	int leading, trailing, length;
+	uint32_t size;
+
+	if (pChunk != NULL)
+	{
+		delta = timestamp_ms - pChunk->last_ms;
+		delta_of_delta = delta - pChunk->prev_delta;
+	}
+
+	if ((pChunk == NULL) || ((pChunk->bit_count + HISTORY_MAX_SAMPLE_BITS) > HISTORY_CHUNK_BITS) ||
+		(delta < 0) || (delta_of_delta > INT32_MAX) || (delta_of_delta < INT32_MIN))
+	{
+		if (pSeries->nbr_chunks >= pSeries->size)
+		{
+			size = (pSeries->size == 0) ? 64 : (pSeries->size * 2);
+			p_chunks = realloc(pSeries->p_chunks, size * sizeof(history_chunk_type*));
+			if (p_chunks == NULL)
+				return;							// The sample is lost, the series stays intact
+			pSeries->p_chunks = p_chunks;
+			pSeries->size = size;
+		}
+
+		pChunk = calloc(1, sizeof(history_chunk_type));
+		if (pChunk == NULL)
+			return;
+
+		pSeries->p_chunks[pSeries->nbr_chunks++] = pChunk;
+		g_memory_bytes += sizeof(history_chunk_type);
+
+		pChunk->first_ms = timestamp_ms;
+		pChunk->last_ms = timestamp_ms;
+		pChunk->prev_value = value_bits;
+		pChunk->prev_leading = HISTORY_NO_WINDOW;
+		History_Write_Bits( pChunk, (uint64_t)timestamp_ms, 64 );
+		History_Write_Bits( pChunk, value_bits, 32 );
+		pChunk->count = 1;
+		return;
+	}
+
+	// Timestamp, delta of delta with a variable length prefix
+	if (delta_of_delta == 0)
+		History_Write_Bits( pChunk, 0x0, 1 );
+	else if ((delta_of_delta >= -63) && (delta_of_delta <= 64))
+	{
+		History_Write_Bits( pChunk, 0x2, 2 );
+		History_Write_Bits( pChunk, (uint64_t)(delta_of_delta + 63), 7 );
+	}
+	else if ((delta_of_delta >= -255) && (delta_of_delta <= 256))
+	{
+		History_Write_Bits( pChunk, 0x6, 3 );
+		History_Write_Bits( pChunk, (uint64_t)(delta_of_delta + 255), 9 );
+	}
+	else if ((delta_of_delta >= -2047) && (delta_of_delta <= 2048))
+	{
+		History_Write_Bits( pChunk, 0xE, 4 );
+		History_Write_Bits( pChunk, (uint64_t)(delta_of_delta + 2047), 12 );
+	}
+	else
+	{
+		History_Write_Bits( pChunk, 0xF, 4 );
+		History_Write_Bits( pChunk, (uint32_t)(int32_t)delta_of_delta, 32 );
+	}
+
+	// Value, XOR with the previous value
+	xor_value = value_bits ^ pChunk->prev_value;
+	if (xor_value == 0)
+		History_Write_Bits( pChunk, 0x0, 1 );
+	else
+	{
+		leading = __builtin_clz(xor_value);
+		trailing = __builtin_ctz(xor_value);
+		if (leading > 31)
+			leading = 31;
+
+		if ((pChunk->prev_leading != HISTORY_NO_WINDOW) &&
+			(leading >= pChunk->prev_leading) && (trailing >= pChunk->prev_trailing))
+		{
+			// The meaningful bits fit in the previous window
+			length = 32 - pChunk->prev_leading - pChunk->prev_trailing;
+			History_Write_Bits( pChunk, 0x2, 2 );
+			History_Write_Bits( pChunk, xor_value >> pChunk->prev_trailing, length );
+		}
+		else
+		{
+			length = 32 - leading - trailing;
+			History_Write_Bits( pChunk, 0x3, 2 );
+			History_Write_Bits( pChunk, (uint64_t)leading, 5 );
+			History_Write_Bits( pChunk, (uint64_t)(length - 1), 5 );
+			History_Write_Bits( pChunk, xor_value >> trailing, length );
+			pChunk->prev_leading = leading;
+			pChunk->prev_trailing = trailing;
+		}
+	}
+
+	pChunk->prev_delta = delta;
+	pChunk->prev_value = value_bits;
+	pChunk->last_ms = timestamp_ms;
+	pChunk->count++;
+}
+
+/***************************************************************************************************
+Decodes a chunk and calls the callback for every sample between from_ms and to_ms
+***************************************************************************************************/
+static int History_Decode_Chunk( const history_chunk_type* pChunk, int channel, int64_t from_ms, int64_t to_ms,
+								 history_sample_function callback, void* pContext )
+{
+	history_bit_reader_type reader = { pChunk->words, 0 };
+	int64_t timestamp_ms;
+	int64_t delta = 0;
+	int64_t delta_of_delta;
+	uint32_t value_bits;
+	uint32_t leading = 0;
+	uint32_t trailing = 0;
+	uint32_t length;
+	uint32_t i;
+	int found = 0;
+
+	timestamp_ms = (int64_t)History_Read_Bits( &reader, 64 );
+	value_bits = (uint32_t)History_Read_Bits( &reader, 32 );
+
+	for (i = 0; i < pChunk->count; i++)
+	{
+		if (i > 0)
+		{
+			if (History_Read_Bits( &reader, 1 ) == 0)
+				delta_of_delta = 0;
+			else if (History_Read_Bits( &reader, 1 ) == 0)
+				delta_of_delta = (int64_t)History_Read_Bits( &reader, 7 ) - 63;
+			else if (History_Read_Bits( &reader, 1 ) == 0)
+				delta_of_delta = (int64_t)History_Read_Bits( &reader, 9 ) - 255;
+			else if (History_Read_Bits( &reader, 1 ) == 0)
+				delta_of_delta = (int64_t)History_Read_Bits( &reader, 12 ) - 2047;
+			else
+				delta_of_delta = (int32_t)(uint32_t)History_Read_Bits( &reader, 32 );
+
+			delta += delta_of_delta;
+			timestamp_ms += delta;
+
+			if (History_Read_Bits( &reader, 1 ) != 0)
+			{
+				if (History_Read_Bits( &reader, 1 ) != 0)
+				{
+					leading = (uint32_t)History_Read_Bits( &reader, 5 );
+					length = (uint32_t)History_Read_Bits( &reader, 5 ) + 1;
+					trailing = 32 - leading - length;
+				}
+				else
+					length = 32 - leading - trailing;
+
+				value_bits ^= (uint32_t)History_Read_Bits( &reader, length ) << trailing;
+			}
+		}
+
+		if (timestamp_ms > to_ms)
+			break;
+
+		if (timestamp_ms >= from_ms)
+		{
+			callback( pContext, channel, timestamp_ms, History_Bits_Float( value_bits ) );
+			found++;
+		}
+	}
+
+	return found;
+}
+
+/***************************************************************************************************
+Calls the callback for every sample of the channel between from_ms and to_ms (inclusive), oldest
+first.  Only the chunks overlapping the requested range are decoded.
+
+Returns the number of samples found or -1 on a bad channel or cook
+***************************************************************************************************/
+int History_Query( history_cook_type cook, int channel, int64_t from_ms, int64_t to_ms,
+				   history_sample_function callback, void* pContext )
+{
+	history_series_type* pSeries;
+	uint32_t i;
+	int found = 0;
+
+	if ((cook >= NBR_HISTORY_COOKS) || (channel < 0) || (channel >= NBR_TELEMETRY_CHANNELS))
+		return -1;
+
+	pthread_rwlock_rdlock(&g_history_lock);
+
+	pSeries = &g_series[cook][channel];
+	for (i = 0; i < pSeries->nbr_chunks; i++)
+	{
+		history_chunk_type* pChunk = pSeries->p_chunks[i];
+
+		if (pChunk->first_ms > to_ms)
+			break;
+		if (pChunk->last_ms < from_ms)
+			continue;
+
+		found += History_Decode_Chunk( pChunk, channel, from_ms, to_ms, callback, pContext );
+	}
+
+	pthread_rwlock_unlock(&g_history_lock);
+
+	return found;
+}
+
+/***************************************************************************************************
+Query callback of History_Query_Arrays(), appends a sample to the arrays.  When the arrays can't grow
+the remaining samples are ignored and failed is set.
+***************************************************************************************************/
+static void History_Collect_Sample( void* pContext, int channel, int64_t timestamp_ms, float value )
+{
+	history_arrays_type* pArrays = (history_arrays_type*)pContext;
+	int64_t* p_times;
+	float* p_values;
+	int size;
+
+	if (pArrays->failed)
+		return;
+
+	if (pArrays->count >= pArrays->size)
+	{
+		size = (pArrays->size == 0) ? 4096 : (pArrays->size * 2);
+		p_times = realloc(pArrays->p_times, size * sizeof(int64_t));
+		if (p_times != NULL)
+			pArrays->p_times = p_times;
+		p_values = realloc(pArrays->p_values, size * sizeof(float));
+		if (p_values != NULL)
+			pArrays->p_values = p_values;
+
+		if ((p_times == NULL) || (p_values == NULL))
+		{
+			pArrays->failed = true;
+			return;
+		}
+		pArrays->size = size;
+	}
+
+	pArrays->p_times[pArrays->count] = timestamp_ms;
+	pArrays->p_values[pArrays->count] = value;
+	pArrays->count++;
+}
+
+/***************************************************************************************************
+Reads the samples of the channel between from_ms and to_ms and reduces them to at most nbr_out points
+with History_Downsample_Lttb().  The cooks from oldest_cook to the current one are read, oldest
+first, so HISTORY_COOK_PREVIOUS spans both cooks and HISTORY_COOK_CURRENT only the current one.
+
+Returns the number of points written to the output arrays, 0 if there are no samples, or -1 on a
+bad channel or cook or if there is not enough memory to collect the samples
+***************************************************************************************************/
+int History_Query_Arrays( history_cook_type oldest_cook, int channel, int64_t from_ms, int64_t to_ms,
+						  int64_t* p_out_times, float* p_out_values, int nbr_out )
+{
+	history_arrays_type arrays = { NULL, NULL, 0, 0, false };
+	int cook;
+	int count = 0;
+
+	if ((oldest_cook >= NBR_HISTORY_COOKS) || (channel < 0) || (channel >= NBR_TELEMETRY_CHANNELS))
+		return -1;
+
+	for (cook = oldest_cook; cook >= HISTORY_COOK_CURRENT; cook--)
+		History_Query( cook, channel, from_ms, to_ms, History_Collect_Sample, &arrays );
+
+	if (arrays.failed)
+		count = -1;
+	else if (arrays.count > 0)
+		count = History_Downsample_Lttb( arrays.p_times, arrays.p_values, arrays.count, p_out_times, p_out_values, nbr_out );
+
+	free(arrays.p_times);
+	free(arrays.p_values);
+
+	return count;
+}
+
+/***************************************************************************************************
+Returns the number of samples and the memory used by a cook, along with the memory used by the whole
+history and its limit
+***************************************************************************************************/
+void History_Get_Stats( history_cook_type cook, history_stats_type* pStats )
+{
+	int channel;
+	uint32_t i;
+
+	memset(pStats, 0, sizeof(*pStats));
+	if (cook >= NBR_HISTORY_COOKS)
+		return;
+
+	pthread_rwlock_rdlock(&g_history_lock);
+	pStats->nbr_released = g_released_samples[cook];
+	pStats->memory_bytes = g_memory_bytes;
+	pStats->max_memory_bytes = HISTORY_MAX_MEMORY_BYTES;
+
+	for (channel = 0; channel < NBR_TELEMETRY_CHANNELS; channel++)
+	{
+		history_series_type* pSeries = &g_series[cook][channel];
+
+		for (i = 0; i < pSeries->nbr_chunks; i++)
+		{
+			pStats->nbr_samples += pSeries->p_chunks[i]->count;
+			pStats->compressed_bytes += (pSeries->p_chunks[i]->bit_count + 7) / 8;
+		}
+		pStats->nbr_chunks += pSeries->nbr_chunks;
+
+		if (pSeries->nbr_chunks > 0)
+		{
+			if ((pStats->first_ms == 0) || (pSeries->p_chunks[0]->first_ms < pStats->first_ms))
+				pStats->first_ms = pSeries->p_chunks[0]->first_ms;
+			if (pSeries->p_chunks[pSeries->nbr_chunks - 1]->last_ms > pStats->last_ms)
+				pStats->last_ms = pSeries->p_chunks[pSeries->nbr_chunks - 1]->last_ms;
+		}
+	}
+	pthread_rwlock_unlock(&g_history_lock);
+}
+
+/***************************************************************************************************
+Largest-Triangle-Three-Buckets downsampling.  Reduces a series to nbr_out points while keeping its
+visual shape: the first and last samples are kept, and for each bucket in between the sample forming
+the largest triangle with the previously selected sample and the average of the next bucket is kept.
+
+Returns the number of points written to the output arrays
+***************************************************************************************************/
+int History_Downsample_Lttb( const int64_t* p_times, const float* p_values, int nbr_samples,
+							 int64_t* p_out_times, float* p_out_values, int nbr_out )
+{
+	double bucket_size;
+	int selected = 0;
+	int out = 0;
+	int bucket;
+	int i;
+
+	if ((nbr_out >= nbr_samples) || (nbr_out < 3))
+	{
+		out = (nbr_samples < nbr_out) ? nbr_samples : nbr_out;
+		memcpy(p_out_times, p_times, out * sizeof(int64_t));
+		memcpy(p_out_values, p_values, out * sizeof(float));
+		return out;
+	}
+
+	bucket_size = (double)(nbr_samples - 2) / (nbr_out - 2);
+
+	p_out_times[out] = p_times[0];
+	p_out_values[out++] = p_values[0];
+
+	for (bucket = 0; bucket < (nbr_out - 2); bucket++)
+	{
+		int start = (int)(bucket * bucket_size) + 1;
+		int end = (int)((bucket + 1) * bucket_size) + 1;
+		int next_start = end;
+		int next_end = (int)((bucket + 2) * bucket_size) + 1;
+		double avg_time = 0.0;
+		double avg_value = 0.0;
+		double max_area = -1.0;
+		double area;
+		int best = start;
+
+		if (next_end > nbr_samples)
+			next_end = nbr_samples;
+
+		// Average of the next bucket, times are relative to the selected sample to keep precision
+		for (i = next_start; i < next_end; i++)
+		{
+			avg_time += (double)(p_times[i] - p_times[selected]);
+			avg_value += p_values[i];
+		}
+		if (next_end > next_start)
+		{
+			avg_time /= (next_end - next_start);
+			avg_value /= (next_end - next_start);
+		}
+
+		for (i = start; i < end; i++)
+		{
+			area = ((double)(p_times[i] - p_times[selected]) * (avg_value - p_values[selected])) -
+				   (avg_time * ((double)p_values[i] - p_values[selected]));
+			if (area < 0)
+				area = -area;
+
+			if (area > max_area)
+			{
+				max_area = area;
+				best = i;
+			}
+		}
+
+		p_out_times[out] = p_times[best];
+		p_out_values[out++] = p_values[best];
+		selected = best;
+	}
+
+	p_out_times[out] = p_times[nbr_samples - 1];
+	p_out_values[out++] = p_values[nbr_samples - 1];
+
+	return out;
+}
+
+/***************************************************************************************************
+Keeps the history within HISTORY_MAX_MEMORY_BYTES.  The previous cook is released first, after that
+the oldest chunk of every channel of the current cook is dropped.  The caller must hold the write
+lock.
+***************************************************************************************************/
+static void History_Release_Memory( void )
+{
+	int channel;
+	uint32_t i;
+
+	if (g_series[HISTORY_COOK_PREVIOUS][0].nbr_chunks > 0)
+	{
+		for (channel = 0; channel < NBR_TELEMETRY_CHANNELS; channel++)
+		{
+			for (i = 0; i < g_series[HISTORY_COOK_PREVIOUS][channel].nbr_chunks; i++)
+				g_released_samples[HISTORY_COOK_PREVIOUS] += g_series[HISTORY_COOK_PREVIOUS][channel].p_chunks[i]->count;
+		}
+		History_Free_Cook( HISTORY_COOK_PREVIOUS );
+		return;
+	}
+
+	for (channel = 0; channel < NBR_TELEMETRY_CHANNELS; channel++)
+	{
+		history_series_type* pSeries = &g_series[HISTORY_COOK_CURRENT][channel];
+
+		if (pSeries->nbr_chunks > 1)
+		{
+			g_released_samples[HISTORY_COOK_CURRENT] += pSeries->p_chunks[0]->count;
+			free(pSeries->p_chunks[0]);
+			g_memory_bytes -= sizeof(history_chunk_type);
+			pSeries->nbr_chunks--;
+			memmove(&pSeries->p_chunks[0], &pSeries->p_chunks[1], pSeries->nbr_chunks * sizeof(history_chunk_type*));
+		}
+	}
+}
+
+/***************************************************************************************************
+Frees every chunk of a cook.  The caller must hold the write lock.
+***************************************************************************************************/
+static void History_Free_Cook( history_cook_type cook )
+{
+	int channel;
+	uint32_t i;
+
+	for (channel = 0; channel < NBR_TELEMETRY_CHANNELS; channel++)
+	{
+		history_series_type* pSeries = &g_series[cook][channel];
+
+		for (i = 0; i < pSeries->nbr_chunks; i++)
+			free(pSeries->p_chunks[i]);
+		g_memory_bytes -= (size_t)pSeries->nbr_chunks * sizeof(history_chunk_type);
+
+		free(pSeries->p_chunks);
+		memset(pSeries, 0, sizeof(*pSeries));
+	}
+}
+
+/* *** End of File *** */
@@ -0,0 +1,45 @@
+#ifndef __HISTORY_H
+#define __HISTORY_H
+
+#include <stdint.h>
+#include "telemetry.h"			// For telemetry_record_type and NBR_TELEMETRY_CHANNELS
+
+#define HISTORY_MAX_MEMORY_BYTES		(192 * 1024 * 1024)	// Oldest chunks are released above this, see history.c
+
+typedef enum
+{
+	HISTORY_COOK_CURRENT = 0,
+	HISTORY_COOK_PREVIOUS,
+
+	NBR_HISTORY_COOKS,
+} history_cook_type;
+
+typedef struct
+{
+	uint32_t nbr_chunks;
+	uint64_t nbr_samples;
+	uint64_t compressed_bytes;					// Bytes of chunk memory in use
+	int64_t first_ms;							// Oldest sample held, 0 if empty
+	int64_t last_ms;							// Newest sample held, 0 if empty
+	uint64_t nbr_released;						// Samples released to stay within HISTORY_MAX_MEMORY_BYTES
+	uint64_t memory_bytes;						// Chunk memory of both cooks, including headers
+	uint64_t max_memory_bytes;					// HISTORY_MAX_MEMORY_BYTES
+} history_stats_type;
+
+// Prototype of the function called for each sample returned by a query
+typedef void (*history_sample_function)( void* pContext, int channel, int64_t timestamp_ms, float value );
+
+int History_Init( void );
+void History_Append_Record( const telemetry_record_type* pRecord );
+void History_Start_New_Cook( void );
+
+int History_Query( history_cook_type cook, int channel, int64_t from_ms, int64_t to_ms,
+				   history_sample_function callback, void* pContext );
+void History_Get_Stats( history_cook_type cook, history_stats_type* pStats );
+
+int History_Query_Arrays( history_cook_type oldest_cook, int channel, int64_t from_ms, int64_t to_ms,
+						  int64_t* p_out_times, float* p_out_values, int nbr_out );
+int History_Downsample_Lttb( const int64_t* p_times, const float* p_values, int nbr_samples,
+							 int64_t* p_out_times, float* p_out_values, int nbr_out );
+
+#endif //__HISTORY_H
@@ -0,0 +1,1170 @@
+/***************************************************************************************************
+HTTP Server
+
+Serves the web interface straight from the daemon, in place of the Node.js relay.  GET requests
+are answered with the files under HTTP_DOCUMENT_ROOT, one request per connection.  GET /ws upgrades
+the connection to a WebSocket (websocket.c) over which the browser sends command lines and
+receives, one message each, their responses and the PUSH/DELTA frames of SUBSCRIBE=.  The commands
+are those of the Ethernet protocol (see cmd_registry.c), except BINARY, and only pages of the
+daemon itself or of HTTP_ALLOWED_ORIGINS may open it.  GET /events is a Server-Sent Events stream
+that starts with the history of the current cook, see Http_Server_Start_Events().  GET /metrics
+returns the metrics of the daemon (metrics.c) for Prometheus to scrape.  Frames are formatted from
+the in-process snapshot, so updates reach the browser without any extra hop.
+
+Like the Ethernet server, a single epoll loop handles every connection and never blocks on a slow
+client.  Files are sent with sendfile() as the socket accepts them.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "main.h"
+#include "http_server.h"
+#include "websocket.h"
+#include "subscription.h"
+#include "telemetry.h"
+#include "str_builder.h"
+#include "cmd_registry.h"
+#include "history.h"
+#include "metrics.h"
+
+/* *** Defined Values *** */
+#define HTTP_LISTENING_PORT			8081
+#define HTTP_DOCUMENT_ROOT			"node/public"
+#define HTTP_DEFAULT_FILE			"/index.htm"
+#define HTTP_WEBSOCKET_PATH			"/ws"
+#define HTTP_EVENTS_PATH			"/events"
+#define HTTP_METRICS_PATH			"/metrics"
+#define HTTP_MAX_PATH				256
+
+#define HTTP_MAX_CONNECTIONS		16			// Further clients are refused
+#define HTTP_MAX_EVENTS				16			// Events returned by one epoll_wait()
+#define HTTP_POLL_PERIOD_MS			1000		// Longest wait before idle connections are checked
+#define HTTP_REQUEST_TIMEOUT_MS		10000		// Plain HTTP connections without progress are closed
+#define HTTP_WS_PING_PERIOD_MS		30000		// WebSocket clients are pinged this often...
+#define HTTP_WS_IDLE_TIMEOUT_MS		90000		// ...and closed when nothing came back for this long
+#define HTTP_RX_BUFFER_SIZE			2048		// Longest request header, and WebSocket frames
+#define HTTP_WS_MAX_MESSAGE			256			// Longest command line from a browser
+#define HTTP_CHUNK_SIZE				1024		// Large responses are sent in fragments of this size
+#define HTTP_TX_BUFFER_INITIAL		4096
+#define HTTP_TX_BUFFER_MAX			(2 * 1024 * 1024)	// A client this far behind is disconnected
+#define HTTP_MAX_PUSH_FRAMES		8			// Distinct field selections formatted once per push pass
+#define HTTP_SSE_PERIOD_MS			1000		// Period of the frames of an event stream
+#define HTTP_SSE_BACKFILL_POINTS	500			// Points per channel of the history sent on connect
+#define HTTP_SSE_RETRY_MS			2000		// Reconnection delay asked of the browser
+#define HTTP_METRICS_BUFFER_SIZE	16384		// Longest metrics exposition
+
+// Further origins, besides the daemon itself, whose pages may open the WebSocket, comma separated
+// host[:port] as in the Origin header, e.g. "smoker.local,192.168.1.20:8081"
+#ifndef HTTP_ALLOWED_ORIGINS
+#define HTTP_ALLOWED_ORIGINS		""
+#endif
+
+#define WEBSOCKET_CLOSE_PROTOCOL_ERROR	1002
+#define WEBSOCKET_CLOSE_UNSUPPORTED		1003
+#define WEBSOCKET_CLOSE_TOO_BIG			1009
+
+/* *** Data Types *** */
+typedef enum
+{
+	HTTP_STATE_REQUEST = 0,						// Receiving the request header
+	HTTP_STATE_FILE,							// Sending a file
+	HTTP_STATE_CLOSING,							// Closed once the transmit buffer is empty
+	HTTP_STATE_WEBSOCKET,
+	HTTP_STATE_EVENTS,							// Server-Sent Events stream
+} http_state_type;
+
+	//! State of one client connection
+typedef struct
+{
+	int fd;										// -1 when the slot is free
+	http_state_type state;
+	int64_t last_activity_ms;					// CLOCK_MONOTONIC time of the last progress
+	int64_t next_ping_ms;
+	char rx_buffer[HTTP_RX_BUFFER_SIZE];
+	int rx_length;
+	int file_fd;								// File being sent, -1 if none
+	off_t file_offset;
+	off_t file_size;
+	bool fragmented;							// A response is being sent in several WebSocket frames
+	bool want_write;							// EPOLLOUT is requested
+	subscription_type subscription;
+	char* p_tx_buffer;							// Data the socket has not accepted yet
+	int tx_offset;
+	int tx_length;
+	int tx_size;
+} http_conn_type;
+
+typedef struct
+{
+	const char* extension;
+	const char* content_type;
+} http_content_type;
+
+/* *** Global Variables *** */
+static int g_http_fd = -1;
+static int g_http_epoll_fd = -1;
+static http_conn_type g_http_conns[HTTP_MAX_CONNECTIONS];
+static shared_data_type* p_shared_data;
+
+static const http_content_type g_content_types[] =
+{
+	{ ".htm",	"text/html; charset=utf-8" },
+	{ ".html",	"text/html; charset=utf-8" },
+	{ ".js",	"application/javascript" },
+	{ ".css",	"text/css" },
+	{ ".json",	"application/json" },
+	{ ".xml",	"application/xml" },
+	{ ".png",	"image/png" },
+	{ ".jpg",	"image/jpeg" },
+	{ ".ico",	"image/x-icon" },
+	{ ".svg",	"image/svg+xml" },
+	{ ".txt",	"text/plain; charset=utf-8" },
+};
+#define HTTP_CONTENT_TYPES_SIZE		(sizeof (g_content_types)/sizeof(g_content_types[0]))
+
+/* *** Function Prototypes *** */
+static void Http_Server_Accept( void );
+static void Http_Server_Read( http_conn_type* pConn );
+static void Http_Server_Close( http_conn_type* pConn );
+static void Http_Server_Check_Idle( int64_t now_ms );
+static void Http_Server_Send( http_conn_type* pConn, const char* pData, int length );
+static void Http_Server_Send_Pending( http_conn_type* pConn );
+static void Http_Server_Process_Request( http_conn_type* pConn, int header_length );
+static void Http_Server_Respond_Error( http_conn_type* pConn, int status, const char* p_reason );
+static void Http_Server_Process_Frames( http_conn_type* pConn );
+static void Http_Server_Start_Events( http_conn_type* pConn );
+static void Http_Server_Respond_Metrics( http_conn_type* pConn );
+static void Http_Ws_Send_Message( http_conn_type* pConn, int opcode, bool fin, const char* p_data, int length );
+static void Http_Ws_Close( http_conn_type* pConn, int status );
+static int Http_Server_Push_Subscriptions( int64_t now_ms );
+
+/* *** Accessors *** */
+static inline int64_t Http_Server_Get_Time_Ms( void ) { return Telemetry_Get_Time_Ns( CLOCK_MONOTONIC ) / 1000000; }
+static inline bool Http_Server_Is_Streaming( const http_conn_type* pConn )
+{
+	return (pConn->state == HTTP_STATE_WEBSOCKET) || (pConn->state == HTTP_STATE_EVENTS);
+}
+
+subscription_type* Http_Server_Get_Subscription( void* pConnection )
+{
+	return &((http_conn_type*)pConnection)->subscription;
+}
+
+/* *** Function Definitions *** */
+
+/***************************************************************************************************
+Opens the listening socket
+
+Returns -1 on error
+		 1 on success
+***************************************************************************************************/
+int Http_Server_Init( void* shared_data_address )
+{
+	struct sockaddr_in serv_addr;
+	struct epoll_event event;
+	int option = 1;
+	int i;
+
+	p_shared_data = (shared_data_type*)shared_data_address;
+
+	for (i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+	{
+		g_http_conns[i].fd = -1;
+		g_http_conns[i].file_fd = -1;
+	}
+
+	g_http_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (g_http_fd < 0)
+	{
+		printf("Error creating the HTTP socket - %s.%u\n", __FILE__, __LINE__);
+		return -1;
+	}
+	setsockopt(g_http_fd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+
+	memset(&serv_addr, 0, sizeof(serv_addr));
+	serv_addr.sin_family = AF_INET;
+	serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	serv_addr.sin_port = htons(HTTP_LISTENING_PORT);
+	if ((bind(g_http_fd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) || (listen(g_http_fd, 10) < 0))
+	{
+		printf("Error listening on HTTP port %d - %s.%u\n", HTTP_LISTENING_PORT, __FILE__, __LINE__);
+		return -1;
+	}
+
+	g_http_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (g_http_epoll_fd < 0)
+	{
+		printf("Error creating the HTTP epoll instance - %s.%u\n", __FILE__, __LINE__);
+		return -1;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;				// NULL identifies the listening socket
+	if (epoll_ctl(g_http_epoll_fd, EPOLL_CTL_ADD, g_http_fd, &event) < 0)
+	{
+		printf("Error adding the HTTP socket to epoll - %s.%u\n", __FILE__, __LINE__);
+		return -1;
+	}
+
+	return 1;
+}
+
+/***************************************************************************************************
+Service routine of the HTTP server
+***************************************************************************************************/
+void Http_Server_Service( void )
+{
+	struct epoll_event events[HTTP_MAX_EVENTS];
+	http_conn_type* pConn;
+	int64_t last_idle_check_ms = Http_Server_Get_Time_Ms();
+	int64_t now_ms;
+	int wait_ms = HTTP_POLL_PERIOD_MS;
+	int nbr_events;
+	int i;
+
+	signal(SIGPIPE, SIG_IGN);
+
+	while (1)
+	{
+		nbr_events = epoll_wait(g_http_epoll_fd, events, HTTP_MAX_EVENTS, wait_ms);
+		if ((nbr_events < 0) && (errno != EINTR))
+		{
+			printf("Error waiting for HTTP events - %s.%u\n", __FILE__, __LINE__);
+			usleep(100000);
+		}
+
+		for (i = 0; i < nbr_events; i++)
+		{
+			pConn = (http_conn_type*)events[i].data.ptr;
+
+			if (pConn == NULL)
+			{
+				Http_Server_Accept();
+				continue;
+			}
+
+			if (events[i].events & (EPOLLERR | EPOLLHUP))
+			{
+				Http_Server_Close( pConn );
+				continue;
+			}
+
+			if (events[i].events & EPOLLOUT)
+				Http_Server_Send_Pending( pConn );
+
+			if ((pConn->fd >= 0) && (events[i].events & EPOLLIN))
+				Http_Server_Read( pConn );
+		}
+
+		now_ms = Http_Server_Get_Time_Ms();
+		if ((now_ms - last_idle_check_ms) >= HTTP_POLL_PERIOD_MS)
+		{
+			Http_Server_Check_Idle( now_ms );
+			last_idle_check_ms = now_ms;
+		}
+
+		wait_ms = Http_Server_Push_Subscriptions( now_ms );
+	}
+}
+
+/***************************************************************************************************
+Accepts every pending connection and gives each one a free connection slot
+***************************************************************************************************/
+static void Http_Server_Accept( void )
+{
+	struct epoll_event event;
+	http_conn_type* pConn;
+	int option = 1;
+	int fd;
+	int i;
+
+	while ((fd = accept(g_http_fd, NULL, NULL)) >= 0)
+	{
+		pConn = NULL;
+		for (i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+		{
+			if (g_http_conns[i].fd < 0)
+			{
+				pConn = &g_http_conns[i];
+				break;
+			}
+		}
+
+		if (pConn == NULL)
+		{
+			close(fd);
+			continue;
+		}
+
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+		// Every response and frame is written at once, there is nothing to gain from Nagle
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+
+		pConn->fd = fd;
+		pConn->state = HTTP_STATE_REQUEST;
+		pConn->last_activity_ms = Http_Server_Get_Time_Ms();
+		pConn->rx_length = 0;
+		pConn->file_fd = -1;
+		pConn->fragmented = false;
+		pConn->want_write = false;
+		Subscription_Stop( &pConn->subscription );
+		pConn->tx_offset = 0;
+		pConn->tx_length = 0;
+
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.ptr = pConn;
+		if (epoll_ctl(g_http_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+		{
+			close(fd);
+			pConn->fd = -1;
+		}
+	}
+}
+
+/***************************************************************************************************
+Closes a connection and releases its slot
+***************************************************************************************************/
+static void Http_Server_Close( http_conn_type* pConn )
+{
+	if (pConn->fd < 0)
+		return;
+
+	epoll_ctl(g_http_epoll_fd, EPOLL_CTL_DEL, pConn->fd, NULL);
+	close(pConn->fd);
+	pConn->fd = -1;
+	pConn->want_write = false;
+	Subscription_Stop( &pConn->subscription );
+
+	if (pConn->file_fd >= 0)
+	{
+		close(pConn->file_fd);
+		pConn->file_fd = -1;
+	}
+
+	free(pConn->p_tx_buffer);
+	pConn->p_tx_buffer = NULL;
+	pConn->tx_size = 0;
+	pConn->tx_offset = 0;
+	pConn->tx_length = 0;
+}
+
+/***************************************************************************************************
+Closes connections that made no progress in time and pings the WebSocket clients, whose pongs
+keep them alive.  Event streams only carry data to the browser, they end when a write fails.
+***************************************************************************************************/
+static void Http_Server_Check_Idle( int64_t now_ms )
+{
+	http_conn_type* pConn;
+	int i;
+
+	for (i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+	{
+		pConn = &g_http_conns[i];
+		if (pConn->fd < 0)
+			continue;
+
+		if (pConn->state == HTTP_STATE_EVENTS)
+			continue;						// Failed writes end event streams
+
+		if (pConn->state != HTTP_STATE_WEBSOCKET)
+		{
+			if ((now_ms - pConn->last_activity_ms) >= HTTP_REQUEST_TIMEOUT_MS)
+				Http_Server_Close( pConn );
+		}
+		else if ((now_ms - pConn->last_activity_ms) >= HTTP_WS_IDLE_TIMEOUT_MS)
+			Http_Server_Close( pConn );
+		else if (now_ms >= pConn->next_ping_ms)
+		{
+			Http_Ws_Send_Message( pConn, WEBSOCKET_OPCODE_PING, true, NULL, 0 );
+			pConn->next_ping_ms = now_ms + HTTP_WS_PING_PERIOD_MS;
+		}
+	}
+}
+
+/***************************************************************************************************
+Reads everything the socket holds.  A complete request header is answered, WebSocket frames are
+processed as they complete.
+***************************************************************************************************/
+static void Http_Server_Read( http_conn_type* pConn )
+{
+	char discard[256];
+	char* p_end;
+	int bytes_read;
+
+	while (pConn->fd >= 0)
+	{
+		// Nothing more is expected from a client that is getting its response
+		if ((pConn->state == HTTP_STATE_FILE) || (pConn->state == HTTP_STATE_CLOSING) ||
+			(pConn->state == HTTP_STATE_EVENTS))
+			bytes_read = read(pConn->fd, discard, sizeof(discard));
+		else if (pConn->rx_length < (HTTP_RX_BUFFER_SIZE - 1))
+			bytes_read = read(pConn->fd, &pConn->rx_buffer[pConn->rx_length], HTTP_RX_BUFFER_SIZE - 1 - pConn->rx_length);
+		else
+		{
+			Http_Server_Respond_Error( pConn, 431, "Request Header Fields Too Large" );
+			return;
+		}
+
+		if (bytes_read > 0)
+		{
+			pConn->last_activity_ms = Http_Server_Get_Time_Ms();
+			if ((pConn->state == HTTP_STATE_FILE) || (pConn->state == HTTP_STATE_CLOSING) ||
+				(pConn->state == HTTP_STATE_EVENTS))
+				continue;
+
+			pConn->rx_length += bytes_read;
+			pConn->rx_buffer[pConn->rx_length] = '\0';
+
+			if (pConn->state == HTTP_STATE_WEBSOCKET)
+				Http_Server_Process_Frames( pConn );
+			else if ((p_end = strstr(pConn->rx_buffer, "\r\n\r\n")) != NULL)
+				Http_Server_Process_Request( pConn, (int)(p_end - pConn->rx_buffer) + 4 );
+		}
+		else if ((bytes_read < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+			break;
+		else if ((bytes_read < 0) && (errno == EINTR))
+			continue;
+		else
+			Http_Server_Close( pConn );
+	}
+}
+
+/***************************************************************************************************
+Selects the epoll events of a connection.  EPOLLOUT is only requested while data is waiting.
+***************************************************************************************************/
+static void Http_Server_Update_Events( http_conn_type* pConn, bool want_write )
+{
+	struct epoll_event event;
+
+	if (pConn->want_write == want_write)
+		return;
+	pConn->want_write = want_write;
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+	event.data.ptr = pConn;
+	epoll_ctl(g_http_epoll_fd, EPOLL_CTL_MOD, pConn->fd, &event);
+}
+
+/***************************************************************************************************
+Writes data to a connection without blocking.  Whatever the socket does not accept is kept in the
+transmit buffer and written once the socket becomes writable again.  A client that lets more than
+HTTP_TX_BUFFER_MAX bytes pile up is disconnected.
+***************************************************************************************************/
+static void Http_Server_Send( http_conn_type* pConn, const char* pData, int length )
+{
+	int written;
+	int pending;
+	int new_size;
+	char* p_new_buffer;
+
+	if (pConn->fd < 0)
+		return;
+
+	// Write directly when nothing is queued ahead of this data
+	while ((pConn->tx_offset == pConn->tx_length) && (length > 0))
+	{
+		written = write(pConn->fd, pData, length);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+			{
+				Http_Server_Close( pConn );
+				return;
+			}
+			break;
+		}
+		pData += written;
+		length -= written;
+	}
+
+	if (length <= 0)
+		return;
+
+	pending = pConn->tx_length - pConn->tx_offset;
+	if (pConn->tx_offset > 0)
+	{
+		memmove(pConn->p_tx_buffer, &pConn->p_tx_buffer[pConn->tx_offset], pending);
+		pConn->tx_offset = 0;
+		pConn->tx_length = pending;
+	}
+
+	if ((pending + length) > pConn->tx_size)
+	{
+		new_size = (pConn->tx_size == 0) ? HTTP_TX_BUFFER_INITIAL : pConn->tx_size;
+		while (new_size < (pending + length))
+			new_size *= 2;
+
+		p_new_buffer = (new_size <= HTTP_TX_BUFFER_MAX) ? realloc(pConn->p_tx_buffer, new_size) : NULL;
+		if (p_new_buffer == NULL)
+		{
+			Http_Server_Close( pConn );
+			return;
+		}
+		pConn->p_tx_buffer = p_new_buffer;
+		pConn->tx_size = new_size;
+	}
+
+	memcpy(&pConn->p_tx_buffer[pConn->tx_length], pData, length);
+	pConn->tx_length += length;
+
+	Http_Server_Update_Events( pConn, true );
+}
+
+/***************************************************************************************************
+Sends as much of the transmit buffer and then of the file being served as the socket accepts.  A
+connection whose response is complete is closed.
+***************************************************************************************************/
+static void Http_Server_Send_Pending( http_conn_type* pConn )
+{
+	ssize_t written;
+
+	if (pConn->fd < 0)
+		return;
+
+	while (pConn->tx_offset < pConn->tx_length)
+	{
+		written = write(pConn->fd, &pConn->p_tx_buffer[pConn->tx_offset], pConn->tx_length - pConn->tx_offset);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+				Http_Server_Close( pConn );
+			else
+				Http_Server_Update_Events( pConn, true );
+			return;
+		}
+		pConn->tx_offset += written;
+		pConn->last_activity_ms = Http_Server_Get_Time_Ms();
+	}
+	pConn->tx_offset = 0;
+	pConn->tx_length = 0;
+
+	while ((pConn->state == HTTP_STATE_FILE) && (pConn->file_offset < pConn->file_size))
+	{
+		written = sendfile(pConn->fd, pConn->file_fd, &pConn->file_offset, pConn->file_size - pConn->file_offset);
+		if (written <= 0)
+		{
+			if ((written < 0) && (errno == EINTR))
+				continue;
+			if ((written < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+				Http_Server_Update_Events( pConn, true );
+			else
+				Http_Server_Close( pConn );
+			return;
+		}
+		pConn->last_activity_ms = Http_Server_Get_Time_Ms();
+	}
+
+	if ((pConn->state == HTTP_STATE_FILE) || (pConn->state == HTTP_STATE_CLOSING))
+	{
+		Http_Server_Close( pConn );
+		return;
+	}
+
+	Http_Server_Update_Events( pConn, false );
+}
+
+/***************************************************************************************************
+Copies the value of a request header into p_value
+
+Returns -1 if the request has no such header
+		 1 on success
+***************************************************************************************************/
+static int Http_Server_Get_Header( const char* p_headers, const char* p_name, char* p_value, int size )
+{
+	const char* p_line = strstr(p_headers, "\r\n");
+	int name_length = strlen(p_name);
+	int length;
+
+	while ((p_line != NULL) && (p_line[2] != '\r'))
+	{
+		p_line += 2;
+		if ((strncasecmp(p_line, p_name, name_length) == 0) && (p_line[name_length] == ':'))
+		{
+			p_line += name_length + 1;
+			while ((*p_line == ' ') || (*p_line == '\t'))
+				p_line++;
+
+			for (length = 0; (length < (size - 1)) && (p_line[length] != '\r'); length++)
+				p_value[length] = p_line[length];
+			p_value[length] = '\0';
+			return 1;
+		}
+		p_line = strstr(p_line, "\r\n");
+	}
+
+	return -1;
+}
+
+/***************************************************************************************************
+Returns the content type of a file from its extension
+***************************************************************************************************/
+static const char* Http_Server_Content_Type( const char* p_path )
+{
+	const char* p_extension = strrchr(p_path, '.');
+	int i;
+
+	for (i = 0; (p_extension != NULL) && (i < HTTP_CONTENT_TYPES_SIZE); i++)
+	{
+		if (strcasecmp(p_extension, g_content_types[i].extension) == 0)
+			return g_content_types[i].content_type;
+	}
+
+	return "application/octet-stream";
+}
+
+/***************************************************************************************************
+Browsers let any page open a WebSocket to any server, and the WebSocket may change settings.  Only
+pages served by the daemon itself, whose Origin is the Host they were requested from, and the
+origins of HTTP_ALLOWED_ORIGINS are let in.  Clients other than browsers send no Origin.
+
+Returns true if the origin of the request may use the WebSocket
+***************************************************************************************************/
+static bool Http_Server_Origin_Allowed( const char* p_headers )
+{
+	char origin[128];
+	char host[128];
+	const char* p_origin;
+	const char* p_allowed = HTTP_ALLOWED_ORIGINS;
+	int length;
+
+	if (Http_Server_Get_Header( p_headers, "Origin", origin, sizeof(origin) ) < 0)
+		return true;
+
+	p_origin = strstr(origin, "://");
+	if (p_origin == NULL)
+		return false;							// "null" of sandboxed pages and files
+	p_origin += 3;
+	length = strlen(p_origin);
+
+	if ((Http_Server_Get_Header( p_headers, "Host", host, sizeof(host) ) > 0) && (strcasecmp(p_origin, host) == 0))
+		return true;
+
+	while (*p_allowed != '\0')
+	{
+		if ((strncasecmp(p_allowed, p_origin, length) == 0) && ((p_allowed[length] == ',') || (p_allowed[length] == '\0')))
+			return true;
+		p_allowed = strchr(p_allowed, ',');
+		if (p_allowed == NULL)
+			break;
+		p_allowed++;
+	}
+
+	return false;
+}
+
+/***************************************************************************************************
+Completes the WebSocket handshake.  Data the client sent after its request stays in the receive
+buffer as the first frames.
+***************************************************************************************************/
+static void Http_Server_Upgrade( http_conn_type* pConn, int header_length )
+{
+	char header[HTTP_RX_BUFFER_SIZE];
+	char key[64];
+	char accept[WEBSOCKET_ACCEPT_SIZE];
+	int length;
+
+	if ((Http_Server_Get_Header( pConn->rx_buffer, "Upgrade", header, sizeof(header) ) < 0) ||
+		(strcasecmp(header, "websocket") != 0) ||
+		(Http_Server_Get_Header( pConn->rx_buffer, "Sec-WebSocket-Key", key, sizeof(key) ) < 0) ||
+		(Websocket_Accept_Key( key, accept ) < 0))
+	{
+		Http_Server_Respond_Error( pConn, 400, "Bad Request" );
+		return;
+	}
+
+	if (!Http_Server_Origin_Allowed( pConn->rx_buffer ))
+	{
+		Metrics_Add( METRIC_WS_ORIGIN_REFUSED, 1 );
+		Http_Server_Respond_Error( pConn, 403, "Forbidden" );
+		return;
+	}
+
+	length = snprintf(header, sizeof(header), "HTTP/1.1 101 Switching Protocols\r\n"
+											  "Upgrade: websocket\r\n"
+											  "Connection: Upgrade\r\n"
+											  "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+
+	pConn->state = HTTP_STATE_WEBSOCKET;
+	pConn->next_ping_ms = Http_Server_Get_Time_Ms() + HTTP_WS_PING_PERIOD_MS;
+	pConn->rx_length -= header_length;
+	memmove(pConn->rx_buffer, &pConn->rx_buffer[header_length], pConn->rx_length);
+
+	Http_Server_Send( pConn, header, length );
+	Http_Server_Process_Frames( pConn );
+}
+
+/***************************************************************************************************
+Answers a complete request header with a file, an error or the WebSocket handshake
+***************************************************************************************************/
+static void Http_Server_Process_Request( http_conn_type* pConn, int header_length )
+{
+	char request[HTTP_MAX_PATH + 32];
+	char path[sizeof(HTTP_DOCUMENT_ROOT) + HTTP_MAX_PATH];
+	char header[256];
+	char* p_save = NULL;
+	char* p_method;
+	char* p_target;
+	struct stat file_stat;
+	int length;
+
+	length = strcspn(pConn->rx_buffer, "\r");
+	if (length >= sizeof(request))
+	{
+		Http_Server_Respond_Error( pConn, 414, "URI Too Long" );
+		return;
+	}
+	memcpy(request, pConn->rx_buffer, length);
+	request[length] = '\0';
+
+	p_method = strtok_r(request, " ", &p_save);
+	p_target = strtok_r(NULL, " ?#", &p_save);
+	if ((p_method == NULL) || (p_target == NULL) || (p_target[0] != '/'))
+	{
+		Http_Server_Respond_Error( pConn, 400, "Bad Request" );
+		return;
+	}
+
+	if (strcmp(p_method, "GET") != 0)
+	{
+		Http_Server_Respond_Error( pConn, 405, "Method Not Allowed" );
+		return;
+	}
+
+	if (strcmp(p_target, HTTP_WEBSOCKET_PATH) == 0)
+	{
+		Http_Server_Upgrade( pConn, header_length );
+		return;
+	}
+
+	if (strcmp(p_target, HTTP_EVENTS_PATH) == 0)
+	{
+		Http_Server_Start_Events( pConn );
+		return;
+	}
+
+	if (strcmp(p_target, HTTP_METRICS_PATH) == 0)
+	{
+		Http_Server_Respond_Metrics( pConn );
+		return;
+	}
+
+	if (strcmp(p_target, "/") == 0)
+		p_target = HTTP_DEFAULT_FILE;
+
+	snprintf(path, sizeof(path), "%s%s", HTTP_DOCUMENT_ROOT, p_target);
+
+	// Nothing outside the document root is served
+	if ((strstr(p_target, "..") != NULL) ||
+		((pConn->file_fd = open(path, O_RDONLY | O_CLOEXEC)) < 0))
+	{
+		Http_Server_Respond_Error( pConn, 404, "Not Found" );
+		return;
+	}
+
+	if ((fstat(pConn->file_fd, &file_stat) < 0) || !S_ISREG(file_stat.st_mode))
+	{
+		close(pConn->file_fd);
+		pConn->file_fd = -1;
+		Http_Server_Respond_Error( pConn, 404, "Not Found" );
+		return;
+	}
+
+	pConn->state = HTTP_STATE_FILE;
+	pConn->file_offset = 0;
+	pConn->file_size = file_stat.st_size;
+
+	length = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\n"
+											  "Content-Type: %s\r\n"
+											  "Content-Length: %lld\r\n"
+											  "Connection: close\r\n\r\n",
+					  Http_Server_Content_Type( path ), (long long)file_stat.st_size);
+
+	Http_Server_Send( pConn, header, length );
+	Http_Server_Send_Pending( pConn );
+}
+
+/***************************************************************************************************
+Sends an error response and closes the connection once it is out
+***************************************************************************************************/
+static void Http_Server_Respond_Error( http_conn_type* pConn, int status, const char* p_reason )
+{
+	char response[256];
+	int length;
+
+	length = snprintf(response, sizeof(response), "HTTP/1.1 %d %s\r\n"
+												  "Content-Type: text/plain\r\n"
+												  "Content-Length: %d\r\n"
+												  "Connection: close\r\n\r\n%s\n",
+					  status, p_reason, (int)strlen(p_reason) + 1, p_reason);
+
+	pConn->state = HTTP_STATE_CLOSING;
+	Http_Server_Send( pConn, response, length );
+	Http_Server_Send_Pending( pConn );
+}
+
+/***************************************************************************************************
+Sends the metrics in the Prometheus text format and closes the connection once they are out
+***************************************************************************************************/
+static void Http_Server_Respond_Metrics( http_conn_type* pConn )
+{
+	static char body[HTTP_METRICS_BUFFER_SIZE];
+	char header[160];
+	str_builder_type builder;
+	int length;
+
+	Str_Builder_Init( &builder, body, sizeof(body), NULL, NULL );
+	Metrics_Format_Prometheus( &builder );
+
+	length = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\n"
+											  "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+											  "Content-Length: %d\r\n"
+											  "Connection: close\r\n\r\n",
+					  builder.length);
+
+	pConn->state = HTTP_STATE_CLOSING;
+	Http_Server_Send( pConn, header, length );
+	Http_Server_Send( pConn, body, builder.length );
+	Http_Server_Send_Pending( pConn );
+}
+
+/***************************************************************************************************
+Sends one WebSocket frame.  The header and payload go out in a single write.
+***************************************************************************************************/
+static void Http_Ws_Send_Message( http_conn_type* pConn, int opcode, bool fin, const char* p_data, int length )
+{
+	uint8_t frame[WEBSOCKET_MAX_HEADER_SIZE + HTTP_CHUNK_SIZE];
+	int header_length;
+
+	if (length > HTTP_CHUNK_SIZE)
+		length = HTTP_CHUNK_SIZE;
+
+	header_length = Websocket_Encode_Header( frame, opcode, fin, length );
+	if (length > 0)
+		memcpy(&frame[header_length], p_data, length);
+
+	Http_Server_Send( pConn, (const char*)frame, header_length + length );
+}
+
+/***************************************************************************************************
+Sends a close frame with a status code and closes the connection once it is out
+***************************************************************************************************/
+static void Http_Ws_Close( http_conn_type* pConn, int status )
+{
+	char payload[2] = { (char)(status >> 8), (char)status };
+
+	Http_Ws_Send_Message( pConn, WEBSOCKET_OPCODE_CLOSE, true, payload, sizeof(payload) );
+	pConn->state = HTTP_STATE_CLOSING;
+	Http_Server_Send_Pending( pConn );
+}
+
+/***************************************************************************************************
+Flush function of the response builder.  A response longer than HTTP_CHUNK_SIZE is sent as a
+fragmented message, this sends every fragment except the last.
+***************************************************************************************************/
+static void Http_Ws_Send_Fragment( void* pContext, const char* p_data, int length )
+{
+	http_conn_type* pConn = (http_conn_type*)pContext;
+
+	Http_Ws_Send_Message( pConn, pConn->fragmented ? WEBSOCKET_OPCODE_CONTINUATION : WEBSOCKET_OPCODE_TEXT,
+						  false, p_data, length );
+	pConn->fragmented = true;
+}
+
+/***************************************************************************************************
+Runs a command line received from a browser and sends the response as one message.  Unknown
+commands are echoed, as on the Ethernet port.
+***************************************************************************************************/
+static void Http_Ws_Process_Command( http_conn_type* pConn, const uint8_t* p_payload, int length )
+{
+	char line[HTTP_WS_MAX_MESSAGE + 1];
+	char buffer[HTTP_CHUNK_SIZE + 1];
+	str_builder_type builder;
+
+	memcpy(line, p_payload, length);
+	line[length] = '\0';
+
+	pConn->fragmented = false;
+	Str_Builder_Init( &builder, buffer, sizeof(buffer), Http_Ws_Send_Fragment, pConn );
+
+	if (Cmd_Registry_Execute( CMD_FRONTEND_WEBSOCKET, pConn, line, &builder ) == CMD_RESULT_UNKNOWN)
+		Str_Builder_Append( &builder, line );
+
+	Http_Ws_Send_Message( pConn, pConn->fragmented ? WEBSOCKET_OPCODE_CONTINUATION : WEBSOCKET_OPCODE_TEXT,
+						  true, Str_Builder_Get( &builder ), Str_Builder_Length( &builder ) );
+}
+
+/***************************************************************************************************
+Processes every complete frame in the receive buffer.  Messages from browsers are short command
+lines, fragmented and binary messages are refused.
+***************************************************************************************************/
+static void Http_Server_Process_Frames( http_conn_type* pConn )
+{
+	websocket_frame_type frame;
+	int offset = 0;
+	int length;
+
+	while (pConn->state == HTTP_STATE_WEBSOCKET)
+	{
+		length = Websocket_Decode_Frame( (uint8_t*)&pConn->rx_buffer[offset], pConn->rx_length - offset,
+										 HTTP_WS_MAX_MESSAGE, &frame );
+		if (length == WEBSOCKET_INCOMPLETE)
+			break;
+		if (length < 0)
+		{
+			Http_Ws_Close( pConn, (length == WEBSOCKET_TOO_LONG) ? WEBSOCKET_CLOSE_TOO_BIG : WEBSOCKET_CLOSE_PROTOCOL_ERROR );
+			return;
+		}
+		offset += length;
+
+		switch (frame.opcode)
+		{
+			case WEBSOCKET_OPCODE_TEXT:
+				if (!frame.fin)
+				{
+					Http_Ws_Close( pConn, WEBSOCKET_CLOSE_UNSUPPORTED );
+					return;
+				}
+				Http_Ws_Process_Command( pConn, frame.p_payload, frame.payload_length );
+				break;
+
+			case WEBSOCKET_OPCODE_PING:
+				Http_Ws_Send_Message( pConn, WEBSOCKET_OPCODE_PONG, true, (const char*)frame.p_payload, frame.payload_length );
+				break;
+
+			case WEBSOCKET_OPCODE_PONG:
+				break;
+
+			case WEBSOCKET_OPCODE_CLOSE:
+				Http_Ws_Send_Message( pConn, WEBSOCKET_OPCODE_CLOSE, true, (const char*)frame.p_payload,
+									  (frame.payload_length >= 2) ? 2 : 0 );
+				pConn->state = HTTP_STATE_CLOSING;
+				Http_Server_Send_Pending( pConn );
+				return;
+
+			default:
+				Http_Ws_Close( pConn, WEBSOCKET_CLOSE_UNSUPPORTED );
+				return;
+		}
+
+		if (pConn->fd < 0)
+			return;
+	}
+
+	pConn->rx_length -= offset;
+	memmove(pConn->rx_buffer, &pConn->rx_buffer[offset], pConn->rx_length);
+}
+
+/***************************************************************************************************
+Flush function of the event stream builder
+***************************************************************************************************/
+static void Http_Server_Send_Chunk( void* pContext, const char* p_data, int length )
+{
+	Http_Server_Send( (http_conn_type*)pContext, p_data, length );
+}
+
+/***************************************************************************************************
+Writes the history of one channel of the current cook as a data line of the backfill event.  A
+channel whose samples there is not enough memory to collect is sent without points.
+***************************************************************************************************/
+static void Http_Server_Backfill_Channel( str_builder_type* pBuilder, int channel, int64_t from_ms, int64_t to_ms )
+{
+	int64_t times[HTTP_SSE_BACKFILL_POINTS];
+	float values[HTTP_SSE_BACKFILL_POINTS];
+	int count;
+	int i;
+
+	count = History_Query_Arrays( HISTORY_COOK_CURRENT, channel, from_ms, to_ms, times, values, HTTP_SSE_BACKFILL_POINTS );
+	if (count < 0)
+		count = 0;
+
+	Str_Builder_Printf( pBuilder, "data: HISTORY,%d,%d", channel, count );
+	for (i = 0; i < count; i++)
+	{
+		Str_Builder_Append_Char( pBuilder, ',' );
+		Str_Builder_Append_Int( pBuilder, times[i] );
+		Str_Builder_Append_Char( pBuilder, ',' );
+		Str_Builder_Append_Fixed( pBuilder, values[i], 2 );
+	}
+	Str_Builder_Append_Char( pBuilder, '\n' );
+}
+
+/***************************************************************************************************
+Starts a Server-Sent Events stream.  The first event holds the history of the current cook,
+downsampled to HTTP_SSE_BACKFILL_POINTS points per channel (0-9 probes, 10 fire, 11 setpoint,
+12 servo), with the time it covers up to as its id:
+
+	event: history
+	data: HISTORY,<channel>,<nbr points>,<time ms>,<value>,...		(one line per channel)
+	data: HISTORY,END
+	id: <time ms>
+
+A browser that reconnects sends the id of the last event it received as Last-Event-ID and only
+gets the history after it.  A DELTA subscription to every field follows, one event per frame with
+the time of the frame as its id:
+
+	id: <time ms>
+	data: PUSH,...  or  DELTA,...
+
+Browsers only dispatch complete events, so a dropped connection never leaves part of one behind
+and a resumed stream neither repeats nor misses samples.
+***************************************************************************************************/
+static void Http_Server_Start_Events( http_conn_type* pConn )
+{
+	char buffer[HTTP_CHUNK_SIZE + 1];
+	char value[32];
+	char* p_end;
+	str_builder_type builder;
+	history_stats_type stats;
+	int64_t now_ms = Telemetry_Get_Time_Ns( CLOCK_REALTIME ) / 1000000;
+	int64_t from_ms;
+	int64_t last_id;
+	int channel;
+
+	History_Get_Stats( HISTORY_COOK_CURRENT, &stats );
+	from_ms = stats.first_ms;
+
+	if (Http_Server_Get_Header( pConn->rx_buffer, "Last-Event-ID", value, sizeof(value) ) > 0)
+	{
+		last_id = strtoll(value, &p_end, 10);
+		if ((*p_end == '\0') && (p_end != value) && (last_id >= from_ms))
+			from_ms = last_id + 1;
+	}
+
+	pConn->state = HTTP_STATE_EVENTS;
+	pConn->rx_length = 0;
+
+	Str_Builder_Init( &builder, buffer, sizeof(buffer), Http_Server_Send_Chunk, pConn );
+	Str_Builder_Printf( &builder, "HTTP/1.1 200 OK\r\n"
+								  "Content-Type: text/event-stream\r\n"
+								  "Cache-Control: no-cache\r\n"
+								  "Connection: keep-alive\r\n\r\n"
+								  "retry: %d\n\n"
+								  "event: history\n", HTTP_SSE_RETRY_MS );
+
+	if ((stats.first_ms > 0) && (from_ms <= now_ms))
+	{
+		for (channel = 0; channel < NBR_TELEMETRY_CHANNELS; channel++)
+			Http_Server_Backfill_Channel( &builder, channel, from_ms, now_ms );
+	}
+
+	Str_Builder_Printf( &builder, "data: HISTORY,END\nid: %lld\n\n", (long long)now_ms );
+	Str_Builder_Flush( &builder );
+
+	Subscription_Start( &pConn->subscription, SUBSCRIPTION_ALL_FIELDS, HTTP_SSE_PERIOD_MS, true );
+}
+
+/***************************************************************************************************
+Fills a snapshot from a copy of the shared data taken under the mutex
+***************************************************************************************************/
+static void Http_Server_Take_Snapshot( subscription_snapshot_type* pSnapshot )
+{
+	shared_data_type local_shared_data;
+
+	pthread_mutex_lock(&mutex);
+	memcpy( (char*)&local_shared_data, (char*)p_shared_data, sizeof(local_shared_data) );
+	pthread_mutex_unlock(&mutex);
+
+	Subscription_Take_Snapshot( &local_shared_data, pSnapshot );
+}
+
+/***************************************************************************************************
+Sends a status frame to every WebSocket and event stream subscriber that is due, as for the
+Ethernet subscribers.  On a WebSocket each frame is one text message without the line terminator,
+on an event stream it is one event.
+
+Returns the time in ms until the next frame is due
+***************************************************************************************************/
+static int Http_Server_Push_Subscriptions( int64_t now_ms )
+{
+	static struct
+	{
+		uint32_t mask;
+		bool keyframe;
+		int length;
+		char buffer[SUBSCRIPTION_MAX_FRAME_SIZE];
+	} frames[HTTP_MAX_PUSH_FRAMES];
+	int nbr_frames = 0;
+	subscription_snapshot_type snapshot;
+	bool have_snapshot = false;
+	char event[SUBSCRIPTION_MAX_FRAME_SIZE + 32];
+	http_conn_type* pConn;
+	subscription_type* pSubscription;
+	uint32_t mask;
+	bool keyframe;
+	int64_t next_ms = now_ms + HTTP_POLL_PERIOD_MS;
+	int length;
+	int i, j;
+
+	for (i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+	{
+		pConn = &g_http_conns[i];
+		pSubscription = &pConn->subscription;
+		if ((pConn->fd < 0) || !Http_Server_Is_Streaming( pConn ) || (pSubscription->mask == 0))
+			continue;
+
+		if (now_ms >= pSubscription->next_ms)
+		{
+			if (!have_snapshot)
+			{
+				Http_Server_Take_Snapshot( &snapshot );
+				have_snapshot = true;
+			}
+
+			mask = Subscription_Next_Frame( pSubscription, &snapshot, now_ms, &keyframe );
+
+			for (j = 0; j < nbr_frames; j++)
+			{
+				if ((frames[j].mask == mask) && (frames[j].keyframe == keyframe))
+					break;
+			}
+
+			if ((mask != 0) && (j >= nbr_frames))
+			{
+				j = (nbr_frames < HTTP_MAX_PUSH_FRAMES) ? nbr_frames++ : (HTTP_MAX_PUSH_FRAMES - 1);
+				frames[j].mask = mask;
+				frames[j].keyframe = keyframe;
+				frames[j].length = Subscription_Format_Frame( &snapshot, mask, keyframe, frames[j].buffer, sizeof(frames[j].buffer) );
+			}
+
+			if ((mask != 0) && (frames[j].length > 1) && (pConn->state == HTTP_STATE_WEBSOCKET))
+				Http_Ws_Send_Message( pConn, WEBSOCKET_OPCODE_TEXT, true, frames[j].buffer, frames[j].length - 1 );
+			else if ((mask != 0) && (frames[j].length > 1))
+			{
+				length = snprintf(event, sizeof(event), "id: %lld\ndata: %s\n", (long long)snapshot.timestamp_ms, frames[j].buffer);
+				Http_Server_Send( pConn, event, length );
+			}
+		}
+
+		if ((pConn->fd >= 0) && (pSubscription->next_ms < next_ms))
+			next_ms = pSubscription->next_ms;
+	}
+
+	return (next_ms > now_ms) ? (int)(next_ms - now_ms) : 0;
+}
+
+/* *** End of File *** */
@@ -0,0 +1,10 @@
+#ifndef __HTTP_SERVER_H
+#define __HTTP_SERVER_H
+
+#include "subscription.h"			// For subscription_type
+
+int Http_Server_Init( void* shared_data_address );
+void Http_Server_Service( void );
+subscription_type* Http_Server_Get_Subscription( void* pConnection );
+
+#endif //__HTTP_SERVER_H
@@ -8,6 +8,7 @@
 #include "main.h"
 #include "logging.h"
 #include "thermistor.h"
+#include "metrics.h"
 
 /* *** Constants *** */
 
@@ -68,6 +69,7 @@ void Logging_Service( void *shared_data_address )
 	uint16_t local_servo_position;                  	// Local copy of the servo position
 	time_t t = time(NULL);								// Used for obtaining current time
 	struct tm tm;										// Used for obtaining current time
+	int64_t write_start_ns;								// For the log write latency metric
 	uint8_t i;
 
 	// Pointer for accessing shared data
@@ -92,6 +94,7 @@ void Logging_Service( void *shared_data_address )
 		// as well write the servo position as well.  Good a time as any.
 		t = time(NULL);
 		tm = *localtime(&t);
+		write_start_ns = Metrics_Now_Ns();
 		fprintf(write_ptr, "%d-%d-%d %2d:%02d:%02d,%u", tm.tm_year + 1900, tm.tm_mon + 1,
 				tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, local_servo_position);
 
@@ -105,6 +108,7 @@ void Logging_Service( void *shared_data_address )
 		
 		fwrite("\n", 1, 1, write_ptr);	// Append a new line to the file
 		fflush(write_ptr);				// Force the write to disk
+		Metrics_Observe_Since( METRIC_LOG_WRITE, write_start_ns );
 
 		Logging_Full_Sleep(15);			// Delay 15 seconds before writing the next log entry
 	}
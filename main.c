@@ -14,6 +14,8 @@ Five threads
     Logging - Thread for logging data to the uSD card
     Command Line - Thread for reading commands from the command line interface
     Ethernet Comms - Thread for listening for system commands over ethernt
+    Telemetry - Thread for writing high rate binary telemetry to the uSD card
+    Event Log - Thread for writing queued events to syslog
 *******************************************************************************/
 
 #include <stdio.h>
@@ -30,9 +32,21 @@ Five threads
 #include "logging.h"
 #include "cmd_line.h"
 #include "rev_history.h"
-//#include "file_fifo.h"
+#include "file_fifo.h"
 #include "eth_comms.h"			// For Ethernet communications
 #include "monitor.h"
+#include "telemetry.h"
+#include "column_log.h"
+#include "history.h"
+#include "rollup.h"
+#include "event_log.h"
+#include "commands.h"
+#include "http_server.h"
+#include "multicast.h"
+#include "metrics.h"
+#include "trace.h"
+#include "shm_telemetry.h"
+#include "notify.h"
 
 typedef enum 
 {
@@ -41,8 +55,12 @@ typedef enum
 	THREAD_ID_CMD_LINE,			// Thread for reading data from the cmd line
 	THREAD_ID_ETHERNET,			// Thread for communication via Ethernet
 	THREAD_ID_MONITOR,			// Thread for monitoring the system and sending notifications
-//	THREAD_ID_FILE_FIFO_IN,		// Thread for reading from external programs
-//	THREAD_ID_FILE_FIFO_OUT,	// Thread for writing to external programs
+	THREAD_ID_TELEMETRY,		// Thread for writing binary telemetry to the uSD card
+	THREAD_ID_EVENT_LOG,		// Thread for writing queued events to syslog
+	THREAD_ID_HTTP,				// Thread for the web interface
+	THREAD_ID_MULTICAST,		// Thread for publishing status datagrams on the LAN
+	THREAD_ID_FILE_FIFO,		// Thread for the named pipes of external programs
+	THREAD_ID_NOTIFY,			// Thread for delivering notifications
 
 	NBR_THREADS,
 } thread_ids;
@@ -65,17 +83,44 @@ static void Main_Signal_Handler( int signal );
 
 void Main_Init_Hardware( void )
 {
+	if (Metrics_Init() < 0)
+	{
+		printf("Error initializing metrics\n");
+		_exit(3);
+	}
+
+	// The cycle counter is opened for the calling thread, the one running the control loop
+	if (Trace_Init() < 0)
+	{
+		printf("Error initializing tracing\n");
+		_exit(3);
+	}
+
+	Event_Log_Init();
+
+	if (Notify_Init() < 0)
+	{
+		printf("Error initializing notifications\n");
+		_exit(3);
+	}
+
+	if (Commands_Init(&shared_data) < 0)
+	{
+		printf("Error registering commands\n");
+		_exit(3);
+	}
+
 	if (Servo_Init() < 0)
 	{
 		printf("Unable to obtain servo control.\nIs pigpiod running?\n");
 		_exit(3);
 	}
 
-//	if (File_Fifo_Init() <= 0)
-//	{
-//		printf("Error making pipes\n");
-//		_exit(3);
-//	}
+	if (File_Fifo_Init() <= 0)
+	{
+		printf("Error making pipes\n");
+		_exit(3);
+	}
 
 	if (Eth_Comms_Init(&shared_data) < 0)
 	{
@@ -83,10 +128,27 @@ void Main_Init_Hardware( void )
 		_exit(3);
 	}
 
+	if (Http_Server_Init(&shared_data) < 0)
+	{
+		printf("Error initializing the web server\n");
+		_exit(3);
+	}
+
+	if (Multicast_Init(&shared_data) < 0)
+	{
+		printf("Error initializing multicast\n");
+		_exit(3);
+	}
+
 	Tlc1543_Init();
 	Thermistor_Init();
 	App_Init( &shared_data );
 	Logging_Init();
+	Telemetry_Init();
+	Shm_Telemetry_Init();
+	Column_Log_Init();
+	History_Init();
+	Rollup_Init();
 	Cmd_Line_Init( &shared_data );
 	Monitor_Init( &shared_data );
 	sleep(1);
@@ -96,6 +158,9 @@ int main( void )
 {
 	pthread_t thread[NBR_THREADS];
 	int thread_result[NBR_THREADS];
+	int64_t tick_start_ns;
+	int64_t last_tick_ns = 0;
+	int64_t sleep_start_ns = 0;
 	int i;
 	
 	signal(SIGINT, Main_Signal_Handler);
@@ -126,14 +191,37 @@ int main( void )
 	
 	// Spin off the monitor thread
 	pthread_create(&thread[THREAD_ID_MONITOR], NULL, (void*)&Monitor_Service, (void*)&shared_data);
+
+	// Spin off the telemetry thread so that binary telemetry may be written in the background
+	pthread_create(&thread[THREAD_ID_TELEMETRY], NULL, (void*)&Telemetry_Service, (void*)&shared_data);
+
+	// Spin off the event log thread so that syslog is only written in the background
+	pthread_create(&thread[THREAD_ID_EVENT_LOG], NULL, (void*)&Event_Log_Service, (void*)&shared_data);
+
+	// Spin off the web server thread so that browsers are served directly
+	pthread_create(&thread[THREAD_ID_HTTP], NULL, (void*)&Http_Server_Service, (void*)&shared_data);
+
+	// Spin off the multicast thread so that status datagrams go out on time
+	pthread_create(&thread[THREAD_ID_MULTICAST], NULL, (void*)&Multicast_Service, (void*)&shared_data);
 	
-	// Spin off the file fifo threads so that external programs can communicate via pipes
-//	pthread_create(&thread[THREAD_ID_FILE_FIFO_IN], NULL, (void*)&File_Fifo_Service_Input, (void*)&shared_data);
-//	pthread_create(&thread[THREAD_ID_FILE_FIFO_OUT], NULL, (void*)&File_Fifo_Service_Output, (void*)&shared_data);
+	// Spin off the file fifo thread so that external programs can communicate via pipes
+	pthread_create(&thread[THREAD_ID_FILE_FIFO], NULL, (void*)&File_Fifo_Service, (void*)&shared_data);
+
+	// Spin off the notification thread so that mail and webhooks never hold up the monitor
+	pthread_create(&thread[THREAD_ID_NOTIFY], NULL, (void*)&Notify_Service, (void*)&shared_data);
 	
 	while (!g_exit_signal_received)
 	{
+		tick_start_ns = Metrics_Now_Ns();
+		if ((last_tick_ns != 0) && ((tick_start_ns - last_tick_ns) > (MAIN_LOOP_OVERRUN_US * 1000LL)))
+			Metrics_Add( METRIC_CONTROL_TICK_OVERRUNS, 1 );
+		if (sleep_start_ns != 0)
+			Metrics_Observe_Since( METRIC_CONTROL_TICK_JITTER, sleep_start_ns + (MAIN_LOOP_TIME_US * 1000LL) );
+		last_tick_ns = tick_start_ns;
+
 		App_Service();
+		sleep_start_ns = Metrics_Now_Ns();
+		Metrics_Observe_Us( METRIC_CONTROL_TICK, (sleep_start_ns - tick_start_ns) / 1000 );
 		usleep(MAIN_LOOP_TIME_US);
 	}
 	
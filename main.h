@@ -17,6 +17,15 @@
 #endif
 
 #define MAIN_LOOP_TIME_US									5000
+#define MAIN_LOOP_OVERRUN_US								(2 * MAIN_LOOP_TIME_US)	// A tick was missed
+
+// Pipes of the pigpio daemon, may be pointed elsewhere at build time, e.g. at a stand-in daemon
+#ifndef PIGPIO_COMMAND_PIPE
+#define PIGPIO_COMMAND_PIPE									"/dev/pigpio"
+#endif
+#ifndef PIGPIO_RESPONSE_PIPE
+#define PIGPIO_RESPONSE_PIPE								"/dev/pigout"
+#endif
 
 extern pthread_mutex_t mutex;
 extern pthread_mutex_t pigpio_mutex;
@@ -25,6 +34,8 @@ extern pthread_mutex_t pigpio_mutex;
 typedef struct
 {
 	uint16_t adc_results[NBR_ADC_CHANNELS];		// Data read by the ADC
+	int64_t adc_sweep_start_ns;						// CLOCK_MONOTONIC start of the sweep that read adc_results
+	int64_t adc_sweep_end_ns;						// ...and its end
 	uint16_t servo_position;							// Current position of the servo
 	float temp_deg_f[NBR_OF_THERMISTORS];			// Temperature data resulting from the ADC conversions
 	float temp_deg_f_fire;								// Thermocouple temperature
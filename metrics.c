@@ -0,0 +1,283 @@
+/***************************************************************************************************
+Metrics
+
+Counters, gauges and fixed-bucket histograms describing how the daemon itself performs: how long an
+ADC sweep takes, how long threads wait for the pigpio pipes, control ticks that ran late, the
+Ethernet clients and how long log writes take.  They are exported in the Prometheus text format by
+GET /metrics of the HTTP server and by the METRICS? command.
+
+Counters and histograms are split into one shard per thread.  A thread claims its shard the first
+time it records something and then only ever adds to its own cache lines, so recording costs a
+relaxed atomic add, with no lock and no line bouncing between the producers.  The exporter sums
+the shards.  Gauges are set rather than added to, so each has a single value.
+
+Histograms are kept in microseconds and exported in seconds, as Prometheus expects.  The CPU time
+of the process is read when exporting, under the standard name of the Prometheus client libraries.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include "metrics.h"
+#include "spsc_ring.h"			// For SPSC_RING_CACHE_LINE_SIZE
+#include "cmd_registry.h"
+
+/* *** Data Types *** */
+typedef enum
+{
+	METRIC_KIND_COUNTER = 0,
+	METRIC_KIND_GAUGE,
+	METRIC_KIND_HISTOGRAM,
+} metric_kind_type;
+
+typedef struct
+{
+	const char* name;							// Without METRICS_PREFIX
+	const char* help;
+	metric_kind_type kind;
+} metric_definition_type;
+
+// The counters recorded by one thread
+typedef struct
+{
+	_Atomic uint64_t slots[METRICS_MAX_SLOTS];
+} __attribute__((aligned(SPSC_RING_CACHE_LINE_SIZE))) metrics_shard_type;
+
+/* *** Global Variables *** */
+static const metric_definition_type g_metrics[NBR_METRICS] =
+{
+	[METRIC_ADC_SWEEP]				= { "adc_sweep_seconds",			"Time to read every ADC channel once",				METRIC_KIND_HISTOGRAM },
+	[METRIC_PIGPIO_MUTEX_WAIT]		= { "pigpio_mutex_wait_seconds",	"Time spent waiting for the pigpio pipes",			METRIC_KIND_HISTOGRAM },
+	[METRIC_SERVO_WRITE]			= { "servo_write_seconds",			"Time to send one servo command to pigpio",		METRIC_KIND_HISTOGRAM },
+	[METRIC_SERVO_WRITE_ERRORS]		= { "servo_write_errors_total",		"Servo commands pigpio did not accept",				METRIC_KIND_COUNTER },
+	[METRIC_CONTROL_TICK]			= { "control_tick_seconds",			"Time of one pass of the control loop",				METRIC_KIND_HISTOGRAM },
+	[METRIC_CONTROL_TICK_OVERRUNS]	= { "control_tick_overruns_total",	"Control loop passes that started late",			METRIC_KIND_COUNTER },
+	[METRIC_CONTROL_TICK_JITTER]	= { "control_tick_jitter_seconds",	"How much later than asked the control loop woke up",	METRIC_KIND_HISTOGRAM },
+	[METRIC_TCP_CLIENTS]			= { "tcp_clients",					"Ethernet clients connected",						METRIC_KIND_GAUGE },
+	[METRIC_TCP_CONNECTIONS]		= { "tcp_connections_total",		"Ethernet connections accepted",					METRIC_KIND_COUNTER },
+	[METRIC_TCP_RX_BYTES]			= { "tcp_rx_bytes_total",			"Bytes received from Ethernet clients",				METRIC_KIND_COUNTER },
+	[METRIC_TCP_TX_BYTES]			= { "tcp_tx_bytes_total",			"Bytes sent to Ethernet clients",					METRIC_KIND_COUNTER },
+	[METRIC_LOCAL_CLIENTS]			= { "local_clients",				"Clients of the local socket connected",			METRIC_KIND_GAUGE },
+	[METRIC_LOCAL_CONNECTIONS]		= { "local_connections_total",		"Local socket connections accepted",				METRIC_KIND_COUNTER },
+	[METRIC_LOCAL_DENIED]			= { "local_denied_total",			"Local commands refused for lack of permission",	METRIC_KIND_COUNTER },
+	[METRIC_WS_ORIGIN_REFUSED]		= { "ws_origin_refused_total",		"WebSocket handshakes refused for their origin",	METRIC_KIND_COUNTER },
+	[METRIC_NOTIFICATIONS]			= { "notifications_total",			"Notifications and digests delivered",				METRIC_KIND_COUNTER },
+	[METRIC_NOTIFICATIONS_HELD]		= { "notifications_held_total",		"Repeated notifications folded into digests",		METRIC_KIND_COUNTER },
+	[METRIC_NOTIFY_SINK_ERRORS]		= { "notify_sink_errors_total",		"Notifications a sink failed to deliver",			METRIC_KIND_COUNTER },
+	[METRIC_LOG_WRITE]				= { "log_write_seconds",			"Time to write and flush one line of the CSV log",	METRIC_KIND_HISTOGRAM },
+	[METRIC_COLUMN_LOG_SYNC]		= { "column_log_sync_seconds",		"Time to schedule the write back of the column log",	METRIC_KIND_HISTOGRAM },
+	[METRIC_TELEMETRY_DROPPED]		= { "telemetry_dropped_records_total",	"Telemetry records lost to a full ring",		METRIC_KIND_COUNTER },
+};
+
+// Upper bounds of the finite buckets of every histogram, the last bucket (+Inf) takes the rest
+static const uint32_t g_bucket_bounds_us[METRICS_NBR_BUCKETS] =
+{
+	10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000
+};
+
+static metrics_shard_type g_shards[METRICS_MAX_THREADS];
+static _Atomic int g_nbr_shards = 0;
+static __thread int t_shard = -1;				// Shard of the calling thread, -1 until it records something
+
+static int g_first_slot[NBR_METRICS];			// Histograms: buckets, +Inf, then the sum
+static _Atomic int64_t g_gauges[NBR_METRICS];
+
+static int Metrics_Command( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+
+static const cmd_definition_type g_metrics_cmds[] =
+{
+	{ "METRICS",	{ NULL },	"Returns the performance metrics of the daemon in the Prometheus text format",
+		CMD_FRONTEND_ALL, 0, 0, { { 0 } },		Metrics_Command },
+};
+#define METRICS_CMDS_SIZE		(sizeof (g_metrics_cmds)/sizeof(g_metrics_cmds[0]))
+
+/***************************************************************************************************
+Lays out the slots of the shards and adds the METRICS command
+
+Returns -1 on error
+		 1 on success
+***************************************************************************************************/
+int Metrics_Init( void )
+{
+	int slot = 0;
+	int i;
+
+	for (i = 0; i < NBR_METRICS; i++)
+	{
+		g_first_slot[i] = slot;
+		if (g_metrics[i].kind == METRIC_KIND_HISTOGRAM)
+			slot += METRICS_NBR_BUCKETS + 2;
+		else if (g_metrics[i].kind == METRIC_KIND_COUNTER)
+			slot++;
+	}
+
+	if (slot > METRICS_MAX_SLOTS)
+	{
+		printf("Error laying out %d metric slots - %s.%u\n", slot, __FILE__, __LINE__);
+		return -1;
+	}
+
+	return Cmd_Registry_Add( g_metrics_cmds, METRICS_CMDS_SIZE );
+}
+
+/***************************************************************************************************
+Returns the shard of the calling thread, claiming one on its first call
+***************************************************************************************************/
+static inline metrics_shard_type* Metrics_Get_Shard( void )
+{
+	if (t_shard < 0)
+	{
+		t_shard = atomic_fetch_add( &g_nbr_shards, 1 );
+		if (t_shard >= METRICS_MAX_THREADS)
+			t_shard = METRICS_MAX_THREADS - 1;	// Still correct, the adds are atomic
+	}
+
+	return &g_shards[t_shard];
+}
+
+/***************************************************************************************************
+Adds value to a counter
+***************************************************************************************************/
+void Metrics_Add( metric_id_type id, uint64_t value )
+{
+	atomic_fetch_add_explicit( &Metrics_Get_Shard()->slots[g_first_slot[id]], value, memory_order_relaxed );
+}
+
+/***************************************************************************************************
+Records one observation of a histogram
+***************************************************************************************************/
+void Metrics_Observe_Us( metric_id_type id, uint64_t value_us )
+{
+	metrics_shard_type* pShard = Metrics_Get_Shard();
+	int bucket = 0;
+
+	while ((bucket < METRICS_NBR_BUCKETS) && (value_us > g_bucket_bounds_us[bucket]))
+		bucket++;
+
+	atomic_fetch_add_explicit( &pShard->slots[g_first_slot[id] + bucket], 1, memory_order_relaxed );
+	atomic_fetch_add_explicit( &pShard->slots[g_first_slot[id] + METRICS_NBR_BUCKETS + 1], value_us, memory_order_relaxed );
+}
+
+void Metrics_Observe_Since( metric_id_type id, int64_t start_ns )
+{
+	int64_t elapsed_ns = Metrics_Now_Ns() - start_ns;
+
+	Metrics_Observe_Us( id, (elapsed_ns > 0) ? (uint64_t)(elapsed_ns / 1000) : 0 );
+}
+
+void Metrics_Gauge_Set( metric_id_type id, int64_t value )
+{
+	atomic_store_explicit( &g_gauges[id], value, memory_order_relaxed );
+}
+
+void Metrics_Gauge_Add( metric_id_type id, int64_t value )
+{
+	atomic_fetch_add_explicit( &g_gauges[id], value, memory_order_relaxed );
+}
+
+/***************************************************************************************************
+Returns the sum of one slot over every shard in use
+***************************************************************************************************/
+static uint64_t Metrics_Sum_Slot( int slot )
+{
+	int nbr_shards = atomic_load( &g_nbr_shards );
+	uint64_t sum = 0;
+	int i;
+
+	if (nbr_shards > METRICS_MAX_THREADS)
+		nbr_shards = METRICS_MAX_THREADS;
+
+	for (i = 0; i < nbr_shards; i++)
+		sum += atomic_load_explicit( &g_shards[i].slots[slot], memory_order_relaxed );
+
+	return sum;
+}
+
+/***************************************************************************************************
+Writes the cumulative buckets, sum and count of a histogram.  Producers keep recording while it is
+read, so the count may be a few observations ahead of the sum; Prometheus tolerates that.
+***************************************************************************************************/
+static void Metrics_Format_Histogram( str_builder_type* pBuilder, const char* p_name, int first_slot )
+{
+	uint64_t count = 0;
+	int i;
+
+	for (i = 0; i <= METRICS_NBR_BUCKETS; i++)
+	{
+		count += Metrics_Sum_Slot( first_slot + i );
+
+		Str_Builder_Printf( pBuilder, METRICS_PREFIX "%s_bucket{le=\"", p_name );
+		if (i < METRICS_NBR_BUCKETS)
+			Str_Builder_Append_Fixed( pBuilder, g_bucket_bounds_us[i] / 1000000.0, 6 );
+		else
+			Str_Builder_Append( pBuilder, "+Inf" );
+		Str_Builder_Append( pBuilder, "\"} " );
+		Str_Builder_Append_Uint( pBuilder, count );
+		Str_Builder_Append_Char( pBuilder, '\n' );
+	}
+
+	Str_Builder_Printf( pBuilder, METRICS_PREFIX "%s_sum ", p_name );
+	Str_Builder_Append_Fixed( pBuilder, Metrics_Sum_Slot( first_slot + METRICS_NBR_BUCKETS + 1 ) / 1000000.0, 6 );
+	Str_Builder_Printf( pBuilder, "\n" METRICS_PREFIX "%s_count ", p_name );
+	Str_Builder_Append_Uint( pBuilder, count );
+	Str_Builder_Append_Char( pBuilder, '\n' );
+}
+
+/***************************************************************************************************
+Writes every metric in the Prometheus text exposition format (version 0.0.4)
+***************************************************************************************************/
+void Metrics_Format_Prometheus( str_builder_type* pBuilder )
+{
+	static const char* kind_names[] = { "counter", "gauge", "histogram" };
+	const metric_definition_type* pMetric;
+	int i;
+
+	for (i = 0; i < NBR_METRICS; i++)
+	{
+		pMetric = &g_metrics[i];
+
+		Str_Builder_Printf( pBuilder, "# HELP " METRICS_PREFIX "%s %s\n", pMetric->name, pMetric->help );
+		Str_Builder_Printf( pBuilder, "# TYPE " METRICS_PREFIX "%s %s\n", pMetric->name, kind_names[pMetric->kind] );
+
+		switch (pMetric->kind)
+		{
+			case METRIC_KIND_COUNTER:
+				Str_Builder_Printf( pBuilder, METRICS_PREFIX "%s ", pMetric->name );
+				Str_Builder_Append_Uint( pBuilder, Metrics_Sum_Slot( g_first_slot[i] ) );
+				Str_Builder_Append_Char( pBuilder, '\n' );
+				break;
+
+			case METRIC_KIND_GAUGE:
+				Str_Builder_Printf( pBuilder, METRICS_PREFIX "%s ", pMetric->name );
+				Str_Builder_Append_Int( pBuilder, atomic_load( &g_gauges[i] ) );
+				Str_Builder_Append_Char( pBuilder, '\n' );
+				break;
+
+			case METRIC_KIND_HISTOGRAM:
+				Metrics_Format_Histogram( pBuilder, pMetric->name, g_first_slot[i] );
+				break;
+		}
+	}
+
+	Str_Builder_Append( pBuilder, "# HELP process_cpu_seconds_total User and system CPU time of the daemon\n"
+								  "# TYPE process_cpu_seconds_total counter\nprocess_cpu_seconds_total " );
+	Str_Builder_Append_Fixed( pBuilder, Telemetry_Get_Time_Ns( CLOCK_PROCESS_CPUTIME_ID ) / 1e9, 6 );
+	Str_Builder_Append_Char( pBuilder, '\n' );
+}
+
+/***************************************************************************************************
+e.g. METRICS?
+
+Response format:  the Prometheus text exposition, one sample per line
+				  METRICS,END
+***************************************************************************************************/
+static int Metrics_Command( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	Metrics_Format_Prometheus( pBuilder );
+	Str_Builder_Append( pBuilder, "METRICS,END" );
+	return 1;
+}
+
+/* *** End of File *** */
@@ -0,0 +1,60 @@
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include <stdint.h>
+#include <time.h>
+#include "str_builder.h"
+#include "telemetry.h"			// For Telemetry_Get_Time_Ns()
+
+#define METRICS_PREFIX				"smokinpi_"
+#define METRICS_MAX_THREADS			16			// Threads with a shard of their own, further threads share the last one
+#define METRICS_MAX_SLOTS			160			// Counters per shard, a histogram uses METRICS_NBR_BUCKETS + 2
+#define METRICS_NBR_BUCKETS			16			// Finite histogram buckets, see g_bucket_bounds_us in metrics.c
+
+/***************************************************************************************************
+Metrics of the daemon itself.  The name, help text and kind of each one are defined in the metric
+table of metrics.c, histograms all share the same latency buckets.
+***************************************************************************************************/
+typedef enum
+{
+	METRIC_ADC_SWEEP = 0,				// Histogram: reading every ADC channel once
+	METRIC_PIGPIO_MUTEX_WAIT,			// Histogram: waiting for pigpio_mutex
+	METRIC_SERVO_WRITE,					// Histogram: one servo command through the pigpio pipes
+	METRIC_SERVO_WRITE_ERRORS,			// Counter
+	METRIC_CONTROL_TICK,				// Histogram: one pass of App_Service()
+	METRIC_CONTROL_TICK_OVERRUNS,		// Counter: ticks started more than MAIN_LOOP_OVERRUN_US after the previous one
+	METRIC_CONTROL_TICK_JITTER,			// Histogram: how much later than asked the control loop woke up
+	METRIC_TCP_CLIENTS,					// Gauge
+	METRIC_TCP_CONNECTIONS,				// Counter: connections accepted
+	METRIC_TCP_RX_BYTES,				// Counter
+	METRIC_TCP_TX_BYTES,				// Counter
+	METRIC_LOCAL_CLIENTS,				// Gauge: clients of the Unix domain socket
+	METRIC_LOCAL_CONNECTIONS,			// Counter
+	METRIC_LOCAL_DENIED,				// Counter: commands refused because the client may not change settings
+	METRIC_WS_ORIGIN_REFUSED,			// Counter: WebSocket handshakes from pages of other sites
+	METRIC_NOTIFICATIONS,				// Counter: notifications and digests handed to the sinks
+	METRIC_NOTIFICATIONS_HELD,			// Counter: repeats held back by the rate limit of their key
+	METRIC_NOTIFY_SINK_ERRORS,			// Counter
+	METRIC_LOG_WRITE,					// Histogram: one line of the CSV log, flush included
+	METRIC_COLUMN_LOG_SYNC,				// Histogram: scheduling the write back of the column log
+	METRIC_TELEMETRY_DROPPED,			// Counter: records lost because a telemetry ring was full
+
+	NBR_METRICS,
+} metric_id_type;
+
+int Metrics_Init( void );
+
+// Producer side, may be called from any thread without a lock
+void Metrics_Add( metric_id_type id, uint64_t value );
+void Metrics_Observe_Us( metric_id_type id, uint64_t value_us );
+void Metrics_Gauge_Set( metric_id_type id, int64_t value );
+void Metrics_Gauge_Add( metric_id_type id, int64_t value );
+
+// Observes the time elapsed since start_ns, a Metrics_Now_Ns() value
+void Metrics_Observe_Since( metric_id_type id, int64_t start_ns );
+
+void Metrics_Format_Prometheus( str_builder_type* pBuilder );
+
+static inline int64_t Metrics_Now_Ns( void ) { return Telemetry_Get_Time_Ns( CLOCK_MONOTONIC ); }
+
+#endif //__METRICS_H
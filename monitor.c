@@ -8,24 +8,8 @@
 #include <time.h>
 #include "monitor.h"
 #include "main.h"
-#include "email.h"
-
-#ifndef NOTIFICATION_EMAIL_ADDRESS
-#warning Need to define email reception address else notifications will not be sent
-	#if 0
-// Create a file named email.h with the following contents
-
-	#ifndef _EMAIL_H
-	#define _EMAIL_H
-
-	#define NOTIFICATION_EMAIL_ADDRESS	"email@some_site.com"
-	
-	#endif
-
-// Replace email@some_site.com with your email address.
-// You may use an email-to-sms address if desired.
-	#endif
-#endif
+#include "history.h"
+#include "notify.h"
 
 
 /* *** Defined Values *** */
@@ -42,6 +26,7 @@ static void _Monitor_Service_Fire_Loss_Detection( void* shared_data_address );
 void Monitor_Light_Fire( void )
 {
 	Monitor_Send_Notification( "Notice", "Opening valve for lighting" );
+	History_Start_New_Cook();		// Lighting the fire starts a new cook
 	g_fire_detect_state = MONITOR_WAITING_FOR_FIRE; 
 }
 
@@ -154,24 +139,11 @@ void _Monitor_Service_Fire_Loss_Detection( void* shared_data_address )
 	pthread_mutex_unlock(&mutex);
 }
 
+/***************************************************************************************************
+Queues a notification for the notification thread (notify.c) and returns at once.  The message is
+the key of its rate limit, so repeats of the same warning are folded into a digest.
+***************************************************************************************************/
 void Monitor_Send_Notification( char* pSubject, char* pMsg )
 {
-#ifdef NOTIFICATION_EMAIL_ADDRESS
-	char cmd_buffer[256];
-	time_t t = time(NULL);								// Used for obtaining current time
-	struct tm tm;										// Used for obtaining current time
-	
-	t = time(NULL);
-	tm = *localtime(&t);
-	
-	strcpy( cmd_buffer, "echo \"" );
-	strcat( cmd_buffer, pMsg );
-	strcat( cmd_buffer, "\" | mail -s \"");
-	sprintf( cmd_buffer, "%s%2d:%02d - ", cmd_buffer, tm.tm_hour, tm.tm_min );
-	strcat( cmd_buffer, pSubject );
-	strcat( cmd_buffer, "\" ");
-	strcat( cmd_buffer, NOTIFICATION_EMAIL_ADDRESS );
-	
-	system( cmd_buffer );
-#endif
+	Notify_Post( pMsg, pSubject, pMsg );
 }
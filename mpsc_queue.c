@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <string.h>
+#include "mpsc_queue.h"
+
+/* *** Defined Values *** */
+#define MPSC_QUEUE_SEQUENCE_SIZE		8			// Keeps the elements 8 byte aligned
+
+/***************************************************************************************************
+Returns the sequence number of a cell
+***************************************************************************************************/
+static inline _Atomic uint32_t* Mpsc_Queue_Sequence( mpsc_queue_type* pQueue, uint32_t index )
+{
+	return (_Atomic uint32_t*)&pQueue->p_storage[(size_t)(index & pQueue->mask) * pQueue->cell_size];
+}
+
+static inline uint8_t* Mpsc_Queue_Element( mpsc_queue_type* pQueue, uint32_t index )
+{
+	return &pQueue->p_storage[((size_t)(index & pQueue->mask) * pQueue->cell_size) + MPSC_QUEUE_SEQUENCE_SIZE];
+}
+
+/***************************************************************************************************
+Allocates storage for the queue.  The capacity is rounded up to the next power of 2 so that the
+indices can be wrapped with a mask.  Cell n starts with sequence number n, meaning free for the
+producer that claims index n.
+
+Returns -1 if the storage could not be allocated
+		 1 on success
+***************************************************************************************************/
+int Mpsc_Queue_Init( mpsc_queue_type* pQueue, uint32_t element_size, uint32_t capacity )
+{
+	uint32_t size = 1;
+	uint32_t i;
+
+	while (size < capacity)
+		size <<= 1;
+
+	pQueue->element_size = element_size;
+	pQueue->cell_size = (MPSC_QUEUE_SEQUENCE_SIZE + element_size + 7) & ~7U;
+	pQueue->mask = size - 1;
+
+	pQueue->p_storage = malloc( (size_t)size * pQueue->cell_size );
+	if (pQueue->p_storage == NULL)
+		return -1;
+
+	for (i = 0; i < size; i++)
+		atomic_init( Mpsc_Queue_Sequence( pQueue, i ), i );
+
+	atomic_init( &pQueue->head, 0 );
+	pQueue->tail = 0;
+	atomic_init( &pQueue->dropped, 0 );
+
+	return 1;
+}
+
+/***************************************************************************************************
+Claims the next free cell with a compare and swap on the head, copies the element in and then
+publishes the cell by setting its sequence to index + 1.  A producer preempted between the claim
+and the publish only holds up the consumer, never the other producers.
+***************************************************************************************************/
+int Mpsc_Queue_Push( mpsc_queue_type* pQueue, const void* pElement )
+{
+	uint32_t head = atomic_load_explicit( &pQueue->head, memory_order_relaxed );
+	uint32_t sequence;
+	int32_t difference;
+
+	while (1)
+	{
+		sequence = atomic_load_explicit( Mpsc_Queue_Sequence( pQueue, head ), memory_order_acquire );
+		difference = (int32_t)(sequence - head);
+
+		if (difference == 0)
+		{
+			if (atomic_compare_exchange_weak_explicit( &pQueue->head, &head, head + 1,
+													   memory_order_relaxed, memory_order_relaxed ))
+				break;
+		}
+		else if (difference < 0)
+		{
+			// The cell still holds the element from the previous lap: the queue is full
+			atomic_fetch_add_explicit( &pQueue->dropped, 1, memory_order_relaxed );
+			return 0;
+		}
+		else
+			head = atomic_load_explicit( &pQueue->head, memory_order_relaxed );
+	}
+
+	memcpy( Mpsc_Queue_Element( pQueue, head ), pElement, pQueue->element_size );
+	atomic_store_explicit( Mpsc_Queue_Sequence( pQueue, head ), head + 1, memory_order_release );
+
+	return 1;
+}
+
+/***************************************************************************************************
+Copies the oldest element out of the queue and hands its cell to the producers of the next lap
+***************************************************************************************************/
+int Mpsc_Queue_Pop( mpsc_queue_type* pQueue, void* pElement )
+{
+	uint32_t tail = pQueue->tail;
+	uint32_t sequence = atomic_load_explicit( Mpsc_Queue_Sequence( pQueue, tail ), memory_order_acquire );
+
+	if (sequence != (tail + 1))
+		return 0;
+
+	memcpy( pElement, Mpsc_Queue_Element( pQueue, tail ), pQueue->element_size );
+	atomic_store_explicit( Mpsc_Queue_Sequence( pQueue, tail ), tail + pQueue->mask + 1, memory_order_release );
+	pQueue->tail = tail + 1;
+
+	return 1;
+}
+
+uint32_t Mpsc_Queue_Dropped( mpsc_queue_type* pQueue )
+{
+	return atomic_load_explicit( &pQueue->dropped, memory_order_relaxed );
+}
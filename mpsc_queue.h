@@ -0,0 +1,35 @@
+#ifndef __MPSC_QUEUE_H
+#define __MPSC_QUEUE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "spsc_ring.h"			// For SPSC_RING_CACHE_LINE_SIZE
+
+/***************************************************************************************************
+Lock-free bounded queue of fixed size elements for any number of producer threads and a single
+consumer thread (D. Vyukov's bounded queue).  Every cell carries a sequence number that tells a
+producer whether the cell is free and the consumer whether it has been completely written, so no
+producer can block another one or the consumer.  The capacity must be a power of 2.
+***************************************************************************************************/
+typedef struct
+{
+	_Atomic uint32_t head __attribute__((aligned(SPSC_RING_CACHE_LINE_SIZE)));	// Claimed by producers
+	uint32_t tail __attribute__((aligned(SPSC_RING_CACHE_LINE_SIZE)));			// Owned by the consumer
+	uint8_t* p_storage __attribute__((aligned(SPSC_RING_CACHE_LINE_SIZE)));		// Cells of sequence + element
+	uint32_t cell_size;
+	uint32_t element_size;
+	uint32_t mask;
+	_Atomic uint32_t dropped;						// Number of pushes rejected because the queue was full
+} mpsc_queue_type;
+
+int Mpsc_Queue_Init( mpsc_queue_type* pQueue, uint32_t element_size, uint32_t capacity );
+
+// Returns 1 if the element was queued, 0 if the queue was full.  May be called from any thread.
+int Mpsc_Queue_Push( mpsc_queue_type* pQueue, const void* pElement );
+
+// Returns 1 if an element was removed, 0 if the queue was empty.  Only the consumer may call this.
+int Mpsc_Queue_Pop( mpsc_queue_type* pQueue, void* pElement );
+
+uint32_t Mpsc_Queue_Dropped( mpsc_queue_type* pQueue );
+
+#endif //__MPSC_QUEUE_H
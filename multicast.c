@@ -0,0 +1,166 @@
+/***************************************************************************************************
+Multicast
+
+Publishes status snapshots as UDP datagrams to MULTICAST_GROUP:MULTICAST_PORT, so any number of
+displays, loggers and bridges on the LAN can follow the smoker without a connection of their own.
+Publishing is off until a period is set with MULTICAST=<period ms> (0 turns it off again).
+
+Each datagram is one CMD_MULTICAST_FRAME of the binary protocol (see bin_proto.c): a sequence
+number that increases by one per datagram, so receivers can count lost datagrams, followed by the
+time and every field of the snapshot.  The CRC lets receivers drop damaged datagrams.  The TTL is 1,
+datagrams are not routed off the local network.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "main.h"
+#include "multicast.h"
+#include "subscription.h"
+#include "bin_proto.h"
+#include "telemetry.h"
+#include "cmd_registry.h"
+
+/* *** Defined Values *** */
+#define MULTICAST_TTL				1
+#define MULTICAST_IDLE_SLEEP_US		100000		// Check for a new period this often while off
+
+/* *** Global Variables *** */
+static int g_multicast_fd = -1;
+static struct sockaddr_in g_group_addr;
+static _Atomic int g_period_ms = 0;				// 0 when not publishing
+static _Atomic uint32_t g_sequence = 0;			// Of the next datagram
+static shared_data_type* p_shared_data;
+
+static int Multicast_Command( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+
+static const cmd_definition_type g_multicast_cmds[] =
+{
+	{ "MULTICAST",	{ NULL },	"Sets (if given, 0 stops) and returns the period of multicast status datagrams",
+		CMD_FRONTEND_ALL, 0, 1, { { CMD_ARG_INT, "period ms", 0, MULTICAST_MAX_PERIOD_MS } },		Multicast_Command, CMD_ACCESS_WRITE_WITH_ARGS },
+};
+#define MULTICAST_CMDS_SIZE		(sizeof (g_multicast_cmds)/sizeof(g_multicast_cmds[0]))
+
+/***************************************************************************************************
+Creates the socket and adds the MULTICAST command
+
+Returns -1 on error
+		 1 on success
+***************************************************************************************************/
+int Multicast_Init( void* shared_data_address )
+{
+	unsigned char ttl = MULTICAST_TTL;
+	unsigned char loop = 1;						// Local listeners receive the datagrams too
+
+	p_shared_data = (shared_data_type*)shared_data_address;
+
+	g_multicast_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (g_multicast_fd < 0)
+	{
+		printf("Error creating the multicast socket - %s.%u\n", __FILE__, __LINE__);
+		return -1;
+	}
+
+	setsockopt(g_multicast_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+	setsockopt(g_multicast_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+
+	memset(&g_group_addr, 0, sizeof(g_group_addr));
+	g_group_addr.sin_family = AF_INET;
+	g_group_addr.sin_port = htons(MULTICAST_PORT);
+	inet_pton(AF_INET, MULTICAST_GROUP, &g_group_addr.sin_addr);
+
+	return Cmd_Registry_Add( g_multicast_cmds, MULTICAST_CMDS_SIZE );
+}
+
+/***************************************************************************************************
+Sends one datagram with the current snapshot
+***************************************************************************************************/
+static void Multicast_Publish( void )
+{
+	shared_data_type local_shared_data;
+	subscription_snapshot_type snapshot;
+	uint8_t frame[BIN_PROTO_MULTICAST_FRAME_SIZE];
+	int length;
+
+	pthread_mutex_lock(&mutex);
+	memcpy( (char*)&local_shared_data, (char*)p_shared_data, sizeof(local_shared_data) );
+	pthread_mutex_unlock(&mutex);
+
+	Subscription_Take_Snapshot( &local_shared_data, &snapshot );
+
+	length = Bin_Proto_Encode_Multicast( &snapshot, atomic_fetch_add( &g_sequence, 1 ), frame, sizeof(frame) );
+	if (length > 0)
+		sendto(g_multicast_fd, frame, length, MSG_DONTWAIT, (struct sockaddr*)&g_group_addr, sizeof(g_group_addr));
+}
+
+/***************************************************************************************************
+Service routine of the publisher.  Datagrams go out at multiples of the period on the monotonic
+clock, so a slow pass does not shift the ones after it.
+***************************************************************************************************/
+void Multicast_Service( void )
+{
+	struct timespec next;
+	int64_t next_ns = 0;
+	int64_t period_ns;
+	int64_t now_ns;
+	int period_ms;
+
+	while (1)
+	{
+		period_ms = atomic_load( &g_period_ms );
+		if (period_ms == 0)
+		{
+			next_ns = 0;
+			usleep(MULTICAST_IDLE_SLEEP_US);
+			continue;
+		}
+
+		period_ns = (int64_t)period_ms * 1000000;
+		now_ns = Telemetry_Get_Time_Ns( CLOCK_MONOTONIC );
+		if ((next_ns == 0) || ((now_ns - next_ns) > period_ns) || ((next_ns - now_ns) > period_ns))
+			next_ns = ((now_ns / period_ns) + 1) * period_ns;	// Started, fell behind or the period changed
+
+		next.tv_sec = next_ns / 1000000000;
+		next.tv_nsec = next_ns % 1000000000;
+		if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) != 0)
+			continue;
+
+		if (atomic_load( &g_period_ms ) != period_ms)
+			continue;
+
+		Multicast_Publish();
+		next_ns += period_ns;
+	}
+}
+
+/***************************************************************************************************
+e.g. MULTICAST=1000 publishes a datagram every second, MULTICAST=0 stops
+
+Response format:  MULTICAST,<period ms>,<group>,<port>,<next sequence number>
+***************************************************************************************************/
+static int Multicast_Command( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	int period_ms;
+
+	if (pArgs->count > 0)
+	{
+		period_ms = (int)pArgs->values[0].i;
+		if ((period_ms > 0) && (period_ms < MULTICAST_MIN_PERIOD_MS))
+			period_ms = MULTICAST_MIN_PERIOD_MS;
+		atomic_store( &g_period_ms, period_ms );
+	}
+
+	Str_Builder_Printf( pBuilder, "MULTICAST,%d,%s,%d,%u", atomic_load( &g_period_ms ), MULTICAST_GROUP, MULTICAST_PORT,
+						(unsigned)atomic_load( &g_sequence ) );
+	return 1;
+}
+
+/* *** End of File *** */
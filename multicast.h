@@ -0,0 +1,12 @@
+#ifndef __MULTICAST_H
+#define __MULTICAST_H
+
+#define MULTICAST_GROUP				"239.255.46.79"		// Administratively scoped, stays on the LAN
+#define MULTICAST_PORT				46880
+#define MULTICAST_MIN_PERIOD_MS		50
+#define MULTICAST_MAX_PERIOD_MS		60000
+
+int Multicast_Init( void* shared_data_address );
+void Multicast_Service( void );
+
+#endif //__MULTICAST_H
@@ -0,0 +1,632 @@
+/***************************************************************************************************
+Notify
+
+Asynchronous delivery of notifications (fire detected, loss of fire, ...).  Posting one only copies
+it into a lock-free queue, so the monitor thread never waits for a mail server.  The notification
+thread drains the queue and:
+
+	- Rate limits every key.  A key is delivered at most once per NOTIFY_KEY_INTERVAL_S, repeats in
+	  between are counted and the latest of them goes out once the interval is over.
+	- Collects bursts.  Everything that becomes due within NOTIFY_BURST_MS of the previous one is
+	  sent as one digest, at the latest NOTIFY_BURST_MAX_MS after the first.
+	- Hands every notification or digest to each sink: mail (NOTIFICATION_EMAIL_ADDRESS), a
+	  webhook (NOTIFICATION_WEBHOOK_URL) and a file (NOTIFICATION_FILE).  Other sinks may be added
+	  with Notify_Add_Sink().
+
+The addresses are defined in email.h:
+
+	#define NOTIFICATION_EMAIL_ADDRESS	"email@some_site.com"			(an email-to-sms address works too)
+	#define NOTIFICATION_WEBHOOK_URL	"http://127.0.0.1:8123/api/smoker"	(optional, plain HTTP only)
+	#define NOTIFICATION_FILE			"logs/notifications.log"		(optional, this is the default)
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "notify.h"
+#include "mpsc_queue.h"
+#include "str_builder.h"
+#include "metrics.h"
+#include "email.h"
+
+#ifndef NOTIFICATION_EMAIL_ADDRESS
+#warning Need to define email reception address else notifications will not be mailed
+#endif
+
+/* *** Defined Values *** */
+#define NOTIFY_QUEUE_CAPACITY			32
+#define NOTIFY_SERVICE_RATE_US			100000		// Idle sleep when the queue is empty
+#define NOTIFY_MAX_KEYS					16			// Keys rate limited at the same time
+#define NOTIFY_KEY_INTERVAL_S			60			// Shortest time between two deliveries of a key
+#define NOTIFY_BURST_MS					2000		// Quiet time that ends a digest
+#define NOTIFY_BURST_MAX_MS				10000		// Longest a digest is held back
+#define NOTIFY_MAX_DIGEST				8			// Entries of one digest
+#define NOTIFY_BODY_SIZE				1024
+#define NOTIFY_SINK_TIMEOUT_MS			10000		// mail is killed and the webhook abandoned after this
+
+#ifndef NOTIFICATION_FILE
+#define NOTIFICATION_FILE				"logs/notifications.log"
+#endif
+
+/* *** Data Types *** */
+// Rate limiting state of one key, only used by the notification thread
+typedef struct
+{
+	char key[NOTIFY_MAX_KEY];					// Empty when the slot is free
+	int64_t last_sent_ms;						// CLOCK_MONOTONIC
+	int held;									// Repeats since last_sent_ms
+	notify_record_type latest;					// The last of them
+} notify_key_state_type;
+
+typedef struct
+{
+	notify_record_type record;
+	int count;									// Occurrences the entry stands for
+} notify_digest_entry_type;
+
+/* *** Global Variables *** */
+extern char** environ;
+
+static mpsc_queue_type g_queue;
+static notify_key_state_type g_keys[NOTIFY_MAX_KEYS];
+
+static notify_digest_entry_type g_digest[NOTIFY_MAX_DIGEST];
+static int g_nbr_digest = 0;
+static int64_t g_digest_first_ms;
+static int64_t g_digest_last_ms;
+
+static notify_sink_type g_sinks[NOTIFY_MAX_SINKS];
+static int g_nbr_sinks = 0;
+
+/* *** Function Declarations *** */
+static int Notify_File_Deliver( const char* pSubject, const char* pBody );
+#ifdef NOTIFICATION_EMAIL_ADDRESS
+static int Notify_Mail_Deliver( const char* pSubject, const char* pBody );
+#endif
+#ifdef NOTIFICATION_WEBHOOK_URL
+static int Notify_Webhook_Init( void );
+static int Notify_Webhook_Deliver( const char* pSubject, const char* pBody );
+#endif
+
+static const notify_sink_type g_builtin_sinks[] =
+{
+#ifdef NOTIFICATION_EMAIL_ADDRESS
+	{ "mail",		NULL,					Notify_Mail_Deliver },
+#endif
+#ifdef NOTIFICATION_WEBHOOK_URL
+	{ "webhook",	Notify_Webhook_Init,	Notify_Webhook_Deliver },
+#endif
+	{ "file",		NULL,					Notify_File_Deliver },
+};
+#define NOTIFY_BUILTIN_SINKS_SIZE		(sizeof(g_builtin_sinks) / sizeof(g_builtin_sinks[0]))
+
+/* *** Accessors *** */
+static inline int64_t Notify_Get_Time_Ms( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ((int64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/***************************************************************************************************
+Allocates the queue and adds the built-in sinks
+
+Returns -1 on error
+		 1 on success
+***************************************************************************************************/
+int Notify_Init( void )
+{
+	int i;
+
+	if (Mpsc_Queue_Init( &g_queue, sizeof(notify_record_type), NOTIFY_QUEUE_CAPACITY ) < 0)
+	{
+		printf("Error allocating the notification queue - %s.%u\n", __FILE__, __LINE__);
+		return -1;
+	}
+
+	for (i = 0; i < NOTIFY_BUILTIN_SINKS_SIZE; i++)
+		Notify_Add_Sink( &g_builtin_sinks[i] );
+
+	return 1;
+}
+
+/***************************************************************************************************
+Adds a sink.  Only to be called during initialization, before the notification thread runs.
+
+Returns -1 if there is no room or the sink failed to initialize
+		 1 on success
+***************************************************************************************************/
+int Notify_Add_Sink( const notify_sink_type* pSink )
+{
+	if (g_nbr_sinks >= NOTIFY_MAX_SINKS)
+	{
+		printf("Error adding notification sink %s - %s.%u\n", pSink->name, __FILE__, __LINE__);
+		return -1;
+	}
+
+	if ((pSink->init != NULL) && (pSink->init() < 0))
+	{
+		printf("Error initializing notification sink %s - %s.%u\n", pSink->name, __FILE__, __LINE__);
+		return -1;
+	}
+
+	g_sinks[g_nbr_sinks++] = *pSink;
+	return 1;
+}
+
+/***************************************************************************************************
+Copies a text into a fixed size field, cutting it if needed
+***************************************************************************************************/
+static void Notify_Copy( char* p_field, int size, const char* p_text )
+{
+	strncpy(p_field, (p_text != NULL) ? p_text : "", size - 1);
+	p_field[size - 1] = '\0';
+}
+
+void Notify_Post( const char* p_key, const char* pSubject, const char* pMsg )
+{
+	notify_record_type record;
+
+	Notify_Copy( record.key, sizeof(record.key), p_key );
+	Notify_Copy( record.subject, sizeof(record.subject), pSubject );
+	Notify_Copy( record.message, sizeof(record.message), pMsg );
+	record.time_s = (int64_t)time(NULL);
+
+	Mpsc_Queue_Push( &g_queue, &record );
+}
+
+/***************************************************************************************************
+Formats a CLOCK_REALTIME time as HH:MM
+***************************************************************************************************/
+static void Notify_Format_Time( char* p_text, int size, int64_t time_s )
+{
+	time_t t = (time_t)time_s;
+	struct tm tm;
+
+	localtime_r(&t, &tm);
+	strftime(p_text, size, "%H:%M", &tm);
+}
+
+/***************************************************************************************************
+Sends the digest collected so far to every sink.  A digest of one entry reads like a single
+notification.
+***************************************************************************************************/
+static void Notify_Deliver_Digest( void )
+{
+	char body[NOTIFY_BODY_SIZE];
+	char subject[NOTIFY_MAX_SUBJECT + 64];
+	char time_text[16];
+	notify_digest_entry_type* pEntry;
+	str_builder_type builder;
+	int i;
+
+	if (g_nbr_digest == 0)
+		return;
+
+	Notify_Format_Time( time_text, sizeof(time_text), g_digest[0].record.time_s );
+	if (g_nbr_digest == 1)
+		snprintf(subject, sizeof(subject), "%s - %s", time_text, g_digest[0].record.subject);
+	else
+		snprintf(subject, sizeof(subject), "%s - %s (%d notifications)", time_text, g_digest[0].record.subject, g_nbr_digest);
+
+	Str_Builder_Init( &builder, body, sizeof(body), NULL, NULL );
+	for (i = 0; i < g_nbr_digest; i++)
+	{
+		pEntry = &g_digest[i];
+		if (g_nbr_digest > 1)
+		{
+			Notify_Format_Time( time_text, sizeof(time_text), pEntry->record.time_s );
+			Str_Builder_Printf( &builder, "%s %s: ", time_text, pEntry->record.subject );
+		}
+		Str_Builder_Append( &builder, pEntry->record.message );
+		if (pEntry->count > 1)
+			Str_Builder_Printf( &builder, " (%d times)", pEntry->count );
+		Str_Builder_Append_Char( &builder, '\n' );
+	}
+
+	for (i = 0; i < g_nbr_sinks; i++)
+	{
+		if (g_sinks[i].deliver( subject, body ) < 0)
+			Metrics_Add( METRIC_NOTIFY_SINK_ERRORS, 1 );
+	}
+
+	Metrics_Add( METRIC_NOTIFICATIONS, 1 );
+	g_nbr_digest = 0;
+}
+
+/***************************************************************************************************
+Adds a notification that is due to the digest.  Another one of the same key still in the digest is
+replaced by it.
+***************************************************************************************************/
+static void Notify_Add_To_Digest( const notify_record_type* pRecord, int count, int64_t now_ms )
+{
+	int i;
+
+	for (i = 0; i < g_nbr_digest; i++)
+	{
+		if (strcmp(g_digest[i].record.key, pRecord->key) == 0)
+		{
+			g_digest[i].record = *pRecord;
+			g_digest[i].count += count;
+			g_digest_last_ms = now_ms;
+			return;
+		}
+	}
+
+	if (g_nbr_digest >= NOTIFY_MAX_DIGEST)
+		Notify_Deliver_Digest();
+
+	if (g_nbr_digest == 0)
+		g_digest_first_ms = now_ms;
+	g_digest[g_nbr_digest].record = *pRecord;
+	g_digest[g_nbr_digest].count = count;
+	g_nbr_digest++;
+	g_digest_last_ms = now_ms;
+}
+
+/***************************************************************************************************
+Returns the rate limiting state of a key, taking a free slot or the one of the key sent longest ago
+for a new key.  Returns NULL if every slot is holding repeats, the key is then not rate limited.
+***************************************************************************************************/
+static notify_key_state_type* Notify_Find_Key( const char* p_key, int64_t now_ms )
+{
+	notify_key_state_type* pOldest = NULL;
+	notify_key_state_type* pFree = NULL;
+	int i;
+
+	for (i = 0; i < NOTIFY_MAX_KEYS; i++)
+	{
+		if (g_keys[i].key[0] == '\0')
+		{
+			if (pFree == NULL)
+				pFree = &g_keys[i];
+		}
+		else if (strcmp(g_keys[i].key, p_key) == 0)
+			return &g_keys[i];
+		else if ((g_keys[i].held == 0) && ((pOldest == NULL) || (g_keys[i].last_sent_ms < pOldest->last_sent_ms)))
+			pOldest = &g_keys[i];
+	}
+
+	if (pFree != NULL)
+		pOldest = pFree;
+	if (pOldest != NULL)
+	{
+		Notify_Copy( pOldest->key, sizeof(pOldest->key), p_key );
+		pOldest->last_sent_ms = now_ms - (NOTIFY_KEY_INTERVAL_S * 1000);
+		pOldest->held = 0;
+	}
+
+	return pOldest;
+}
+
+/***************************************************************************************************
+Applies the rate limit of its key to a notification taken from the queue
+***************************************************************************************************/
+static void Notify_Accept( const notify_record_type* pRecord, int64_t now_ms )
+{
+	notify_key_state_type* pState = Notify_Find_Key( pRecord->key, now_ms );
+
+	if (pState == NULL)
+	{
+		Notify_Add_To_Digest( pRecord, 1, now_ms );
+		return;
+	}
+
+	if ((pState->held == 0) && ((now_ms - pState->last_sent_ms) >= (NOTIFY_KEY_INTERVAL_S * 1000)))
+	{
+		Notify_Add_To_Digest( pRecord, 1, now_ms );
+		pState->last_sent_ms = now_ms;
+		return;
+	}
+
+	pState->latest = *pRecord;
+	pState->held++;
+	Metrics_Add( METRIC_NOTIFICATIONS_HELD, 1 );
+}
+
+/***************************************************************************************************
+Delivers the notifications, one queue drain and one digest at a time.  Sinks may block this thread
+for up to NOTIFY_SINK_TIMEOUT_MS each, which holds up nothing but later notifications.
+***************************************************************************************************/
+void Notify_Service( void* shared_data_address )
+{
+	notify_record_type record;
+	uint32_t reported_drops = 0;
+	uint32_t drops;
+	int64_t now_ms;
+	int drained;
+	int i;
+
+	signal(SIGPIPE, SIG_IGN);
+
+	while (1)
+	{
+		drained = 0;
+		now_ms = Notify_Get_Time_Ms();
+
+		while (Mpsc_Queue_Pop( &g_queue, &record ))
+		{
+			drained++;
+			Notify_Accept( &record, now_ms );
+		}
+
+		// Repeats held back by the rate limit, once the interval of their key is over
+		for (i = 0; i < NOTIFY_MAX_KEYS; i++)
+		{
+			if ((g_keys[i].held > 0) && ((now_ms - g_keys[i].last_sent_ms) >= (NOTIFY_KEY_INTERVAL_S * 1000)))
+			{
+				Notify_Add_To_Digest( &g_keys[i].latest, g_keys[i].held, now_ms );
+				g_keys[i].last_sent_ms = now_ms;
+				g_keys[i].held = 0;
+			}
+		}
+
+		if ((g_nbr_digest > 0) && (((now_ms - g_digest_last_ms) >= NOTIFY_BURST_MS) ||
+			((now_ms - g_digest_first_ms) >= NOTIFY_BURST_MAX_MS)))
+			Notify_Deliver_Digest();
+
+		drops = Mpsc_Queue_Dropped( &g_queue );
+		if (drops != reported_drops)
+		{
+			printf("Notification queue full, %u notifications lost\n", drops - reported_drops);
+			reported_drops = drops;
+		}
+
+		if (drained == 0)
+			usleep(NOTIFY_SERVICE_RATE_US);
+	}
+}
+
+/* *** Sinks *** */
+
+/***************************************************************************************************
+Appends the notification to NOTIFICATION_FILE with the date and time
+***************************************************************************************************/
+static int Notify_File_Deliver( const char* pSubject, const char* pBody )
+{
+	char time_text[32];
+	time_t t = time(NULL);
+	struct tm tm;
+	FILE* pFile;
+	int result;
+
+	pFile = fopen(NOTIFICATION_FILE, "a");
+	if (pFile == NULL)
+		return -1;
+
+	localtime_r(&t, &tm);
+	strftime(time_text, sizeof(time_text), "%Y-%m-%d %H:%M:%S", &tm);
+	result = fprintf(pFile, "%s %s\n%s\n", time_text, pSubject, pBody);
+
+	return ((fclose(pFile) == 0) && (result > 0)) ? 1 : -1;
+}
+
+#ifdef NOTIFICATION_EMAIL_ADDRESS
+/***************************************************************************************************
+Waits up to NOTIFY_SINK_TIMEOUT_MS for a child process to finish, then kills it
+
+Returns -1 if it failed or was killed
+		 1 if it exited with status 0
+***************************************************************************************************/
+static int Notify_Wait_Child( pid_t pid )
+{
+	int64_t start_ms = Notify_Get_Time_Ms();
+	int status;
+	pid_t result;
+
+	while ((result = waitpid(pid, &status, WNOHANG)) == 0)
+	{
+		if ((Notify_Get_Time_Ms() - start_ms) >= NOTIFY_SINK_TIMEOUT_MS)
+		{
+			kill(pid, SIGKILL);
+			waitpid(pid, &status, 0);
+			return -1;
+		}
+		usleep(10000);
+	}
+
+	return ((result == pid) && WIFEXITED(status) && (WEXITSTATUS(status) == 0)) ? 1 : -1;
+}
+
+/***************************************************************************************************
+Mails the notification with mail(1), started directly rather than through a shell so the texts need
+no quoting.  The body is passed on its standard input.
+***************************************************************************************************/
+static int Notify_Mail_Deliver( const char* pSubject, const char* pBody )
+{
+	char* argv[] = { "mail", "-s", (char*)pSubject, NOTIFICATION_EMAIL_ADDRESS, NULL };
+	posix_spawn_file_actions_t actions;
+	int pipe_fds[2];
+	int length = strlen(pBody);
+	int written;
+	int result;
+	pid_t pid;
+
+	if (pipe(pipe_fds) < 0)
+		return -1;
+	fcntl(pipe_fds[1], F_SETFD, FD_CLOEXEC);
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, pipe_fds[0], STDIN_FILENO);
+	posix_spawn_file_actions_addclose(&actions, pipe_fds[0]);
+	result = posix_spawnp(&pid, "mail", &actions, NULL, argv, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	close(pipe_fds[0]);
+
+	if (result != 0)
+	{
+		close(pipe_fds[1]);
+		return -1;
+	}
+
+	// The body is far smaller than the pipe, mail is not waited for here
+	while (length > 0)
+	{
+		written = write(pipe_fds[1], pBody, length);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		pBody += written;
+		length -= written;
+	}
+	close(pipe_fds[1]);
+
+	return Notify_Wait_Child( pid );
+}
+#endif
+
+#ifdef NOTIFICATION_WEBHOOK_URL
+static char g_webhook_host[64];
+static char g_webhook_port[8];
+static char g_webhook_path[128];
+
+/***************************************************************************************************
+Splits NOTIFICATION_WEBHOOK_URL, http://host[:port]/path
+
+Returns -1 if it is not such a URL
+		 1 on success
+***************************************************************************************************/
+static int Notify_Webhook_Init( void )
+{
+	const char* p_url = NOTIFICATION_WEBHOOK_URL;
+	const char* p_path;
+	const char* p_port;
+	int length;
+
+	if (strncmp(p_url, "http://", 7) != 0)
+		return -1;
+	p_url += 7;
+
+	p_path = strchr(p_url, '/');
+	if (p_path == NULL)
+		p_path = p_url + strlen(p_url);
+	p_port = memchr(p_url, ':', p_path - p_url);
+
+	length = ((p_port != NULL) ? p_port : p_path) - p_url;
+	if ((length <= 0) || (length >= sizeof(g_webhook_host)))
+		return -1;
+	memcpy(g_webhook_host, p_url, length);
+	g_webhook_host[length] = '\0';
+
+	if (p_port != NULL)
+	{
+		length = p_path - (p_port + 1);
+		if ((length <= 0) || (length >= sizeof(g_webhook_port)))
+			return -1;
+		memcpy(g_webhook_port, p_port + 1, length);
+		g_webhook_port[length] = '\0';
+	}
+	else
+		strcpy(g_webhook_port, "80");
+
+	Notify_Copy( g_webhook_path, sizeof(g_webhook_path), (*p_path != '\0') ? p_path : "/" );
+	return 1;
+}
+
+/***************************************************************************************************
+Appends a JSON string, quotes included
+***************************************************************************************************/
+static void Notify_Append_Json_String( str_builder_type* pBuilder, const char* p_text )
+{
+	Str_Builder_Append_Char( pBuilder, '"' );
+	for (; *p_text != '\0'; p_text++)
+	{
+		if ((*p_text == '"') || (*p_text == '\\'))
+		{
+			Str_Builder_Append_Char( pBuilder, '\\' );
+			Str_Builder_Append_Char( pBuilder, *p_text );
+		}
+		else if (*p_text == '\n')
+			Str_Builder_Append( pBuilder, "\\n" );
+		else if ((unsigned char)*p_text < 0x20)
+			Str_Builder_Printf( pBuilder, "\\u%04X", (unsigned char)*p_text );
+		else
+			Str_Builder_Append_Char( pBuilder, *p_text );
+	}
+	Str_Builder_Append_Char( pBuilder, '"' );
+}
+
+/***************************************************************************************************
+POSTs {"subject": ..., "body": ...} to NOTIFICATION_WEBHOOK_URL, any 2xx answer is success
+***************************************************************************************************/
+static int Notify_Webhook_Deliver( const char* pSubject, const char* pBody )
+{
+	char json[NOTIFY_BODY_SIZE + 256];
+	char request[sizeof(json) + 512];
+	char response[32];
+	struct timeval timeout = { NOTIFY_SINK_TIMEOUT_MS / 1000, (NOTIFY_SINK_TIMEOUT_MS % 1000) * 1000 };
+	struct addrinfo hints;
+	struct addrinfo* pAddress;
+	str_builder_type builder;
+	int length;
+	int sent = 0;
+	int received = 0;
+	int n;
+	int fd;
+
+	Str_Builder_Init( &builder, json, sizeof(json), NULL, NULL );
+	Str_Builder_Append( &builder, "{\"subject\":" );
+	Notify_Append_Json_String( &builder, pSubject );
+	Str_Builder_Append( &builder, ",\"body\":" );
+	Notify_Append_Json_String( &builder, pBody );
+	Str_Builder_Append_Char( &builder, '}' );
+	if (builder.overflow)
+		return -1;
+
+	length = snprintf(request, sizeof(request), "POST %s HTTP/1.0\r\nHost: %s\r\nContent-Type: application/json\r\n"
+					  "Content-Length: %d\r\nConnection: close\r\n\r\n%s", g_webhook_path, g_webhook_host,
+					  Str_Builder_Length( &builder ), json);
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(g_webhook_host, g_webhook_port, &hints, &pAddress) != 0)
+		return -1;
+
+	fd = socket(pAddress->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd >= 0)
+	{
+		// The timeouts bound connect() too
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		if (connect(fd, pAddress->ai_addr, pAddress->ai_addrlen) < 0)
+		{
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(pAddress);
+	if (fd < 0)
+		return -1;
+
+	while ((sent < length) && ((n = send(fd, &request[sent], length - sent, MSG_NOSIGNAL)) > 0))
+		sent += n;
+
+	// Only the status line matters, e.g. HTTP/1.1 204 No Content
+	while ((sent == length) && (received < (int)sizeof(response) - 1) &&
+		   ((n = recv(fd, &response[received], sizeof(response) - 1 - received, 0)) > 0))
+		received += n;
+	response[received] = '\0';
+	close(fd);
+
+	return ((received >= 12) && (strncmp(response, "HTTP/", 5) == 0) && (strchr(response, ' ') != NULL) &&
+			(strchr(response, ' ')[1] == '2')) ? 1 : -1;
+}
+#endif
+
+/* *** End of File *** */
@@ -0,0 +1,41 @@
+#ifndef __NOTIFY_H
+#define __NOTIFY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NOTIFY_MAX_KEY				32			// Lengths include the terminator, longer texts are cut
+#define NOTIFY_MAX_SUBJECT			32
+#define NOTIFY_MAX_MESSAGE			128
+#define NOTIFY_MAX_SINKS			8
+
+// One notification, as queued by Notify_Post()
+typedef struct
+{
+	char key[NOTIFY_MAX_KEY];					// Repeats of a key are rate limited together
+	char subject[NOTIFY_MAX_SUBJECT];
+	char message[NOTIFY_MAX_MESSAGE];
+	int64_t time_s;								// CLOCK_REALTIME when it was posted
+} notify_record_type;
+
+/***************************************************************************************************
+A destination of notifications.  deliver is only called by the notification thread and may block
+for as long as the destination takes; it returns -1 on error, 1 on success.  init is called once by
+Notify_Add_Sink(), a sink whose init returns -1 is not used.  Either may be NULL.
+***************************************************************************************************/
+typedef struct
+{
+	const char* name;
+	int (*init)( void );
+	int (*deliver)( const char* pSubject, const char* pBody );
+} notify_sink_type;
+
+int Notify_Init( void );
+void Notify_Service( void* shared_data_address );
+
+int Notify_Add_Sink( const notify_sink_type* pSink );
+
+// Queues a notification without blocking.  May be called from any thread.
+void Notify_Post( const char* p_key, const char* pSubject, const char* pMsg );
+
+#endif //__NOTIFY_H
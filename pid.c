@@ -25,7 +25,7 @@ void Pid_Update(pid_type* pid, float current_error, float dt)
     if (dt != 0)
         diff = ((current_error - pid->prev_error) / dt);
     else
-        dt = 0;
+        diff = 0;
 
     // scaling
     p_term = (pid->proportional_gain * current_error);
@@ -33,6 +33,9 @@ void Pid_Update(pid_type* pid, float current_error, float dt)
     d_term = (pid->derivative_gain   * diff);
 
     // summation of terms
+    pid->p_term = p_term;
+    pid->i_term = i_term;
+    pid->d_term = d_term;
     pid->control = p_term + i_term + d_term;
 
     // save current error as previous error for next iteration
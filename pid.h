@@ -6,6 +6,9 @@ typedef struct
     float derivative_gain;
     float prev_error;
     float int_error;
+    float p_term;
+    float i_term;
+    float d_term;
     float control;
 } pid_type;
 
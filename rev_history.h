@@ -4,11 +4,87 @@ File:  rev_history.h
 ***************************************************************************************************/
 
 #define FIRMWARE_MAJOR		0
-#define FIRMWARE_MINOR		3
+#define FIRMWARE_MINOR		4
 #define FIRMWARE_REVISION	0
 
 /* Description of changes. *************************************************************************
 
+*** Ver 0.4.0 *** (in development)
+1. Added high rate binary telemetry logging (telemetry.?).  Every ADC sweep and control tick is
+pushed through a lock-free ring and written to logs/Telemetry-*.bin in large batches.  Enable with
+the TELEM=1 console command, TELEM=1,<0|1|2> also selects the fsync policy.
+2. Added a memory mapped, block-columnar history file (column_log.?) with a per-block time and
+min/max index.  The EXPORT= console command exports it to CSV.
+3. Added a Gorilla style compressed in-memory history (history.?) holding every control tick of the
+current and previous cook.  The LIGHT command starts a new cook.
+4. Added an incremental rollup engine (rollup.?) keeping min/max/mean/last per channel at 1 s, 1 min
+and 15 min resolution for serving charts of the whole cook.
+5. Added the HISTORY?<channels>,<from>,<to>,<max_points> Ethernet command.  Responses are streamed
+in chunks and come from the rollups or from the in-memory history with LTTB downsampling.
+6. The Ethernet server now runs on epoll and serves up to 64 clients at once.  Each connection has
+its own receive ring and transmit buffer, writes never block and idle connections are closed after
+5 minutes.
+7. Ethernet commands are now framed: each command and each response line ends with '\n' ('\r' is
+ignored).  Several commands may be sent in one write and are answered in one write.  Clients that
+never send a '\n' still work, their data is taken as a command after 50 ms without new data.
+8. Added the SUBSCRIBE=<fields>,<period_ms> and UNSUBSCRIBE Ethernet commands.  Subscribers get
+PUSH frames at their own rate, each frame is formatted once per pass and sent to every client with
+the same field selection (subscription.?).  piserver.js subscribes instead of polling STATUS?.
+9. Added an optional binary Ethernet protocol (bin_proto.?) using the msg_header_type framing with
+a CRC-16.  The BINARY command switches a connection over; status, history, setpoint and
+subscription messages are supported.
+10. SUBSCRIBE=<fields>,<period_ms>,DELTA sends DELTA frames holding only the fields that moved
+beyond their deadband (DEADBAND=<fields>,<value>).  A full PUSH keyframe goes out every 10 s and on
+the KEYFRAME command.  The binary protocol has the same options.
+11. ASCII responses are built with a bounds checked string builder (str_builder.?) that formats
+numbers directly and never rescans the text already built.  Command handling no longer uses static
+buffers.
+12. Network events go through a lock-free queue to an event log thread (event_log.?, mpsc_queue.?)
+instead of calling syslog on the Ethernet thread.  The LOGLEVEL= and LOGRATE= console commands set
+the verbosity and the per-event rate limit and sampling.  Packet dumps are only made at level 7.
+13. The console, the named pipes and the Ethernet server share one command table (cmd_registry.?,
+commands.c).  Arguments are type and range checked in one place, every front-end accepts the same
+names and aliases and answers in the NAME,value format, and HELP lists what is available.  The
+console HISTORY statistics command is now HISTSTATS.
+14. Built-in HTTP server (http_server.c, websocket.c) on port 8081 serving node/public and a
+WebSocket at /ws for commands and SUBSCRIBE= frames, replacing the Node.js relay (piserver.js).
+15. GET /events is a Server-Sent Events stream: the downsampled history of the current cook, then
+DELTA frames.  Reconnecting browsers resume after their Last-Event-ID.  index.htm uses it.
+16. MULTICAST=<period ms> publishes sequence numbered status datagrams to 239.255.46.79:46880
+(multicast.?).  tools/mcast_listen receives them and counts lost datagrams.
+17. Performance metrics (metrics.?): ADC sweep time, pigpio mutex waits, control tick time and
+overruns, servo write time, Ethernet clients and bytes, log write time.  Exported in the Prometheus
+text format by GET /metrics and the METRICS? command.
+18. Per-stage latency tracing of each control tick (trace.?): ADC sweep, wait for the tick,
+temperature conversion, PID update, servo command and the total age of the data acted on, with
+CPU cycles where perf_event allows.  TRACE? returns log-linear histogram percentiles per stage and
+the 16 slowest ticks in full, TRACE=RESET clears them.
+19. make bench builds microbenchmarks of the hot paths (bench/) without pigpio or ncurses: the
+temperature conversions, the PID, the response builders, command dispatch and the ADC and servo
+transfers against a stand-in pigpiod.  Results as text, CSV or JSON.  PIGPIO_COMMAND_PIPE and
+PIGPIO_RESPONSE_PIPE (main.h) may now be set at build time.
+20. tools/fake_pigpiod emulates pigpiod for s, spio, spix and spic on the pipes and on the socket,
+with a pipelined TLC1543 reading simulated or scripted values.  Injects reply latency and jitter,
+dropped replies, error codes and restarts of the daemon mid-session.
+21. tools/loadgen loads the Ethernet port with N connections sending STATUS?, TEMPS?, SETTEMP= and
+subscriptions at a target rate, and reports latency percentiles, errors, the CPU of the daemon and
+whether the control loop kept within its jitter budget.  METRICS? gained the wake up lateness of
+the control loop (control_tick_jitter_seconds) and process_cpu_seconds_total.
+22. The telemetry is mirrored into the shared memory segment /smokinpi_telemetry (shm_telemetry.?):
+the latest control tick and a ring of ADC sweeps under seqlocks, with a futex to wait on.  Local
+programs read it through shm_telemetry.h without syscalls, tools/shm_watch is an example.
+23. The named pipes (file_fifo.?) are served again, by one poll() driven thread that runs every
+command of a read and queues the replies.  Replies only go to a reader present within 250 ms, and
+a slow reader loses the oldest whole replies rather than commands being held up.
+24. The command protocol is offered on the Unix domain socket /tmp/smpi.sock as well.  Only root,
+the user of the daemon and the group smokinpi may change settings there, checked with the
+SCM_CREDENTIALS of every read (<NAME>,DENIED otherwise).  SHMFD passes a read only descriptor of
+the shared memory telemetry with SCM_RIGHTS.  loadgen and shm_watch (-u) can use the socket.
+25. Notifications are queued and delivered by a thread of their own (notify.?), the monitor no longer
+waits for mail.  mail is started with posix_spawn instead of a shell, NOTIFICATION_WEBHOOK_URL and
+NOTIFICATION_FILE add a webhook and a file.  Repeats of a notification are sent at most once a
+minute with a count, and notifications close together go out as one digest.
+
 *** 26FEB17 *** Ver 0.3.0 *** HGM
 1. Changed thermocouple support to the Maverick PR-005 for availability purposes
 2. Corrected an issue with the SPI speed that was causing ADC readings to be
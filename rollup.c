@@ -0,0 +1,272 @@
+/***************************************************************************************************
+Rollup
+
+Incremental multi-resolution aggregation of the history channels.  Every control tick updates the
+min/max/mean/last of the current bucket of each channel at each resolution.  Buckets live in fixed
+size rings (one per level and channel), so an update is O(1) and the memory used by each level is
+fixed at start up.
+
+	Level		Bucket		Retention
+	1 second	1 s			2 hours
+	1 minute	60 s		48 hours
+	15 minutes	900 s		14 days
+
+A chart request is served from the coarsest level that still provides the requested number of
+points over the requested span.  Buckets are merged down to the requested point count, so raw
+samples are never scanned.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "main.h"
+#include "rollup.h"
+
+/* *** Types *** */
+typedef struct
+{
+	int64_t start_ms;							// Start time of the bucket, 0 if never used
+	double sum;
+	float min_value;
+	float max_value;
+	float last_value;
+	uint32_t count;
+} rollup_bucket_type;
+
+typedef struct
+{
+	int64_t period_ms;
+	uint32_t capacity;							// Buckets per channel
+	int64_t newest_start_ms;					// Start time of the most recent bucket
+	rollup_bucket_type* p_buckets;				// [channel * capacity + slot]
+} rollup_level_data_type;
+
+/* *** Global Variables *** */
+static pthread_rwlock_t g_rollup_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static rollup_level_data_type g_levels[NBR_ROLLUP_LEVELS] =
+{
+	{ 1000,		7200,	0, NULL },			// 1 second for 2 hours
+	{ 60000,	2880,	0, NULL },			// 1 minute for 48 hours
+	{ 900000,	1344,	0, NULL },			// 15 minutes for 14 days
+};
+
+/* *** Accessors *** */
+int64_t Rollup_Get_Level_Period_Ms( rollup_level_type level ) { return g_levels[level].period_ms; }
+
+/***************************************************************************************************
+Allocates the bucket rings of every level
+
+Returns -1 on error
+		 1 on success
+***************************************************************************************************/
+int Rollup_Init( void )
+{
+	int level;
+
+	for (level = 0; level < NBR_ROLLUP_LEVELS; level++)
+	{
+		g_levels[level].p_buckets = calloc((size_t)g_levels[level].capacity * NBR_TELEMETRY_CHANNELS,
+										   sizeof(rollup_bucket_type));
+		if (g_levels[level].p_buckets == NULL)
+		{
+			printf("Error allocating rollup buckets\n");
+			return -1;
+		}
+	}
+
+	return 1;
+}
+
+static inline rollup_bucket_type* Rollup_Get_Bucket( rollup_level_data_type* pLevel, int channel, int64_t start_ms )
+{
+	uint32_t slot = (uint32_t)((start_ms / pLevel->period_ms) % pLevel->capacity);
+
+	return &pLevel->p_buckets[((size_t)channel * pLevel->capacity) + slot];
+}
+
+/***************************************************************************************************
+Called by the telemetry thread for every control tick.  Each channel updates one bucket per level;
+a bucket left over from a previous lap of the ring is reset before it is reused.
+***************************************************************************************************/
+void Rollup_Append_Record( const telemetry_record_type* pRecord )
+{
+	int64_t timestamp_ms = pRecord->timestamp_ns / 1000000;
+	int64_t start_ms;
+	rollup_level_data_type* pLevel;
+	rollup_bucket_type* pBucket;
+	float value;
+	int level;
+	int channel;
+
+	pthread_rwlock_wrlock(&g_rollup_lock);
+
+	for (level = 0; level < NBR_ROLLUP_LEVELS; level++)
+	{
+		pLevel = &g_levels[level];
+		start_ms = timestamp_ms - (timestamp_ms % pLevel->period_ms);
+		if (start_ms > pLevel->newest_start_ms)
+			pLevel->newest_start_ms = start_ms;
+
+		for (channel = 0; channel < NBR_TELEMETRY_CHANNELS; channel++)
+		{
+			value = Telemetry_Get_Channel_Value( pRecord, channel );
+			pBucket = Rollup_Get_Bucket( pLevel, channel, start_ms );
+
+			if (pBucket->start_ms != start_ms)
+			{
+				pBucket->start_ms = start_ms;
+				pBucket->sum = value;
+				pBucket->min_value = value;
+				pBucket->max_value = value;
+				pBucket->count = 1;
+			}
+			else
+			{
+				pBucket->sum += value;
+				if (value < pBucket->min_value)
+					pBucket->min_value = value;
+				if (value > pBucket->max_value)
+					pBucket->max_value = value;
+				pBucket->count++;
+			}
+			pBucket->last_value = value;
+		}
+	}
+
+	pthread_rwlock_unlock(&g_rollup_lock);
+}
+
+/***************************************************************************************************
+Picks the level used to serve a request: the coarsest level that still holds the start of the span
+and provides at least max_points buckets over it.  If none provides enough points, the finest level
+holding the start of the span is used.  If no level reaches back far enough, the coarsest is used.
+The caller must hold the lock.
+***************************************************************************************************/
+static int Rollup_Select_Level( int64_t from_ms, int64_t to_ms, int max_points )
+{
+	int level;
+	int finest_covering = -1;
+	int64_t oldest_ms;
+	int64_t span_buckets;
+
+	for (level = NBR_ROLLUP_LEVELS - 1; level >= 0; level--)
+	{
+		rollup_level_data_type* pLevel = &g_levels[level];
+
+		oldest_ms = pLevel->newest_start_ms - ((int64_t)(pLevel->capacity - 1) * pLevel->period_ms);
+		if (from_ms < oldest_ms)
+			continue;
+
+		span_buckets = ((to_ms - from_ms) / pLevel->period_ms) + 1;
+		if (span_buckets >= max_points)
+			return level;
+
+		finest_covering = level;
+	}
+
+	return (finest_covering >= 0) ? finest_covering : (NBR_ROLLUP_LEVELS - 1);
+}
+
+/***************************************************************************************************
+Fills p_points (which must hold max_points entries) with at most max_points aggregated points of the
+channel between from_ms and to_ms, oldest first.  The level used is returned through pLevel when
+pLevel is not NULL.
+
+Returns the number of points written or -1 on a bad channel
+***************************************************************************************************/
+int Rollup_Query( int channel, int64_t from_ms, int64_t to_ms, int max_points,
+				  rollup_point_type* p_points, rollup_level_type* pLevel )
+{
+	rollup_level_data_type* pLevelData;
+	rollup_bucket_type* pBucket;
+	rollup_point_type* pPoint;
+	int64_t first_start_ms, last_start_ms, start_ms;
+	int64_t span_buckets;
+	int64_t group_size;
+	int64_t in_group = 0;
+	double group_sum = 0.0;
+	int nbr_points = 0;
+	int level;
+
+	if ((channel < 0) || (channel >= NBR_TELEMETRY_CHANNELS) || (max_points <= 0) || (to_ms < from_ms))
+		return -1;
+
+	pthread_rwlock_rdlock(&g_rollup_lock);
+
+	level = Rollup_Select_Level( from_ms, to_ms, max_points );
+	pLevelData = &g_levels[level];
+	if (pLevel != NULL)
+		*pLevel = level;
+
+	first_start_ms = from_ms - (from_ms % pLevelData->period_ms);
+	last_start_ms = to_ms - (to_ms % pLevelData->period_ms);
+	span_buckets = ((last_start_ms - first_start_ms) / pLevelData->period_ms) + 1;
+	if (span_buckets > pLevelData->capacity)
+	{
+		// Older buckets have already been overwritten
+		first_start_ms = last_start_ms - ((int64_t)(pLevelData->capacity - 1) * pLevelData->period_ms);
+		span_buckets = pLevelData->capacity;
+	}
+	group_size = (span_buckets + max_points - 1) / max_points;
+
+	pPoint = &p_points[0];
+	for (start_ms = first_start_ms; start_ms <= last_start_ms; start_ms += pLevelData->period_ms)
+	{
+		pBucket = Rollup_Get_Bucket( pLevelData, channel, start_ms );
+
+		if (in_group == 0)
+		{
+			memset(pPoint, 0, sizeof(*pPoint));
+			group_sum = 0.0;
+		}
+
+		if ((pBucket->start_ms == start_ms) && (pBucket->count > 0))
+		{
+			if (pPoint->count == 0)
+			{
+				pPoint->start_ms = start_ms;
+				pPoint->min_value = pBucket->min_value;
+				pPoint->max_value = pBucket->max_value;
+			}
+
+			if (pBucket->min_value < pPoint->min_value)
+				pPoint->min_value = pBucket->min_value;
+			if (pBucket->max_value > pPoint->max_value)
+				pPoint->max_value = pBucket->max_value;
+			pPoint->last_value = pBucket->last_value;
+			pPoint->end_ms = start_ms + pLevelData->period_ms;
+			pPoint->count += pBucket->count;
+			group_sum += pBucket->sum;
+		}
+
+		// Close the group once it spans group_size buckets
+		if (++in_group >= group_size)
+		{
+			if (pPoint->count > 0)
+			{
+				pPoint->mean_value = (float)(group_sum / pPoint->count);
+				nbr_points++;
+				if (nbr_points >= max_points)
+					break;
+				pPoint = &p_points[nbr_points];
+			}
+			in_group = 0;
+		}
+	}
+
+	// Close a partially filled final group
+	if ((in_group > 0) && (nbr_points < max_points) && (pPoint->count > 0))
+	{
+		pPoint->mean_value = (float)(group_sum / pPoint->count);
+		nbr_points++;
+	}
+
+	pthread_rwlock_unlock(&g_rollup_lock);
+
+	return nbr_points;
+}
+
+/* *** End of File *** */
@@ -0,0 +1,36 @@
+#ifndef __ROLLUP_H
+#define __ROLLUP_H
+
+#include <stdint.h>
+#include "telemetry.h"			// For telemetry_record_type and NBR_TELEMETRY_CHANNELS
+
+typedef enum
+{
+	ROLLUP_LEVEL_1_SECOND = 0,
+	ROLLUP_LEVEL_1_MINUTE,
+	ROLLUP_LEVEL_15_MINUTES,
+
+	NBR_ROLLUP_LEVELS,
+} rollup_level_type;
+
+// One aggregated point
+typedef struct
+{
+	int64_t start_ms;							// Start of the bucket (ms since the epoch)
+	int64_t end_ms;								// End of the bucket, exclusive
+	float min_value;
+	float max_value;
+	float mean_value;
+	float last_value;
+	uint32_t count;								// Number of raw samples aggregated
+} rollup_point_type;
+
+int Rollup_Init( void );
+void Rollup_Append_Record( const telemetry_record_type* pRecord );
+
+int Rollup_Query( int channel, int64_t from_ms, int64_t to_ms, int max_points,
+				  rollup_point_type* p_points, rollup_level_type* pLevel );
+
+int64_t Rollup_Get_Level_Period_Ms( rollup_level_type level );
+
+#endif //__ROLLUP_H
@@ -7,6 +7,8 @@
 #include "servo.h"
 #include "main.h"
 #include "app.h"
+#include "metrics.h"
+#include "trace.h"
 
 /* **** Function Declarations **** */
 static int Servo_Set_Position( int pulse_width );
@@ -119,11 +121,15 @@ static int Servo_Set_Position( int width )
 
 	int pigpio_response;
 	int result = 0;
+	int64_t start_ns = Metrics_Now_Ns();
 
+	Trace_Stage_Begin( TRACE_STAGE_SERVO );
 	pthread_mutex_lock(&pigpio_mutex);
+	Metrics_Observe_Since( METRIC_PIGPIO_MUTEX_WAIT, start_ns );
+	start_ns = Metrics_Now_Ns();
 
-	pigpio_write = fopen("/dev/pigpio", "w");
-	pigpio_read = fopen("/dev/pigout", "r");
+	pigpio_write = fopen(PIGPIO_COMMAND_PIPE, "w");
+	pigpio_read = fopen(PIGPIO_RESPONSE_PIPE, "r");
 
 	if ((pigpio_write == NULL) || (pigpio_read == NULL))
 	{
@@ -147,6 +153,11 @@ static int Servo_Set_Position( int width )
 		fclose(pigpio_read);
 
 	pthread_mutex_unlock(&pigpio_mutex);
+	Trace_Stage_End( TRACE_STAGE_SERVO );
+
+	Metrics_Observe_Since( METRIC_SERVO_WRITE, start_ns );
+	if (result != 1)
+		Metrics_Add( METRIC_SERVO_WRITE_ERRORS, 1 );
 
 	return result;
 }
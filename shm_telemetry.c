@@ -0,0 +1,139 @@
+/***************************************************************************************************
+Shared Memory Telemetry
+
+Writer side of the shared memory telemetry segment, see shm_telemetry.h for the layout and the
+client functions.  The telemetry thread is the only writer: it publishes every record it drains
+from the telemetry rings, then bumps the generation and wakes the waiting clients once per batch,
+so the control and ADC threads do not pay for the clients at all.  Records reach the segment within
+TELEMETRY_SERVICE_RATE_US of being produced.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "shm_telemetry.h"
+
+/* *** Global Variables *** */
+static shm_telemetry_segment_type* g_segment = NULL;
+static int g_client_fd = -1;					// Read only, handed to clients of the local socket
+
+/***************************************************************************************************
+Creates the segment.  A segment left behind by an earlier run is replaced, clients still mapping it
+keep the old one until they attach again.
+
+Returns -1 on error
+		 1 on success
+***************************************************************************************************/
+int Shm_Telemetry_Init( void )
+{
+	int fd;
+
+	shm_unlink( SHM_TELEMETRY_NAME );
+	fd = shm_open( SHM_TELEMETRY_NAME, O_RDWR | O_CREAT | O_EXCL, 0644 );
+	if (fd < 0)
+	{
+		printf("Error creating the shared memory segment - %s.%u\n", __FILE__, __LINE__);
+		return -1;
+	}
+
+	if (ftruncate(fd, sizeof(shm_telemetry_segment_type)) < 0)
+	{
+		printf("Error sizing the shared memory segment - %s.%u\n", __FILE__, __LINE__);
+		close(fd);
+		shm_unlink( SHM_TELEMETRY_NAME );
+		return -1;
+	}
+
+	g_segment = mmap(NULL, sizeof(shm_telemetry_segment_type), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (g_segment == MAP_FAILED)
+	{
+		printf("Error mapping the shared memory segment - %s.%u\n", __FILE__, __LINE__);
+		g_segment = NULL;
+		shm_unlink( SHM_TELEMETRY_NAME );
+		return -1;
+	}
+
+	g_client_fd = shm_open( SHM_TELEMETRY_NAME, O_RDONLY, 0 );
+
+	// ftruncate() zeroed the segment, which leaves every slot empty
+	g_segment->version = SHM_TELEMETRY_VERSION;
+	g_segment->segment_size = sizeof(shm_telemetry_segment_type);
+	g_segment->record_size = TELEMETRY_RECORD_SIZE;
+	g_segment->nbr_sweeps = SHM_TELEMETRY_NBR_SWEEPS;
+	g_segment->writer_pid = getpid();
+	g_segment->created_ns = Telemetry_Get_Time_Ns( CLOCK_REALTIME );
+	atomic_store_explicit( &g_segment->magic, SHM_TELEMETRY_MAGIC, memory_order_release );
+
+	return 1;
+}
+
+/***************************************************************************************************
+Returns a read only descriptor of the segment for Shm_Telemetry_Attach_Fd() of a client, -1 if there
+is none.  The descriptor stays open, it is meant to be passed on with SCM_RIGHTS.
+***************************************************************************************************/
+int Shm_Telemetry_Get_Client_Fd( void )
+{
+	return g_client_fd;
+}
+
+/***************************************************************************************************
+Writes a record into its slot under the seqlock of the slot
+***************************************************************************************************/
+static void Shm_Telemetry_Write_Slot( shm_telemetry_slot_type* pSlot, uint64_t sequence, const telemetry_record_type* pRecord )
+{
+	atomic_store_explicit( &pSlot->sequence, sequence + 1, memory_order_relaxed );
+	atomic_thread_fence(memory_order_release);
+
+	memcpy(&pSlot->record, pRecord, sizeof(pSlot->record));
+
+	atomic_store_explicit( &pSlot->sequence, sequence + 2, memory_order_release );
+}
+
+/***************************************************************************************************
+Publishes one record of the telemetry stream.  Control ticks replace the latest tick, ADC sweeps go
+into the next slot of the ring.
+***************************************************************************************************/
+void Shm_Telemetry_Publish( const telemetry_record_type* pRecord )
+{
+	shm_telemetry_slot_type* pSlot;
+	uint64_t n;
+
+	if (g_segment == NULL)
+		return;
+
+	if (pRecord->record_type == TELEMETRY_RECORD_CONTROL_TICK)
+	{
+		pSlot = &g_segment->tick;
+		Shm_Telemetry_Write_Slot( pSlot, atomic_load_explicit( &pSlot->sequence, memory_order_relaxed ), pRecord );
+	}
+	else if (pRecord->record_type == TELEMETRY_RECORD_ADC_SWEEP)
+	{
+		// Sweep n completes its slot with sequence 2 * (n + 1), see Shm_Telemetry_Read_Sweep()
+		n = atomic_load_explicit( &g_segment->nbr_sweeps_written, memory_order_relaxed );
+		Shm_Telemetry_Write_Slot( &g_segment->sweeps[n % SHM_TELEMETRY_NBR_SWEEPS], 2 * n, pRecord );
+		atomic_store_explicit( &g_segment->nbr_sweeps_written, n + 1, memory_order_release );
+	}
+}
+
+/***************************************************************************************************
+Tells the clients new records were published.  FUTEX_WAKE costs a syscall even without a waiter,
+which is why it is done once per batch rather than once per record.
+***************************************************************************************************/
+void Shm_Telemetry_Notify( void )
+{
+	if (g_segment == NULL)
+		return;
+
+	atomic_fetch_add_explicit( &g_segment->generation, 1, memory_order_release );
+	syscall(SYS_futex, &g_segment->generation, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/* *** End of File *** */
@@ -0,0 +1,220 @@
+#ifndef __SHM_TELEMETRY_H
+#define __SHM_TELEMETRY_H
+
+/***************************************************************************************************
+Shared memory telemetry segment
+
+The daemon mirrors its telemetry into a POSIX shared memory segment, so other programs on the Pi (a
+local display, a data exporter) can read it without a socket, a syscall or any parsing.  This
+header is all a client needs:
+
+	const shm_telemetry_segment_type* pSegment = Shm_Telemetry_Attach();
+	telemetry_record_type tick;
+	uint32_t generation = 0;
+
+	while (Shm_Telemetry_Wait( pSegment, generation, 1000 ) >= 0)
+	{
+		generation = atomic_load( &pSegment->generation );
+		Shm_Telemetry_Read_Tick( pSegment, &tick );
+		...
+	}
+
+The segment holds the latest control tick record and a ring of the latest ADC sweep records, in
+the format of the telemetry file (telemetry.h).  Every record sits in a slot guarded by a seqlock:
+its sequence is odd while the daemon writes the record and even once it is complete, so readers
+never block the daemon and retry the rare read that overlapped a write.  Shm_Telemetry_Read_*()
+copy a record out; to read fields in place instead, check them between
+Shm_Telemetry_Read_Begin() and Shm_Telemetry_Read_Valid().
+
+generation is bumped after every batch of records and is a futex word: Shm_Telemetry_Wait()
+sleeps until it moves.  Clients map the segment read only, they cannot disturb the daemon.  A
+restarted daemon creates a new segment, so a client that sees no new generation for a few seconds
+should attach again.  Clients that cannot open the segment by name, e.g. in another mount namespace,
+ask the local control socket for a descriptor (SHMFD) and use Shm_Telemetry_Attach_Fd().
+***************************************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "telemetry.h"			// For telemetry_record_type
+
+#define SHM_TELEMETRY_NAME			"/smokinpi_telemetry"		// Under /dev/shm
+#define SHM_TELEMETRY_MAGIC			0x4D485350					// "PSHM" in little endian byte order
+#define SHM_TELEMETRY_VERSION		1
+#define SHM_TELEMETRY_NBR_SWEEPS	256							// Ring of ADC sweeps, a few seconds worth
+#define SHM_TELEMETRY_ALIGNMENT		64							// Cache line size
+
+// One record and the seqlock guarding it
+typedef struct
+{
+	_Atomic uint64_t sequence;					// Odd while being written
+	telemetry_record_type record;
+} __attribute__((aligned(SHM_TELEMETRY_ALIGNMENT))) shm_telemetry_slot_type;
+
+typedef struct
+{
+	_Atomic uint32_t magic;						// SHM_TELEMETRY_MAGIC once the segment is ready
+	uint32_t version;							// SHM_TELEMETRY_VERSION
+	uint32_t segment_size;						// sizeof(shm_telemetry_segment_type)
+	uint32_t record_size;						// TELEMETRY_RECORD_SIZE
+	uint32_t nbr_sweeps;						// SHM_TELEMETRY_NBR_SWEEPS
+	int32_t writer_pid;
+	int64_t created_ns;							// CLOCK_REALTIME when the daemon created the segment
+
+	_Atomic uint32_t generation __attribute__((aligned(SHM_TELEMETRY_ALIGNMENT)));	// Futex word
+	_Atomic uint64_t nbr_sweeps_written;		// Sweep n is in slot n % nbr_sweeps
+
+	shm_telemetry_slot_type tick;				// Latest control tick
+	shm_telemetry_slot_type sweeps[SHM_TELEMETRY_NBR_SWEEPS];
+} shm_telemetry_segment_type;
+
+// Daemon side
+int Shm_Telemetry_Init( void );
+void Shm_Telemetry_Publish( const telemetry_record_type* pRecord );
+void Shm_Telemetry_Notify( void );
+int Shm_Telemetry_Get_Client_Fd( void );
+
+/* *** Client side *** */
+
+/***************************************************************************************************
+Maps the segment read only from a descriptor of it, which the caller may close afterwards
+
+Returns NULL if the descriptor is not a segment with this layout
+***************************************************************************************************/
+static inline const shm_telemetry_segment_type* Shm_Telemetry_Attach_Fd( int fd )
+{
+	const shm_telemetry_segment_type* pSegment;
+	struct stat status;
+
+	if ((fstat(fd, &status) < 0) || (status.st_size < (off_t)sizeof(shm_telemetry_segment_type)))
+		return NULL;
+
+	pSegment = mmap(NULL, sizeof(shm_telemetry_segment_type), PROT_READ, MAP_SHARED, fd, 0);
+	if (pSegment == MAP_FAILED)
+		return NULL;
+
+	if ((atomic_load_explicit( &pSegment->magic, memory_order_acquire ) != SHM_TELEMETRY_MAGIC) ||
+		(pSegment->version != SHM_TELEMETRY_VERSION) || (pSegment->segment_size != sizeof(shm_telemetry_segment_type)) ||
+		(pSegment->record_size != TELEMETRY_RECORD_SIZE) || (pSegment->nbr_sweeps != SHM_TELEMETRY_NBR_SWEEPS))
+	{
+		munmap((void*)pSegment, sizeof(shm_telemetry_segment_type));
+		return NULL;
+	}
+
+	return pSegment;
+}
+
+/***************************************************************************************************
+Maps the segment read only
+
+Returns NULL if the daemon is not running or its segment has another layout
+***************************************************************************************************/
+static inline const shm_telemetry_segment_type* Shm_Telemetry_Attach( void )
+{
+	const shm_telemetry_segment_type* pSegment;
+	int fd = shm_open( SHM_TELEMETRY_NAME, O_RDONLY, 0 );
+
+	if (fd < 0)
+		return NULL;
+
+	pSegment = Shm_Telemetry_Attach_Fd( fd );
+	close(fd);
+	return pSegment;
+}
+
+static inline void Shm_Telemetry_Detach( const shm_telemetry_segment_type* pSegment )
+{
+	munmap((void*)pSegment, sizeof(shm_telemetry_segment_type));
+}
+
+/***************************************************************************************************
+Zero copy reads of a slot: the fields read between the two calls are consistent if
+Shm_Telemetry_Read_Valid() returns true
+***************************************************************************************************/
+static inline uint64_t Shm_Telemetry_Read_Begin( const shm_telemetry_slot_type* pSlot )
+{
+	return atomic_load_explicit( &pSlot->sequence, memory_order_acquire );
+}
+
+static inline bool Shm_Telemetry_Read_Valid( const shm_telemetry_slot_type* pSlot, uint64_t sequence )
+{
+	atomic_thread_fence(memory_order_acquire);
+	return ((sequence & 1) == 0) && (atomic_load_explicit( &pSlot->sequence, memory_order_relaxed ) == sequence);
+}
+
+/***************************************************************************************************
+Copies the latest control tick
+
+Returns false if no tick was published yet
+***************************************************************************************************/
+static inline bool Shm_Telemetry_Read_Tick( const shm_telemetry_segment_type* pSegment, telemetry_record_type* pRecord )
+{
+	uint64_t sequence;
+
+	do {
+		sequence = Shm_Telemetry_Read_Begin( &pSegment->tick );
+		memcpy(pRecord, (const void*)&pSegment->tick.record, sizeof(*pRecord));
+	} while (!Shm_Telemetry_Read_Valid( &pSegment->tick, sequence ));
+
+	return sequence != 0;
+}
+
+/***************************************************************************************************
+Copies ADC sweep number n, counting from 0 since the segment was created.  Read from
+nbr_sweeps_written - nbr_sweeps up to nbr_sweeps_written - 1 to get every sweep still in the ring.
+
+Returns  1 on success
+		 0 if the sweep was not written yet
+		-1 if it was overwritten already
+***************************************************************************************************/
+static inline int Shm_Telemetry_Read_Sweep( const shm_telemetry_segment_type* pSegment, uint64_t n,
+											telemetry_record_type* pRecord )
+{
+	const shm_telemetry_slot_type* pSlot = &pSegment->sweeps[n % SHM_TELEMETRY_NBR_SWEEPS];
+	uint64_t expected = 2 * (n + 1);			// Sequence of the slot once sweep n is complete
+	uint64_t sequence;
+
+	do {
+		sequence = Shm_Telemetry_Read_Begin( pSlot );
+		if (sequence < expected - 1)
+			return 0;
+		if (sequence > expected)
+			return -1;
+		memcpy(pRecord, (const void*)&pSlot->record, sizeof(*pRecord));
+	} while (!Shm_Telemetry_Read_Valid( pSlot, sequence ));
+
+	return 1;
+}
+
+/***************************************************************************************************
+Sleeps until the generation differs from the one given, or timeout_ms passes (negative for no
+timeout).  Does not sleep at all if it differs already.
+
+Returns  1 when there is new data
+		 0 on timeout
+		-1 on error
+***************************************************************************************************/
+static inline int Shm_Telemetry_Wait( const shm_telemetry_segment_type* pSegment, uint32_t generation, int timeout_ms )
+{
+	struct timespec timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+
+	while (atomic_load_explicit( &pSegment->generation, memory_order_acquire ) == generation)
+	{
+		if ((syscall(SYS_futex, &pSegment->generation, FUTEX_WAIT, generation, (timeout_ms < 0) ? NULL : &timeout,
+					 NULL, 0) < 0) && (errno == ETIMEDOUT))
+			return 0;
+	}
+
+	return 1;
+}
+
+#endif //__SHM_TELEMETRY_H
@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <string.h>
+#include "spsc_ring.h"
+
+/***************************************************************************************************
+Allocates storage for the ring.  The capacity is rounded up to the next power of 2 so that the
+indices can be wrapped with a mask.
+
+Returns -1 if the storage could not be allocated
+		 1 on success
+***************************************************************************************************/
+int Spsc_Ring_Init( spsc_ring_type* pRing, uint32_t element_size, uint32_t capacity )
+{
+	uint32_t size = 1;
+
+	while (size < capacity)
+		size <<= 1;
+
+	pRing->p_storage = malloc( (size_t)size * element_size );
+	if (pRing->p_storage == NULL)
+		return -1;
+
+	pRing->element_size = element_size;
+	pRing->mask = size - 1;
+	atomic_init( &pRing->head, 0 );
+	atomic_init( &pRing->tail, 0 );
+	atomic_init( &pRing->dropped, 0 );
+
+	return 1;
+}
+
+/***************************************************************************************************
+Copies an element into the ring.  Only the producer thread may call this function.  The element is
+copied before the head is published, so the consumer never sees a partially written element.
+***************************************************************************************************/
+int Spsc_Ring_Push( spsc_ring_type* pRing, const void* pElement )
+{
+	uint32_t head = atomic_load_explicit( &pRing->head, memory_order_relaxed );
+	uint32_t tail = atomic_load_explicit( &pRing->tail, memory_order_acquire );
+
+	if ((head - tail) > pRing->mask)
+	{
+		atomic_fetch_add_explicit( &pRing->dropped, 1, memory_order_relaxed );
+		return 0;
+	}
+
+	memcpy( &pRing->p_storage[(head & pRing->mask) * pRing->element_size], pElement, pRing->element_size );
+	atomic_store_explicit( &pRing->head, head + 1, memory_order_release );
+
+	return 1;
+}
+
+/***************************************************************************************************
+Copies the oldest element out of the ring.  Only the consumer thread may call this function.
+***************************************************************************************************/
+int Spsc_Ring_Pop( spsc_ring_type* pRing, void* pElement )
+{
+	uint32_t tail = atomic_load_explicit( &pRing->tail, memory_order_relaxed );
+	uint32_t head = atomic_load_explicit( &pRing->head, memory_order_acquire );
+
+	if (head == tail)
+		return 0;
+
+	memcpy( pElement, &pRing->p_storage[(tail & pRing->mask) * pRing->element_size], pRing->element_size );
+	atomic_store_explicit( &pRing->tail, tail + 1, memory_order_release );
+
+	return 1;
+}
+
+uint32_t Spsc_Ring_Count( spsc_ring_type* pRing )
+{
+	return atomic_load_explicit( &pRing->head, memory_order_acquire ) -
+		   atomic_load_explicit( &pRing->tail, memory_order_acquire );
+}
+
+uint32_t Spsc_Ring_Dropped( spsc_ring_type* pRing )
+{
+	return atomic_load_explicit( &pRing->dropped, memory_order_relaxed );
+}
+
+/* *** End of File *** */
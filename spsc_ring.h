@@ -0,0 +1,35 @@
+#ifndef __SPSC_RING_H
+#define __SPSC_RING_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define SPSC_RING_CACHE_LINE_SIZE		64
+
+/***************************************************************************************************
+Lock-free single producer, single consumer ring of fixed size elements.  Exactly one thread may push
+and exactly one (other) thread may pop.  The capacity must be a power of 2.  The head and tail
+indices live on separate cache lines so the producer and consumer do not fight over the same line.
+***************************************************************************************************/
+typedef struct
+{
+	_Atomic uint32_t head __attribute__((aligned(SPSC_RING_CACHE_LINE_SIZE)));	// Written by the producer
+	_Atomic uint32_t tail __attribute__((aligned(SPSC_RING_CACHE_LINE_SIZE)));	// Written by the consumer
+	uint8_t* p_storage __attribute__((aligned(SPSC_RING_CACHE_LINE_SIZE)));
+	uint32_t element_size;
+	uint32_t mask;
+	_Atomic uint32_t dropped;						// Number of pushes rejected because the ring was full
+} spsc_ring_type;
+
+int Spsc_Ring_Init( spsc_ring_type* pRing, uint32_t element_size, uint32_t capacity );
+
+// Returns 1 if the element was queued, 0 if the ring was full
+int Spsc_Ring_Push( spsc_ring_type* pRing, const void* pElement );
+
+// Returns 1 if an element was removed, 0 if the ring was empty
+int Spsc_Ring_Pop( spsc_ring_type* pRing, void* pElement );
+
+uint32_t Spsc_Ring_Count( spsc_ring_type* pRing );
+uint32_t Spsc_Ring_Dropped( spsc_ring_type* pRing );
+
+#endif //__SPSC_RING_H
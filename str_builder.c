@@ -0,0 +1,238 @@
+/***************************************************************************************************
+String Builder
+
+Bounds checked, append-only text formatting for command responses.  Integers and fixed precision
+floats are converted directly instead of through printf(), and appending never rescans the text
+already built, so a response costs time in proportion to its length.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "str_builder.h"
+
+/* *** Global Variables *** */
+static const uint64_t g_powers_of_ten[STR_BUILDER_MAX_DECIMALS + 1] =
+{
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+};
+
+/***************************************************************************************************
+Prepares a builder over p_buffer (size bytes).  flush may be NULL.
+***************************************************************************************************/
+void Str_Builder_Init( str_builder_type* pBuilder, char* p_buffer, int size,
+					   str_builder_flush_function flush, void* pContext )
+{
+	pBuilder->p_buffer = p_buffer;
+	pBuilder->size = size;
+	pBuilder->flush = flush;
+	pBuilder->pContext = pContext;
+	Str_Builder_Reset( pBuilder );
+}
+
+void Str_Builder_Reset( str_builder_type* pBuilder )
+{
+	pBuilder->length = 0;
+	pBuilder->overflow = false;
+	pBuilder->p_buffer[0] = '\0';
+}
+
+/***************************************************************************************************
+Hands the text built so far to the flush function and empties the builder.  Does nothing for a
+builder without a flush function.
+***************************************************************************************************/
+void Str_Builder_Flush( str_builder_type* pBuilder )
+{
+	if ((pBuilder->flush == NULL) || (pBuilder->length == 0))
+		return;
+
+	pBuilder->flush( pBuilder->pContext, pBuilder->p_buffer, pBuilder->length );
+	pBuilder->length = 0;
+	pBuilder->p_buffer[0] = '\0';
+}
+
+/***************************************************************************************************
+Makes room for length more characters by flushing if needed
+
+Returns true if the characters fit
+***************************************************************************************************/
+static inline bool Str_Builder_Reserve( str_builder_type* pBuilder, int length )
+{
+	if ((pBuilder->length + length) < pBuilder->size)
+		return true;
+
+	Str_Builder_Flush( pBuilder );
+
+	return (pBuilder->length + length) < pBuilder->size;
+}
+
+void Str_Builder_Append_N( str_builder_type* pBuilder, const char* p_str, int length )
+{
+	int chunk;
+
+	while (length > 0)
+	{
+		if (!Str_Builder_Reserve( pBuilder, length ))
+		{
+			// Does not fit at once: fill what is left, then flush or give up
+			chunk = pBuilder->size - 1 - pBuilder->length;
+			memcpy(&pBuilder->p_buffer[pBuilder->length], p_str, chunk);
+			pBuilder->length += chunk;
+			pBuilder->p_buffer[pBuilder->length] = '\0';
+
+			if (pBuilder->flush == NULL)
+			{
+				pBuilder->overflow = true;
+				return;
+			}
+
+			Str_Builder_Flush( pBuilder );
+			p_str += chunk;
+			length -= chunk;
+			continue;
+		}
+
+		memcpy(&pBuilder->p_buffer[pBuilder->length], p_str, length);
+		pBuilder->length += length;
+		pBuilder->p_buffer[pBuilder->length] = '\0';
+		return;
+	}
+}
+
+void Str_Builder_Append( str_builder_type* pBuilder, const char* p_str )
+{
+	Str_Builder_Append_N( pBuilder, p_str, strlen(p_str) );
+}
+
+void Str_Builder_Append_Char( str_builder_type* pBuilder, char ch )
+{
+	Str_Builder_Append_N( pBuilder, &ch, 1 );
+}
+
+/***************************************************************************************************
+Appends an unsigned integer in decimal
+***************************************************************************************************/
+void Str_Builder_Append_Uint( str_builder_type* pBuilder, uint64_t value )
+{
+	char digits[20];
+	int index = sizeof(digits);
+
+	do
+	{
+		digits[--index] = (char)('0' + (value % 10));
+		value /= 10;
+	} while (value != 0);
+
+	Str_Builder_Append_N( pBuilder, &digits[index], sizeof(digits) - index );
+}
+
+void Str_Builder_Append_Int( str_builder_type* pBuilder, int64_t value )
+{
+	if (value < 0)
+	{
+		Str_Builder_Append_Char( pBuilder, '-' );
+		Str_Builder_Append_Uint( pBuilder, (uint64_t)0 - (uint64_t)value );
+	}
+	else
+		Str_Builder_Append_Uint( pBuilder, (uint64_t)value );
+}
+
+/***************************************************************************************************
+Appends a value with a fixed number of decimals (0 to STR_BUILDER_MAX_DECIMALS).  Exact ties are
+rounded to even like printf("%.<decimals>f"), so the output is identical to printf() for float
+values with up to 6 decimals.  Values too large for the fast path, infinities and NaN go through
+printf().
+***************************************************************************************************/
+void Str_Builder_Append_Fixed( str_builder_type* pBuilder, double value, int decimals )
+{
+	char fraction[STR_BUILDER_MAX_DECIMALS];
+	uint64_t scaled;
+	uint64_t power;
+	uint64_t remainder;
+	double magnitude;
+	double rest;
+	int i;
+
+	if (decimals < 0)
+		decimals = 0;
+	if (decimals > STR_BUILDER_MAX_DECIMALS)
+		decimals = STR_BUILDER_MAX_DECIMALS;
+
+	power = g_powers_of_ten[decimals];
+	magnitude = fabs(value) * (double)power;
+	if (!(magnitude < 9.0e18))					// Also true for NaN
+	{
+		Str_Builder_Printf( pBuilder, "%.*f", decimals, value );
+		return;
+	}
+
+	scaled = (uint64_t)magnitude;
+	rest = magnitude - (double)scaled;
+	if ((rest > 0.5) || ((rest == 0.5) && (scaled & 1)))
+		scaled++;
+
+	if (value < 0.0)
+		Str_Builder_Append_Char( pBuilder, '-' );
+
+	Str_Builder_Append_Uint( pBuilder, scaled / power );
+
+	if (decimals > 0)
+	{
+		remainder = scaled % power;
+		for (i = decimals - 1; i >= 0; i--)
+		{
+			fraction[i] = (char)('0' + (remainder % 10));
+			remainder /= 10;
+		}
+
+		Str_Builder_Append_Char( pBuilder, '.' );
+		Str_Builder_Append_N( pBuilder, fraction, decimals );
+	}
+}
+
+/***************************************************************************************************
+printf() style append for the cases the specialised functions do not cover.  Output longer than the
+buffer is truncated.
+***************************************************************************************************/
+void Str_Builder_VPrintf( str_builder_type* pBuilder, const char* format, va_list args )
+{
+	va_list args_copy;
+	int length;
+
+	va_copy(args_copy, args);
+	length = vsnprintf(&pBuilder->p_buffer[pBuilder->length], pBuilder->size - pBuilder->length, format, args_copy);
+	va_end(args_copy);
+
+	if (length < 0)
+		return;
+
+	if ((pBuilder->length + length) >= pBuilder->size)
+	{
+		pBuilder->p_buffer[pBuilder->length] = '\0';		// Drop the partial output
+		Str_Builder_Flush( pBuilder );
+
+		length = vsnprintf(&pBuilder->p_buffer[pBuilder->length], pBuilder->size - pBuilder->length, format, args);
+		if (length < 0)
+			return;
+
+		if ((pBuilder->length + length) >= pBuilder->size)
+		{
+			pBuilder->overflow = true;
+			length = pBuilder->size - 1 - pBuilder->length;
+		}
+	}
+
+	pBuilder->length += length;
+}
+
+void Str_Builder_Printf( str_builder_type* pBuilder, const char* format, ... )
+{
+	va_list args;
+
+	va_start(args, format);
+	Str_Builder_VPrintf( pBuilder, format, args );
+	va_end(args);
+}
+
+/* *** End of File *** */
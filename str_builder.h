@@ -0,0 +1,46 @@
+#ifndef __STR_BUILDER_H
+#define __STR_BUILDER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#define STR_BUILDER_MAX_DECIMALS		9
+
+// Prototype of the function that takes the contents of a full builder, e.g. to write them to a socket
+typedef void (*str_builder_flush_function)( void* pContext, const char* p_data, int length );
+
+/***************************************************************************************************
+Append-only string builder over a caller supplied buffer.  The text is always null terminated.
+When the buffer is full, the flush function (if any) is handed the contents and the builder starts
+over, otherwise the text is truncated and the overflow flag is set.  A builder holds no global
+state, so any number of threads can use their own builders at the same time.
+***************************************************************************************************/
+typedef struct
+{
+	char* p_buffer;
+	int size;									// Bytes in p_buffer, including the terminator
+	int length;									// Characters in use
+	bool overflow;								// Text was lost because it did not fit
+	str_builder_flush_function flush;			// May be NULL
+	void* pContext;								// Passed to flush
+} str_builder_type;
+
+void Str_Builder_Init( str_builder_type* pBuilder, char* p_buffer, int size,
+					   str_builder_flush_function flush, void* pContext );
+void Str_Builder_Reset( str_builder_type* pBuilder );
+void Str_Builder_Flush( str_builder_type* pBuilder );
+
+void Str_Builder_Append_N( str_builder_type* pBuilder, const char* p_str, int length );
+void Str_Builder_Append( str_builder_type* pBuilder, const char* p_str );
+void Str_Builder_Append_Char( str_builder_type* pBuilder, char ch );
+void Str_Builder_Append_Uint( str_builder_type* pBuilder, uint64_t value );
+void Str_Builder_Append_Int( str_builder_type* pBuilder, int64_t value );
+void Str_Builder_Append_Fixed( str_builder_type* pBuilder, double value, int decimals );
+void Str_Builder_Printf( str_builder_type* pBuilder, const char* format, ... ) __attribute__((format(printf, 2, 3)));
+void Str_Builder_VPrintf( str_builder_type* pBuilder, const char* format, va_list args );
+
+static inline const char* Str_Builder_Get( const str_builder_type* pBuilder ) { return pBuilder->p_buffer; }
+static inline int Str_Builder_Length( const str_builder_type* pBuilder ) { return pBuilder->length; }
+
+#endif //__STR_BUILDER_H
@@ -0,0 +1,246 @@
+/***************************************************************************************************
+Subscription
+
+Field selection, snapshots and frame formatting for push based telemetry.  A front end (e.g. the
+Ethernet server) takes one snapshot of the shared data per push pass and formats it once per
+distinct field selection, then sends the same frame to every subscriber with that selection.
+
+Frame format:  PUSH,<time ms>,<field mask in hex>,<value>,...\n
+The values of the fields present in the mask follow in subscription_field_type order.
+Temperatures have two decimals, ADC counts, fire state and servo position are integers.
+
+Delta subscribers get DELTA frames (same layout) holding only the fields that moved beyond their
+deadband since the value last sent, and nothing when no field moved.  A full PUSH keyframe is sent
+first, every SUBSCRIPTION_KEYFRAME_PERIOD_MS and on request.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include "main.h"
+#include "telemetry.h"
+#include "subscription.h"
+#include "str_builder.h"
+
+/* *** Types *** */
+typedef struct
+{
+	const char* name;
+	uint32_t mask;
+} subscription_group_type;
+
+/* *** Global Variables *** */
+	// Names accepted in the field list of a subscription
+static const subscription_group_type g_subscription_groups[] =
+{
+	{ "ALL",		SUBSCRIPTION_ALL_FIELDS },
+	{ "SETPOINT",	1UL << SUBSCRIPTION_FIELD_SETPOINT },
+	{ "TEMPS",		((1UL << NBR_OF_THERMISTORS) - 1) << SUBSCRIPTION_FIELD_PROBE_0 },
+	{ "FIRE",		1UL << SUBSCRIPTION_FIELD_FIRE },
+	{ "ADC",		((1UL << NBR_ADC_CHANNELS) - 1) << SUBSCRIPTION_FIELD_ADC_0 },
+	{ "STATE",		1UL << SUBSCRIPTION_FIELD_FIRE_STATE },
+	{ "SERVO",		1UL << SUBSCRIPTION_FIELD_SERVO },
+};
+#define NBR_SUBSCRIPTION_GROUPS		(sizeof(g_subscription_groups) / sizeof(g_subscription_groups[0]))
+
+	// Default deadbands: temperatures in degrees F, ADC in counts, state and servo on any change
+#define SUBSCRIPTION_TEMP_DEADBAND		0.1f
+#define SUBSCRIPTION_ADC_DEADBAND		2.0f
+
+/***************************************************************************************************
+Converts a ':' separated list of field group names (e.g. "SETPOINT:TEMPS:FIRE") to a field mask.
+Names are not case sensitive.
+
+Returns -1 if a name is unknown or nothing is selected
+		 1 on success
+***************************************************************************************************/
+int Subscription_Parse_Fields( const char* p_fields, uint32_t* pMask )
+{
+	const char* p_name = p_fields;
+	size_t length;
+	uint32_t mask = 0;
+	int i;
+
+	while (*p_name != '\0')
+	{
+		length = strcspn(p_name, ":");
+
+		for (i = 0; i < NBR_SUBSCRIPTION_GROUPS; i++)
+		{
+			if ((strlen(g_subscription_groups[i].name) == length) &&
+				(strncasecmp(p_name, g_subscription_groups[i].name, length) == 0))
+			{
+				mask |= g_subscription_groups[i].mask;
+				break;
+			}
+		}
+
+		if (i >= NBR_SUBSCRIPTION_GROUPS)
+			return -1;
+
+		p_name += length;
+		if (*p_name == ':')
+			p_name++;
+	}
+
+	if (mask == 0)
+		return -1;
+
+	*pMask = mask;
+	return 1;
+}
+
+/***************************************************************************************************
+Fills a snapshot from a copy of the shared data.  The caller takes the copy under the mutex.
+***************************************************************************************************/
+void Subscription_Take_Snapshot( const shared_data_type* pShared_Data, subscription_snapshot_type* pSnapshot )
+{
+	int i;
+
+	pSnapshot->timestamp_ms = Telemetry_Get_Time_Ns( CLOCK_REALTIME ) / 1000000;
+
+	pSnapshot->values[SUBSCRIPTION_FIELD_SETPOINT] = pShared_Data->temp_deg_f_cabinet_setpoint;
+	for (i = 0; i < NBR_OF_THERMISTORS; i++)
+		pSnapshot->values[SUBSCRIPTION_FIELD_PROBE_0 + i] = pShared_Data->temp_deg_f[i];
+	pSnapshot->values[SUBSCRIPTION_FIELD_FIRE] = pShared_Data->temp_deg_f_fire;
+	for (i = 0; i < NBR_ADC_CHANNELS; i++)
+		pSnapshot->values[SUBSCRIPTION_FIELD_ADC_0 + i] = (float)(0x3FF & pShared_Data->adc_results[i]);
+	pSnapshot->values[SUBSCRIPTION_FIELD_FIRE_STATE] = (float)pShared_Data->fire_detect_state;
+	pSnapshot->values[SUBSCRIPTION_FIELD_SERVO] = (float)pShared_Data->servo_position;
+}
+
+/***************************************************************************************************
+Formats the fields of the mask into a PUSH (keyframe) or DELTA frame terminated by '\n'
+
+Returns the length of the frame, or -1 if it does not fit in buffer_size bytes
+***************************************************************************************************/
+int Subscription_Format_Frame( const subscription_snapshot_type* pSnapshot, uint32_t mask, bool keyframe,
+							   char* p_buffer, int buffer_size )
+{
+	str_builder_type builder;
+	int field;
+
+	Str_Builder_Init( &builder, p_buffer, buffer_size, NULL, NULL );
+	Str_Builder_Printf( &builder, "%s,%lld,%X", keyframe ? "PUSH" : "DELTA", (long long)pSnapshot->timestamp_ms, mask );
+
+	for (field = 0; field < NBR_SUBSCRIPTION_FIELDS; field++)
+	{
+		if ((mask & (1UL << field)) == 0)
+			continue;
+
+		Str_Builder_Append_Char( &builder, ',' );
+		if (field >= SUBSCRIPTION_FIELD_ADC_0)
+			Str_Builder_Append_Uint( &builder, (uint32_t)pSnapshot->values[field] );
+		else
+			Str_Builder_Append_Fixed( &builder, pSnapshot->values[field], 2 );
+	}
+
+	Str_Builder_Append_Char( &builder, '\n' );
+
+	return builder.overflow ? -1 : Str_Builder_Length( &builder );
+}
+
+/***************************************************************************************************
+Starts (or replaces) a subscription.  The period is limited to the supported range, deadbands are
+reset to their defaults and the first frame is a keyframe sent on the next pass.
+***************************************************************************************************/
+void Subscription_Start( subscription_type* pSubscription, uint32_t mask, int period_ms, bool delta )
+{
+	int field;
+
+	if (period_ms < SUBSCRIPTION_MIN_PERIOD_MS)
+		period_ms = SUBSCRIPTION_MIN_PERIOD_MS;
+	if (period_ms > SUBSCRIPTION_MAX_PERIOD_MS)
+		period_ms = SUBSCRIPTION_MAX_PERIOD_MS;
+
+	pSubscription->mask = mask & SUBSCRIPTION_ALL_FIELDS;
+	pSubscription->period_ms = period_ms;
+	pSubscription->next_ms = 0;
+	pSubscription->delta = delta;
+	pSubscription->keyframe_due = true;
+
+	for (field = 0; field < NBR_SUBSCRIPTION_FIELDS; field++)
+	{
+		if (field < SUBSCRIPTION_FIELD_ADC_0)
+			pSubscription->deadbands[field] = SUBSCRIPTION_TEMP_DEADBAND;
+		else if (field < SUBSCRIPTION_FIELD_FIRE_STATE)
+			pSubscription->deadbands[field] = SUBSCRIPTION_ADC_DEADBAND;
+		else
+			pSubscription->deadbands[field] = 0.0f;
+	}
+}
+
+void Subscription_Stop( subscription_type* pSubscription )
+{
+	pSubscription->mask = 0;
+}
+
+/***************************************************************************************************
+Sets the deadband of the fields in the mask.  A field is sent when it differs from the value last
+sent by more than its deadband.
+***************************************************************************************************/
+void Subscription_Set_Deadband( subscription_type* pSubscription, uint32_t mask, float deadband )
+{
+	int field;
+
+	for (field = 0; field < NBR_SUBSCRIPTION_FIELDS; field++)
+	{
+		if (mask & (1UL << field))
+			pSubscription->deadbands[field] = (deadband > 0.0f) ? deadband : 0.0f;
+	}
+}
+
+void Subscription_Request_Keyframe( subscription_type* pSubscription )
+{
+	pSubscription->keyframe_due = true;
+	pSubscription->next_ms = 0;
+}
+
+/***************************************************************************************************
+Called when the subscription is due (now_ms >= next_ms) to decide what to send and to schedule the
+next frame.  Deadlines are aligned to multiples of the period, so subscribers with the same period
+are served in the same pass and can share formatted frames.
+
+Returns the mask of the fields to send, 0 if nothing is to be sent.  *pKeyframe tells whether the
+frame is a keyframe.
+***************************************************************************************************/
+uint32_t Subscription_Next_Frame( subscription_type* pSubscription, const subscription_snapshot_type* pSnapshot,
+								  int64_t now_ms, bool* pKeyframe )
+{
+	uint32_t mask = pSubscription->mask;
+	float difference;
+	int field;
+
+	pSubscription->next_ms = now_ms - (now_ms % pSubscription->period_ms) + pSubscription->period_ms;
+
+	*pKeyframe = (!pSubscription->delta) || pSubscription->keyframe_due || (now_ms >= pSubscription->next_keyframe_ms);
+	if (*pKeyframe)
+	{
+		pSubscription->keyframe_due = false;
+		pSubscription->next_keyframe_ms = now_ms + SUBSCRIPTION_KEYFRAME_PERIOD_MS;
+	}
+
+	for (field = 0; field < NBR_SUBSCRIPTION_FIELDS; field++)
+	{
+		if ((mask & (1UL << field)) == 0)
+			continue;
+
+		if (!*pKeyframe)
+		{
+			difference = pSnapshot->values[field] - pSubscription->last_values[field];
+			if ((difference <= pSubscription->deadbands[field]) && (-difference <= pSubscription->deadbands[field]))
+			{
+				mask &= ~(1UL << field);
+				continue;
+			}
+		}
+
+		pSubscription->last_values[field] = pSnapshot->values[field];
+	}
+
+	return mask;
+}
+
+/* *** End of File *** */
@@ -0,0 +1,66 @@
+#ifndef __SUBSCRIPTION_H
+#define __SUBSCRIPTION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "main.h"				// For shared_data_type
+#include "tlc1543.h"			// For NBR_ADC_CHANNELS
+#include "thermistor.h"			// For NBR_OF_THERMISTORS
+
+#define SUBSCRIPTION_MIN_PERIOD_MS		50			// Fastest push rate (20 Hz)
+#define SUBSCRIPTION_MAX_PERIOD_MS		60000
+#define SUBSCRIPTION_MAX_FRAME_SIZE		512			// Longest formatted frame, including the terminator
+#define SUBSCRIPTION_KEYFRAME_PERIOD_MS	10000		// Delta subscribers get every field at least this often
+
+/***************************************************************************************************
+Fields that can be pushed to subscribers.  Frames always list the selected fields in this order.
+***************************************************************************************************/
+typedef enum
+{
+	SUBSCRIPTION_FIELD_SETPOINT = 0,
+	SUBSCRIPTION_FIELD_PROBE_0,													// Probes 0 to NBR_OF_THERMISTORS-1
+	SUBSCRIPTION_FIELD_FIRE = SUBSCRIPTION_FIELD_PROBE_0 + NBR_OF_THERMISTORS,	// Thermocouple temperature
+	SUBSCRIPTION_FIELD_ADC_0,													// ADC channels 0 to NBR_ADC_CHANNELS-1
+	SUBSCRIPTION_FIELD_FIRE_STATE = SUBSCRIPTION_FIELD_ADC_0 + NBR_ADC_CHANNELS,
+	SUBSCRIPTION_FIELD_SERVO,
+
+	NBR_SUBSCRIPTION_FIELDS,
+} subscription_field_type;
+
+_Static_assert(NBR_SUBSCRIPTION_FIELDS <= 32, "subscription field masks are 32 bits");
+
+#define SUBSCRIPTION_ALL_FIELDS		((uint32_t)((1ULL << NBR_SUBSCRIPTION_FIELDS) - 1))
+
+// Values of every field at one point in time
+typedef struct
+{
+	int64_t timestamp_ms;						// CLOCK_REALTIME when the snapshot was taken
+	float values[NBR_SUBSCRIPTION_FIELDS];
+} subscription_snapshot_type;
+
+// State of one subscriber
+typedef struct
+{
+	uint32_t mask;								// Subscribed fields, 0 when not subscribed
+	int period_ms;
+	int64_t next_ms;							// Time the next frame is due
+	bool delta;									// Only send fields that moved beyond their deadband
+	bool keyframe_due;							// Send every field in the next frame
+	int64_t next_keyframe_ms;
+	float last_values[NBR_SUBSCRIPTION_FIELDS];	// Values most recently sent
+	float deadbands[NBR_SUBSCRIPTION_FIELDS];
+} subscription_type;
+
+int Subscription_Parse_Fields( const char* p_fields, uint32_t* pMask );
+void Subscription_Take_Snapshot( const shared_data_type* pShared_Data, subscription_snapshot_type* pSnapshot );
+int Subscription_Format_Frame( const subscription_snapshot_type* pSnapshot, uint32_t mask, bool keyframe,
+							   char* p_buffer, int buffer_size );
+
+void Subscription_Start( subscription_type* pSubscription, uint32_t mask, int period_ms, bool delta );
+void Subscription_Stop( subscription_type* pSubscription );
+void Subscription_Set_Deadband( subscription_type* pSubscription, uint32_t mask, float deadband );
+void Subscription_Request_Keyframe( subscription_type* pSubscription );
+uint32_t Subscription_Next_Frame( subscription_type* pSubscription, const subscription_snapshot_type* pSnapshot,
+								  int64_t now_ms, bool* pKeyframe );
+
+#endif //__SUBSCRIPTION_H
@@ -0,0 +1,281 @@
+/***************************************************************************************************
+Telemetry
+
+High rate binary logging of every ADC sweep and every control tick.  The producing threads only copy
+a fixed size record into a lock-free ring.  The telemetry thread drains the rings and hands each
+record to the consumers of the telemetry stream:
+
+	- The binary telemetry file (when enabled).  Records are collected in a page aligned batch buffer
+	  and written to the uSD card in large blocks, optionally followed by an fdatasync() depending on
+	  the selected fsync policy.
+	- The column log, which keeps a decimated, queryable history of the cook.
+	- The compressed in-memory history of the current and previous cook.
+	- The rollup engine, which keeps 1 s / 1 min / 15 min aggregates for charting.
+	- The shared memory segment read by other programs on the Pi.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include "main.h"
+#include "telemetry.h"
+#include "spsc_ring.h"
+#include "column_log.h"
+#include "history.h"
+#include "rollup.h"
+#include "shm_telemetry.h"
+#include "metrics.h"
+
+/* *** Defined Values *** */
+#define TELEMETRY_RING_CAPACITY			1024		// Records per producer, ~5 seconds of control ticks
+#define TELEMETRY_BATCH_SIZE			32768		// Bytes per write, a multiple of the page size
+#define TELEMETRY_BATCH_ALIGNMENT		4096
+#define TELEMETRY_MAX_FLUSH_DELAY_MS	2000		// Partially filled batches are written after this
+#define TELEMETRY_FSYNC_PERIOD_S		10
+#define TELEMETRY_SERVICE_RATE_US		10000		// Idle sleep when the rings are empty
+
+/* *** Global Variables *** */
+static int g_telemetry_fd = -1;
+static spsc_ring_type g_sweep_ring;				// Filled by the Tlc1543 thread
+static spsc_ring_type g_tick_ring;				// Filled by the main thread
+
+static atomic_bool g_enabled = false;
+static _Atomic int g_fsync_policy = TELEMETRY_FSYNC_PERIODIC;
+
+static uint8_t* g_batch_buffer;
+static uint32_t g_batch_bytes;
+
+/* *** Function Declarations *** */
+static void Telemetry_Write_Batch( void );
+static int Telemetry_Write_All( const uint8_t* pData, size_t length );
+
+/* *** Accessors *** */
+void Telemetry_Set_Enabled( bool enabled ) { atomic_store( &g_enabled, enabled ); }
+bool Telemetry_Get_Enabled( void ) { return atomic_load( &g_enabled ); }
+void Telemetry_Set_Fsync_Policy( telemetry_fsync_policy_type policy ) { atomic_store( &g_fsync_policy, policy ); }
+telemetry_fsync_policy_type Telemetry_Get_Fsync_Policy( void ) { return atomic_load( &g_fsync_policy ); }
+
+uint32_t Telemetry_Get_Dropped_Records( void )
+{
+	return Spsc_Ring_Dropped( &g_sweep_ring ) + Spsc_Ring_Dropped( &g_tick_ring );
+}
+
+/***************************************************************************************************
+Allocates the rings and the batch buffer, then opens the day's telemetry file for appending.  A file
+header record is written when the file is new.
+
+Returns -1 on error
+		 1 on success
+***************************************************************************************************/
+int Telemetry_Init( void )
+{
+	char filename[50];
+	time_t t = time(NULL);
+	struct tm tm;
+	telemetry_file_header_type header;
+
+	if ((Spsc_Ring_Init( &g_sweep_ring, sizeof(telemetry_record_type), TELEMETRY_RING_CAPACITY ) < 0) ||
+		(Spsc_Ring_Init( &g_tick_ring, sizeof(telemetry_record_type), TELEMETRY_RING_CAPACITY ) < 0) ||
+		(posix_memalign( (void**)&g_batch_buffer, TELEMETRY_BATCH_ALIGNMENT, TELEMETRY_BATCH_SIZE ) != 0))
+	{
+		printf("Error allocating telemetry buffers\n");
+		return -1;
+	}
+	g_batch_bytes = 0;
+
+	tm = *localtime(&t);
+	sprintf(filename, "logs/Telemetry-%d-%d-%d.bin", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+	g_telemetry_fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+	if (g_telemetry_fd < 0)
+	{
+		printf("Error, can't open telemetry file: %s\n", filename);
+		return -1;
+	}
+
+	if (lseek(g_telemetry_fd, 0, SEEK_END) == 0)
+	{
+		memset(&header, 0, sizeof(header));
+		header.record_type = TELEMETRY_RECORD_FILE_HEADER;
+		header.record_size = TELEMETRY_RECORD_SIZE;
+		header.magic = TELEMETRY_FILE_MAGIC;
+		header.version = TELEMETRY_FILE_VERSION;
+		header.nbr_adc_channels = NBR_ADC_CHANNELS;
+		header.nbr_thermistors = NBR_OF_THERMISTORS;
+		header.timestamp_ns = Telemetry_Get_Time_Ns( CLOCK_REALTIME );
+		memcpy(g_batch_buffer, &header, sizeof(header));
+		g_batch_bytes = sizeof(header);
+	}
+
+	printf("Telemetry file: %s\n", filename);
+	return 1;
+}
+
+/***************************************************************************************************
+Called by the Tlc1543 thread after each complete sweep of the ADC.  Costs a single ring push.
+***************************************************************************************************/
+void Telemetry_Record_Adc_Sweep( const uint16_t* p_adc_results )
+{
+	static uint32_t sequence = 0;
+	telemetry_record_type record;
+
+	memset(&record, 0, sizeof(record));
+	record.record_type = TELEMETRY_RECORD_ADC_SWEEP;
+	record.record_size = TELEMETRY_RECORD_SIZE;
+	record.sequence = sequence++;
+	record.timestamp_ns = Telemetry_Get_Time_Ns( CLOCK_REALTIME );
+	record.monotonic_ns = Telemetry_Get_Time_Ns( CLOCK_MONOTONIC );
+	memcpy(record.adc_results, p_adc_results, sizeof(record.adc_results));
+
+	Spsc_Ring_Push( &g_sweep_ring, &record );
+}
+
+/***************************************************************************************************
+Called by the main thread at the end of App_Service.  The caller fills in the measurement and PID
+fields, this function stamps the header fields and pushes the record into the ring.
+***************************************************************************************************/
+void Telemetry_Record_Control_Tick( telemetry_record_type* pRecord )
+{
+	static uint32_t sequence = 0;
+
+	pRecord->record_type = TELEMETRY_RECORD_CONTROL_TICK;
+	pRecord->record_size = TELEMETRY_RECORD_SIZE;
+	pRecord->sequence = sequence++;
+	pRecord->timestamp_ns = Telemetry_Get_Time_Ns( CLOCK_REALTIME );
+	pRecord->monotonic_ns = Telemetry_Get_Time_Ns( CLOCK_MONOTONIC );
+
+	Spsc_Ring_Push( &g_tick_ring, pRecord );
+}
+
+/***************************************************************************************************
+Drains the telemetry rings and passes each record to the telemetry consumers.  Full batches of the
+binary file are written immediately, partial batches are written once they are
+TELEMETRY_MAX_FLUSH_DELAY_MS old so that little data is lost if the process is stopped.  Records
+dropped by full rings are added to the telemetry_dropped_records_total metric.
+***************************************************************************************************/
+void Telemetry_Service( void* shared_data_address )
+{
+	int64_t last_write_ns = Telemetry_Get_Time_Ns( CLOCK_MONOTONIC );
+	int64_t now_ns;
+	int drained;
+	uint32_t dropped;
+	uint32_t reported_dropped = 0;
+	telemetry_record_type record;
+
+	while (1)
+	{
+		drained = 0;
+
+		while (Spsc_Ring_Pop( &g_sweep_ring, &record ) || Spsc_Ring_Pop( &g_tick_ring, &record ))
+		{
+			drained++;
+			Shm_Telemetry_Publish( &record );
+
+			if (record.record_type == TELEMETRY_RECORD_CONTROL_TICK)
+			{
+				Column_Log_Append_Record( &record );
+				History_Append_Record( &record );
+				Rollup_Append_Record( &record );
+			}
+
+			if ((g_telemetry_fd < 0) || !atomic_load_explicit( &g_enabled, memory_order_relaxed ))
+				continue;
+
+			memcpy(&g_batch_buffer[g_batch_bytes], &record, TELEMETRY_RECORD_SIZE);
+			g_batch_bytes += TELEMETRY_RECORD_SIZE;
+
+			if (g_batch_bytes >= TELEMETRY_BATCH_SIZE)
+			{
+				Telemetry_Write_Batch();
+				last_write_ns = Telemetry_Get_Time_Ns( CLOCK_MONOTONIC );
+			}
+		}
+
+		if (drained > 0)
+			Shm_Telemetry_Notify();
+
+		dropped = Telemetry_Get_Dropped_Records();
+		if (dropped != reported_dropped)
+		{
+			Metrics_Add( METRIC_TELEMETRY_DROPPED, dropped - reported_dropped );
+			reported_dropped = dropped;
+		}
+
+		now_ns = Telemetry_Get_Time_Ns( CLOCK_MONOTONIC );
+		if ((g_batch_bytes > 0) && ((now_ns - last_write_ns) >= (TELEMETRY_MAX_FLUSH_DELAY_MS * 1000000LL)))
+		{
+			Telemetry_Write_Batch();
+			last_write_ns = now_ns;
+		}
+
+		if (drained == 0)
+			usleep(TELEMETRY_SERVICE_RATE_US);
+	}
+}
+
+/***************************************************************************************************
+Writes the batch buffer to the telemetry file and applies the fsync policy
+***************************************************************************************************/
+static void Telemetry_Write_Batch( void )
+{
+	static int64_t last_sync_ns = 0;
+	int64_t now_ns;
+
+	if (Telemetry_Write_All( g_batch_buffer, g_batch_bytes ) < 0)
+		printf("Error writing telemetry - %s.%u\n", __FILE__, __LINE__);
+
+	g_batch_bytes = 0;
+
+	switch (atomic_load( &g_fsync_policy ))
+	{
+		case TELEMETRY_FSYNC_EVERY_WRITE:
+			fdatasync(g_telemetry_fd);
+			break;
+
+		case TELEMETRY_FSYNC_PERIODIC:
+			now_ns = Telemetry_Get_Time_Ns( CLOCK_MONOTONIC );
+			if ((now_ns - last_sync_ns) >= (TELEMETRY_FSYNC_PERIOD_S * 1000000000LL))
+			{
+				fdatasync(g_telemetry_fd);
+				last_sync_ns = now_ns;
+			}
+			break;
+
+		default:
+		case TELEMETRY_FSYNC_NEVER:
+			break;
+	}
+}
+
+/***************************************************************************************************
+write() may return early when interrupted by a signal.  Keep writing until everything is out.
+***************************************************************************************************/
+static int Telemetry_Write_All( const uint8_t* pData, size_t length )
+{
+	ssize_t written;
+
+	while (length > 0)
+	{
+		written = write(g_telemetry_fd, pData, length);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		pData += written;
+		length -= written;
+	}
+
+	return 1;
+}
+
+/* *** End of File *** */
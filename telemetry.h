@@ -0,0 +1,125 @@
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "tlc1543.h"			// For NBR_ADC_CHANNELS
+#include "thermistor.h"			// For NBR_OF_THERMISTORS
+
+#define TELEMETRY_RECORD_SIZE			128
+#define TELEMETRY_FILE_MAGIC			0x4D4C5450		// "PTLM" in little endian byte order
+#define TELEMETRY_FILE_VERSION			1
+
+typedef enum
+{
+	TELEMETRY_RECORD_FILE_HEADER = 0,	// First record of every telemetry file
+	TELEMETRY_RECORD_ADC_SWEEP,			// One complete sweep of the ADC channels
+	TELEMETRY_RECORD_CONTROL_TICK,		// One pass of App_Service
+
+	NBR_TELEMETRY_RECORD_TYPES,
+} telemetry_record_id_type;
+
+/***************************************************************************************************
+Channels that are tracked over time by the history features.  Values are taken from control tick
+records with Telemetry_Get_Channel_Value().
+***************************************************************************************************/
+typedef enum
+{
+	TELEMETRY_CHANNEL_PROBE_0 = 0,					// Probes 0 (cabinet) to NBR_OF_THERMISTORS-1
+	TELEMETRY_CHANNEL_FIRE = NBR_OF_THERMISTORS,	// Thermocouple temperature
+	TELEMETRY_CHANNEL_SETPOINT,						// Cabinet setpoint
+	TELEMETRY_CHANNEL_SERVO,						// Servo position
+
+	NBR_TELEMETRY_CHANNELS,
+} telemetry_channel_type;
+
+typedef enum
+{
+	TELEMETRY_FSYNC_NEVER = 0,			// Leave flushing to the kernel
+	TELEMETRY_FSYNC_EVERY_WRITE,		// fdatasync() after every batch
+	TELEMETRY_FSYNC_PERIODIC,			// fdatasync() at most once per TELEMETRY_FSYNC_PERIOD_S
+} telemetry_fsync_policy_type;
+
+/***************************************************************************************************
+Fixed size binary telemetry record.  Records are written back to back, so a file can be read by
+seeking to (n * TELEMETRY_RECORD_SIZE).  Multi-byte values are in the native (little endian) order
+of the Pi.
+***************************************************************************************************/
+typedef struct
+{
+	uint16_t record_type;						// telemetry_record_id_type
+	uint16_t record_size;						// Always TELEMETRY_RECORD_SIZE
+	uint32_t sequence;							// Per record type sequence number, used to spot drops
+	int64_t timestamp_ns;						// CLOCK_REALTIME when the record was produced
+	int64_t monotonic_ns;						// CLOCK_MONOTONIC when the record was produced
+	uint16_t adc_results[NBR_ADC_CHANNELS];		// Raw ADC counts
+	uint16_t servo_position;					// Servo command (control ticks only)
+	float temp_deg_f[NBR_OF_THERMISTORS];		// Probe temperatures (control ticks only)
+	float temp_deg_f_fire;						// Thermocouple temperature (control ticks only)
+	float temp_deg_f_cabinet_setpoint;			// Cabinet setpoint (control ticks only)
+	float pid_p_term;							// Proportional term of the last PID update
+	float pid_i_term;							// Integral term of the last PID update
+	float pid_d_term;							// Derivative term of the last PID update
+	float pid_control;							// Output of the last PID update
+	uint8_t fire_detect_state;					// fire_detect_state_type
+	uint8_t pid_updated;						// Non-zero if the PID was executed on this tick
+	uint8_t reserved[TELEMETRY_RECORD_SIZE - 114];
+} telemetry_record_type;
+
+typedef struct
+{
+	uint16_t record_type;						// TELEMETRY_RECORD_FILE_HEADER
+	uint16_t record_size;						// Always TELEMETRY_RECORD_SIZE
+	uint32_t magic;								// TELEMETRY_FILE_MAGIC
+	uint32_t version;							// TELEMETRY_FILE_VERSION
+	uint16_t nbr_adc_channels;
+	uint16_t nbr_thermistors;
+	int64_t timestamp_ns;						// CLOCK_REALTIME when the file was created
+	uint8_t reserved[TELEMETRY_RECORD_SIZE - 24];
+} telemetry_file_header_type;
+
+_Static_assert(sizeof(telemetry_record_type) == TELEMETRY_RECORD_SIZE, "telemetry record size");
+_Static_assert(sizeof(telemetry_file_header_type) == TELEMETRY_RECORD_SIZE, "telemetry header size");
+
+/***************************************************************************************************
+Returns the time of the specified clock in nanoseconds
+***************************************************************************************************/
+static inline int64_t Telemetry_Get_Time_Ns( clockid_t clock_id )
+{
+	struct timespec ts;
+
+	clock_gettime( clock_id, &ts );
+	return ((int64_t)ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+}
+
+/***************************************************************************************************
+Returns the value of a history channel from a control tick record
+***************************************************************************************************/
+static inline float Telemetry_Get_Channel_Value( const telemetry_record_type* pRecord, int channel )
+{
+	if (channel < NBR_OF_THERMISTORS)
+		return pRecord->temp_deg_f[channel];
+	else if (channel == TELEMETRY_CHANNEL_FIRE)
+		return pRecord->temp_deg_f_fire;
+	else if (channel == TELEMETRY_CHANNEL_SETPOINT)
+		return pRecord->temp_deg_f_cabinet_setpoint;
+	else
+		return (float)pRecord->servo_position;
+}
+
+int Telemetry_Init( void );
+void Telemetry_Service( void* shared_data_address );
+
+// Producer side.  Each function may only be called from a single thread.
+void Telemetry_Record_Adc_Sweep( const uint16_t* p_adc_results );		// Tlc1543 thread
+void Telemetry_Record_Control_Tick( telemetry_record_type* pRecord );	// Main thread
+
+void Telemetry_Set_Enabled( bool enabled );
+bool Telemetry_Get_Enabled( void );
+void Telemetry_Set_Fsync_Policy( telemetry_fsync_policy_type policy );
+telemetry_fsync_policy_type Telemetry_Get_Fsync_Policy( void );
+
+uint32_t Telemetry_Get_Dropped_Records( void );
+
+#endif //__TELEMETRY_H
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
@@ -7,6 +8,9 @@
 #include <pthread.h>
 #include "tlc1543.h"
 #include "main.h"
+#include "telemetry.h"
+#include "metrics.h"
+#include "trace.h"
 
 /* *** Defined Values *** */
 #define SPI_CHANNEL         0
@@ -44,7 +48,6 @@ first read in the service routine to be valid data
 int Tlc1543_Init( void )
 {
     uint8_t data[2] = { 0 };
-    uint8_t i;
 
     printf("Initializing Tlc1543\n");
 
@@ -69,7 +72,6 @@ static int Tlc1543_Transfer( uint8_t* pData, int length )
 {
     uint8_t* write_data = pData;
     uint8_t* read_data = pData;
-    char carriage_return;
 
     int pigpio_handle;
     int pigpio_response = 0;
@@ -77,11 +79,13 @@ static int Tlc1543_Transfer( uint8_t* pData, int length )
     int i, j;
     char response_buffer[10];
     char ch;
+    int64_t start_ns = Metrics_Now_Ns();
 
     pthread_mutex_lock(&pigpio_mutex);
+    Metrics_Observe_Since( METRIC_PIGPIO_MUTEX_WAIT, start_ns );
 
-    pigpio_read = fopen("/dev/pigout", "r");
-    pigpio_write = fopen("/dev/pigpio", "w");
+    pigpio_read = fopen(PIGPIO_RESPONSE_PIPE, "r");
+    pigpio_write = fopen(PIGPIO_COMMAND_PIPE, "w");
 
     if ((pigpio_write == NULL) || (pigpio_read == NULL))
     {
@@ -166,11 +170,14 @@ void Tlc1543_Service( void *shared_data_address )
     int i;
     uint16_t result;
     uint16_t channel_adc_result[NBR_ADC_CHANNELS];
+    int64_t sweep_start_ns;
+    int64_t sweep_end_ns;
     shared_data_type* p_shared_data = (shared_data_type*)shared_data_address;
 
     while (1)
     {
         usleep(10000);  // Sleep for 10mS
+        sweep_start_ns = Metrics_Now_Ns();
 
         // start i at 1 as we've already sent the command to read channel 0
         // as we send the command to read channel 1, the data we get back
@@ -207,9 +214,16 @@ void Tlc1543_Service( void *shared_data_address )
         result = result >> 6;
 
         channel_adc_result[i-1] = result;
+        sweep_end_ns = Metrics_Now_Ns();
+        Metrics_Observe_Us( METRIC_ADC_SWEEP, (sweep_end_ns - sweep_start_ns) / 1000 );
+        Trace_Record_Sweep( sweep_start_ns, sweep_end_ns );
 
         pthread_mutex_lock(&mutex);
         memcpy( (uint8_t*)p_shared_data->adc_results, (uint8_t*)channel_adc_result, sizeof(p_shared_data->adc_results));
+        p_shared_data->adc_sweep_start_ns = sweep_start_ns;
+        p_shared_data->adc_sweep_end_ns = sweep_end_ns;
         pthread_mutex_unlock(&mutex);
+
+        Telemetry_Record_Adc_Sweep( channel_adc_result );
     }
 }
\ No newline at end of file
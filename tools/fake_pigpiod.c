@@ -0,0 +1,407 @@
+/***************************************************************************************************
+Fake pigpiod
+
+Emulates the part of the pigpio daemon the Smokin'Pi uses, so the ADC and servo paths can be run
+end to end on any Linux machine.  Both interfaces of pigpiod are served:
+
+	the pipe interface, text commands on a command pipe and replies on a response pipe
+	the socket interface, binary commands on TCP port 8888 as sent by pigs or pigpiod_if2
+
+and both understand the same commands, s, spio, spix and spic, run by the emulator core shared with
+the benchmarks (pigpio_emulator.c).  The core also describes the simulated TLC1543.
+
+Faults can be injected to test how the daemon copes: reply latency with jitter, replies that never
+come, negative error codes in place of results, and restarts of the daemon in the middle of the
+session, which remove the pipes and close the sockets for a while.
+
+	tools/fake_pigpiod [-c command pipe] [-r response pipe] [-p port] [-s script] [-n noise]
+					   [-l latency us] [-j jitter us] [-d drop %] [-e error %] [-R restart s]
+					   [-D downtime ms] [-v]
+
+The pipes default to /tmp/pigpio and /tmp/pigout, -p 0 disables the socket.  Build the daemon
+against them with
+	make CFLAGS='-I. -DPIGPIO_COMMAND_PIPE=\"/tmp/pigpio\" -DPIGPIO_RESPONSE_PIPE=\"/tmp/pigout\"'
+
+The format of the -s script is described in pigpio_emulator.c.
+
+SIGHUP restarts the daemon at once, SIGUSR1 prints the counters, which are also printed on exit.
+Commands are served one at a time, so latency holds up every client, as it would a busy pigpiod.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "tools/pigpio_emulator.h"
+
+/* *** Defined Values *** */
+#define FAKE_COMMAND_PIPE			"/tmp/pigpio"
+#define FAKE_RESPONSE_PIPE			"/tmp/pigout"
+#define FAKE_SOCKET_PORT			8888
+
+#define FAKE_MAX_CLIENTS			8
+#define FAKE_SOCKET_HEADER_SIZE		16			// cmd, p1, p2, p3 as 32 bit words
+
+/* *** Data Types *** */
+typedef struct
+{
+	int fd;										// -1 when the slot is free
+	uint8_t buffer[FAKE_SOCKET_HEADER_SIZE + PIGPIO_EMULATOR_MAX_XFER];
+	int length;
+} fake_client_type;
+
+/* *** Global Variables *** */
+static const char* g_command_pipe = FAKE_COMMAND_PIPE;
+static const char* g_response_pipe = FAKE_RESPONSE_PIPE;
+static int g_port = FAKE_SOCKET_PORT;
+static int g_restart_s = 0;
+static int g_downtime_ms = 1000;
+static pigpio_emulator_config_type g_config;
+
+static int g_command_fd = -1;
+static int g_response_fd = -1;
+static int g_listen_fd = -1;
+static fake_client_type g_clients[FAKE_MAX_CLIENTS];
+static pigpio_emulator_line_type g_line;
+
+static volatile sig_atomic_t g_stop = 0;
+static volatile sig_atomic_t g_restart = 0;
+static volatile sig_atomic_t g_print = 0;
+
+static void Fake_Pigpiod_Signal_Handler( int signal )
+{
+	if (signal == SIGHUP)
+		g_restart = 1;
+	else if (signal == SIGUSR1)
+		g_print = 1;
+	else
+		g_stop = 1;
+}
+
+static double Fake_Pigpiod_Now_S( void )
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* *** Socket interface *** */
+
+static uint32_t Fake_Pigpiod_Get_U32( const uint8_t* p_data )
+{
+	uint32_t value;
+
+	memcpy(&value, p_data, sizeof(value));		// pigpio sends host order, little endian on the Pi
+	return value;
+}
+
+static void Fake_Pigpiod_Close_Client( fake_client_type* pClient )
+{
+	close(pClient->fd);
+	pClient->fd = -1;
+	pClient->length = 0;
+}
+
+/***************************************************************************************************
+Runs every complete command received from a client.  The extension of SPIO is its flags, that of
+SPIX the bytes to send.  The reply echoes cmd, p1 and p2 with the result in place of p3, followed
+for SPIX by the bytes read.
+***************************************************************************************************/
+static void Fake_Pigpiod_Socket_Service( fake_client_type* pClient )
+{
+	uint8_t reply[FAKE_SOCKET_HEADER_SIZE + PIGPIO_EMULATOR_MAX_XFER];
+	uint8_t data[PIGPIO_EMULATOR_MAX_XFER];
+	uint32_t cmd, p1, p2, p3;
+	uint32_t extension;
+	int32_t result;
+	int bytes_read;
+	int length;
+
+	bytes_read = recv(pClient->fd, &pClient->buffer[pClient->length], sizeof(pClient->buffer) - pClient->length, 0);
+	if (bytes_read <= 0)
+	{
+		Fake_Pigpiod_Close_Client( pClient );
+		return;
+	}
+	pClient->length += bytes_read;
+
+	while (pClient->length >= FAKE_SOCKET_HEADER_SIZE)
+	{
+		cmd = Fake_Pigpiod_Get_U32( &pClient->buffer[0] );
+		p1 = Fake_Pigpiod_Get_U32( &pClient->buffer[4] );
+		p2 = Fake_Pigpiod_Get_U32( &pClient->buffer[8] );
+		p3 = Fake_Pigpiod_Get_U32( &pClient->buffer[12] );
+		extension = ((cmd == PI_CMD_SPIO) || (cmd == PI_CMD_SPIX)) ? p3 : 0;
+
+		if (extension > PIGPIO_EMULATOR_MAX_XFER)
+		{
+			Fake_Pigpiod_Close_Client( pClient );
+			return;
+		}
+		if (pClient->length < (int)(FAKE_SOCKET_HEADER_SIZE + extension))
+			return;
+
+		memcpy(data, &pClient->buffer[FAKE_SOCKET_HEADER_SIZE], extension);
+		if (cmd == PI_CMD_SPIO)
+			p3 = (extension >= 4) ? Fake_Pigpiod_Get_U32( data ) : 0;
+
+		length = FAKE_SOCKET_HEADER_SIZE + extension;
+		memmove(pClient->buffer, &pClient->buffer[length], pClient->length - length);
+		pClient->length -= length;
+
+		if (!Pigpio_Emulator_Execute( cmd, p1, p2, p3, data, extension, &result ))
+			continue;
+
+		memcpy(&reply[0], &cmd, 4);
+		memcpy(&reply[4], &p1, 4);
+		memcpy(&reply[8], &p2, 4);
+		memcpy(&reply[12], &result, 4);
+		length = FAKE_SOCKET_HEADER_SIZE;
+		if ((cmd == PI_CMD_SPIX) && (result > 0))
+		{
+			memcpy(&reply[length], data, result);
+			length += result;
+		}
+
+		if (send(pClient->fd, reply, length, MSG_NOSIGNAL) != length)
+		{
+			Fake_Pigpiod_Close_Client( pClient );
+			return;
+		}
+	}
+}
+
+static void Fake_Pigpiod_Accept( void )
+{
+	int fd = accept(g_listen_fd, NULL, NULL);
+	int option = 1;
+	int i;
+
+	if (fd < 0)
+		return;
+
+	for (i = 0; i < FAKE_MAX_CLIENTS; i++)
+	{
+		if (g_clients[i].fd < 0)
+		{
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+			g_clients[i].fd = fd;
+			g_clients[i].length = 0;
+			return;
+		}
+	}
+
+	close(fd);									// Full
+}
+
+/* *** Start up and restarts *** */
+
+/***************************************************************************************************
+Creates the pipes and the listening socket.  The pipes are kept open read-write, as pigpiod keeps
+them open, so clients opening and closing them for every command never see end of file.
+
+Returns -1 on error
+		 1 on success
+***************************************************************************************************/
+static int Fake_Pigpiod_Start( void )
+{
+	struct sockaddr_in addr;
+	int option = 1;
+
+	unlink(g_command_pipe);
+	unlink(g_response_pipe);
+	if ((mkfifo(g_command_pipe, 0666) < 0) || (mkfifo(g_response_pipe, 0666) < 0))
+	{
+		perror("mkfifo");
+		return -1;
+	}
+
+	g_command_fd = open(g_command_pipe, O_RDWR | O_NONBLOCK);
+	g_response_fd = open(g_response_pipe, O_RDWR);
+	if ((g_command_fd < 0) || (g_response_fd < 0))
+	{
+		perror("open pipes");
+		return -1;
+	}
+	g_line.length = 0;
+
+	if (g_port > 0)
+	{
+		g_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+		setsockopt(g_listen_fd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		addr.sin_port = htons(g_port);
+		if ((bind(g_listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) || (listen(g_listen_fd, 8) < 0))
+		{
+			perror("bind");
+			return -1;
+		}
+	}
+
+	return 1;
+}
+
+/***************************************************************************************************
+Goes away like a dying pigpiod: the pipes are removed and every socket is closed.  A client blocked
+reading the response pipe gets end of file.
+***************************************************************************************************/
+static void Fake_Pigpiod_Stop( void )
+{
+	int i;
+
+	unlink(g_command_pipe);
+	unlink(g_response_pipe);
+
+	if (g_command_fd >= 0)
+		close(g_command_fd);
+	if (g_response_fd >= 0)
+		close(g_response_fd);
+	if (g_listen_fd >= 0)
+		close(g_listen_fd);
+	g_command_fd = g_response_fd = g_listen_fd = -1;
+
+	for (i = 0; i < FAKE_MAX_CLIENTS; i++)
+		if (g_clients[i].fd >= 0)
+			Fake_Pigpiod_Close_Client( &g_clients[i] );
+}
+
+static int Fake_Pigpiod_Restart( void )
+{
+	printf("restarting, down for %d ms\n", g_downtime_ms);
+	fflush(stdout);
+
+	Fake_Pigpiod_Stop();
+	Pigpio_Emulator_Restart();				// The SPI handles are lost
+	usleep(g_downtime_ms * 1000);
+
+	return Fake_Pigpiod_Start();
+}
+
+int main( int argc, char* argv[] )
+{
+	struct pollfd fds[2 + FAKE_MAX_CLIENTS];
+	fake_client_type* pClients[2 + FAKE_MAX_CLIENTS];
+	double next_restart_s;
+	int nbr_fds;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "c:r:p:s:n:l:j:d:e:R:D:v")) != -1)
+	{
+		switch (opt)
+		{
+			case 'c': g_command_pipe = optarg;					break;
+			case 'r': g_response_pipe = optarg;					break;
+			case 'p': g_port = atoi(optarg);					break;
+			case 'n': g_config.noise = atoi(optarg);			break;
+			case 'l': g_config.latency_us = atoi(optarg);		break;
+			case 'j': g_config.jitter_us = atoi(optarg);		break;
+			case 'd': g_config.drop_percent = atof(optarg);		break;
+			case 'e': g_config.error_percent = atof(optarg);	break;
+			case 'R': g_restart_s = atoi(optarg);				break;
+			case 'D': g_downtime_ms = atoi(optarg);				break;
+			case 'v': g_config.verbose = true;					break;
+			case 's':
+				if (Pigpio_Emulator_Load_Script( optarg ) < 0)
+					return 1;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-c command pipe] [-r response pipe] [-p port] [-s script] [-n noise]\n"
+								"\t[-l latency us] [-j jitter us] [-d drop %%] [-e error %%] [-R restart s]\n"
+								"\t[-D downtime ms] [-v]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	for (i = 0; i < FAKE_MAX_CLIENTS; i++)
+		g_clients[i].fd = -1;
+
+	signal(SIGINT, Fake_Pigpiod_Signal_Handler);
+	signal(SIGTERM, Fake_Pigpiod_Signal_Handler);
+	signal(SIGHUP, Fake_Pigpiod_Signal_Handler);
+	signal(SIGUSR1, Fake_Pigpiod_Signal_Handler);
+	signal(SIGPIPE, SIG_IGN);
+
+	srand(time(NULL));
+	Pigpio_Emulator_Init( &g_config );
+	next_restart_s = Fake_Pigpiod_Now_S() + g_restart_s;
+
+	if (Fake_Pigpiod_Start() < 0)
+		return 1;
+	printf("serving %s and %s, port %d\n", g_command_pipe, g_response_pipe, g_port);
+	fflush(stdout);
+
+	while (!g_stop)
+	{
+		if (g_restart || ((g_restart_s > 0) && (Fake_Pigpiod_Now_S() >= next_restart_s)))
+		{
+			g_restart = 0;
+			next_restart_s = Fake_Pigpiod_Now_S() + g_restart_s;
+			if (Fake_Pigpiod_Restart() < 0)
+				break;
+		}
+
+		if (g_print)
+		{
+			g_print = 0;
+			Pigpio_Emulator_Print_Counters();
+		}
+
+		nbr_fds = 0;
+		fds[nbr_fds].fd = g_command_fd;
+		fds[nbr_fds].events = POLLIN;
+		pClients[nbr_fds++] = NULL;
+		if (g_listen_fd >= 0)
+		{
+			fds[nbr_fds].fd = g_listen_fd;
+			fds[nbr_fds].events = POLLIN;
+			pClients[nbr_fds++] = NULL;
+		}
+		for (i = 0; i < FAKE_MAX_CLIENTS; i++)
+		{
+			if (g_clients[i].fd >= 0)
+			{
+				fds[nbr_fds].fd = g_clients[i].fd;
+				fds[nbr_fds].events = POLLIN;
+				pClients[nbr_fds++] = &g_clients[i];
+			}
+		}
+
+		if (poll(fds, nbr_fds, 100) <= 0)
+			continue;
+
+		for (i = 0; i < nbr_fds; i++)
+		{
+			if (fds[i].revents == 0)
+				continue;
+
+			if (fds[i].fd == g_command_fd)
+				Pigpio_Emulator_Pipe_Read( g_command_fd, g_response_fd, &g_line );
+			else if (fds[i].fd == g_listen_fd)
+				Fake_Pigpiod_Accept();
+			else if (pClients[i]->fd >= 0)
+				Fake_Pigpiod_Socket_Service( pClients[i] );
+		}
+	}
+
+	Fake_Pigpiod_Stop();
+	Pigpio_Emulator_Print_Counters();
+	return 0;
+}
+
+/* *** End of File *** */
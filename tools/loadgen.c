@@ -0,0 +1,642 @@
+/***************************************************************************************************
+Load Generator
+
+Opens many connections to the Ethernet command port of the Smokin'Pi and sends a mix of commands at
+a target rate, to find how many dashboards and integrations one Pi can serve before the control
+loop suffers:
+
+	tools/loadgen [-h host] [-c connections] [-r rate] [-t seconds] [-m mix] [-s subscribers]
+				  [-P period ms] [-F fields] [-B budget us] [-T]
+
+-c connections each send -r commands per second for -t seconds, picked at random with the weights
+of -m, by default STATUS:5,TEMPS:4,SETTEMP:1.  SETTEMP= writes back the setpoint read by SETPOINT?
+at start up, so a cook in progress is left alone.  The first -s connections also SUBSCRIBE= to -F
+(ALL) every -P (1000) ms and count the frames pushed to them.  A host starting with '/' or '@' is the
+local Unix domain socket of the daemon instead, e.g. -h /tmp/smpi.sock, to compare the two.
+
+Commands are sent on a fixed schedule, one outstanding per connection, and latencies are measured
+from the time a command was due, so a slow server is not hidden by commands sent late.  The report
+gives the latency percentiles and error rate per command, the push rate and, from METRICS? on a
+separate connection before and after the run, the CPU used by the daemon and how late its control
+loop woke up.  The exit code is 1 when the control loop missed ticks or its 99th percentile of
+lateness exceeded -B (1000 us), so the tool can gate a change.  -T resets TRACE first, so TRACE?
+afterwards covers the run only.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/* *** Defined Values *** */
+#define LOADGEN_PORT				"46879"
+#define LOADGEN_MAX_CONNECTIONS		1024
+#define LOADGEN_MAX_COMMANDS		8
+#define LOADGEN_RX_BUFFER_SIZE		4096
+#define LOADGEN_METRICS_SIZE		65536
+#define LOADGEN_METRICS_PREFIX		"smokinpi_"
+#define LOADGEN_JITTER_METRIC		LOADGEN_METRICS_PREFIX "control_tick_jitter_seconds"
+#define LOADGEN_MAX_BUCKETS			32
+
+/* *** Data Types *** */
+typedef struct
+{
+	char name[16];								// As sent, without ? or =
+	int weight;
+	uint64_t sent;
+	uint64_t errors;
+	int64_t* p_latencies_ns;
+	int nbr_latencies;
+	int max_latencies;
+} loadgen_command_type;
+
+typedef struct
+{
+	int fd;										// -1 once closed
+	bool subscriber;
+	bool subscribed;							// SUBSCRIBE= answered
+	int outstanding;							// Index of the command awaiting its response, -1 for none
+	int64_t due_ns;								// When the outstanding or next command is due
+	char rx_buffer[LOADGEN_RX_BUFFER_SIZE];
+	int rx_length;
+} loadgen_conn_type;
+
+// What METRICS? said at one moment
+typedef struct
+{
+	double cpu_s;
+	uint64_t overruns;
+	int nbr_buckets;
+	double bucket_bounds_s[LOADGEN_MAX_BUCKETS];
+	uint64_t bucket_counts[LOADGEN_MAX_BUCKETS];	// Cumulative, the last is +Inf
+} loadgen_metrics_type;
+
+/* *** Global Variables *** */
+static loadgen_command_type g_commands[LOADGEN_MAX_COMMANDS];
+static int g_nbr_commands = 0;
+static int g_total_weight = 0;
+static loadgen_conn_type g_conns[LOADGEN_MAX_CONNECTIONS];
+static int g_nbr_conns = 10;
+static char g_setpoint[32] = "";
+static uint64_t g_pushes = 0;
+static uint64_t g_disconnects = 0;
+static volatile sig_atomic_t g_stop = 0;
+
+static void Loadgen_Signal_Handler( int signal )
+{
+	g_stop = 1;
+}
+
+static bool Loadgen_Starts_With( const char* p_string, const char* p_prefix )
+{
+	return strncmp(p_string, p_prefix, strlen(p_prefix)) == 0;
+}
+
+static int64_t Loadgen_Now_Ns( void )
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/***************************************************************************************************
+Parses the command mix, e.g. STATUS:5,TEMPS:4,SETTEMP:1
+
+Returns -1 on error
+		 1 on success
+***************************************************************************************************/
+static int Loadgen_Parse_Mix( char* p_mix )
+{
+	loadgen_command_type* pCommand;
+	char* p_save = NULL;
+	char* p_item;
+	char* p_weight;
+
+	for (p_item = strtok_r(p_mix, ",", &p_save); p_item != NULL; p_item = strtok_r(NULL, ",", &p_save))
+	{
+		if (g_nbr_commands >= LOADGEN_MAX_COMMANDS)
+			return -1;
+
+		pCommand = &g_commands[g_nbr_commands++];
+		p_weight = strchr(p_item, ':');
+		if (p_weight != NULL)
+			*p_weight++ = '\0';
+
+		snprintf(pCommand->name, sizeof(pCommand->name), "%s", p_item);
+		pCommand->weight = (p_weight != NULL) ? atoi(p_weight) : 1;
+		if (pCommand->weight < 0)
+			return -1;
+		g_total_weight += pCommand->weight;
+	}
+
+	return (g_total_weight > 0) ? 1 : -1;
+}
+
+static int Loadgen_Connect( const char* p_host )
+{
+	struct sockaddr_un address;
+	struct addrinfo hints;
+	struct addrinfo* pResult;
+	int option = 1;
+	int fd = -1;
+
+	if ((p_host[0] == '/') || (p_host[0] == '@'))
+	{
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		strncpy(address.sun_path, p_host, sizeof(address.sun_path) - 1);
+		if (address.sun_path[0] == '@')
+			address.sun_path[0] = '\0';		// Abstract namespace
+
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if ((fd >= 0) && (connect(fd, (struct sockaddr*)&address, offsetof(struct sockaddr_un, sun_path) + strlen(p_host)) < 0))
+		{
+			close(fd);
+			fd = -1;
+		}
+		return fd;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(p_host, LOADGEN_PORT, &hints, &pResult) != 0)
+		return -1;
+
+	fd = socket(pResult->ai_family, SOCK_STREAM, 0);
+	if ((fd >= 0) && (connect(fd, pResult->ai_addr, pResult->ai_addrlen) < 0))
+	{
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(pResult);
+
+	if (fd >= 0)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+	return fd;
+}
+
+/***************************************************************************************************
+Sends a command on a blocking connection and collects its response, up to the line starting with
+p_last, or the first line if p_last is NULL
+
+Returns the length of the response, -1 on error
+***************************************************************************************************/
+static int Loadgen_Query( int fd, const char* p_command, const char* p_last, char* p_response, int size )
+{
+	int length = 0;
+	int bytes_read;
+	char* p_line;
+
+	if (write(fd, p_command, strlen(p_command)) < 0)
+		return -1;
+
+	while (length < size - 1)
+	{
+		bytes_read = read(fd, &p_response[length], size - 1 - length);
+		if (bytes_read <= 0)
+			return -1;
+		length += bytes_read;
+		p_response[length] = '\0';
+
+		if (p_response[length - 1] != '\n')
+			continue;
+		if (p_last == NULL)
+			return length;
+
+		// The start of the last complete line
+		p_response[length - 1] = '\0';
+		p_line = strrchr(p_response, '\n');
+		p_line = (p_line != NULL) ? p_line + 1 : p_response;
+		p_response[length - 1] = '\n';
+		if (Loadgen_Starts_With( p_line, p_last ))
+			return length;
+	}
+
+	return -1;
+}
+
+/***************************************************************************************************
+Reads the CPU time of the daemon, its missed ticks and the histogram of how late its control loop
+woke up from METRICS?
+
+Returns -1 on error
+		 1 on success
+***************************************************************************************************/
+static int Loadgen_Read_Metrics( int fd, loadgen_metrics_type* pMetrics )
+{
+	static char response[LOADGEN_METRICS_SIZE];
+	char* p_save = NULL;
+	char* p_line;
+	char* p_value;
+
+	memset(pMetrics, 0, sizeof(*pMetrics));
+	pMetrics->cpu_s = -1.0;
+
+	if (Loadgen_Query( fd, "METRICS?\n", "METRICS,END", response, sizeof(response) ) < 0)
+		return -1;
+
+	for (p_line = strtok_r(response, "\n", &p_save); p_line != NULL; p_line = strtok_r(NULL, "\n", &p_save))
+	{
+		p_value = strrchr(p_line, ' ');
+		if ((p_line[0] == '#') || (p_value == NULL))
+			continue;
+
+		if (Loadgen_Starts_With( p_line, "process_cpu_seconds_total " ))
+			pMetrics->cpu_s = atof(p_value);
+		else if (Loadgen_Starts_With( p_line, LOADGEN_METRICS_PREFIX "control_tick_overruns_total " ))
+			pMetrics->overruns = strtoull(p_value, NULL, 10);
+		else if (Loadgen_Starts_With( p_line, LOADGEN_JITTER_METRIC "_bucket{le=\"" ) &&
+				 (pMetrics->nbr_buckets < LOADGEN_MAX_BUCKETS))
+		{
+			p_line += strlen(LOADGEN_JITTER_METRIC "_bucket{le=\"");
+			pMetrics->bucket_bounds_s[pMetrics->nbr_buckets] = (strncmp(p_line, "+Inf", 4) == 0) ? -1.0 : atof(p_line);
+			pMetrics->bucket_counts[pMetrics->nbr_buckets++] = strtoull(p_value, NULL, 10);
+		}
+	}
+
+	return 1;
+}
+
+/***************************************************************************************************
+Sends the next command of a connection, picked at random with the weights of the mix.  A command
+the socket does not take counts as an error and skips its period, a connection that failed is
+closed, so neither is retried in a busy loop.
+***************************************************************************************************/
+static void Loadgen_Send( loadgen_conn_type* pConn, int64_t period_ns )
+{
+	char command[64];
+	int pick = rand() % g_total_weight;
+	int i;
+
+	for (i = 0; (i < g_nbr_commands - 1) && (pick >= g_commands[i].weight); i++)
+		pick -= g_commands[i].weight;
+
+	if (strcmp(g_commands[i].name, "SETTEMP") == 0)
+		snprintf(command, sizeof(command), "SETTEMP=%s\n", g_setpoint);
+	else
+		snprintf(command, sizeof(command), "%s?\n", g_commands[i].name);
+
+	g_commands[i].sent++;
+	pConn->outstanding = i;
+
+	if (send(pConn->fd, command, strlen(command), MSG_NOSIGNAL) < 0)
+	{
+		g_commands[i].errors++;
+		pConn->outstanding = -1;
+		pConn->due_ns += period_ns;
+
+		if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+		{
+			close(pConn->fd);
+			pConn->fd = -1;
+			g_disconnects++;
+		}
+	}
+}
+
+// Latencies there is no memory for are left out of the percentiles
+static void Loadgen_Record_Latency( loadgen_command_type* pCommand, int64_t latency_ns )
+{
+	int64_t* p_latencies_ns;
+	int max_latencies;
+
+	if (pCommand->nbr_latencies == pCommand->max_latencies)
+	{
+		max_latencies = (pCommand->max_latencies == 0) ? 4096 : 2 * pCommand->max_latencies;
+		p_latencies_ns = realloc(pCommand->p_latencies_ns, max_latencies * sizeof(int64_t));
+		if (p_latencies_ns == NULL)
+			return;
+		pCommand->p_latencies_ns = p_latencies_ns;
+		pCommand->max_latencies = max_latencies;
+	}
+	pCommand->p_latencies_ns[pCommand->nbr_latencies++] = latency_ns;
+}
+
+/***************************************************************************************************
+Sorts out the lines received on a connection: pushed frames, the answer to SUBSCRIBE= and the
+response to the outstanding command, which ends its latency
+***************************************************************************************************/
+static void Loadgen_Receive( loadgen_conn_type* pConn, int64_t now_ns, int64_t period_ns )
+{
+	loadgen_command_type* pCommand;
+	char* p_line;
+	char* p_end;
+	int bytes_read;
+	int line_length;
+
+	bytes_read = recv(pConn->fd, &pConn->rx_buffer[pConn->rx_length], sizeof(pConn->rx_buffer) - 1 - pConn->rx_length, 0);
+	if (bytes_read <= 0)
+	{
+		if ((bytes_read < 0) && (errno == EAGAIN))
+			return;
+
+		if (pConn->outstanding >= 0)
+			g_commands[pConn->outstanding].errors++;
+		close(pConn->fd);
+		pConn->fd = -1;
+		g_disconnects++;
+		return;
+	}
+	pConn->rx_length += bytes_read;
+	pConn->rx_buffer[pConn->rx_length] = '\0';
+
+	p_line = pConn->rx_buffer;
+	while ((p_end = strchr(p_line, '\n')) != NULL)
+	{
+		*p_end = '\0';
+
+		if (Loadgen_Starts_With( p_line, "PUSH," ) || Loadgen_Starts_With( p_line, "DELTA," ))
+			g_pushes++;
+		else if (Loadgen_Starts_With( p_line, "SUBSCRIBE," ))
+			pConn->subscribed = (strstr(p_line, ",ERROR") == NULL);
+		else if (pConn->outstanding >= 0)
+		{
+			pCommand = &g_commands[pConn->outstanding];
+			if (!Loadgen_Starts_With( p_line, pCommand->name ) || (strstr(p_line, ",ERROR") != NULL))
+				pCommand->errors++;
+			else
+				Loadgen_Record_Latency( pCommand, now_ns - pConn->due_ns );
+
+			pConn->outstanding = -1;
+			pConn->due_ns += period_ns;
+		}
+
+		p_line = p_end + 1;
+	}
+
+	line_length = p_line - pConn->rx_buffer;
+	memmove(pConn->rx_buffer, p_line, pConn->rx_length - line_length + 1);
+	pConn->rx_length -= line_length;
+	if (pConn->rx_length >= (int)sizeof(pConn->rx_buffer) - 1)
+		pConn->rx_length = 0;					// Overlong line, drop it
+}
+
+static int Loadgen_Compare( const void* pA, const void* pB )
+{
+	int64_t a = *(const int64_t*)pA;
+	int64_t b = *(const int64_t*)pB;
+
+	return (a > b) - (a < b);
+}
+
+static double Loadgen_Percentile_Ms( const loadgen_command_type* pCommand, double percent )
+{
+	int index = (int)(percent / 100.0 * pCommand->nbr_latencies);
+
+	if (pCommand->nbr_latencies == 0)
+		return 0.0;
+	if (index >= pCommand->nbr_latencies)
+		index = pCommand->nbr_latencies - 1;
+
+	return pCommand->p_latencies_ns[index] / 1e6;
+}
+
+/***************************************************************************************************
+Returns the upper bound in microseconds of the bucket holding the 99th percentile of the jitter
+observed between two METRICS? reads, 0 if nothing was observed and -1 if it is past the last bound
+***************************************************************************************************/
+static double Loadgen_Jitter_P99_Us( const loadgen_metrics_type* pBefore, const loadgen_metrics_type* pAfter,
+									 uint64_t* p_count )
+{
+	uint64_t total;
+	int i;
+
+	*p_count = 0;
+	if ((pAfter->nbr_buckets == 0) || (pAfter->nbr_buckets != pBefore->nbr_buckets))
+		return 0.0;
+
+	total = pAfter->bucket_counts[pAfter->nbr_buckets - 1] - pBefore->bucket_counts[pBefore->nbr_buckets - 1];
+	*p_count = total;
+	if (total == 0)
+		return 0.0;
+
+	for (i = 0; i < pAfter->nbr_buckets; i++)
+		if ((pAfter->bucket_counts[i] - pBefore->bucket_counts[i]) * 100 >= total * 99)
+			return (pAfter->bucket_bounds_s[i] < 0.0) ? -1.0 : pAfter->bucket_bounds_s[i] * 1e6;
+
+	return -1.0;
+}
+
+int main( int argc, char* argv[] )
+{
+	static char response[LOADGEN_METRICS_SIZE];
+	char default_mix[] = "STATUS:5,TEMPS:4,SETTEMP:1";
+	char* p_mix = default_mix;
+	const char* p_host = "127.0.0.1";
+	const char* p_fields = "ALL";
+	struct epoll_event events[64];
+	struct epoll_event event;
+	loadgen_metrics_type before;
+	loadgen_metrics_type after;
+	loadgen_command_type* pCommand;
+	loadgen_conn_type* pConn;
+	double rate = 5.0;
+	double seconds = 10.0;
+	double budget_us = 1000.0;
+	double jitter_p99_us;
+	double elapsed_s;
+	int64_t period_ns;
+	int64_t start_ns;
+	int64_t end_ns;
+	int64_t now_ns;
+	int64_t next_ns;
+	uint64_t sent = 0;
+	uint64_t errors = 0;
+	uint64_t ticks;
+	int nbr_subscribers = 0;
+	int push_period_ms = 1000;
+	int nbr_subscribed = 0;
+	bool reset_trace = false;
+	bool pass = true;
+	int control_fd;
+	int epoll_fd;
+	int nbr_events;
+	int timeout_ms;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "h:c:r:t:m:s:P:F:B:T")) != -1)
+	{
+		switch (opt)
+		{
+			case 'h': p_host = optarg;					break;
+			case 'c': g_nbr_conns = atoi(optarg);		break;
+			case 'r': rate = atof(optarg);				break;
+			case 't': seconds = atof(optarg);			break;
+			case 'm': p_mix = optarg;					break;
+			case 's': nbr_subscribers = atoi(optarg);	break;
+			case 'P': push_period_ms = atoi(optarg);	break;
+			case 'F': p_fields = optarg;				break;
+			case 'B': budget_us = atof(optarg);			break;
+			case 'T': reset_trace = true;				break;
+			default:
+				fprintf(stderr, "usage: %s [-h host] [-c connections] [-r rate] [-t seconds] [-m mix] [-s subscribers]\n"
+								"\t[-P period ms] [-F fields] [-B budget us] [-T]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	if ((g_nbr_conns < 1) || (g_nbr_conns > LOADGEN_MAX_CONNECTIONS) || (rate <= 0.0) || (Loadgen_Parse_Mix( p_mix ) < 0))
+	{
+		fprintf(stderr, "bad connections, rate or mix\n");
+		return 2;
+	}
+
+	signal(SIGINT, Loadgen_Signal_Handler);
+	signal(SIGTERM, Loadgen_Signal_Handler);
+	signal(SIGPIPE, SIG_IGN);
+	srand(time(NULL));
+
+	// The control connection: setpoint, trace and metrics, kept out of the measurements
+	control_fd = Loadgen_Connect( p_host );
+	if (control_fd < 0)
+	{
+		perror(p_host);
+		return 1;
+	}
+
+	if ((Loadgen_Query( control_fd, "SETPOINT?\n", NULL, response, sizeof(response) ) < 0) ||
+		!Loadgen_Starts_With( response, "SETPOINT," ))
+	{
+		fprintf(stderr, "no answer to SETPOINT?\n");
+		return 1;
+	}
+	snprintf(g_setpoint, sizeof(g_setpoint), "%.*s", (int)strcspn(&response[9], ",\r\n"), &response[9]);
+
+	if (reset_trace)
+		Loadgen_Query( control_fd, "TRACE=RESET\n", "TRACE,END", response, sizeof(response) );
+	Loadgen_Read_Metrics( control_fd, &before );
+
+	epoll_fd = epoll_create1(0);
+	period_ns = (int64_t)(1e9 / rate);
+	start_ns = Loadgen_Now_Ns();
+
+	for (i = 0; i < g_nbr_conns; i++)
+	{
+		pConn = &g_conns[i];
+		pConn->fd = Loadgen_Connect( p_host );
+		pConn->outstanding = -1;
+		if (pConn->fd < 0)
+		{
+			g_disconnects++;
+			continue;
+		}
+
+		fcntl(pConn->fd, F_SETFL, fcntl(pConn->fd, F_GETFL) | O_NONBLOCK);
+		event.events = EPOLLIN;
+		event.data.ptr = pConn;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pConn->fd, &event);
+
+		if (i < nbr_subscribers)
+		{
+			pConn->subscriber = true;
+			snprintf(response, sizeof(response), "SUBSCRIBE=%s,%d\n", p_fields, push_period_ms);
+			send(pConn->fd, response, strlen(response), MSG_NOSIGNAL);
+		}
+	}
+
+	// Connecting may take seconds when the listen backlog overflows, the schedule starts afterwards
+	now_ns = Loadgen_Now_Ns();
+	printf("connected in %.0f ms\n", (now_ns - start_ns) / 1e6);
+	start_ns = now_ns;
+	end_ns = start_ns + (int64_t)(seconds * 1e9);
+	for (i = 0; i < g_nbr_conns; i++)
+		g_conns[i].due_ns = start_ns + (int64_t)((double)period_ns * rand() / RAND_MAX);	// Spread over one period
+
+	while (!g_stop && ((now_ns = Loadgen_Now_Ns()) < end_ns))
+	{
+		next_ns = end_ns;
+		for (i = 0; i < g_nbr_conns; i++)
+		{
+			pConn = &g_conns[i];
+			if (pConn->fd < 0)
+				continue;
+
+			if ((pConn->outstanding < 0) && (now_ns >= pConn->due_ns))
+				Loadgen_Send( pConn, period_ns );
+			if ((pConn->fd >= 0) && (pConn->outstanding < 0) && (pConn->due_ns < next_ns))
+				next_ns = pConn->due_ns;
+		}
+
+		timeout_ms = (next_ns > now_ns) ? (int)((next_ns - now_ns + 999999) / 1000000) : 0;
+		nbr_events = epoll_wait(epoll_fd, events, sizeof(events) / sizeof(events[0]), timeout_ms);
+
+		now_ns = Loadgen_Now_Ns();
+		for (i = 0; i < nbr_events; i++)
+		{
+			pConn = events[i].data.ptr;
+			if (pConn->fd >= 0)
+				Loadgen_Receive( pConn, now_ns, period_ns );
+		}
+	}
+	elapsed_s = (Loadgen_Now_Ns() - start_ns) / 1e9;
+
+	Loadgen_Read_Metrics( control_fd, &after );
+
+	// Report
+	printf("%d connections, %.1f commands/s each, %.1f s, %d subscribed\n\n", g_nbr_conns, rate, elapsed_s, nbr_subscribers);
+	printf("%-10s %10s %8s %9s %9s %9s %9s %9s\n", "command", "sent", "errors", "p50 ms", "p90 ms", "p99 ms",
+		   "p99.9 ms", "max ms");
+	for (i = 0; i < g_nbr_commands; i++)
+	{
+		pCommand = &g_commands[i];
+		qsort(pCommand->p_latencies_ns, pCommand->nbr_latencies, sizeof(int64_t), Loadgen_Compare);
+		printf("%-10s %10llu %8llu %9.3f %9.3f %9.3f %9.3f %9.3f\n", pCommand->name, (unsigned long long)pCommand->sent,
+			   (unsigned long long)pCommand->errors, Loadgen_Percentile_Ms( pCommand, 50.0 ),
+			   Loadgen_Percentile_Ms( pCommand, 90.0 ), Loadgen_Percentile_Ms( pCommand, 99.0 ),
+			   Loadgen_Percentile_Ms( pCommand, 99.9 ), Loadgen_Percentile_Ms( pCommand, 100.0 ));
+		sent += pCommand->sent;
+		errors += pCommand->errors;
+	}
+
+	for (i = 0; i < g_nbr_conns; i++)
+		nbr_subscribed += g_conns[i].subscribed ? 1 : 0;
+
+	printf("\ntotal %.0f commands/s, errors %.3f%%, disconnects %llu\n", sent / elapsed_s,
+		   (sent > 0) ? 100.0 * errors / sent : 0.0, (unsigned long long)g_disconnects);
+	if (nbr_subscribers > 0)
+		printf("pushed %.1f frames/s to %d subscribers\n", g_pushes / elapsed_s, nbr_subscribed);
+
+	if ((before.cpu_s >= 0.0) && (after.cpu_s >= 0.0))
+		printf("server cpu %.1f%%\n", 100.0 * (after.cpu_s - before.cpu_s) / elapsed_s);
+	else
+		printf("server cpu unknown, METRICS? has no process_cpu_seconds_total\n");
+
+	jitter_p99_us = Loadgen_Jitter_P99_Us( &before, &after, &ticks );
+	if (ticks == 0)
+		printf("control loop jitter unknown, METRICS? has no %s\n", LOADGEN_JITTER_METRIC);
+	else
+	{
+		pass = (after.overruns == before.overruns) && (jitter_p99_us >= 0.0) && (jitter_p99_us <= budget_us);
+		printf("control loop: %llu ticks, %llu missed, p99 wake up lateness ", (unsigned long long)ticks,
+			   (unsigned long long)(after.overruns - before.overruns));
+		if (jitter_p99_us < 0.0)
+			printf("beyond the last bucket");
+		else
+			printf("<= %.0f us", jitter_p99_us);
+		printf(", budget %.0f us: %s\n", budget_us, pass ? "PASS" : "FAIL");
+	}
+
+	if (reset_trace && (Loadgen_Query( control_fd, "TRACE?\n", "TRACE,END", response, sizeof(response) ) > 0))
+		printf("\n%s", response);
+
+	close(control_fd);
+	return pass ? 0 : 1;
+}
+
+/* *** End of File *** */
@@ -0,0 +1,145 @@
+/***************************************************************************************************
+Multicast Listener
+
+Joins the status multicast group of the Smokin'Pi (see multicast.c) and prints every datagram,
+reporting sequence gaps as lost datagrams.  Run it on any host of the LAN, or on the Pi itself
+to check the publisher over loopback:
+
+	tools/mcast_listen [-n count] [-q]
+
+-n stops after count datagrams, -q only prints the summary.  Start the publisher with
+MULTICAST=<period ms> on any command front-end.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "bin_proto.h"
+#include "multicast.h"
+
+/* *** Global Variables *** */
+static volatile sig_atomic_t g_stop = 0;
+
+static void Mcast_Listen_Signal_Handler( int signal )
+{
+	g_stop = 1;
+}
+
+/***************************************************************************************************
+Prints the time, sequence and temperatures of a datagram
+***************************************************************************************************/
+static void Mcast_Listen_Print( const uint8_t* p_payload, uint32_t sequence )
+{
+	const uint8_t* p_fields = &p_payload[16];
+	int field;
+
+	printf("%u %lld", sequence, (long long)((uint64_t)Bin_Proto_Get_U32( &p_payload[4] ) |
+										   ((uint64_t)Bin_Proto_Get_U32( &p_payload[8] ) << 32)));
+
+	for (field = 0; field < NBR_SUBSCRIPTION_FIELDS; field++, p_fields += 2)
+	{
+		if (field < SUBSCRIPTION_FIELD_ADC_0)
+			printf(" %.1f", (int16_t)Bin_Proto_Get_U16( p_fields ) / (float)BIN_PROTO_TEMP_SCALE);
+		else
+			printf(" %u", Bin_Proto_Get_U16( p_fields ));
+	}
+	printf("\n");
+}
+
+int main( int argc, char* argv[] )
+{
+	struct sockaddr_in addr;
+	struct ip_mreq membership;
+	uint8_t datagram[1500];
+	uint32_t sequence;
+	uint32_t expected = 0;
+	uint64_t received = 0;
+	uint64_t lost = 0;
+	uint64_t late = 0;
+	uint64_t bad = 0;
+	long count = 0;
+	bool quiet = false;
+	int option = 1;
+	int length;
+	int fd;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:q")) != -1)
+	{
+		if (opt == 'n')
+			count = atol(optarg);
+		else if (opt == 'q')
+			quiet = true;
+		else
+		{
+			fprintf(stderr, "usage: %s [-n count] [-q]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(MULTICAST_PORT);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		perror("bind");
+		return 1;
+	}
+
+	inet_pton(AF_INET, MULTICAST_GROUP, &membership.imr_multiaddr);
+	membership.imr_interface.s_addr = htonl(INADDR_ANY);
+	if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0)
+	{
+		perror("IP_ADD_MEMBERSHIP");
+		return 1;
+	}
+
+	signal(SIGINT, Mcast_Listen_Signal_Handler);
+	signal(SIGTERM, Mcast_Listen_Signal_Handler);
+
+	while (!g_stop && ((count == 0) || (received < (uint64_t)count)))
+	{
+		length = recv(fd, datagram, sizeof(datagram), 0);
+		if (length < 0)
+			continue;
+
+		if ((Bin_Proto_Check_Frame( datagram, length, sizeof(datagram) ) != length) ||
+			(Bin_Proto_Get_U16( &datagram[4] ) != CMD_MULTICAST_FRAME) ||
+			(length != BIN_PROTO_MULTICAST_FRAME_SIZE))
+		{
+			bad++;
+			continue;
+		}
+
+		sequence = Bin_Proto_Get_U32( &datagram[BIN_PROTO_HEADER_SIZE] );
+		if ((received > 0) && ((int32_t)(sequence - expected) < 0))
+			late++;								// Duplicated or reordered
+		else
+		{
+			if (received > 0)
+				lost += sequence - expected;
+			expected = sequence + 1;
+		}
+		received++;
+
+		if (!quiet)
+			Mcast_Listen_Print( &datagram[BIN_PROTO_HEADER_SIZE], sequence );
+	}
+
+	printf("received %llu lost %llu late %llu bad %llu\n", (unsigned long long)received,
+		   (unsigned long long)lost, (unsigned long long)late, (unsigned long long)bad);
+	return 0;
+}
+
+/* *** End of File *** */
@@ -0,0 +1,449 @@
+/***************************************************************************************************
+Pigpio Emulator
+
+The command and reply core of the emulated pigpio daemon, shared by tools/fake_pigpiod and the
+stand-in daemon of the benchmarks (bench/pigpio_standin.c).  It runs the part of pigpio the
+Smokin'Pi uses:
+
+	s <gpio> <width>				PI_CMD_SERVO	servo pulse width, 0 or 500 to 2500 us
+	spio <channel> <baud> <flags>	PI_CMD_SPIO		opens an SPI handle
+	spix <handle> <byte>...			PI_CMD_SPIX		transfers bytes with the TLC1543
+	spic <handle>					PI_CMD_SPIC		closes an SPI handle
+
+The TLC1543 behind the SPI handles is pipelined like the real one: every transfer latches the
+channel address in the top nibble of the first byte and returns the conversion of the channel
+addressed by the previous transfer, left adjusted in the first 10 bits.  Channels 0 to 10 follow a
+slow simulated temperature swing, or a script of values, channels 11 to 13 are the self tests.
+
+Faults are injected as configured: reply latency with jitter, replies that never come and negative
+error codes in place of results.  The caller owns the pipes and sockets, this file only turns
+commands into replies and is not thread safe.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "tlc1543.h"			// For NBR_ADC_CHANNELS
+#include "tools/pigpio_emulator.h"
+
+/* *** Defined Values *** */
+#define EMULATOR_MAX_SPI_HANDLES		32			// PI_SPI_SLOTS of pigpio
+#define EMULATOR_MAX_SCRIPT_STEPS		4096
+
+// Simulated ADC: a swing of +/- EMULATOR_SIM_AMPLITUDE around mid scale over EMULATOR_SIM_PERIOD_S
+#define EMULATOR_SIM_AMPLITUDE			300.0
+#define EMULATOR_SIM_PERIOD_S			600.0
+#define EMULATOR_ADC_MAX				1023
+
+// Error codes of pigpio
+#define PI_BAD_USER_GPIO				-2
+#define PI_BAD_PULSEWIDTH				-7
+#define PI_BAD_HANDLE					-25
+#define PI_NO_HANDLE					-24
+#define PI_SPI_OPEN_FAILED				-73
+#define PI_BAD_SPI_CHANNEL				-76
+#define PI_BAD_SPI_COUNT				-84
+#define PI_SPI_XFER_FAILED				-89
+#define EMULATOR_UNKNOWN_COMMAND		-1
+
+/* *** Data Types *** */
+typedef struct
+{
+	double time_s;
+	int values[NBR_ADC_CHANNELS];
+} emulator_script_step_type;
+
+typedef struct
+{
+	uint64_t commands;
+	uint64_t replies;
+	uint64_t dropped;
+	uint64_t errors;							// Injected, not the errors of bad commands
+	uint64_t restarts;
+	uint64_t adc_transfers;
+	uint64_t servo_writes;
+} emulator_counters_type;
+
+/* *** Global Variables *** */
+static pigpio_emulator_config_type g_config;
+
+static bool g_spi_open[EMULATOR_MAX_SPI_HANDLES];
+static int g_adc_address = 0;					// Channel of the conversion the next transfer returns
+static int g_servo_width = 0;
+
+static emulator_script_step_type g_script[EMULATOR_MAX_SCRIPT_STEPS];
+static int g_script_steps = 0;
+static double g_start_s;
+
+static emulator_counters_type g_counters;
+
+static double Pigpio_Emulator_Now_S( void )
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static bool Pigpio_Emulator_Chance( double percent )
+{
+	return (percent > 0.0) && ((rand() / (RAND_MAX + 1.0)) * 100.0 < percent);
+}
+
+/***************************************************************************************************
+Takes the fault settings and starts the clock of the simulated temperatures.  A script loaded before
+is kept.
+***************************************************************************************************/
+void Pigpio_Emulator_Init( const pigpio_emulator_config_type* pConfig )
+{
+	g_config = *pConfig;
+	g_start_s = Pigpio_Emulator_Now_S();
+}
+
+/***************************************************************************************************
+Reads the ADC script.  A script holds one line per step, "<seconds> <channel 0> ... <channel 10>",
+the ADC values from that many seconds after start up until the next step.  Missing channels keep
+their value, lines starting with # are comments, and the script starts over after its last step.
+
+Returns -1 on error
+		 1 on success
+***************************************************************************************************/
+int Pigpio_Emulator_Load_Script( const char* p_path )
+{
+	FILE* p_file = fopen(p_path, "r");
+	char line[PIGPIO_EMULATOR_MAX_LINE];
+	emulator_script_step_type* pStep;
+	char* p_next;
+	char* p_end;
+	int channel;
+	long value;
+
+	if (p_file == NULL)
+	{
+		perror(p_path);
+		return -1;
+	}
+
+	while ((fgets(line, sizeof(line), p_file) != NULL) && (g_script_steps < EMULATOR_MAX_SCRIPT_STEPS))
+	{
+		pStep = &g_script[g_script_steps];
+		pStep->time_s = strtod(line, &p_end);
+		if ((line[0] == '#') || (p_end == line))
+			continue;
+
+		// Start from the values of the previous step
+		if (g_script_steps > 0)
+			memcpy(pStep->values, g_script[g_script_steps - 1].values, sizeof(pStep->values));
+		else
+			for (channel = 0; channel < NBR_ADC_CHANNELS; channel++)
+				pStep->values[channel] = (EMULATOR_ADC_MAX + 1) / 2;
+
+		for (channel = 0; channel < NBR_ADC_CHANNELS; channel++)
+		{
+			p_next = p_end;
+			value = strtol(p_next, &p_end, 0);
+			if (p_end == p_next)
+				break;
+			pStep->values[channel] = value;
+		}
+		g_script_steps++;
+	}
+
+	fclose(p_file);
+
+	if (g_script_steps == 0)
+	{
+		fprintf(stderr, "%s: no steps\n", p_path);
+		return -1;
+	}
+	return 1;
+}
+
+/***************************************************************************************************
+Returns the conversion result of a TLC1543 channel at this moment
+***************************************************************************************************/
+static int Pigpio_Emulator_Adc_Value( int channel )
+{
+	double elapsed_s = Pigpio_Emulator_Now_S() - g_start_s;
+	double cycle_s;
+	int value;
+	int step;
+
+	// Self tests: (Vref+ - Vref-) / 2, Vref- and Vref+
+	if (channel == 11)
+		return (EMULATOR_ADC_MAX + 1) / 2;
+	if (channel == 12)
+		return 0;
+	if (channel == 13)
+		return EMULATOR_ADC_MAX;
+	if (channel >= NBR_ADC_CHANNELS)
+		return 0;
+
+	if (g_script_steps > 0)
+	{
+		cycle_s = g_script[g_script_steps - 1].time_s;
+		if (cycle_s > 0.0)
+			elapsed_s = fmod(elapsed_s, cycle_s + 1.0);
+
+		for (step = 0; (step + 1 < g_script_steps) && (g_script[step + 1].time_s <= elapsed_s); step++)
+			;
+		value = g_script[step].values[channel];
+	}
+	else
+		value = (EMULATOR_ADC_MAX + 1) / 2 + EMULATOR_SIM_AMPLITUDE * sin(2.0 * M_PI * elapsed_s / EMULATOR_SIM_PERIOD_S + channel * 0.5);
+
+	if (g_config.noise > 0)
+		value += (rand() % (2 * g_config.noise + 1)) - g_config.noise;
+
+	if (value < 0)
+		value = 0;
+	else if (value > EMULATOR_ADC_MAX)
+		value = EMULATOR_ADC_MAX;
+
+	return value;
+}
+
+/* *** Commands *** */
+
+static int Pigpio_Emulator_Servo( uint32_t gpio, uint32_t width )
+{
+	if (gpio > 31)
+		return PI_BAD_USER_GPIO;
+	if ((width != 0) && ((width < 500) || (width > 2500)))
+		return PI_BAD_PULSEWIDTH;
+
+	g_servo_width = width;
+	g_counters.servo_writes++;
+	return 0;
+}
+
+static int Pigpio_Emulator_Spi_Open( uint32_t channel, uint32_t baud, uint32_t flags )
+{
+	int handle;
+
+	if (channel > 2)
+		return PI_BAD_SPI_CHANNEL;
+
+	for (handle = 0; handle < EMULATOR_MAX_SPI_HANDLES; handle++)
+	{
+		if (!g_spi_open[handle])
+		{
+			g_spi_open[handle] = true;
+			return handle;
+		}
+	}
+	return PI_NO_HANDLE;
+}
+
+static int Pigpio_Emulator_Spi_Close( uint32_t handle )
+{
+	if ((handle >= EMULATOR_MAX_SPI_HANDLES) || !g_spi_open[handle])
+		return PI_BAD_HANDLE;
+
+	g_spi_open[handle] = false;
+	return 0;
+}
+
+/***************************************************************************************************
+Shifts count bytes through the TLC1543, in place
+
+Returns the number of bytes read, or a negative pigpio error code
+***************************************************************************************************/
+static int Pigpio_Emulator_Spi_Xfer( uint32_t handle, uint8_t* pData, int count )
+{
+	int value;
+	int i;
+
+	if ((handle >= EMULATOR_MAX_SPI_HANDLES) || !g_spi_open[handle])
+		return PI_BAD_HANDLE;
+	if ((count <= 0) || (count > PIGPIO_EMULATOR_MAX_XFER))
+		return PI_BAD_SPI_COUNT;
+
+	value = Pigpio_Emulator_Adc_Value( g_adc_address );
+	g_adc_address = pData[0] >> 4;
+
+	for (i = 0; i < count; i++)
+		pData[i] = (i == 0) ? (value >> 2) : (i == 1) ? ((value & 0x03) << 6) : 0;
+
+	g_counters.adc_transfers++;
+	return count;
+}
+
+/***************************************************************************************************
+Runs one command, with the injected faults.  An injected error stands for a command that failed, so
+the command does not run: a failed spic leaves its handle open, as it would on pigpiod.  A dropped
+reply is decided after the command ran, as a reply lost on its way back would be.  spix shifts the
+count bytes of pData in place.
+
+Returns true if the reply is to be sent, in *p_result
+***************************************************************************************************/
+bool Pigpio_Emulator_Execute( uint32_t cmd, uint32_t p1, uint32_t p2, uint32_t p3, uint8_t* pData, int count,
+							  int* p_result )
+{
+	static const int fault_codes[] = { [PI_CMD_SERVO] = PI_BAD_PULSEWIDTH, [PI_CMD_SPIO] = PI_SPI_OPEN_FAILED,
+									   [PI_CMD_SPIC] = PI_BAD_HANDLE, [PI_CMD_SPIX] = PI_SPI_XFER_FAILED };
+	int delay_us = g_config.latency_us + ((g_config.jitter_us > 0) ? rand() % (g_config.jitter_us + 1) : 0);
+
+	g_counters.commands++;
+
+	if (Pigpio_Emulator_Chance( g_config.error_percent ) && (cmd < sizeof(fault_codes) / sizeof(fault_codes[0])) &&
+		(fault_codes[cmd] != 0))
+	{
+		g_counters.errors++;
+		*p_result = fault_codes[cmd];
+	}
+	else if (cmd == PI_CMD_SERVO)
+		*p_result = Pigpio_Emulator_Servo( p1, p2 );
+	else if (cmd == PI_CMD_SPIO)
+		*p_result = Pigpio_Emulator_Spi_Open( p1, p2, p3 );
+	else if (cmd == PI_CMD_SPIC)
+		*p_result = Pigpio_Emulator_Spi_Close( p1 );
+	else if (cmd == PI_CMD_SPIX)
+		*p_result = Pigpio_Emulator_Spi_Xfer( p1, pData, count );
+	else
+		*p_result = EMULATOR_UNKNOWN_COMMAND;
+
+	if (Pigpio_Emulator_Chance( g_config.drop_percent ))
+	{
+		g_counters.dropped++;
+		if (g_config.verbose)
+			printf("cmd %u result %d dropped\n", cmd, *p_result);
+		return false;
+	}
+
+	if (delay_us > 0)
+		usleep(delay_us);
+
+	if (g_config.verbose)
+		printf("cmd %u %u %u result %d\n", cmd, p1, p2, *p_result);
+
+	g_counters.replies++;
+	return true;
+}
+
+/* *** Pipe interface *** */
+
+/***************************************************************************************************
+Runs one line of the command pipe and builds its reply: the result code, followed for spix by the
+bytes read
+
+Returns the length of the reply, 0 when there is none
+***************************************************************************************************/
+static int Pigpio_Emulator_Pipe_Command( char* p_line, char* p_reply, int size )
+{
+	uint8_t data[PIGPIO_EMULATOR_MAX_XFER];
+	uint32_t params[3] = { 0 };
+	uint32_t cmd;
+	char* p_save = NULL;
+	char* p_word = strtok_r(p_line, " \t\r", &p_save);
+	int nbr_params = 0;
+	int count = 0;
+	int length;
+	int result;
+	int i;
+
+	if (p_word == NULL)
+		return 0;
+
+	if (strcmp(p_word, "s") == 0)
+		cmd = PI_CMD_SERVO;
+	else if (strcmp(p_word, "spio") == 0)
+		cmd = PI_CMD_SPIO;
+	else if (strcmp(p_word, "spic") == 0)
+		cmd = PI_CMD_SPIC;
+	else if (strcmp(p_word, "spix") == 0)
+		cmd = PI_CMD_SPIX;
+	else
+		cmd = 0;
+
+	// spix takes the handle, then the bytes to send
+	while ((p_word = strtok_r(NULL, " \t\r", &p_save)) != NULL)
+	{
+		if ((cmd == PI_CMD_SPIX) && (nbr_params == 1))
+		{
+			if (count < PIGPIO_EMULATOR_MAX_XFER)
+				data[count++] = strtoul(p_word, NULL, 0);
+		}
+		else if (nbr_params < 3)
+			params[nbr_params++] = strtoul(p_word, NULL, 0);
+	}
+
+	if (!Pigpio_Emulator_Execute( cmd, params[0], params[1], params[2], data, count, &result ))
+		return 0;
+
+	length = snprintf(p_reply, size, "%d", result);
+	if (cmd == PI_CMD_SPIX)
+		for (i = 0; i < result; i++)
+			length += snprintf(&p_reply[length], size - length, " %u", data[i]);
+	p_reply[length++] = '\n';
+
+	return length;
+}
+
+/***************************************************************************************************
+Reads what is available on the command pipe, then runs every complete line and writes its reply to
+the response pipe.  Works on blocking and non-blocking pipes alike.
+
+Returns the result of read(), or -1 if a reply could not be written
+***************************************************************************************************/
+int Pigpio_Emulator_Pipe_Read( int command_fd, int response_fd, pigpio_emulator_line_type* pLine )
+{
+	char reply[PIGPIO_EMULATOR_MAX_XFER * 4 + 16];
+	char* p_end;
+	int bytes_read = read(command_fd, &pLine->text[pLine->length], sizeof(pLine->text) - 1 - pLine->length);
+	int line_length;
+	int length;
+
+	if (bytes_read <= 0)
+		return bytes_read;
+
+	pLine->length += bytes_read;
+	pLine->text[pLine->length] = '\0';
+
+	while ((p_end = strchr(pLine->text, '\n')) != NULL)
+	{
+		*p_end = '\0';
+		line_length = p_end - pLine->text + 1;
+
+		length = Pigpio_Emulator_Pipe_Command( pLine->text, reply, sizeof(reply) );
+		if ((length > 0) && (write(response_fd, reply, length) < 0))
+		{
+			perror("write response pipe");
+			return -1;
+		}
+
+		memmove(pLine->text, &pLine->text[line_length], pLine->length - line_length + 1);
+		pLine->length -= line_length;
+	}
+
+	if (pLine->length >= (int)sizeof(pLine->text) - 1)
+		pLine->length = 0;						// Overlong line, drop it
+
+	return bytes_read;
+}
+
+/***************************************************************************************************
+The daemon went away and came back: every SPI handle is lost
+***************************************************************************************************/
+void Pigpio_Emulator_Restart( void )
+{
+	memset(g_spi_open, 0, sizeof(g_spi_open));
+	g_counters.restarts++;
+}
+
+void Pigpio_Emulator_Print_Counters( void )
+{
+	printf("commands %llu replies %llu dropped %llu errors %llu restarts %llu adc %llu servo %llu width %d\n",
+		   (unsigned long long)g_counters.commands, (unsigned long long)g_counters.replies,
+		   (unsigned long long)g_counters.dropped, (unsigned long long)g_counters.errors,
+		   (unsigned long long)g_counters.restarts, (unsigned long long)g_counters.adc_transfers,
+		   (unsigned long long)g_counters.servo_writes, g_servo_width);
+	fflush(stdout);
+}
+
+/* *** End of File *** */
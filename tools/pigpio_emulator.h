@@ -0,0 +1,43 @@
+#ifndef __PIGPIO_EMULATOR_H
+#define __PIGPIO_EMULATOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PIGPIO_EMULATOR_MAX_LINE		1024
+#define PIGPIO_EMULATOR_MAX_XFER		256			// Bytes of one SPI transfer
+
+// Socket command numbers of pigpio, also used for the commands of the pipe interface
+#define PI_CMD_SERVO					8
+#define PI_CMD_SPIO						71
+#define PI_CMD_SPIC						72
+#define PI_CMD_SPIX						75
+
+typedef struct
+{
+	int latency_us;								// Added to every reply
+	int jitter_us;								// Random extra latency, up to this
+	double drop_percent;						// Replies that never come
+	double error_percent;						// Commands failing with a pigpio error code
+	int noise;									// Random +/- counts added to every conversion
+	bool verbose;								// Prints every command
+} pigpio_emulator_config_type;
+
+// Command pipe input not yet ended by a new line
+typedef struct
+{
+	char text[PIGPIO_EMULATOR_MAX_LINE];
+	int length;
+} pigpio_emulator_line_type;
+
+void Pigpio_Emulator_Init( const pigpio_emulator_config_type* pConfig );
+int Pigpio_Emulator_Load_Script( const char* p_path );
+
+bool Pigpio_Emulator_Execute( uint32_t cmd, uint32_t p1, uint32_t p2, uint32_t p3, uint8_t* pData, int count,
+							  int* p_result );
+int Pigpio_Emulator_Pipe_Read( int command_fd, int response_fd, pigpio_emulator_line_type* pLine );
+
+void Pigpio_Emulator_Restart( void );
+void Pigpio_Emulator_Print_Counters( void );
+
+#endif //__PIGPIO_EMULATOR_H
@@ -0,0 +1,196 @@
+/***************************************************************************************************
+Shared Memory Watcher
+
+Attaches to the shared memory telemetry segment of the Smokin'Pi (see shm_telemetry.h) and prints
+the latest control tick every time the daemon publishes, with the number of ADC sweeps read from
+the ring and those overwritten before they could be read.  Run it on the Pi, next to the daemon:
+
+	tools/shm_watch [-n count] [-q] [-u socket]
+
+-n stops after count publications, -q only prints the summary.  With -u the segment is not opened
+by name but passed over the local control socket of the daemon (SHMFD), e.g. -u /tmp/smpi.sock.
+The watcher is also the smallest example of a client of the segment.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "shm_telemetry.h"
+
+/* *** Global Variables *** */
+static volatile sig_atomic_t g_stop = 0;
+
+static void Shm_Watch_Signal_Handler( int signal )
+{
+	g_stop = 1;
+}
+
+/***************************************************************************************************
+Asks the daemon for a descriptor of the segment on its local socket
+
+Returns the descriptor, -1 on error
+***************************************************************************************************/
+static int Shm_Watch_Receive_Fd( const char* p_path )
+{
+	union
+	{
+		struct cmsghdr header;
+		char buffer[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct sockaddr_un address;
+	struct cmsghdr* pHeader;
+	struct msghdr message;
+	struct iovec iov;
+	char response[64];
+	int received = 0;
+	int segment_fd = -1;
+	int fd;
+	int n;
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, p_path, sizeof(address.sun_path) - 1);
+	if (address.sun_path[0] == '@')
+		address.sun_path[0] = '\0';
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if ((fd < 0) || (connect(fd, (struct sockaddr*)&address, offsetof(struct sockaddr_un, sun_path) + strlen(p_path)) < 0) ||
+		(write(fd, "SHMFD\n", 6) != 6))
+	{
+		perror(p_path);
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	// The descriptor comes with the response, which ends with a new line
+	while ((received < (int)sizeof(response) - 1) && ((received == 0) || (response[received - 1] != '\n')))
+	{
+		iov.iov_base = &response[received];
+		iov.iov_len = sizeof(response) - 1 - received;
+		memset(&message, 0, sizeof(message));
+		message.msg_iov = &iov;
+		message.msg_iovlen = 1;
+		message.msg_control = control.buffer;
+		message.msg_controllen = sizeof(control.buffer);
+
+		n = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+		if (n <= 0)
+			break;
+		received += n;
+
+		for (pHeader = CMSG_FIRSTHDR(&message); pHeader != NULL; pHeader = CMSG_NXTHDR(&message, pHeader))
+		{
+			if ((pHeader->cmsg_level == SOL_SOCKET) && (pHeader->cmsg_type == SCM_RIGHTS))
+				memcpy(&segment_fd, CMSG_DATA(pHeader), sizeof(int));
+		}
+	}
+	response[received] = '\0';
+	close(fd);
+
+	if ((segment_fd >= 0) && (strncmp(response, "SHMFD,", 6) != 0))
+	{
+		close(segment_fd);
+		segment_fd = -1;
+	}
+	if (segment_fd < 0)
+		fprintf(stderr, "no descriptor from %s: %s", p_path, response);
+	return segment_fd;
+}
+
+int main( int argc, char* argv[] )
+{
+	const shm_telemetry_segment_type* pSegment;
+	telemetry_record_type record;
+	uint32_t generation = 0;
+	uint64_t next_sweep;
+	uint64_t written;
+	uint64_t sweeps = 0;
+	uint64_t lost = 0;
+	const char* p_socket = NULL;
+	long publications = 0;
+	long count = 0;
+	bool quiet = false;
+	int segment_fd;
+	int result;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "n:qu:")) != -1)
+	{
+		if (opt == 'n')
+			count = atol(optarg);
+		else if (opt == 'q')
+			quiet = true;
+		else if (opt == 'u')
+			p_socket = optarg;
+		else
+		{
+			fprintf(stderr, "usage: %s [-n count] [-q] [-u socket]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (p_socket == NULL)
+		pSegment = Shm_Telemetry_Attach();
+	else
+	{
+		segment_fd = Shm_Watch_Receive_Fd( p_socket );
+		if (segment_fd < 0)
+			return 1;
+		pSegment = Shm_Telemetry_Attach_Fd( segment_fd );
+		close(segment_fd);
+	}
+	if (pSegment == NULL)
+	{
+		fprintf(stderr, "no telemetry segment %s, is the daemon running?\n", SHM_TELEMETRY_NAME);
+		return 1;
+	}
+
+	signal(SIGINT, Shm_Watch_Signal_Handler);
+	signal(SIGTERM, Shm_Watch_Signal_Handler);
+
+	next_sweep = atomic_load( &pSegment->nbr_sweeps_written );
+
+	while (!g_stop && ((count == 0) || (publications < count)))
+	{
+		result = Shm_Telemetry_Wait( pSegment, generation, 1000 );
+		if (result < 0)
+			break;
+		if (result == 0)
+			continue;
+		generation = atomic_load( &pSegment->generation );
+		publications++;
+
+		// Every sweep since the last publication, skipping those already overwritten
+		written = atomic_load( &pSegment->nbr_sweeps_written );
+		for (; next_sweep < written; next_sweep++)
+		{
+			if (Shm_Telemetry_Read_Sweep( pSegment, next_sweep, &record ) > 0)
+				sweeps++;
+			else
+				lost++;
+		}
+
+		if (!quiet && Shm_Telemetry_Read_Tick( pSegment, &record ))
+		{
+			printf("%u %lld %.1f", record.sequence, (long long)(record.timestamp_ns / 1000000),
+				   record.temp_deg_f_cabinet_setpoint);
+			for (i = 0; i < NBR_OF_THERMISTORS; i++)
+				printf(" %.1f", record.temp_deg_f[i]);
+			printf(" %.1f %u\n", record.temp_deg_f_fire, record.servo_position);
+		}
+	}
+
+	printf("publications %ld sweeps %llu lost %llu\n", publications, (unsigned long long)sweeps, (unsigned long long)lost);
+	Shm_Telemetry_Detach( pSegment );
+	return 0;
+}
+
+/* *** End of File *** */
@@ -0,0 +1,392 @@
+/***************************************************************************************************
+Trace
+
+Times every stage of the path from the ADC to the servo for each control tick: the ADC sweep, the
+time its data waits in the shared data, the temperature conversion, the PID update and the servo
+command including the reply of pigpio.  Each stage has a log-linear histogram in the style of
+HdrHistogram: TRACE_SUB_BUCKET_BITS linear sub-buckets per power of 2 of nanoseconds, so every
+percentile is within ~6% whatever its magnitude.  The TRACE_NBR_SLOWEST ticks with the oldest data
+at the time they ended are kept with their full breakdown.  TRACE? reports both.
+
+Times are read from CLOCK_MONOTONIC.  When the kernel allows it (see perf_event_paranoid), the
+stages that run in the control thread also count CPU cycles with a perf_event counter, which tells
+a stage that computed for long from one that was preempted or waited.
+
+Only the control thread traces ticks.  The histograms are updated with relaxed atomic adds, so the
+ADC thread and the command handlers may touch them at any time.  The list of slowest ticks has its
+own mutex, which the control thread only takes for a tick slower than every tick in the list.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "trace.h"
+#include "telemetry.h"
+#include "cmd_registry.h"
+
+/* *** Defined Values *** */
+#define TRACE_SUB_BUCKET_MASK		((1 << TRACE_SUB_BUCKET_BITS) - 1)
+#define TRACE_MAX_VALUE				((1ULL << TRACE_MAX_VALUE_BITS) - 1)
+
+/* *** Data Types *** */
+typedef struct
+{
+	_Atomic uint32_t counts[TRACE_NBR_BUCKETS];
+	_Atomic int64_t max_ns;
+} trace_histogram_type;
+
+/* *** Global Variables *** */
+static const char* g_stage_names[NBR_TRACE_STAGES] = { "ADC", "WAIT", "THERMISTOR", "PID", "SERVO", "TOTAL" };
+static const int g_percentiles[] = { 500, 900, 990, 999 };			// Per mille
+#define TRACE_PERCENTILES_SIZE		(sizeof (g_percentiles)/sizeof(g_percentiles[0]))
+
+static trace_histogram_type g_histograms[NBR_TRACE_STAGES];
+static _Atomic uint32_t g_nbr_ticks = 0;
+
+static pthread_mutex_t g_slowest_mutex = PTHREAD_MUTEX_INITIALIZER;
+static trace_tick_type g_slowest[TRACE_NBR_SLOWEST];
+static int g_nbr_slowest = 0;
+static _Atomic int64_t g_slowest_floor_ns = 0;		// A tick must be slower than this to enter the list
+
+// Tick being traced, only used by the control thread
+static bool g_tick_active = false;
+static trace_tick_type g_tick;
+static int64_t g_tick_sweep_start_ns;
+static int64_t g_stage_start_ns[NBR_TRACE_STAGES];
+static uint64_t g_stage_start_cycles[NBR_TRACE_STAGES];
+
+static int g_cycles_fd = -1;						// perf_event counter of the control thread
+
+static int Trace_Command( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder );
+
+static const cmd_definition_type g_trace_cmds[] =
+{
+	{ "TRACE",	{ NULL },	"Returns the control tick latency per stage and the slowest ticks, RESET clears them",
+		CMD_FRONTEND_ALL, 0, 1, { { CMD_ARG_STRING, "RESET", 0, 8 } },		Trace_Command, CMD_ACCESS_WRITE_WITH_ARGS },
+};
+#define TRACE_CMDS_SIZE		(sizeof (g_trace_cmds)/sizeof(g_trace_cmds[0]))
+
+/***************************************************************************************************
+Opens the cycle counter of the calling thread, which must be the control thread, and adds the TRACE
+command.  The cycle counter is optional, tracing works without it.
+
+Returns -1 on error
+		 1 on success
+***************************************************************************************************/
+int Trace_Init( void )
+{
+#if TRACE_USE_CYCLE_COUNTER
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	g_cycles_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);	// This thread, any CPU
+#endif
+
+	return Cmd_Registry_Add( g_trace_cmds, TRACE_CMDS_SIZE );
+}
+
+static inline int64_t Trace_Get_Time_Ns( void ) { return Telemetry_Get_Time_Ns( CLOCK_MONOTONIC ); }
+
+static inline uint64_t Trace_Get_Cycles( void )
+{
+	uint64_t cycles = 0;
+
+	if ((g_cycles_fd < 0) || (read(g_cycles_fd, &cycles, sizeof(cycles)) != sizeof(cycles)))
+		return 0;
+	return cycles;
+}
+
+/***************************************************************************************************
+Returns the histogram bucket of a duration.  Values below 2^TRACE_SUB_BUCKET_BITS have a bucket
+each, above that each power of 2 is split into 2^TRACE_SUB_BUCKET_BITS equal buckets.
+***************************************************************************************************/
+static inline int Trace_Bucket( uint64_t value_ns )
+{
+	int shift;
+
+	if (value_ns > TRACE_MAX_VALUE)
+		value_ns = TRACE_MAX_VALUE;
+	if (value_ns <= TRACE_SUB_BUCKET_MASK)
+		return (int)value_ns;
+
+	shift = (63 - __builtin_clzll(value_ns)) - TRACE_SUB_BUCKET_BITS;
+	return ((shift + 1) << TRACE_SUB_BUCKET_BITS) + (int)((value_ns >> shift) & TRACE_SUB_BUCKET_MASK);
+}
+
+/***************************************************************************************************
+Returns the largest duration that falls in a bucket
+***************************************************************************************************/
+static uint64_t Trace_Bucket_Value( int bucket )
+{
+	int shift;
+
+	if (bucket <= TRACE_SUB_BUCKET_MASK)
+		return bucket;
+
+	shift = (bucket >> TRACE_SUB_BUCKET_BITS) - 1;
+	return ((uint64_t)((1 << TRACE_SUB_BUCKET_BITS) + (bucket & TRACE_SUB_BUCKET_MASK)) << shift) + ((1ULL << shift) - 1);
+}
+
+static void Trace_Record( trace_stage_type stage, int64_t value_ns )
+{
+	trace_histogram_type* pHistogram = &g_histograms[stage];
+	int64_t max_ns;
+
+	if (value_ns < 0)
+		value_ns = 0;
+
+	atomic_fetch_add_explicit( &pHistogram->counts[Trace_Bucket( value_ns )], 1, memory_order_relaxed );
+
+	max_ns = atomic_load_explicit( &pHistogram->max_ns, memory_order_relaxed );
+	while ((value_ns > max_ns) &&
+		   !atomic_compare_exchange_weak_explicit( &pHistogram->max_ns, &max_ns, value_ns, memory_order_relaxed, memory_order_relaxed ))
+		;
+}
+
+void Trace_Record_Sweep( int64_t start_ns, int64_t end_ns )
+{
+	Trace_Record( TRACE_STAGE_ADC_SWEEP, end_ns - start_ns );
+}
+
+/***************************************************************************************************
+Starts tracing a tick acting on the data of the sweep between sweep_start_ns and sweep_end_ns.
+Nothing is traced before the first sweep.
+***************************************************************************************************/
+void Trace_Begin_Tick( int64_t sweep_start_ns, int64_t sweep_end_ns )
+{
+	int64_t now_ns = Trace_Get_Time_Ns();
+	int i;
+
+	g_tick_active = (sweep_start_ns != 0);
+	if (!g_tick_active)
+		return;
+
+	for (i = 0; i < NBR_TRACE_STAGES; i++)
+	{
+		g_tick.stage_ns[i] = TRACE_NOT_RUN;
+		g_tick.stage_cycles[i] = 0;
+	}
+
+	g_tick_sweep_start_ns = sweep_start_ns;
+	g_tick.stage_ns[TRACE_STAGE_ADC_SWEEP] = sweep_end_ns - sweep_start_ns;
+	g_tick.stage_ns[TRACE_STAGE_DATA_WAIT] = now_ns - sweep_end_ns;
+	Trace_Record( TRACE_STAGE_DATA_WAIT, g_tick.stage_ns[TRACE_STAGE_DATA_WAIT] );
+}
+
+void Trace_Stage_Begin( trace_stage_type stage )
+{
+	if (!g_tick_active)
+		return;
+
+	g_stage_start_cycles[stage] = Trace_Get_Cycles();
+	g_stage_start_ns[stage] = Trace_Get_Time_Ns();
+}
+
+void Trace_Stage_End( trace_stage_type stage )
+{
+	int64_t now_ns;
+
+	if (!g_tick_active)
+		return;
+
+	now_ns = Trace_Get_Time_Ns();
+	g_tick.stage_cycles[stage] = Trace_Get_Cycles() - g_stage_start_cycles[stage];
+	g_tick.stage_ns[stage] = now_ns - g_stage_start_ns[stage];
+	Trace_Record( stage, g_tick.stage_ns[stage] );
+}
+
+/***************************************************************************************************
+Records the total of the tick and keeps it if it is one of the slowest
+***************************************************************************************************/
+void Trace_End_Tick( void )
+{
+	int64_t total_ns;
+	int slot;
+	int i;
+
+	if (!g_tick_active)
+		return;
+	g_tick_active = false;
+
+	total_ns = Trace_Get_Time_Ns() - g_tick_sweep_start_ns;
+	g_tick.stage_ns[TRACE_STAGE_TOTAL] = total_ns;
+	g_tick.tick = atomic_fetch_add( &g_nbr_ticks, 1 );
+	Trace_Record( TRACE_STAGE_TOTAL, total_ns );
+
+	if (total_ns <= atomic_load_explicit( &g_slowest_floor_ns, memory_order_relaxed ))
+		return;
+
+	g_tick.timestamp_ms = Telemetry_Get_Time_Ns( CLOCK_REALTIME ) / 1000000;
+
+	pthread_mutex_lock(&g_slowest_mutex);
+
+	// Take a free entry, else replace the fastest of the slowest
+	slot = g_nbr_slowest;
+	if (g_nbr_slowest < TRACE_NBR_SLOWEST)
+		g_nbr_slowest++;
+	else
+	{
+		slot = 0;
+		for (i = 1; i < TRACE_NBR_SLOWEST; i++)
+		{
+			if (g_slowest[i].stage_ns[TRACE_STAGE_TOTAL] < g_slowest[slot].stage_ns[TRACE_STAGE_TOTAL])
+				slot = i;
+		}
+	}
+	g_slowest[slot] = g_tick;
+
+	if (g_nbr_slowest == TRACE_NBR_SLOWEST)
+	{
+		total_ns = g_slowest[0].stage_ns[TRACE_STAGE_TOTAL];
+		for (i = 1; i < TRACE_NBR_SLOWEST; i++)
+		{
+			if (g_slowest[i].stage_ns[TRACE_STAGE_TOTAL] < total_ns)
+				total_ns = g_slowest[i].stage_ns[TRACE_STAGE_TOTAL];
+		}
+		atomic_store( &g_slowest_floor_ns, total_ns );
+	}
+
+	pthread_mutex_unlock(&g_slowest_mutex);
+}
+
+/***************************************************************************************************
+Clears the histograms and the slowest ticks
+***************************************************************************************************/
+static void Trace_Reset( void )
+{
+	int stage;
+	int i;
+
+	for (stage = 0; stage < NBR_TRACE_STAGES; stage++)
+	{
+		for (i = 0; i < TRACE_NBR_BUCKETS; i++)
+			atomic_store_explicit( &g_histograms[stage].counts[i], 0, memory_order_relaxed );
+		atomic_store( &g_histograms[stage].max_ns, 0 );
+	}
+
+	pthread_mutex_lock(&g_slowest_mutex);
+	g_nbr_slowest = 0;
+	atomic_store( &g_slowest_floor_ns, 0 );
+	pthread_mutex_unlock(&g_slowest_mutex);
+}
+
+static void Trace_Append_Us( str_builder_type* pBuilder, int64_t value_ns )
+{
+	Str_Builder_Append_Char( pBuilder, ',' );
+	if (value_ns == TRACE_NOT_RUN)
+		Str_Builder_Append( pBuilder, "-1" );
+	else
+		Str_Builder_Append_Fixed( pBuilder, value_ns / 1000.0, 1 );
+}
+
+/***************************************************************************************************
+Writes the count, percentiles and maximum of one stage
+***************************************************************************************************/
+static void Trace_Format_Stage( str_builder_type* pBuilder, trace_stage_type stage )
+{
+	trace_histogram_type* pHistogram = &g_histograms[stage];
+	uint32_t counts[TRACE_NBR_BUCKETS];
+	uint64_t total = 0;
+	uint64_t cumulative = 0;
+	uint64_t target;
+	int64_t max_ns = atomic_load( &pHistogram->max_ns );
+	int64_t value_ns;
+	int bucket = 0;
+	int i;
+
+	for (i = 0; i < TRACE_NBR_BUCKETS; i++)
+	{
+		counts[i] = atomic_load_explicit( &pHistogram->counts[i], memory_order_relaxed );
+		total += counts[i];
+	}
+
+	Str_Builder_Printf( pBuilder, "STAGE,%s,", g_stage_names[stage] );
+	Str_Builder_Append_Uint( pBuilder, total );
+
+	for (i = 0; i < TRACE_PERCENTILES_SIZE; i++)
+	{
+		target = ((total * g_percentiles[i]) + 999) / 1000;
+		while ((bucket < TRACE_NBR_BUCKETS) && ((cumulative + counts[bucket]) < target))
+			cumulative += counts[bucket++];
+
+		value_ns = (total == 0) ? 0 : (int64_t)Trace_Bucket_Value( bucket );
+		Trace_Append_Us( pBuilder, (value_ns < max_ns) ? value_ns : max_ns );
+	}
+
+	Trace_Append_Us( pBuilder, max_ns );
+	Str_Builder_Append_Char( pBuilder, '\n' );
+}
+
+/***************************************************************************************************
+e.g. TRACE? or TRACE=RESET
+
+Response format:  TRACE,<ticks traced>,<1 if cycles are counted>
+				  STAGE,<name>,<count>,<p50 us>,<p90 us>,<p99 us>,<p99.9 us>,<max us>	(one per stage)
+				  SLOW,<tick>,<time ms>,<us of each stage>...,<cycles of THERMISTOR,PID,SERVO>
+				  TRACE,END
+
+Stages are in the order ADC, WAIT, THERMISTOR, PID, SERVO, TOTAL.  The slowest ticks come first,
+-1 marks a stage the tick did not run.
+***************************************************************************************************/
+static int Trace_Command( const cmd_context_type* pContext, const cmd_args_type* pArgs, str_builder_type* pBuilder )
+{
+	trace_tick_type slowest[TRACE_NBR_SLOWEST];
+	trace_tick_type tick;
+	int nbr_slowest;
+	int stage;
+	int i, j;
+
+	if (pArgs->count > 0)
+	{
+		if (strcasecmp(pArgs->values[0].s, "RESET") != 0)
+			return -1;
+		Trace_Reset();
+	}
+
+	Str_Builder_Printf( pBuilder, "TRACE,%u,%d\n", (unsigned)atomic_load( &g_nbr_ticks ), (g_cycles_fd >= 0) ? 1 : 0 );
+
+	for (stage = 0; stage < NBR_TRACE_STAGES; stage++)
+		Trace_Format_Stage( pBuilder, stage );
+
+	pthread_mutex_lock(&g_slowest_mutex);
+	nbr_slowest = g_nbr_slowest;
+	memcpy(slowest, g_slowest, nbr_slowest * sizeof(trace_tick_type));
+	pthread_mutex_unlock(&g_slowest_mutex);
+
+	// Slowest first
+	for (i = 1; i < nbr_slowest; i++)
+	{
+		tick = slowest[i];
+		for (j = i; (j > 0) && (slowest[j - 1].stage_ns[TRACE_STAGE_TOTAL] < tick.stage_ns[TRACE_STAGE_TOTAL]); j--)
+			slowest[j] = slowest[j - 1];
+		slowest[j] = tick;
+	}
+
+	for (i = 0; i < nbr_slowest; i++)
+	{
+		Str_Builder_Printf( pBuilder, "SLOW,%u,%lld", slowest[i].tick, (long long)slowest[i].timestamp_ms );
+		for (stage = 0; stage < NBR_TRACE_STAGES; stage++)
+			Trace_Append_Us( pBuilder, slowest[i].stage_ns[stage] );
+		Str_Builder_Printf( pBuilder, ",%lld,%lld,%lld\n", (long long)slowest[i].stage_cycles[TRACE_STAGE_THERMISTOR],
+							(long long)slowest[i].stage_cycles[TRACE_STAGE_PID], (long long)slowest[i].stage_cycles[TRACE_STAGE_SERVO] );
+	}
+
+	Str_Builder_Append( pBuilder, "TRACE,END" );
+	return 1;
+}
+
+/* *** End of File *** */
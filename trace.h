@@ -0,0 +1,50 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_USE_CYCLE_COUNTER		1			// 0 leaves out the perf_event cycle counter
+#define TRACE_NBR_SLOWEST			16			// Slowest ticks kept with their full breakdown
+#define TRACE_SUB_BUCKET_BITS		4			// Histogram buckets per power of 2 = 2^bits (~6% resolution)
+#define TRACE_MAX_VALUE_BITS		36			// Longer durations (> 68 s) are clamped
+#define TRACE_NBR_BUCKETS			((TRACE_MAX_VALUE_BITS - TRACE_SUB_BUCKET_BITS + 1) << TRACE_SUB_BUCKET_BITS)
+#define TRACE_NOT_RUN				-1			// Stage time of a stage a tick did not run
+
+/***************************************************************************************************
+Stages of the sensor to actuator path of a control tick.  PID and SERVO only run on the ticks that
+recalculate the PID.  TOTAL is the age of the oldest sample the tick acted on when the tick ends,
+from the start of the ADC sweep that produced it to the reply of pigpio to the servo command.
+***************************************************************************************************/
+typedef enum
+{
+	TRACE_STAGE_ADC_SWEEP = 0,			// Tlc1543_Service() reading every channel
+	TRACE_STAGE_DATA_WAIT,				// End of the sweep to the start of the tick using it
+	TRACE_STAGE_THERMISTOR,				// Thermistor_Service()
+	TRACE_STAGE_PID,					// Pid_Update()
+	TRACE_STAGE_SERVO,					// Servo_Set_Position(), pigpio reply included
+	TRACE_STAGE_TOTAL,
+
+	NBR_TRACE_STAGES,
+} trace_stage_type;
+
+// Breakdown of one control tick
+typedef struct
+{
+	uint32_t tick;								// Ticks traced since start up
+	int64_t timestamp_ms;						// Wall clock time the tick ended
+	int64_t stage_ns[NBR_TRACE_STAGES];			// TRACE_NOT_RUN if the tick did not run the stage
+	int64_t stage_cycles[NBR_TRACE_STAGES];		// Control thread stages only, 0 without the cycle counter
+} trace_tick_type;
+
+int Trace_Init( void );
+
+// Called by the ADC thread for every sweep
+void Trace_Record_Sweep( int64_t start_ns, int64_t end_ns );
+
+// Called by the control thread.  Stages outside a tick are not traced.
+void Trace_Begin_Tick( int64_t sweep_start_ns, int64_t sweep_end_ns );
+void Trace_Stage_Begin( trace_stage_type stage );
+void Trace_Stage_End( trace_stage_type stage );
+void Trace_End_Tick( void );
+
+#endif //__TRACE_H
@@ -0,0 +1,256 @@
+/***************************************************************************************************
+WebSocket
+
+The parts of RFC 6455 the HTTP server needs: the handshake key, the header of the frames sent to
+browsers and the decoding of the masked frames they send.  Frames are
+
+	uint8 FIN, RSV1-3, opcode
+	uint8 MASK, payload length 0-125 (126: uint16 length follows, 127: uint64 length follows)
+	uint8 masking key[4]		clients only
+	payload
+
+Lengths are big endian.  SHA-1 is only used for the handshake, so the small implementation below
+is enough.
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "websocket.h"
+
+/* *** Defined Values *** */
+#define WEBSOCKET_GUID				"258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WEBSOCKET_MAX_KEY_LENGTH	64
+#define SHA1_DIGEST_SIZE			20
+#define SHA1_BLOCK_SIZE				64
+
+static inline uint32_t Websocket_Rotate_Left( uint32_t value, int bits )
+{
+	return (value << bits) | (value >> (32 - bits));
+}
+
+/***************************************************************************************************
+Processes one 64 byte block of SHA-1
+***************************************************************************************************/
+static void Websocket_Sha1_Block( uint32_t* p_state, const uint8_t* p_block )
+{
+	uint32_t w[80];
+	uint32_t a = p_state[0], b = p_state[1], c = p_state[2], d = p_state[3], e = p_state[4];
+	uint32_t f, k, temp;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = ((uint32_t)p_block[i * 4] << 24) | ((uint32_t)p_block[i * 4 + 1] << 16) |
+			   ((uint32_t)p_block[i * 4 + 2] << 8) | p_block[i * 4 + 3];
+	for (; i < 80; i++)
+		w[i] = Websocket_Rotate_Left( w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1 );
+
+	for (i = 0; i < 80; i++)
+	{
+		if (i < 20)
+		{
+			f = (b & c) | (~b & d);
+			k = 0x5A827999UL;
+		}
+		else if (i < 40)
+		{
+			f = b ^ c ^ d;
+			k = 0x6ED9EBA1UL;
+		}
+		else if (i < 60)
+		{
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8F1BBCDCUL;
+		}
+		else
+		{
+			f = b ^ c ^ d;
+			k = 0xCA62C1D6UL;
+		}
+
+		temp = Websocket_Rotate_Left( a, 5 ) + f + e + k + w[i];
+		e = d;
+		d = c;
+		c = Websocket_Rotate_Left( b, 30 );
+		b = a;
+		a = temp;
+	}
+
+	p_state[0] += a;
+	p_state[1] += b;
+	p_state[2] += c;
+	p_state[3] += d;
+	p_state[4] += e;
+}
+
+/***************************************************************************************************
+SHA-1 of a short message (at most a few blocks, as the handshake needs)
+***************************************************************************************************/
+static void Websocket_Sha1( const uint8_t* p_data, int length, uint8_t* p_digest )
+{
+	uint32_t state[5] = { 0x67452301UL, 0xEFCDAB89UL, 0x98BADCFEUL, 0x10325476UL, 0xC3D2E1F0UL };
+	uint8_t block[SHA1_BLOCK_SIZE];
+	uint64_t bit_length = (uint64_t)length * 8;
+	int remaining = length;
+	int i;
+
+	for (; remaining >= SHA1_BLOCK_SIZE; remaining -= SHA1_BLOCK_SIZE, p_data += SHA1_BLOCK_SIZE)
+		Websocket_Sha1_Block( state, p_data );
+
+	// Padding: 0x80, zeros, then the length in bits in the last 8 bytes of a block
+	memset(block, 0, sizeof(block));
+	memcpy(block, p_data, remaining);
+	block[remaining] = 0x80;
+	if (remaining >= (SHA1_BLOCK_SIZE - 8))
+	{
+		Websocket_Sha1_Block( state, block );
+		memset(block, 0, sizeof(block));
+	}
+	for (i = 0; i < 8; i++)
+		block[SHA1_BLOCK_SIZE - 1 - i] = (uint8_t)(bit_length >> (i * 8));
+	Websocket_Sha1_Block( state, block );
+
+	for (i = 0; i < SHA1_DIGEST_SIZE; i++)
+		p_digest[i] = (uint8_t)(state[i / 4] >> (24 - ((i % 4) * 8)));
+}
+
+/***************************************************************************************************
+Base64 encodes length bytes into p_text, which must hold ((length + 2) / 3) * 4 + 1 characters
+***************************************************************************************************/
+static void Websocket_Base64( const uint8_t* p_data, int length, char* p_text )
+{
+	static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	uint32_t triple;
+	int i;
+
+	for (i = 0; i < length; i += 3)
+	{
+		triple = (uint32_t)p_data[i] << 16;
+		if ((i + 1) < length)
+			triple |= (uint32_t)p_data[i + 1] << 8;
+		if ((i + 2) < length)
+			triple |= p_data[i + 2];
+
+		*p_text++ = digits[(triple >> 18) & 0x3F];
+		*p_text++ = digits[(triple >> 12) & 0x3F];
+		*p_text++ = ((i + 1) < length) ? digits[(triple >> 6) & 0x3F] : '=';
+		*p_text++ = ((i + 2) < length) ? digits[triple & 0x3F] : '=';
+	}
+	*p_text = '\0';
+}
+
+/***************************************************************************************************
+Computes the Sec-WebSocket-Accept value for the Sec-WebSocket-Key of a handshake request.
+p_accept must hold WEBSOCKET_ACCEPT_SIZE characters.
+
+Returns -1 if the key is too long
+		 1 on success
+***************************************************************************************************/
+int Websocket_Accept_Key( const char* p_key, char* p_accept )
+{
+	char text[WEBSOCKET_MAX_KEY_LENGTH + sizeof(WEBSOCKET_GUID)];
+	uint8_t digest[SHA1_DIGEST_SIZE];
+	int length = strlen(p_key);
+
+	if (length > WEBSOCKET_MAX_KEY_LENGTH)
+		return -1;
+
+	memcpy(text, p_key, length);
+	memcpy(&text[length], WEBSOCKET_GUID, sizeof(WEBSOCKET_GUID) - 1);
+
+	Websocket_Sha1( (const uint8_t*)text, length + sizeof(WEBSOCKET_GUID) - 1, digest );
+	Websocket_Base64( digest, SHA1_DIGEST_SIZE, p_accept );
+	return 1;
+}
+
+/***************************************************************************************************
+Writes the header of an unmasked (server) frame.  p_header must hold WEBSOCKET_MAX_HEADER_SIZE bytes.
+
+Returns the length of the header
+***************************************************************************************************/
+int Websocket_Encode_Header( uint8_t* p_header, int opcode, bool fin, uint64_t payload_length )
+{
+	int i;
+
+	p_header[0] = (uint8_t)((fin ? 0x80 : 0x00) | (opcode & 0x0F));
+
+	if (payload_length < 126)
+	{
+		p_header[1] = (uint8_t)payload_length;
+		return 2;
+	}
+
+	if (payload_length <= 0xFFFF)
+	{
+		p_header[1] = 126;
+		p_header[2] = (uint8_t)(payload_length >> 8);
+		p_header[3] = (uint8_t)payload_length;
+		return 4;
+	}
+
+	p_header[1] = 127;
+	for (i = 0; i < 8; i++)
+		p_header[2 + i] = (uint8_t)(payload_length >> (56 - (i * 8)));
+	return 10;
+}
+
+/***************************************************************************************************
+Decodes the client frame at the start of p_data and unmasks its payload in place
+
+Returns the length of the frame (header and payload)
+		WEBSOCKET_INCOMPLETE	when more data is needed
+		WEBSOCKET_BAD_FRAME		when the frame is not masked or uses reserved bits
+		WEBSOCKET_TOO_LONG		when the payload is longer than max_payload
+***************************************************************************************************/
+int Websocket_Decode_Frame( uint8_t* p_data, int available, int max_payload, websocket_frame_type* pFrame )
+{
+	uint64_t payload_length;
+	uint8_t* p_mask;
+	int header_length = 2;
+	int i;
+
+	if (available < 2)
+		return WEBSOCKET_INCOMPLETE;
+
+	if (((p_data[0] & 0x70) != 0) || ((p_data[1] & 0x80) == 0))
+		return WEBSOCKET_BAD_FRAME;
+
+	payload_length = p_data[1] & 0x7F;
+	if (payload_length == 126)
+	{
+		header_length += 2;
+		if (available < header_length)
+			return WEBSOCKET_INCOMPLETE;
+		payload_length = ((uint64_t)p_data[2] << 8) | p_data[3];
+	}
+	else if (payload_length == 127)
+	{
+		header_length += 8;
+		if (available < header_length)
+			return WEBSOCKET_INCOMPLETE;
+		payload_length = 0;
+		for (i = 0; i < 8; i++)
+			payload_length = (payload_length << 8) | p_data[2 + i];
+	}
+
+	if (payload_length > (uint64_t)max_payload)
+		return WEBSOCKET_TOO_LONG;
+
+	p_mask = &p_data[header_length];
+	header_length += 4;
+	if (available < (header_length + (int)payload_length))
+		return WEBSOCKET_INCOMPLETE;
+
+	pFrame->fin = (p_data[0] & 0x80) != 0;
+	pFrame->opcode = p_data[0] & 0x0F;
+	pFrame->p_payload = &p_data[header_length];
+	pFrame->payload_length = (int)payload_length;
+
+	for (i = 0; i < pFrame->payload_length; i++)
+		pFrame->p_payload[i] ^= p_mask[i & 3];
+
+	return header_length + pFrame->payload_length;
+}
+
+/* *** End of File *** */
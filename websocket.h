@@ -0,0 +1,36 @@
+#ifndef __WEBSOCKET_H
+#define __WEBSOCKET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define WEBSOCKET_ACCEPT_SIZE		29			// Sec-WebSocket-Accept value, including the terminator
+#define WEBSOCKET_MAX_HEADER_SIZE	10			// Server frames are never masked
+
+	// Opcodes (RFC 6455 section 5.2)
+#define WEBSOCKET_OPCODE_CONTINUATION	0x0
+#define WEBSOCKET_OPCODE_TEXT			0x1
+#define WEBSOCKET_OPCODE_BINARY			0x2
+#define WEBSOCKET_OPCODE_CLOSE			0x8
+#define WEBSOCKET_OPCODE_PING			0x9
+#define WEBSOCKET_OPCODE_PONG			0xA
+
+	// Results of Websocket_Decode_Frame() other than a frame length
+#define WEBSOCKET_INCOMPLETE		0
+#define WEBSOCKET_BAD_FRAME			-1
+#define WEBSOCKET_TOO_LONG			-2
+
+// A frame received from a client, its payload already unmasked
+typedef struct
+{
+	bool fin;
+	int opcode;
+	uint8_t* p_payload;
+	int payload_length;
+} websocket_frame_type;
+
+int Websocket_Accept_Key( const char* p_key, char* p_accept );
+int Websocket_Encode_Header( uint8_t* p_header, int opcode, bool fin, uint64_t payload_length );
+int Websocket_Decode_Frame( uint8_t* p_data, int available, int max_payload, websocket_frame_type* pFrame );
+
+#endif //__WEBSOCKET_H